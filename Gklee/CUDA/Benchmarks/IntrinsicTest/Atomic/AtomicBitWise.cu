@@ -0,0 +1,72 @@
+#include <cuda.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define NUM 4
+
+// Each thread updates its own word and keeps the old value, so the
+// results are fixed: a failing assert means the atomic stored the old
+// value back instead of the combined one.
+
+__global__
+void atomicAndKernel(unsigned *uA, unsigned *uB, unsigned *uC) {
+  unsigned tid = threadIdx.x;
+  uC[tid] = atomicAnd(uA+tid, uB[tid]); 
+}
+
+__global__
+void atomicOrKernel(unsigned *uA, unsigned *uB, unsigned *uC) {
+  unsigned tid = threadIdx.x;
+  uC[tid] = atomicOr(uA+tid, uB[tid]); 
+}
+
+__global__
+void atomicXorKernel(unsigned *uA, unsigned *uB, unsigned *uC) {
+  unsigned tid = threadIdx.x;
+  uC[tid] = atomicXor(uA+tid, uB[tid]); 
+}
+
+int main(int argv, char **argc) {
+  unsigned init[NUM] = {0xF0, 0x0F, 0xFF, 0x3C};
+  unsigned hB[NUM] = {0x3C, 0x3C, 0x0F, 0xF0};
+  unsigned hA[NUM], hC[NUM];
+
+  unsigned *dA, *dB, *dC;
+  cudaMalloc((void**)&dA, sizeof(unsigned)*NUM);
+  cudaMalloc((void**)&dB, sizeof(unsigned)*NUM);
+  cudaMalloc((void**)&dC, sizeof(unsigned)*NUM);
+  cudaMemcpy(dB, hB, sizeof(unsigned)*NUM, cudaMemcpyHostToDevice);
+
+  cudaMemcpy(dA, init, sizeof(unsigned)*NUM, cudaMemcpyHostToDevice);
+  atomicAndKernel<<<1, NUM>>>(dA, dB, dC);
+  cudaMemcpy(hA, dA, sizeof(unsigned)*NUM, cudaMemcpyDeviceToHost);
+  cudaMemcpy(hC, dC, sizeof(unsigned)*NUM, cudaMemcpyDeviceToHost);
+  for (unsigned i = 0; i < NUM; i++) {
+    assert(hC[i] == init[i]);
+    assert(hA[i] == (init[i] & hB[i]));
+  }
+
+  cudaMemcpy(dA, init, sizeof(unsigned)*NUM, cudaMemcpyHostToDevice);
+  atomicOrKernel<<<1, NUM>>>(dA, dB, dC);
+  cudaMemcpy(hA, dA, sizeof(unsigned)*NUM, cudaMemcpyDeviceToHost);
+  cudaMemcpy(hC, dC, sizeof(unsigned)*NUM, cudaMemcpyDeviceToHost);
+  for (unsigned i = 0; i < NUM; i++) {
+    assert(hC[i] == init[i]);
+    assert(hA[i] == (init[i] | hB[i]));
+  }
+
+  cudaMemcpy(dA, init, sizeof(unsigned)*NUM, cudaMemcpyHostToDevice);
+  atomicXorKernel<<<1, NUM>>>(dA, dB, dC);
+  cudaMemcpy(hA, dA, sizeof(unsigned)*NUM, cudaMemcpyDeviceToHost);
+  cudaMemcpy(hC, dC, sizeof(unsigned)*NUM, cudaMemcpyDeviceToHost);
+  for (unsigned i = 0; i < NUM; i++) {
+    assert(hC[i] == init[i]);
+    assert(hA[i] == (init[i] ^ hB[i]));
+  }
+
+  printf("atomicAnd/Or/Xor store the combined value and return the old one\n");
+
+  cudaFree(dA);
+  cudaFree(dB);
+  cudaFree(dC);
+}
@@ -0,0 +1,41 @@
+#include <cuda.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define NUM 64
+
+// Every thread bumps the same counters through the atomicAdd/atomicOr
+// wrappers of the CUDA headers and ignores what they return. Run with
+// -summarize-atomics: the hotspot report should show the updates folded
+// rather than one interleaving per thread, and the totals must still hold.
+
+__global__
+void countKernel(int *count, unsigned *mask) {
+  unsigned tid = threadIdx.x;
+  atomicAdd(count, 1);
+  atomicOr(mask, 1u << (tid % 32));
+}
+
+int main(int argv, char **argc) {
+  int hCount = 0;
+  unsigned hMask = 0;
+
+  int *dCount;
+  unsigned *dMask;
+  cudaMalloc((void**)&dCount, sizeof(int));
+  cudaMalloc((void**)&dMask, sizeof(unsigned));
+  cudaMemcpy(dCount, &hCount, sizeof(int), cudaMemcpyHostToDevice);
+  cudaMemcpy(dMask, &hMask, sizeof(unsigned), cudaMemcpyHostToDevice);
+
+  countKernel<<<1, NUM>>>(dCount, dMask);
+
+  cudaMemcpy(&hCount, dCount, sizeof(int), cudaMemcpyDeviceToHost);
+  cudaMemcpy(&hMask, dMask, sizeof(unsigned), cudaMemcpyDeviceToHost);
+  assert(hCount == NUM);
+  assert(hMask == 0xFFFFFFFFu);
+
+  printf("summarized atomicAdd/atomicOr through the header wrappers\n");
+
+  cudaFree(dCount);
+  cudaFree(dMask);
+}
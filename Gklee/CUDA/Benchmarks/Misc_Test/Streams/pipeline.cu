@@ -0,0 +1,61 @@
+#include <cuda.h>
+#include <stdio.h>
+
+#define NUM 64
+#define CHUNKS 2
+// Large enough for a copy to outlast the runtime calls issued meanwhile.
+#define SIZE (1 << 18)
+
+unsigned hA[CHUNKS][SIZE];
+
+__global__
+void scaleKernel(unsigned *a) {
+  unsigned tid = threadIdx.x;
+  a[tid] = a[tid] * 2;
+}
+
+int main(int argv, char **argc) {
+  for (unsigned c = 0; c < CHUNKS; c++)
+    for (unsigned i = 0; i < NUM; i++)
+      hA[c][i] = c * NUM + i;
+
+  unsigned *dA[CHUNKS];
+  for (unsigned c = 0; c < CHUNKS; c++)
+    cudaMalloc((void**)&dA[c], sizeof(unsigned)*SIZE);
+
+#ifdef SERIAL
+  cudaStream_t copyStream = 0, computeStream = 0;
+#else
+  cudaStream_t copyStream, computeStream;
+  cudaStreamCreate(&copyStream);
+  cudaStreamCreate(&computeStream);
+#endif
+  cudaEvent_t copied;
+  cudaEventCreate(&copied);
+
+  // Chunk c is scaled on the compute stream while chunk c + 1 is copied
+  // in on the copy stream; they touch different buffers.
+  cudaMemcpyAsync(dA[0], hA[0], sizeof(unsigned)*SIZE,
+                  cudaMemcpyHostToDevice, copyStream);
+  for (unsigned c = 0; c < CHUNKS; c++) {
+    cudaEventRecord(copied, copyStream);
+    cudaStreamWaitEvent(computeStream, copied, 0);
+    scaleKernel<<<1, NUM, 0, computeStream>>>(dA[c]);
+    if (c + 1 < CHUNKS)
+      cudaMemcpyAsync(dA[c + 1], hA[c + 1], sizeof(unsigned)*SIZE,
+                      cudaMemcpyHostToDevice, copyStream);
+  }
+
+  cudaStreamSynchronize(computeStream);
+  for (unsigned c = 0; c < CHUNKS; c++)
+    cudaMemcpy(hA[c], dA[c], sizeof(unsigned)*SIZE, cudaMemcpyDeviceToHost);
+  printf("hA[1][1]: %u\n", hA[1][1]);
+
+  cudaEventDestroy(copied);
+#ifndef SERIAL
+  cudaStreamDestroy(copyStream);
+  cudaStreamDestroy(computeStream);
+#endif
+  for (unsigned c = 0; c < CHUNKS; c++)
+    cudaFree(dA[c]);
+}
@@ -12,6 +12,7 @@
 
 #include "klee/Expr.h"
 #include <map>
+#include <vector>
 
 // FIXME: Currently we use ConstraintManager for two things: to pass
 // sets of constraints around, and to optimize constraints. We should
@@ -20,21 +21,118 @@
 namespace klee {
 
 class ExprVisitor;
+
+/// IndependenceIndex - A union-find over the arrays read by a constraint
+/// set. Two arrays are in the same class when some chain of constraints
+/// links them, so the constraints which can matter for an expression are
+/// those in the classes of the arrays it reads.
+///
+/// The index is shared between copies of a ConstraintManager and copied
+/// on the first write.
+class IndependenceIndex {
+public:
+  unsigned refCount;
+
+private:
+  std::map<const Array*, const Array*> parents;
+  /// The positions in the constraint vector of the constraints in each
+  /// class, keyed by the class representative.
+  std::map<const Array*, std::vector<unsigned> > classes;
+
+  const Array *unite(const Array *a, const Array *b);
+
+public:
+  IndependenceIndex() : refCount(0) {}
+  IndependenceIndex(const IndependenceIndex &other)
+    : refCount(0), parents(other.parents), classes(other.classes) {}
+
+  const Array *find(const Array *array);
+
+  /// add - Record that the constraint at the given position reads the
+  /// arrays read by e.
+  void add(klee::ref<Expr> e, unsigned position);
+
+  /// getPositions - Append the positions of the constraints in the
+  /// classes of the given arrays.
+  void getPositions(const std::vector<const Array*> &arrays,
+                    std::vector<unsigned> &positions);
+
+  /// findIndependenceArrays - Compute the arrays of e which take part in
+  /// independence; reads from unmodified constant arrays do not.
+  static void findIndependenceArrays(klee::ref<Expr> e,
+                                     std::vector<const Array*> &arrays);
+};
   
+/// EqualityIndex - The substitutions simplifyExpr makes under a
+/// constraint set: the constant a value is known to equal, and true for
+/// every other constraint. Results of simplification are memoized until
+/// the substitutions change.
+///
+/// Like IndependenceIndex, it is shared between copies of a
+/// ConstraintManager. On the first write a copy gets an overlay instead
+/// of a copy: it holds only the substitutions added since, and simplifies
+/// the base's (memoized) result with them, so neither the base's map nor
+/// its memo is copied.
+class EqualityIndex {
+public:
+  unsigned refCount;
+
+  typedef std::map< klee::ref<Expr>, klee::ref<Expr> > equalities_ty;
+
+private:
+  /// The index this one overlays, if any; it is never written again.
+  klee::ref<EqualityIndex> base;
+  /// The number of indices below this one.
+  unsigned depth;
+  equalities_ty equalities;
+  equalities_ty simplified;
+
+  EqualityIndex(const EqualityIndex&);
+  void operator=(const EqualityIndex&);
+
+  /// Whether some index of the chain has a substitution for e.
+  bool contains(klee::ref<Expr> e) const;
+
+public:
+  EqualityIndex() : refCount(0), depth(0) {}
+  /// Overlay _base, or a flattened copy of it once the chain gets too
+  /// deep.
+  explicit EqualityIndex(klee::ref<EqualityIndex> _base);
+
+  /// add - Record the substitution implied by constraint e. An earlier
+  /// constraint for the same expression takes precedence.
+  void add(klee::ref<Expr> e);
+
+  /// simplify - Apply the substitutions to e. Memoizing the result only
+  /// adds to the index, so this is safe on a shared index.
+  klee::ref<Expr> simplify(klee::ref<Expr> e);
+
+  /// The memo holds at most this many results.
+  static const unsigned MaxSimplified = 4096;
+
+  /// Overlays are flattened beyond this many levels.
+  static const unsigned MaxDepth = 8;
+
+  unsigned getNumSimplified() const { return simplified.size(); }
+  unsigned getDepth() const { return depth; }
+};
+
 class ConstraintManager {
 public:
   typedef std::vector< klee::ref<Expr> > constraints_ty;
   typedef constraints_ty::iterator iterator;
   typedef constraints_ty::const_iterator const_iterator;
 
-  ConstraintManager() {}
+  ConstraintManager() : generation(0) {}
 
   // create from constraints with no optimization
   explicit
   ConstraintManager(const std::vector< klee::ref<Expr> > &_constraints) :
-    constraints(_constraints) {}
+    constraints(_constraints), generation(++nextGeneration) {}
 
-  ConstraintManager(const ConstraintManager &cs) : constraints(cs.constraints) {}
+  ConstraintManager(const ConstraintManager &cs) 
+    : constraints(cs.constraints), independence(cs.independence),
+      equalities(cs.equalities), generation(cs.generation) {}
 
   typedef std::vector< klee::ref<Expr> >::const_iterator constraint_iterator;
 
@@ -44,15 +142,24 @@ public:
 
   klee::ref<Expr> simplifyExpr(klee::ref<Expr> e) const;
 
-  klee::ref<Expr> updateExprThroughReplacement(klee::ref<Expr> e, std::map< klee::ref<Expr>, klee::ref<Expr> > equalities) const; 
+  klee::ref<Expr> updateExprThroughReplacement(klee::ref<Expr> e, const std::map< klee::ref<Expr>, klee::ref<Expr> > &equalities) const; 
 
   void addConstraint(klee::ref<Expr> e);
 
+  /// getIndependentSlice - Append, in order, the constraints which share
+  /// an array with e through some chain of constraints. Any constraint
+  /// that can affect the satisfiability of e is among them.
+  void getIndependentSlice(klee::ref<Expr> e,
+                           std::vector< klee::ref<Expr> > &result) const;
+
   bool empty() const {
     return constraints.empty();
   }
   void clear() {
     constraints.clear();
+    independence = 0;
+    equalities = 0;
+    generation = 0;
   }
   klee::ref<Expr> back() const {
     return constraints.back();
@@ -64,12 +171,23 @@ public:
     return constraints.end();
   }
   std::vector< klee::ref<Expr> >& getConstraints() {
+    // The caller may change the constraints behind our back.
+    independence = 0;
+    equalities = 0;
+    generation = ++nextGeneration;
     return constraints;
   }
   size_t size() const {
     return constraints.size();
   }
 
+  /// getGeneration - Identify the constraint set cheaply: copies share
+  /// the generation of their original, and every change to a set gives
+  /// it a fresh one, so equal generations mean equal constraints.
+  uint64_t getGeneration() const {
+    return generation;
+  }
+
   bool operator==(const ConstraintManager &other) const {
     return constraints == other.constraints;
   }
@@ -85,10 +203,25 @@ private:
 
   std::vector< klee::ref<Expr> > constraints;
 
+  // Built on the first getIndependentSlice and kept up to date by
+  // addConstraint from then on.
+  mutable klee::ref<IndependenceIndex> independence;
+
+  // Built on the first simplifyExpr and kept up to date by addConstraint
+  // from then on.
+  mutable klee::ref<EqualityIndex> equalities;
+
+  uint64_t generation;
+  static uint64_t nextGeneration;
+
   // returns true iff the constraints were modified
   bool rewriteConstraints(ExprVisitor &visitor);
 
   void addConstraintInternal(klee::ref<Expr> e);
+
+  void addToIndependence(klee::ref<Expr> e);
+
+  void addToEqualities(klee::ref<Expr> e);
 };
 
 }
@@ -17,6 +17,8 @@
 // FIXME: We do not want to be exposing these? :(
 #include "../../lib/Core/AddressSpace.h"
 #include "../../lib/Core/ParametricTree.h"
+#include "../../lib/Core/Occupancy.h"
+#include "../../lib/Core/StreamTimeline.h"
 #include "klee/Internal/Module/KInstIterator.h"
 #include "../../lib/Core/CUDA.h"
 #include "llvm/Analysis/PostDominators.h"
@@ -117,6 +119,11 @@ public:
   // objects.
   unsigned underConstrained;
   unsigned depth;
+  // Fresh for every state and at every fork. The solver tries the recent
+  // counterexamples of this lineage and of the one it was forked from,
+  // which its sibling shares, first.
+  unsigned lineage;
+  unsigned parentLineage;
   BranchInstMeta brMeta;
   
   // // pc - pointer to current instruction stream
@@ -144,6 +151,29 @@ public:
                               // used for collecting time
   unsigned kernelNum; 
   unsigned BINum;
+  // The <kernel, barrier count> at which this state was last offered for
+  // merging, so that it is not parked again at the same barrier.
+  std::pair<unsigned, unsigned> barrierMergePoint;
+  // Whether the constraints, locals and private memory of this state
+  // are currently written out to disk (see StateSpiller).
+  bool spilled;
+  // The access pairs proven safe by the symbolic-config checkers under
+  // these constraints.
+  klee::ref<ProvenAccessPairs> provenPairs;
+  // The commutative atomics folded in the current barrier interval
+  // (see -summarize-atomics).
+  klee::ref<AtomicSummaries> atomicSummaries;
+  // The blockIdx and threadIdx substitution between the two parametric
+  // flows, built by the first check of a barrier interval and dropped
+  // at its end.
+  klee::ref<BuiltInSubstitution> builtInSubstitution;
+  // The device work issued along this path (see -output-timeline), and
+  // the instructions executed in GPU mode, which kernels are timed by.
+  klee::ref<StreamTimeline> timeline;
+  uint64_t deviceInstructions;
+  // The occupancy of each kernel launched along this path (see
+  // -check-occupancy).
+  std::vector<LaunchOccupancy> launchOccupancy;
 
   TreeOStream pathOS, symPathOS;
   unsigned instsSinceCovNew;
@@ -175,7 +205,8 @@ public:
   void removeFnAlias(std::string fn);
   
 private:
-  ExecutionState() : fakeState(false), underConstrained(0), 
+  ExecutionState() : fakeState(false), underConstrained(0), lineage(0),
+                     parentLineage(0),
                      brMeta(NA, NULL), ptreeNode(0) {}
 
 public:
@@ -219,6 +250,7 @@ public:
 
   // used in "Searcher.cpp"
   bool merge(const ExecutionState &b);
+  bool atBarrierMergePoint();
   void dumpStack(std::ostream &out) const;
 
   // for CUDA
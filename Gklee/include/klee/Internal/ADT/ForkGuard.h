@@ -0,0 +1,45 @@
+//===-- ForkGuard.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FORKGUARD_H
+#define KLEE_FORKGUARD_H
+
+#include <pthread.h>
+
+namespace klee {
+  /// ForkGuard - Keeps fork() from copying a background thread's work in
+  /// progress.
+  ///
+  /// A child only gets the thread which forked it. Any lock another thread
+  /// held at that moment, in stdio, the allocator or the C++ library,
+  /// stays held in the child forever. A background thread therefore holds
+  /// its guard around each step of its work, and drops it between steps
+  /// and while waiting for work. Every fork() in the process first takes
+  /// all the live guards (through pthread_atfork), so a child is only made
+  /// between steps. Keep the steps short: every fork waits for them.
+  class ForkGuard {
+    pthread_mutex_t lock;
+
+    ForkGuard(const ForkGuard&);
+    void operator=(const ForkGuard&);
+
+    static void registerAtfork();
+    static void prepare();
+    static void release();
+
+  public:
+    ForkGuard();
+    ~ForkGuard();
+
+    void enter() { pthread_mutex_lock(&lock); }
+    void leave() { pthread_mutex_unlock(&lock); }
+  };
+}
+
+#endif
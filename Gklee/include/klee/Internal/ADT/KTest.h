@@ -55,6 +55,52 @@ extern "C" {
 
   void  kTest_free(KTest *);
 
+
+  /* Test case packs: an append-only file holding many KTests, plus a
+     sidecar index (<pack>.idx) so any one of them is reached directly.
+     Readers map the pack into memory; the tests they return point into
+     the mapping instead of copying the object bytes. */
+
+  typedef struct KTestInfo KTestInfo;
+  struct KTestInfo {
+    /* the NNNNNN of the test's testNNNNNN.* files */
+    unsigned id;
+    /* the kernel launch and barrier interval the test ended in */
+    unsigned kernel;
+    unsigned barrierInterval;
+    /* the suffix of the defect report (e.g. "assert.err"), or "" */
+    const char *defect;
+  };
+
+  typedef struct KTestPack KTestPack;
+  typedef struct KTestPackWriter KTestPackWriter;
+
+  /* return true iff file at path matches the pack header */
+  int   kTestPack_isPackFile(const char *path);
+
+  /* creates the pack, or opens it for appending; NULL on error */
+  KTestPackWriter *kTestPackWriter_open(const char *path);
+
+  /* returns 1 on success, 0 on (unspecified) error */
+  int   kTestPackWriter_append(KTestPackWriter *, KTest *, const KTestInfo *);
+
+  void  kTestPackWriter_close(KTestPackWriter *);
+
+  /* returns NULL on (unspecified) error */
+  KTestPack *kTestPack_open(const char *path);
+
+  unsigned kTestPack_numTests(KTestPack *);
+
+  /* returns test i of the pack, or NULL if it is damaged. Strings and
+     object bytes point into the pack and may be modified, privately, but
+     not freed; release the test with kTestPack_freeTest before closing
+     the pack. info may be NULL; its defect also points into the pack. */
+  KTest* kTestPack_get(KTestPack *, unsigned i, KTestInfo *info);
+
+  void  kTestPack_freeTest(KTest *);
+
+  void  kTestPack_close(KTestPack *);
+
 #ifdef __cplusplus
 }
 #endif
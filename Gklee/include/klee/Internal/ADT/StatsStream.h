@@ -0,0 +1,147 @@
+//===-- StatsStream.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_STATSSTREAM_H
+#define KLEE_STATSSTREAM_H
+
+#include "klee/Internal/ADT/ForkGuard.h"
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+
+namespace klee {
+  /* Stats streams: an append-only binary trace of the run's statistics.
+
+     The file starts with a header describing the columns:
+
+       "KSTS" magic, u32 version, u32 number of columns, then for each
+       column a u8 type (StatsStream::ColumnType), a u16 name length and
+       the name.
+
+     It is followed by the records, each holding one 8-byte slot per
+     column: a count, or the bits of a double. Integers are stored
+     little-endian. Records are all the same size, so the N-th is found
+     directly, and a reader ignores a record that is only partly
+     written. */
+
+  namespace StatsStream {
+    enum ColumnType {
+      Count = 0,
+      Real = 1
+    };
+
+    struct Column {
+      std::string name;
+      ColumnType type;
+
+      Column(const std::string &_name, ColumnType _type)
+        : name(_name), type(_type) {}
+    };
+
+    unsigned getCurrentVersion();
+
+    /// Store \a value in a record slot.
+    uint64_t fromReal(double value);
+    /// Read the double stored in a record slot.
+    double toReal(uint64_t slot);
+  }
+
+  /// StatsStreamWriter - Appends records to a stats stream from a
+  /// background thread.
+  ///
+  /// Records are filled in place in a ring of slots shared with the
+  /// writer thread, without taking a lock; a record is dropped if the
+  /// ring is full, so the executor never waits on the filesystem.
+  class StatsStreamWriter {
+    int fd;
+    unsigned numColumns;
+    unsigned capacity;
+    uint64_t *ring;
+    /// The number of records committed and written, respectively. Only
+    /// the executor advances head, and only the writer advances tail.
+    volatile unsigned head, tail;
+    unsigned numDropped;
+    bool inRecord;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t workAvailable;
+    volatile bool done;
+    /// Held while writing, so that fork() waits for the writes to finish.
+    ForkGuard forkGuard;
+
+    StatsStreamWriter(int fd, unsigned numColumns, unsigned capacity);
+
+    static void *run(void *writer);
+    void writeRecords();
+
+  public:
+    /// Create the stream at \a path and start its writer thread.
+    ///
+    /// \return The writer, or null if the file cannot be created.
+    static StatsStreamWriter *open(const std::string &path,
+                                   const std::vector<StatsStream::Column>
+                                     &columns,
+                                   unsigned capacity = 64);
+
+    /// Writes whatever is still queued.
+    ~StatsStreamWriter();
+
+    /// Get the slots of the next record, one per column, or null if the
+    /// ring is full. A non-null record must be committed.
+    uint64_t *beginRecord();
+    void commitRecord();
+
+    unsigned getNumColumns() const { return numColumns; }
+    unsigned getNumDropped() const { return numDropped; }
+  };
+
+  /// StatsStreamReader - Reads a stats stream, possibly while it is still
+  /// being written.
+  class StatsStreamReader {
+    int fd;
+    uint64_t headerSize;
+    uint64_t numRecords;
+    std::vector<StatsStream::Column> columns;
+
+    StatsStreamReader(int fd);
+
+  public:
+    /// \return The reader, or null if \a path is not a stats stream.
+    static StatsStreamReader *open(const std::string &path);
+    ~StatsStreamReader();
+
+    const std::vector<StatsStream::Column> &getColumns() const {
+      return columns;
+    }
+
+    /// Find the column called \a name.
+    ///
+    /// \return Its index, or -1 if there is none.
+    int getColumnIndex(const std::string &name) const;
+
+    /// Pick up the records written since the stream was opened or last
+    /// refreshed.
+    ///
+    /// \return The number of new records.
+    uint64_t refresh();
+
+    uint64_t getNumRecords() const { return numRecords; }
+
+    /// Read record \a index into \a slots.
+    ///
+    /// \return True on success.
+    bool readRecord(uint64_t index, std::vector<uint64_t> &slots) const;
+  };
+}
+
+#endif
@@ -15,8 +15,67 @@
 namespace klee {
   class MemoryObject;
 
+  /// CellValue - The value held by a Cell: either an expression, or a
+  /// concrete integer of at most 64 bits stored inline. Reading an inline
+  /// value as an expression builds its ConstantExpr, which is then kept,
+  /// so the interpreter only pays for one when a concrete value meets a
+  /// symbolic one (or code which only deals in expressions).
+  class CellValue {
+    mutable klee::ref<Expr> expr;
+    uint64_t bits;
+    /// The width of the inline value, or 0 if there is none.
+    Expr::Width width;
+
+  public:
+    CellValue() : bits(0), width(0) {}
+    CellValue(const klee::ref<Expr> &e) : expr(e), bits(0), width(0) {}
+
+    CellValue &operator=(const klee::ref<Expr> &e) {
+      expr = e;
+      width = 0;
+      return *this;
+    }
+
+    /// Hold \a value, of width \a w (at most 64 bits), inline.
+    void setConcrete(uint64_t value, Expr::Width w) {
+      expr = 0;
+      bits = value;
+      width = w;
+    }
+
+    /// Get the value if it is a concrete integer of at most 64 bits,
+    /// whether held inline or as a ConstantExpr.
+    bool getConcrete(uint64_t &value, Expr::Width &w) const {
+      if (width) {
+        value = bits;
+        w = width;
+        return true;
+      }
+      if (ConstantExpr *CE = dyn_cast_or_null<ConstantExpr>(expr.get())) {
+        if (CE->getWidth() <= 64) {
+          value = CE->getZExtValue();
+          w = CE->getWidth();
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool isInline() const { return width != 0; }
+    bool isNull() const { return !width && expr.isNull(); }
+
+    const klee::ref<Expr> &getExpr() const {
+      if (width && expr.isNull())
+        expr = ConstantExpr::create(bits, width);
+      return expr;
+    }
+
+    operator const klee::ref<Expr> &() const { return getExpr(); }
+    Expr *operator->() const { return getExpr().get(); }
+  };
+
   struct Cell {
-    klee::ref<Expr> value;
+    CellValue value;
   };
 }
 
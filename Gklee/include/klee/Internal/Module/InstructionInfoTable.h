@@ -13,6 +13,7 @@
 #include <map>
 #include <string>
 #include <set>
+#include <vector>
 
 namespace llvm {
   class Function;
@@ -59,9 +60,16 @@ namespace klee {
                                  const std::string *&File, unsigned &Line);
 
   public:
-    InstructionInfoTable(llvm::Module *m);
+    /// \param assemblyLines If given, the assembly line of each
+    /// instruction of \a m in module order, as from getAssemblyLines;
+    /// otherwise the lines are found by printing the module.
+    InstructionInfoTable(llvm::Module *m,
+                         const std::vector<unsigned> *assemblyLines = 0);
     ~InstructionInfoTable();
 
+    /// Get the assembly line of each instruction of \a m, in module order.
+    void getAssemblyLines(llvm::Module *m, std::vector<unsigned> &out) const;
+
     unsigned getMaxID() const;
     const InstructionInfo &getInfo(const llvm::Instruction*) const;
     const InstructionInfo &getFunctionInfo(const llvm::Function*) const;
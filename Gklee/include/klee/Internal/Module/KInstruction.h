@@ -19,6 +19,7 @@
 #include <vector>
 
 namespace llvm {
+  class Function;
   class Instruction;
 }
 
@@ -42,6 +43,19 @@ namespace klee {
     /// Destination register index.
     unsigned dest;
 
+    /// Width in bits of the value the instruction produces, or 0 if it
+    /// produces none.
+    unsigned width;
+
+    /// For calls, the callee when it is known statically (through casts
+    /// and global aliases), otherwise null. This ignores the function
+    /// aliases of a state (klee_alias_function).
+    llvm::Function *target;
+
+    /// For calls to a declared function, the CUDA intrinsic handler the
+    /// target is dispatched to (a CUDAIntrinsic::Kind), or 0 if unknown.
+    unsigned cudaIntrinsic;
+
   public:
     virtual ~KInstruction(); 
   };
@@ -101,11 +101,17 @@ namespace klee {
 
     Cell *constantTable;
 
+    /// Instrument and optimize the module and link the runtime into it,
+    /// leaving the module that is interpreted.
+    void transform(const Interpreter::ModuleOptions &opts);
+
   public:
     KModule(llvm::Module *_module);
     ~KModule();
 
-    /// Initialize local data structures.
+    /// Initialize local data structures. With -module-cache-dir, the
+    /// transformed module may be replaced by a cached copy, in which case
+    /// \ref module changes.
     //
     // FIXME: ihandler should not be here
     void prepare(const Interpreter::ModuleOptions &opts, 
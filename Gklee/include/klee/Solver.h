@@ -75,7 +75,27 @@ namespace klee {
     ///
     /// \return True on success.
     bool evaluate(const Query&, Validity &result);
-  
+
+    /// evaluateBatch - Determine the full validity of a batch of mutually
+    /// independent expressions under the same constraint set.
+    ///
+    /// The batch is striped over up to \a numWorkers forked solver
+    /// processes; with fewer than two workers it is evaluated in
+    /// order in this process. Any query a worker did not answer is
+    /// retried here, so the result only depends on the input order.
+    ///
+    /// \param [out] results - The validity of each expression, in the
+    /// order given by \a exprs.
+    /// \param [out] solved - Whether the solver succeeded on each
+    /// expression.
+    ///
+    /// \return True iff every expression was solved.
+    bool evaluateBatch(const ConstraintManager &constraints,
+                       const std::vector< klee::ref<Expr> > &exprs,
+                       std::vector<Validity> &results,
+                       std::vector<bool> &solved,
+                       unsigned numWorkers);
+
     /// mustBeTrue - Determine if the expression is provably true.
     ///
     /// \param [out] result - On success, true iff the expresssion is provably
@@ -170,6 +190,9 @@ namespace klee {
     /// setTimeout - Set constraint solver timeout delay to the given value; 0
     /// is off.
     void setTimeout(double timeout);
+
+    /// getTimeout - Return the current constraint solver timeout delay.
+    double getTimeout() const;
   };
 
   /* *** */
@@ -197,6 +220,15 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createCexCachingSolver(Solver *s);
 
+  /// setCexReuseContext - Set the context under which the following
+  /// queries are issued: the state lineage, the lineage it was forked from
+  /// (0 for none) and the client within it (such as a defect checker). The
+  /// counterexample caching solver keeps the last few satisfying
+  /// assignments of each context and of its parent, and tries them before
+  /// asking the underlying solver (see -cex-reuse-depth).
+  void setCexReuseContext(unsigned lineage, unsigned parentLineage,
+                          unsigned client);
+
   /// createFastCexSolver - Create a "fast counterexample solver", which tries
   /// to quickly compute a satisfying assignment for a constraint set using
   /// value propogation and range analysis.
@@ -211,6 +243,17 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createIndependentSolver(Solver *s);
   
+  /// createPortfolioSolver - Create a solver which runs several solver
+  /// configurations on each query in forked processes and takes the first
+  /// answer. It learns which configuration wins on each query shape and
+  /// runs that one alone once it is consistently the fastest.
+  ///
+  /// \param primary - The main solver, which should not fork itself. Its
+  /// timeout applies to every configuration.
+  /// \param alternates - The other configurations to race against it.
+  Solver *createPortfolioSolver(STPSolver *primary,
+                                const std::vector<Solver*> &alternates);
+
   /// createPCLoggingSolver - Create a solver which will forward all queries
   /// after writing them to the given path in .pc format.
   Solver *createPCLoggingSolver(Solver *s, std::string path,
@@ -225,6 +268,11 @@ namespace klee {
   /// createDummySolver - Create a dummy solver implementation which always
   /// fails.
   Solver *createDummySolver();
+
+  /// reinitializeSolverSharedMemory - Called in a process forked to solve
+  /// on its own copy of the solvers, so that its forked STP runs do not
+  /// share a counterexample segment with those of its parent.
+  void reinitializeSolverSharedMemory();
   
 }
 
@@ -0,0 +1,58 @@
+//===-- ForkGuard.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/ADT/ForkGuard.h"
+
+#include <set>
+
+using namespace klee;
+
+static pthread_mutex_t guardsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t atforkOnce = PTHREAD_ONCE_INIT;
+/// Allocated once and never freed, so that it outlives every guard.
+static std::set<ForkGuard*> *guards;
+
+void ForkGuard::registerAtfork() {
+  guards = new std::set<ForkGuard*>();
+  pthread_atfork(&ForkGuard::prepare, &ForkGuard::release,
+                 &ForkGuard::release);
+}
+
+ForkGuard::ForkGuard() {
+  pthread_mutex_init(&lock, 0);
+  pthread_once(&atforkOnce, &ForkGuard::registerAtfork);
+  pthread_mutex_lock(&guardsLock);
+  guards->insert(this);
+  pthread_mutex_unlock(&guardsLock);
+}
+
+ForkGuard::~ForkGuard() {
+  pthread_mutex_lock(&guardsLock);
+  guards->erase(this);
+  pthread_mutex_unlock(&guardsLock);
+  pthread_mutex_destroy(&lock);
+}
+
+void ForkGuard::prepare() {
+  // The guards are always taken in the same order, after guardsLock, and
+  // their threads never take guardsLock.
+  pthread_mutex_lock(&guardsLock);
+  for (std::set<ForkGuard*>::iterator it = guards->begin(),
+         ie = guards->end(); it != ie; ++it)
+    (*it)->enter();
+}
+
+void ForkGuard::release() {
+  // In the child the locks were taken by its only thread, which can
+  // therefore release them.
+  for (std::set<ForkGuard*>::iterator it = guards->begin(),
+         ie = guards->end(); it != ie; ++it)
+    (*it)->leave();
+  pthread_mutex_unlock(&guardsLock);
+}
@@ -9,9 +9,15 @@
 
 #include "klee/Internal/ADT/KTest.h"
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define KTEST_VERSION 3
 #define KTEST_MAGIC_SIZE 5
@@ -20,6 +26,11 @@
 // for compatibility reasons
 #define BOUT_MAGIC "BOUT\n"
 
+#define KTEST_PACK_VERSION 1
+#define KTEST_PACK_MAGIC_SIZE 6
+#define KTEST_PACK_MAGIC "KTPACK"
+#define KTEST_PACK_HEADER_SIZE (KTEST_PACK_MAGIC_SIZE + 4)
+
 /***/
 
 static int read_uint32(FILE *f, unsigned *value_out) {
@@ -238,3 +249,392 @@ void kTest_free(KTest *bo) {
   free(bo->objects);
   free(bo);
 }
+
+/***/
+
+/* A pack starts with KTEST_PACK_MAGIC and a version, followed by one
+   record per test:
+
+     uint32 length of the rest of the record
+     uint32 id, uint32 kernel, uint32 barrier interval, string defect
+     uint32 numArgs, string args[numArgs]
+     uint32 symArgvs, uint32 symArgvLen
+     uint32 numObjects, { string name, uint32 numBytes, bytes }[numObjects]
+
+   where a string is its uint32 length, its bytes and a NUL, so readers
+   can use it in place. The index file holds the uint64 offset of each
+   record; it is appended after the record, so it never refers to a
+   record which was not completely written. All integers are big
+   endian. */
+
+struct KTestPackWriter {
+  FILE *pack, *index;
+  uint64_t offset;
+};
+
+struct KTestPack {
+  unsigned char *data;
+  size_t size;
+  /* the mapped index, or NULL if the offsets were recovered by scanning
+     the pack */
+  unsigned char *index;
+  size_t indexSize;
+  uint64_t *offsets;
+  unsigned numTests;
+};
+
+static void put_uint32(unsigned char **p, unsigned value) {
+  (*p)[0] = value>>24;
+  (*p)[1] = value>>16;
+  (*p)[2] = value>> 8;
+  (*p)[3] = value>> 0;
+  *p += 4;
+}
+
+static void put_string(unsigned char **p, const char *value) {
+  unsigned len = strlen(value);
+  put_uint32(p, len);
+  memcpy(*p, value, len + 1);
+  *p += len + 1;
+}
+
+static unsigned get_uint32(const unsigned char *p) {
+  return (((((p[0]<<8) + p[1])<<8) + p[2])<<8) + p[3];
+}
+
+static uint64_t get_uint64(const unsigned char *p) {
+  return ((uint64_t) get_uint32(p) << 32) | get_uint32(p + 4);
+}
+
+/* Bounds-checked cursor over a record of a mapped pack. */
+typedef struct {
+  unsigned char *p, *end;
+} PackCursor;
+
+static int take_uint32(PackCursor *c, unsigned *value_out) {
+  if (c->end - c->p < 4)
+    return 0;
+  *value_out = get_uint32(c->p);
+  c->p += 4;
+  return 1;
+}
+
+static int take_bytes(PackCursor *c, unsigned len, unsigned char **value_out) {
+  if ((size_t) (c->end - c->p) < len)
+    return 0;
+  *value_out = c->p;
+  c->p += len;
+  return 1;
+}
+
+static int take_string(PackCursor *c, char **value_out) {
+  unsigned len;
+  unsigned char *s;
+  if (!take_uint32(c, &len) || len == ~0u || !take_bytes(c, len + 1, &s) ||
+      s[len])
+    return 0;
+  *value_out = (char*) s;
+  return 1;
+}
+
+static int kTestPack_checkHeader(const unsigned char *header, size_t size) {
+  return size >= KTEST_PACK_HEADER_SIZE &&
+    !memcmp(header, KTEST_PACK_MAGIC, KTEST_PACK_MAGIC_SIZE) &&
+    get_uint32(header + KTEST_PACK_MAGIC_SIZE) <= KTEST_PACK_VERSION;
+}
+
+int kTestPack_isPackFile(const char *path) {
+  unsigned char header[KTEST_PACK_HEADER_SIZE];
+  FILE *f = fopen(path, "rb");
+  int res;
+
+  if (!f)
+    return 0;
+  res = fread(header, sizeof header, 1, f)==1 &&
+    kTestPack_checkHeader(header, sizeof header);
+  fclose(f);
+
+  return res;
+}
+
+KTestPackWriter *kTestPackWriter_open(const char *path) {
+  KTestPackWriter *w = (KTestPackWriter*) calloc(1, sizeof(*w));
+  char *indexPath = (char*) malloc(strlen(path) + 5);
+  long size;
+
+  if (!w || !indexPath)
+    goto error;
+  sprintf(indexPath, "%s.idx", path);
+
+  w->pack = fopen(path, "ab");
+  if (!w->pack)
+    goto error;
+  w->index = fopen(indexPath, "ab");
+  if (!w->index)
+    goto error;
+
+  if (fseek(w->pack, 0, SEEK_END) || (size = ftell(w->pack)) < 0)
+    goto error;
+  if (size == 0) {
+    if (fwrite(KTEST_PACK_MAGIC, KTEST_PACK_MAGIC_SIZE, 1, w->pack)!=1 ||
+        !write_uint32(w->pack, KTEST_PACK_VERSION))
+      goto error;
+    size = KTEST_PACK_HEADER_SIZE;
+  }
+  w->offset = size;
+
+  free(indexPath);
+  return w;
+ error:
+  if (w) {
+    if (w->pack) fclose(w->pack);
+    if (w->index) fclose(w->index);
+    free(w);
+  }
+  free(indexPath);
+  return 0;
+}
+
+int kTestPackWriter_append(KTestPackWriter *w, KTest *bo,
+                           const KTestInfo *info) {
+  const char *defect = info && info->defect ? info->defect : "";
+  /* length, id, kernel, barrier interval, defect and numArgs */
+  size_t size = 4 * 4 + 4 + strlen(defect) + 1 + 4;
+  unsigned char *record, *p, offset[8];
+  unsigned i;
+  int res;
+
+  for (i=0; i<bo->numArgs; i++)
+    size += 4 + strlen(bo->args[i]) + 1;
+  /* symArgvs, symArgvLen and numObjects */
+  size += 4 * 3;
+  for (i=0; i<bo->numObjects; i++)
+    size += 4 + strlen(bo->objects[i].name) + 1 + 4 + bo->objects[i].numBytes;
+
+  /* Build the record in memory so that it is written by a single call. */
+  p = record = (unsigned char*) malloc(size);
+  if (!record)
+    return 0;
+  put_uint32(&p, size - 4);
+  put_uint32(&p, info ? info->id : 0);
+  put_uint32(&p, info ? info->kernel : 0);
+  put_uint32(&p, info ? info->barrierInterval : 0);
+  put_string(&p, defect);
+  put_uint32(&p, bo->numArgs);
+  for (i=0; i<bo->numArgs; i++)
+    put_string(&p, bo->args[i]);
+  put_uint32(&p, bo->symArgvs);
+  put_uint32(&p, bo->symArgvLen);
+  put_uint32(&p, bo->numObjects);
+  for (i=0; i<bo->numObjects; i++) {
+    KTestObject *o = &bo->objects[i];
+    put_string(&p, o->name);
+    put_uint32(&p, o->numBytes);
+    memcpy(p, o->bytes, o->numBytes);
+    p += o->numBytes;
+  }
+  assert(p == record + size);
+
+  for (i=0; i<8; i++)
+    offset[i] = w->offset >> (56 - 8 * i);
+
+  res = fwrite(record, size, 1, w->pack)==1 && fflush(w->pack)==0 &&
+    fwrite(offset, 8, 1, w->index)==1 && fflush(w->index)==0;
+  free(record);
+  if (res)
+    w->offset += size;
+
+  return res;
+}
+
+void kTestPackWriter_close(KTestPackWriter *w) {
+  fclose(w->pack);
+  fclose(w->index);
+  free(w);
+}
+
+static unsigned char *map_file(const char *path, size_t *size_out) {
+  struct stat st;
+  void *data;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) || st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  /* Private and writable, so that clients may edit the tests in place
+     (klee-replay rewrites argv) without touching the file. */
+  data = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return 0;
+
+  *size_out = st.st_size;
+  return (unsigned char*) data;
+}
+
+/* Recover the record offsets of a pack whose index is missing or does
+   not match it, stopping at the first incomplete record. */
+static int kTestPack_scan(KTestPack *pack) {
+  size_t capacity = 0;
+  uint64_t offset = KTEST_PACK_HEADER_SIZE;
+
+  pack->numTests = 0;
+  while (pack->size - offset >= 4) {
+    uint64_t length = get_uint32(pack->data + offset);
+    if (pack->size - offset - 4 < length)
+      break;
+    if (pack->numTests == capacity) {
+      uint64_t *offsets;
+      capacity = capacity ? 2 * capacity : 1024;
+      offsets = (uint64_t*) realloc(pack->offsets, capacity * sizeof(*offsets));
+      if (!offsets)
+        return 0;
+      pack->offsets = offsets;
+    }
+    pack->offsets[pack->numTests++] = offset;
+    offset += 4 + length;
+  }
+
+  return 1;
+}
+
+/* Trust the index only if it lists consecutive records from the start of
+   the pack, each of which lies within it, as kTestPack_scan would. */
+static int kTestPack_checkIndex(KTestPack *pack) {
+  uint64_t expected = KTEST_PACK_HEADER_SIZE;
+  unsigned i;
+
+  if (pack->indexSize % 8)
+    return 0;
+  pack->numTests = pack->indexSize / 8;
+  for (i = 0; i < pack->numTests; i++) {
+    uint64_t offset = get_uint64(pack->index + 8 * i);
+    if (offset != expected || pack->size - offset < 4 ||
+        pack->size - offset - 4 < get_uint32(pack->data + offset))
+      return 0;
+    expected = offset + 4 + get_uint32(pack->data + offset);
+  }
+  return 1;
+}
+
+KTestPack *kTestPack_open(const char *path) {
+  KTestPack *pack = (KTestPack*) calloc(1, sizeof(*pack));
+  char *indexPath = (char*) malloc(strlen(path) + 5);
+
+  if (!pack || !indexPath)
+    goto error;
+  sprintf(indexPath, "%s.idx", path);
+
+  pack->data = map_file(path, &pack->size);
+  if (!pack->data || !kTestPack_checkHeader(pack->data, pack->size))
+    goto error;
+
+  pack->index = map_file(indexPath, &pack->indexSize);
+  if (pack->index && !kTestPack_checkIndex(pack)) {
+    munmap(pack->index, pack->indexSize);
+    pack->index = 0;
+  }
+  if (!pack->index && !kTestPack_scan(pack))
+    goto error;
+
+  free(indexPath);
+  return pack;
+ error:
+  if (pack) {
+    if (pack->data) munmap(pack->data, pack->size);
+    if (pack->index) munmap(pack->index, pack->indexSize);
+    free(pack->offsets);
+    free(pack);
+  }
+  free(indexPath);
+  return 0;
+}
+
+unsigned kTestPack_numTests(KTestPack *pack) {
+  return pack->numTests;
+}
+
+KTest *kTestPack_get(KTestPack *pack, unsigned index, KTestInfo *info) {
+  KTest *res = 0;
+  PackCursor c;
+  uint64_t offset;
+  unsigned i, length;
+  KTestInfo tmp;
+  char *defect;
+
+  if (index >= pack->numTests)
+    return 0;
+  offset = pack->index ? get_uint64(pack->index + 8 * index)
+                       : pack->offsets[index];
+  if (offset < KTEST_PACK_HEADER_SIZE || offset > pack->size - 4)
+    return 0;
+  length = get_uint32(pack->data + offset);
+  if (pack->size - offset - 4 < length)
+    return 0;
+  c.p = pack->data + offset + 4;
+  c.end = c.p + length;
+
+  if (!info)
+    info = &tmp;
+  if (!take_uint32(&c, &info->id) ||
+      !take_uint32(&c, &info->kernel) ||
+      !take_uint32(&c, &info->barrierInterval) ||
+      !take_string(&c, &defect))
+    return 0;
+  info->defect = defect;
+
+  res = (KTest*) calloc(1, sizeof(*res));
+  if (!res)
+    goto error;
+  res->version = KTEST_VERSION;
+
+  if (!take_uint32(&c, &res->numArgs) ||
+      res->numArgs > (size_t) (c.end - c.p) / 5)
+    goto error;
+  res->args = (char**) calloc(res->numArgs + 1, sizeof(*res->args));
+  if (!res->args)
+    goto error;
+  for (i=0; i<res->numArgs; i++)
+    if (!take_string(&c, &res->args[i]))
+      goto error;
+
+  if (!take_uint32(&c, &res->symArgvs) ||
+      !take_uint32(&c, &res->symArgvLen) ||
+      !take_uint32(&c, &res->numObjects) ||
+      res->numObjects > (size_t) (c.end - c.p) / 9)
+    goto error;
+  res->objects = (KTestObject*) calloc(res->numObjects + 1,
+                                       sizeof(*res->objects));
+  if (!res->objects)
+    goto error;
+  for (i=0; i<res->numObjects; i++) {
+    KTestObject *o = &res->objects[i];
+    if (!take_string(&c, &o->name) ||
+        !take_uint32(&c, &o->numBytes) ||
+        !take_bytes(&c, o->numBytes, &o->bytes))
+      goto error;
+  }
+
+  return res;
+ error:
+  if (res)
+    kTestPack_freeTest(res);
+  return 0;
+}
+
+void kTestPack_freeTest(KTest *bo) {
+  free(bo->args);
+  free(bo->objects);
+  free(bo);
+}
+
+void kTestPack_close(KTestPack *pack) {
+  munmap(pack->data, pack->size);
+  if (pack->index)
+    munmap(pack->index, pack->indexSize);
+  free(pack->offsets);
+  free(pack);
+}
@@ -0,0 +1,298 @@
+//===-- StatsStream.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/ADT/StatsStream.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace klee;
+
+#define STATS_STREAM_VERSION 1
+#define STATS_STREAM_MAGIC_SIZE 4
+#define STATS_STREAM_MAGIC "KSTS"
+
+/***/
+
+static void put_uint(std::string &out, uint64_t value, unsigned bytes) {
+  for (unsigned i = 0; i < bytes; i++)
+    out += (char) ((value >> (8 * i)) & 0xFF);
+}
+
+static uint64_t get_uint(const unsigned char *data, unsigned bytes) {
+  uint64_t value = 0;
+  for (unsigned i = bytes; i; i--)
+    value = (value << 8) | data[i - 1];
+  return value;
+}
+
+static bool write_all(int fd, const char *data, size_t size) {
+  while (size) {
+    ssize_t n = ::write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool read_all(int fd, uint64_t offset, unsigned char *data,
+                     size_t size) {
+  while (size) {
+    ssize_t n = ::pread(fd, data, size, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    offset += n;
+    size -= n;
+  }
+  return true;
+}
+
+/***/
+
+unsigned StatsStream::getCurrentVersion() {
+  return STATS_STREAM_VERSION;
+}
+
+uint64_t StatsStream::fromReal(double value) {
+  uint64_t slot;
+  memcpy(&slot, &value, sizeof slot);
+  return slot;
+}
+
+double StatsStream::toReal(uint64_t slot) {
+  double value;
+  memcpy(&value, &slot, sizeof value);
+  return value;
+}
+
+/***/
+
+StatsStreamWriter::StatsStreamWriter(int _fd, unsigned _numColumns,
+                                     unsigned _capacity)
+  : fd(_fd),
+    numColumns(_numColumns),
+    capacity(_capacity),
+    ring(new uint64_t[_numColumns * _capacity]),
+    head(0),
+    tail(0),
+    numDropped(0),
+    inRecord(false),
+    done(false) {
+  pthread_mutex_init(&lock, 0);
+  pthread_cond_init(&workAvailable, 0);
+}
+
+StatsStreamWriter *
+StatsStreamWriter::open(const std::string &path,
+                        const std::vector<StatsStream::Column> &columns,
+                        unsigned capacity) {
+  std::string header(STATS_STREAM_MAGIC, STATS_STREAM_MAGIC_SIZE);
+  put_uint(header, STATS_STREAM_VERSION, 4);
+  put_uint(header, columns.size(), 4);
+  for (unsigned i = 0; i < columns.size(); i++) {
+    put_uint(header, columns[i].type, 1);
+    put_uint(header, columns[i].name.size(), 2);
+    header += columns[i].name;
+  }
+
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return 0;
+  if (!write_all(fd, header.data(), header.size())) {
+    ::close(fd);
+    return 0;
+  }
+
+  StatsStreamWriter *w = new StatsStreamWriter(fd, columns.size(),
+                                               capacity ? capacity : 1);
+  if (pthread_create(&w->thread, 0, &StatsStreamWriter::run, w)) {
+    // Leave the thread out of the destructor.
+    w->done = true;
+    w->fd = -1;
+    delete w;
+    ::close(fd);
+    return 0;
+  }
+  return w;
+}
+
+StatsStreamWriter::~StatsStreamWriter() {
+  if (fd >= 0) {
+    pthread_mutex_lock(&lock);
+    done = true;
+    pthread_cond_signal(&workAvailable);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, 0);
+    ::close(fd);
+  }
+
+  pthread_cond_destroy(&workAvailable);
+  pthread_mutex_destroy(&lock);
+  delete[] ring;
+}
+
+uint64_t *StatsStreamWriter::beginRecord() {
+  assert(!inRecord && "record already in progress");
+  if (head - tail >= capacity) {
+    ++numDropped;
+    return 0;
+  }
+  inRecord = true;
+  return ring + (head % capacity) * numColumns;
+}
+
+void StatsStreamWriter::commitRecord() {
+  assert(inRecord && "no record in progress");
+  inRecord = false;
+  // The record must be complete before the writer can see it.
+  __sync_synchronize();
+  head = head + 1;
+  pthread_cond_signal(&workAvailable);
+}
+
+void *StatsStreamWriter::run(void *writer) {
+  static_cast<StatsStreamWriter*>(writer)->writeRecords();
+  return 0;
+}
+
+void StatsStreamWriter::writeRecords() {
+  std::string buffer;
+  for (;;) {
+    pthread_mutex_lock(&lock);
+    // commitRecord signals without the lock, so do not rely on being
+    // woken up.
+    while (!done && head == tail) {
+      struct timeval now;
+      gettimeofday(&now, 0);
+      struct timespec deadline;
+      deadline.tv_sec = now.tv_sec + 1;
+      deadline.tv_nsec = now.tv_usec * 1000;
+      pthread_cond_timedwait(&workAvailable, &lock, &deadline);
+    }
+    bool finished = done;
+    pthread_mutex_unlock(&lock);
+    forkGuard.enter();
+
+    unsigned end = head;
+    __sync_synchronize();
+    buffer.clear();
+    for (unsigned r = tail; r != end; r++) {
+      const uint64_t *record = ring + (r % capacity) * numColumns;
+      for (unsigned i = 0; i < numColumns; i++)
+        put_uint(buffer, record[i], 8);
+    }
+    // Give the slots back only once they have been read.
+    __sync_synchronize();
+    tail = end;
+
+    if (!buffer.empty())
+      write_all(fd, buffer.data(), buffer.size());
+    forkGuard.leave();
+    if (finished && head == tail)
+      break;
+  }
+}
+
+/***/
+
+StatsStreamReader::StatsStreamReader(int _fd)
+  : fd(_fd), headerSize(0), numRecords(0) {}
+
+StatsStreamReader *StatsStreamReader::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return 0;
+
+  StatsStreamReader *r = new StatsStreamReader(fd);
+  unsigned char data[STATS_STREAM_MAGIC_SIZE + 8];
+  if (!read_all(fd, 0, data, sizeof data) ||
+      memcmp(data, STATS_STREAM_MAGIC, STATS_STREAM_MAGIC_SIZE) ||
+      get_uint(data + STATS_STREAM_MAGIC_SIZE, 4) > STATS_STREAM_VERSION) {
+    delete r;
+    return 0;
+  }
+
+  unsigned numColumns = get_uint(data + STATS_STREAM_MAGIC_SIZE + 4, 4);
+  uint64_t offset = sizeof data;
+  for (unsigned i = 0; i < numColumns; i++) {
+    unsigned char desc[3];
+    if (!read_all(fd, offset, desc, sizeof desc)) {
+      delete r;
+      return 0;
+    }
+    offset += sizeof desc;
+    std::vector<unsigned char> name(get_uint(desc + 1, 2) + 1);
+    if (!read_all(fd, offset, &name[0], name.size() - 1)) {
+      delete r;
+      return 0;
+    }
+    offset += name.size() - 1;
+    r->columns.push_back(StatsStream::Column(
+                           std::string(name.begin(), name.end() - 1),
+                           (StatsStream::ColumnType) desc[0]));
+  }
+  r->headerSize = offset;
+
+  if (r->columns.empty()) {
+    delete r;
+    return 0;
+  }
+  r->refresh();
+  return r;
+}
+
+StatsStreamReader::~StatsStreamReader() {
+  ::close(fd);
+}
+
+int StatsStreamReader::getColumnIndex(const std::string &name) const {
+  for (unsigned i = 0; i < columns.size(); i++)
+    if (columns[i].name == name)
+      return i;
+  return -1;
+}
+
+uint64_t StatsStreamReader::refresh() {
+  struct stat st;
+  if (fstat(fd, &st) || (uint64_t) st.st_size < headerSize)
+    return 0;
+  // A record still being appended is left for the next refresh.
+  uint64_t count = ((uint64_t) st.st_size - headerSize)
+    / (8 * columns.size());
+  uint64_t added = count > numRecords ? count - numRecords : 0;
+  numRecords = count;
+  return added;
+}
+
+bool StatsStreamReader::readRecord(uint64_t index,
+                                   std::vector<uint64_t> &slots) const {
+  if (index >= numRecords)
+    return false;
+  std::vector<unsigned char> data(8 * columns.size());
+  if (!read_all(fd, headerSize + index * data.size(), &data[0], data.size()))
+    return false;
+  slots.resize(columns.size());
+  for (unsigned i = 0; i < columns.size(); i++)
+    slots[i] = get_uint(&data[8 * i], 8);
+  return true;
+}
@@ -31,6 +31,12 @@ void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
   objects = objects.replace(std::make_pair(mo, os));
 }
 
+void AddressSpace::bindSharedObject(const MemoryObject *mo, ObjectState *os) {
+  assert(os->readOnly && "shared object is not read only");
+  assert(mo->ctype == ctype && "unmatched ctypes");
+  objects = objects.replace(std::make_pair(mo, os));
+}
+
 void AddressSpace::unbindObject(const MemoryObject *mo) {
   assert(mo->ctype == ctype && "unmatched ctypes");
   objects = objects.remove(mo);
@@ -353,6 +359,157 @@ bool AddressSpace::copyInConcretes() {
   return true;
 }
 
+/***/
+
+// Values recorded at the same point of both states are merged into a
+// select; a value missing in only one of them cannot be merged.
+static bool mergeValue(klee::ref<Expr> &a, const klee::ref<Expr> &b,
+                       klee::ref<Expr> inA, bool apply, unsigned &numSelects) {
+  if (a.isNull() || b.isNull())
+    return a.isNull() && b.isNull();
+  if (a == b)
+    return true;
+  if (a->getWidth() != b->getWidth())
+    return false;
+
+  ++numSelects;
+  if (apply)
+    a = SelectExpr::create(inA, a, b);
+  return true;
+}
+
+static bool mergeAccessVec(MemoryAccessVec &a, const MemoryAccessVec &b,
+                           klee::ref<Expr> inA, bool apply,
+                           unsigned &numSelects) {
+  if (a.size() != b.size())
+    return false;
+
+  for (unsigned i = 0; i < a.size(); i++) {
+    MemoryAccess &x = a[i];
+    const MemoryAccess &y = b[i];
+    if (x.mo->id != y.mo->id || x.width != y.width
+        || x.bid != y.bid || x.tid != y.tid
+        || x.instr != y.instr || x.instSeqNum != y.instSeqNum
+        || x.fence != y.fence || x.isAtomic != y.isAtomic
+        || x.is_write != y.is_write)
+      return false;
+    if (!mergeValue(x.offset, y.offset, inA, apply, numSelects)
+        || !mergeValue(x.val, y.val, inA, apply, numSelects)
+        || !mergeValue(x.accessCondExpr, y.accessCondExpr,
+                       inA, apply, numSelects))
+      return false;
+  }
+  return true;
+}
+
+static bool mergeAccessVecs(std::vector<MemoryAccessVec> &a,
+                            const std::vector<MemoryAccessVec> &b,
+                            klee::ref<Expr> inA, bool apply,
+                            unsigned &numSelects) {
+  if (a.size() != b.size())
+    return false;
+
+  for (unsigned i = 0; i < a.size(); i++) {
+    if (!mergeAccessVec(a[i], b[i], inA, apply, numSelects))
+      return false;
+  }
+  return true;
+}
+
+bool AddressSpace::merge(const AddressSpace &b, klee::ref<Expr> inA,
+                         bool apply, unsigned &numSelects) {
+  // Addresses must resolve the same way in both states, so neither may
+  // have allocated or freed an object the other has not.
+  std::vector<const MemoryObject*> mutated;
+  MemoryMap::iterator ai = objects.begin();
+  MemoryMap::iterator bi = b.objects.begin();
+  MemoryMap::iterator ae = objects.end();
+  MemoryMap::iterator be = b.objects.end();
+  for (; ai!=ae && bi!=be; ++ai, ++bi) {
+    if (ai->first != bi->first)
+      return false;
+    if (ai->second != bi->second)
+      mutated.push_back(ai->first);
+  }
+  if (ai!=ae || bi!=be)
+    return false;
+
+  for (std::vector<const MemoryObject*>::iterator it = mutated.begin(),
+         ie = mutated.end(); it != ie; ++it) {
+    const MemoryObject *mo = *it;
+    const ObjectState *os = findObject(mo);
+    const ObjectState *otherOS = b.findObject(mo);
+    ObjectState *wos = 0;
+
+    for (unsigned i = 0; i < mo->size; i++) {
+      klee::ref<Expr> av = os->read8(i);
+      klee::ref<Expr> bv = otherOS->read8(i);
+      if (av == bv)
+        continue;
+      if (os->readOnly)
+        return false;
+
+      ++numSelects;
+      if (apply) {
+        if (!wos)
+          wos = getWriteable(mo, os);
+        wos->write(i, SelectExpr::create(inA, av, bv));
+      }
+    }
+  }
+
+  if (!mergeAccessVec(readSet, b.readSet, inA, apply, numSelects)
+      || !mergeAccessVec(writeSet, b.writeSet, inA, apply, numSelects)
+      || !mergeAccessVecs(accumWriteSets, b.accumWriteSets,
+                          inA, apply, numSelects)
+      || !mergeAccessVecs(symGlobalReadSets, b.symGlobalReadSets,
+                          inA, apply, numSelects)
+      || !mergeAccessVecs(symGlobalWriteSets, b.symGlobalWriteSets,
+                          inA, apply, numSelects))
+    return false;
+
+  if (MemAccessSets.size() != b.MemAccessSets.size())
+    return false;
+  for (unsigned i = 0; i < MemAccessSets.size(); i++) {
+    MemoryAccessSetVec &setVec = MemAccessSets[i];
+    const MemoryAccessSetVec &otherSetVec = b.MemAccessSets[i];
+    if (setVec.size() != otherSetVec.size())
+      return false;
+    for (unsigned j = 0; j < setVec.size(); j++) {
+      MemoryAccessSet &set = setVec[j];
+      const MemoryAccessSet &otherSet = otherSetVec[j];
+      if (set.bid != otherSet.bid || set.warpNum != otherSet.warpNum
+          || set.biNum != otherSet.biNum
+          || !mergeAccessVecs(set.readVecSet, otherSet.readVecSet,
+                              inA, apply, numSelects)
+          || !mergeAccessVecs(set.writeVecSet, otherSet.writeVecSet,
+                              inA, apply, numSelects))
+        return false;
+    }
+  }
+
+  if (MemAccessSetsPureCS.size() != b.MemAccessSetsPureCS.size())
+    return false;
+  for (unsigned i = 0; i < MemAccessSetsPureCS.size(); i++) {
+    MemoryAccessSetVecPureCS &setVec = MemAccessSetsPureCS[i];
+    const MemoryAccessSetVecPureCS &otherSetVec = b.MemAccessSetsPureCS[i];
+    if (setVec.size() != otherSetVec.size())
+      return false;
+    for (unsigned j = 0; j < setVec.size(); j++) {
+      MemoryAccessSetPureCS &set = setVec[j];
+      const MemoryAccessSetPureCS &otherSet = otherSetVec[j];
+      if (set.bid != otherSet.bid || set.biNum != otherSet.biNum
+          || !mergeAccessVec(set.readSet, otherSet.readSet,
+                             inA, apply, numSelects)
+          || !mergeAccessVec(set.writeSet, otherSet.writeSet,
+                             inA, apply, numSelects))
+        return false;
+    }
+  }
+
+  return true;
+}
+
 static bool isTwoBBIdentical(std::string funcName1, std::string funcName2, 
                              llvm::BasicBlock *bb1, llvm::BasicBlock *bb2) {
   return funcName1.compare(funcName2) == 0 && bb1 == bb2;
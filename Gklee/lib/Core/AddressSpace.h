@@ -16,6 +16,7 @@
 #include "Memory.h"
 #include "klee/Expr.h"
 #include "klee/Constraints.h"
+#include "klee/util/ExprHashMap.h"
 #include "klee/Internal/ADT/ImmutableMap.h"
 #include "llvm/Function.h"
 #include <set>
@@ -31,6 +32,7 @@ namespace klee {
   class MemoryObject;
   class ObjectState;
   class TimingSolver;
+  class ConstantMemory;
 
   template<class T> class ref;
 
@@ -376,6 +378,16 @@ namespace klee {
     /// \return A writeable ObjectState (\a os or a copy).
     ObjectState *getWriteable(const MemoryObject *mo, const ObjectState *os);
 
+    /// Add a binding to a read-only object shared with other address
+    /// spaces. It is never owned by any of them.
+    void bindSharedObject(const MemoryObject *mo, ObjectState *os);
+
+    /// Whether this address space owns \a os, i.e. no other state can
+    /// refer to it.
+    bool owns(const ObjectState *os) const {
+      return os->copyOnWriteOwner == cowKey;
+    }
+
     /// Copy the concrete values of all managed ObjectStates into the
     /// actual system memory location they were allocated at.
     void copyOutConcretes();
@@ -390,6 +402,16 @@ namespace klee {
     /// \retval false The copy failed because a read-only object was modified.
     bool copyInConcretes();
 
+    /// Merge the bindings and access records of \a b into this address
+    /// space as (inA ? ours : theirs). Both must bind the same objects and
+    /// have recorded accesses of the same shape. Without \a apply nothing
+    /// is changed; the number of values that would need a select is added
+    /// to \a numSelects.
+    ///
+    /// \return true iff the address spaces can be merged.
+    bool merge(const AddressSpace &b, klee::ref<Expr> inA, bool apply,
+               unsigned &numSelects);
+
     bool belongToSameDivergenceRegion(const MemoryAccess &, const MemoryAccess &, 
                                       std::vector<CorrespondTid> &,  
                                       std::vector< std::vector<BranchDivRegionSet> > &,
@@ -521,6 +543,10 @@ namespace klee {
     std::vector<WarpDefVec> nomcWDSet;
     std::vector<WarpDefVec> wdWDSet;
 
+    /// The constant objects, looked up ahead of the device memory when
+    /// resolving device addresses.
+    static const ConstantMemory *constantMemory;
+
     HierAddressSpace();
     HierAddressSpace(const HierAddressSpace &address);
 
@@ -616,6 +642,13 @@ namespace klee {
     void dumpVerboseAddressSpaceMO();
 
     void clearAccessSet(char mask = 15);
+    /// The number of accesses the defect checks at the next barrier will 
+    /// examine.
+    unsigned getNumPendingAccesses() const;
+    /// Merge \a b into this hierarchy at every memory level; see
+    /// AddressSpace::merge. The per-thread instruction traces must agree.
+    bool merge(const HierAddressSpace &b, klee::ref<Expr> inA, bool apply,
+               unsigned &numSelects);
     void clearInstAccessSet(bool clearAll);
     void clearGlobalAccessSet();
     void clearWarpDefectSet();
@@ -658,10 +691,117 @@ namespace klee {
     void getRaceRate();
   };
 
+  /// BuiltInSubstitution - Maps the blockIdx and threadIdx of the first
+  /// parametric flow to those of the second. The symbolic-config checkers
+  /// apply it to every access of a barrier interval, mostly to the same
+  /// few expressions over and over, so the results are kept. A state
+  /// holds one per barrier interval, shared with the states it forks.
+  class BuiltInSubstitution {
+    std::map< klee::ref<Expr>, klee::ref<Expr> > equalities;
+    ExprHashMap< klee::ref<Expr> > substituted;
+
+  public:
+    unsigned refCount;
+
+    explicit BuiltInSubstitution(ExecutionState &state);
+
+    klee::ref<Expr> apply(const ConstraintManager &constr, 
+                          const klee::ref<Expr> &e);
+  };
+
+  /// ProvenAccessPairs - The access pairs the symbolic-config checkers
+  /// have shown to be free of the defect they look for under a state's
+  /// constraints. A pair is known by the checker, its two instructions
+  /// and the conjunction it was queried with, so a loop body issuing the
+  /// same query shape on every iteration is proven once. Constraints only
+  /// grow along a path, so the verdicts hold in later barrier intervals
+  /// and in the states branched off; those share the set copy-on-write.
+  class ProvenAccessPairs {
+  public:
+    enum Check {
+      RaceCheck,
+      PureCSRaceCheck,
+      BankConflictCheck
+    };
+
+    struct Key {
+      Check check;
+      const llvm::Instruction *inst1, *inst2;
+      klee::ref<Expr> query;
+
+      bool operator<(const Key &b) const {
+        if (check != b.check) return check < b.check;
+        if (inst1 != b.inst1) return inst1 < b.inst1;
+        if (inst2 != b.inst2) return inst2 < b.inst2;
+        return query < b.query;
+      }
+    };
+
+    unsigned refCount;
+    std::set<Key> pairs;
+
+    ProvenAccessPairs() : refCount(0) {}
+    ProvenAccessPairs(const ProvenAccessPairs &other)
+      : refCount(0), pairs(other.pairs) {}
+  };
+
+  /// AtomicSummaries - The commutative atomic updates a state has applied
+  /// to each location in the current barrier interval, kept apart from
+  /// the value they were applied to. The location is then written the
+  /// value combined with a balanced fold of the operands, so N updates
+  /// nest log(N) deep instead of N. States branched off in the interval
+  /// share the summaries copy-on-write.
+  class AtomicSummaries {
+  public:
+    enum Op {
+      Add,
+      And,
+      Or,
+      Xor,
+      SMin,
+      SMax,
+      UMin,
+      UMax
+    };
+
+    struct Key {
+      Op op;
+      klee::ref<Expr> address;
+
+      bool operator<(const Key &b) const {
+        if (op != b.op) return op < b.op;
+        return address < b.address;
+      }
+    };
+
+    struct Summary {
+      /// The value of the location before the first folded update.
+      klee::ref<Expr> base;
+      /// Balanced folds of the operands, each with the number it covers;
+      /// the counts halve along the vector, like the bits of a counter.
+      std::vector< std::pair<unsigned, klee::ref<Expr> > > partials;
+      /// The number of operands folded.
+      unsigned count;
+      /// The value last written to the location. The summary is dropped
+      /// once the location holds anything else.
+      klee::ref<Expr> written;
+
+      Summary() : count(0) {}
+    };
+
+    unsigned refCount;
+    std::map<Key, Summary> summaries;
+
+    AtomicSummaries() : refCount(0) {}
+    AtomicSummaries(const AtomicSummaries &other)
+      : refCount(0), summaries(other.summaries) {}
+  };
+
   class AddressSpaceUtil {
     public: 
       static bool evaluateQueryMustBeTrue(Executor &, ExecutionState &, klee::ref<Expr> &, bool &, bool &);
       static bool evaluateQueryMustBeFalse(Executor &, ExecutionState &, klee::ref<Expr> &, bool &, bool &);
+      static void prefetchQueries(Executor &, ExecutionState &, std::vector< klee::ref<Expr> > &);
       static bool isTwoInstIdentical(llvm::Instruction *inst1, llvm::Instruction *inst2); 
       static void constructTmpRWSet(Executor &, ExecutionState &, 
                                     MemoryAccessVec &, MemoryAccessVec &, 
@@ -65,6 +65,9 @@ class BCCoverage {
 public:
   BCCoverage() { }
   BICovInfo& getCovInfo(unsigned kernelNum) { return covInfoVec[kernelNum-1]; };
+  bool hasCovInfo(unsigned kernelNum) const { 
+    return kernelNum && kernelNum <= covInfoVec.size(); 
+  };
 
   void initPerThreadCov();
   // process stats for a single instruction step, es is the state
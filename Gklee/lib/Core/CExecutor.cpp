@@ -11,6 +11,7 @@
 
 #include "Executor.h"
 
+#include "ConstantMemory.h"
 #include "Context.h"
 #include "CoreStats.h"
 #include "ExternalDispatcher.h"
@@ -647,6 +648,8 @@ void Executor::initializeGlobals(ExecutionState &state) {
 	ObjectState *os = bindObjectInState(state, mo, false);
 	if (!i->hasInitializer())
 	  os->initializeToRandom();
+	if (i->hasSection() && i->getSection() == "__constant__")
+	  constantMemory->addObject(mo);
       }
 
       globalObjects.insert(std::make_pair(i, mo));
@@ -843,8 +846,7 @@ void Executor::executeMemoryOperation(ExecutionState &state,
                                       KInstruction *target, 
                                       unsigned seqNum, bool isAtomic) {
   Gklee::Logging::enterFunc( address , __PRETTY_FUNCTION__ );
-  Expr::Width type = (isWrite ? value->getWidth() : 
-		      getWidthForLLVMType(target->inst->getType()));
+  Expr::Width type = (isWrite ? value->getWidth() : target->width);
   unsigned bytes = Expr::getMinBytesForWidth(type);
   
   if (SimplifySymIndices) {
@@ -905,9 +907,23 @@ void Executor::executeMemoryOperation(ExecutionState &state,
          state.tinfo.is_GPU_mode) {
       if (!AvoidOOBCheck) {
         ExecutorUtil::copyOutConstraint(state);
+        solver->queryClient = TimingSolver::OutOfBoundsCheckClient;
         success = solver->mustBeTrue(state, 
                                      mo->getBoundsCheckOffset(offset, bytes),
                                      inBounds);
+        solver->queryClient = TimingSolver::ExecutionClient;
+        if (!success && solver->wasAbandoned()) {
+          // Out of checking time: whether the access stays in bounds is
+          // unknown. Say so, and carry on with the access unchecked, as
+          // with -avoid-oob-check.
+          klee_warning_once(target, 
+                            "out-of-bounds check at %s:%u gave up for lack of "
+                            "solver time (-check-time-budget); the access is "
+                            "not known to be in bounds",
+                            target->info->file.c_str(), target->info->line);
+          success = true;
+          inBounds = true;
+        }
         if (!inBounds) {
           dumpTmpOutOfBoundConfig(state, 
                                   mo->getBoundsCheckOffset(offset, bytes), 
@@ -937,6 +953,9 @@ void Executor::executeMemoryOperation(ExecutionState &state,
     if (inBounds) {      // no memory out-of-bound error
       const ObjectState *os = op.second;
       if (isWrite) {
+        // host code may write constant memory between kernel launches
+        if (os->readOnly && !state.tinfo.is_GPU_mode)
+          os = constantMemory->thaw(state, mo, os);
         if (os->readOnly) {
           terminateStateOnError(state,
                                 "memory error: object read only",
@@ -1035,6 +1054,8 @@ void Executor::executeMemoryOperation(ExecutionState &state,
     // bound can be 0 on failure or overlapped 
     if (bound) {
       if (isWrite) {
+        if (os->readOnly && !bound->tinfo.is_GPU_mode)
+          os = constantMemory->thaw(*bound, mo, os);
         if (os->readOnly) {
           terminateStateOnError(*bound,
                                 "memory error: object read only",
@@ -1075,8 +1096,7 @@ void Executor::executeNoMemoryCoalescing(ExecutionState &state, klee::ref<Expr>
   }
   ExecutionState *anoState = state.branch(); 
   addConstraint(*anoState, noMCCond);
-  char suffix[256] = "mc";
-  interpreterHandler->processTestCase(*anoState, "execution encounters the performance defect of non-memory coalescing", "mc.err", suffix);
+  emitTestCase(*anoState, "execution encounters the performance defect of non-memory coalescing", "mc.err", "mc");
   traceInfo.empty();
   delete anoState;
   Gklee::Logging::exitFunc();
@@ -1089,8 +1109,7 @@ void Executor::executeBankConflict(ExecutionState &state, klee::ref<Expr> &bcCon
   }
   ExecutionState *anoState = state.branch(); 
   addConstraint(*anoState, bcCond);
-  char suffix[256] = "bc";
-  interpreterHandler->processTestCase(*anoState, "execution encounters the performance defect of bank conflict", "bc.err", suffix);
+  emitTestCase(*anoState, "execution encounters the performance defect of bank conflict", "bc.err", "bc");
   traceInfo.empty();
   delete anoState;
 }
@@ -1102,8 +1121,7 @@ void Executor::executeVolatileMissing(ExecutionState &state, klee::ref<Expr> &vm
   }
   ExecutionState *anoState = state.branch(); 
   addConstraint(*anoState, vmCond);
-  char suffix[256] = "vm";
-  interpreterHandler->processTestCase(*anoState, "execution encounters the potential volatile missing", "vm.err", suffix);
+  emitTestCase(*anoState, "execution encounters the potential volatile missing", "vm.err", "vm");
   traceInfo.empty();
   delete anoState;
 }
@@ -216,7 +216,7 @@ class ThreadInfo {
       cur_tid = tid;
   }
 
-  inline unsigned get_cur_tid() {
+  inline unsigned get_cur_tid() const {
     /* return cur_tid + cur_bid * GPUConfig::BlockSize[0]; */
     return (UseSymbolicConfig)? sym_cur_tid : cur_tid;
   }
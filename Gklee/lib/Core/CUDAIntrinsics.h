@@ -1,4 +1,4 @@
-//===-- ExecutorCUDAIntrinsic.cpp ------------------------------------------------------===//
+//===-- CUDAIntrinsics.h ----------------------------------------*- C++ -*-===//
 //
 //                     The KLEE Symbolic Virtual Machine
 //
@@ -7,95 +7,72 @@
 //
 //===----------------------------------------------------------------------===//
 
-#include <string.h> 
+#ifndef KLEE_CUDAINTRINSICS_H
+#define KLEE_CUDAINTRINSICS_H
 
-static std::string CUDAArithmetic[] = {
-  "mulhi",
-  "mul64hi",
-  "mul24",
-  "sad",
-  "fdivide",
-  "sin",
-  "cos",
-  "tan",
-  "exp",
-  "log",
-  "pow",
-  "__fadd_",
-  "__dadd_",
-  "__fmul_",
-  "__dmul_",
-  "fma",
-  "rcp",
-  "sqrt",
-  "__fdiv_",
-  "__ddiv_",
-  "clz", 
-  "ffs", 
-  "popc", 
-  "brev",
-  "byte_perm"
-  "hadd",
-  "abs",
-  "min",
-  "max",
-  "saturate",
-  "round",
-  "trunc",
-  "floor",
-  "ceil"
-};
+#include <string>
 
-static std::string CUDAConversion[] = {
-  "__float2int_",
-  "__float2uint_",
-  "__int2float_", 
-  "__uint2float_",
-  "__float2ll_", 
-  "__float2ull_", 
-  "__ll2float_", 
-  "__ull2float_", 
-  "__float2half_", 
-  "__half2float",   
-  "__int2double_",
-  "__uint2double_",
-  "__ll2double_",
-  "__ull2double_"
-  "__double2int_",
-  "__double2uint_",
-  "__double2ll_",
-  "__double2ull_",
-  "__double2hiint",
-  "__double2loint",
-  "__hiloint2double",
-  "__float_as_int",
-  "__int_as_float",
-  "__double_as_longlong",
-  "__longlong_as_double"
-};
+namespace klee {
+  class KModule;
 
-static std::string CUDAAtomic[] = {
-  "AtomicAdd",
-  "AtomicExch",
-  "AtomicMin",
-  "AtomicMax",
-  "AtomicInc",
-  "AtomicDec",
-  "AtomicCas",
-  "AtomicAnd",
-  "AtomicOr",
-  "AtomicXor"
-};
+  namespace CUDAIntrinsic {
+    /// The handler a call to a declared function is dispatched to in GPU
+    /// mode. Call instructions keep theirs in KInstruction::cudaIntrinsic.
+    enum Kind {
+      /// Not classified yet.
+      Unresolved = 0,
+      /// Not a CUDA intrinsic; the call goes to an external function.
+      None,
 
-static std::string CUDASync[] = {
-  "__syncthreads",
-  "__syncthreads_count",
-  "__syncthreads_and",
-  "__syncthreads_or"
-};
+      // Arithmetic
+      MulHi,
+      Sad,
+      FDivide,
+      Triangle,
+      Exponential,
+      Comparison,
+      FloatAdd,
+      FloatMul,
+      FloatFma,
+      FloatRcp,
+      FloatSqrt,
+      FloatDiv,
+      BitWise,
+      ParAdd,
+      Abs,
+      FPConversion,
 
-static std::string CUDAMemfence[] = {
-  "__threadfence",
-  "__threadfence_block",
-  "__threadfence_system"
-};
+      // Conversion
+      FPToSI,
+      FPToUI,
+      SIToFP,
+      UIToFP,
+      FPToHiOrLoInt,
+      HiLoIntToFP,
+      FPAsInt,
+      IntAsFP,
+
+      // Atomics
+      AtomicAdd,
+      AtomicExch,
+      AtomicMin,
+      AtomicMax,
+      AtomicInc,
+      AtomicDec,
+      AtomicCAS,
+      AtomicBitWise,
+
+      Memfence,
+      Barrier
+    };
+
+    /// Find the handler for a function called \a fName. Names are matched
+    /// by substring, first match wins, in the order of Kind.
+    Kind classify(const std::string &fName);
+
+    /// Set KInstruction::cudaIntrinsic on every direct call in \a kmodule.
+    void resolveCalls(KModule *kmodule);
+  }
+}
+
+#endif
@@ -0,0 +1,122 @@
+//===-- ConstantMemory.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ConstantMemory.h"
+
+#include "AddressSpace.h"
+#include "CoreStats.h"
+#include "Memory.h"
+
+#include "klee/ExecutionState.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace klee;
+
+namespace {
+  /// The number of distinct contents interned for one object, beyond
+  /// which states keep their own copies.
+  const unsigned MaxInternedVersions = 16;
+
+  struct MemoryObjectAddressLT {
+    bool operator()(const MemoryObject *a, const MemoryObject *b) const {
+      return a->address < b->address;
+    }
+  };
+}
+
+/***/
+
+void ConstantMemory::addObject(const MemoryObject *mo) {
+  objects.insert(std::upper_bound(objects.begin(), objects.end(), mo,
+                                  MemoryObjectAddressLT()),
+                 mo);
+}
+
+const MemoryObject *ConstantMemory::lookup(uint64_t address) const {
+  if (objects.empty() || address < objects.front()->address)
+    return 0;
+
+  // The last object starting at or below the address.
+  unsigned lo = 0, hi = objects.size();
+  while (hi - lo > 1) {
+    unsigned mid = (lo + hi) / 2;
+    if (objects[mid]->address <= address)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  const MemoryObject *mo = objects[lo];
+  if (address - mo->address < mo->size)
+    return mo;
+  return 0;
+}
+
+void ConstantMemory::freeze(ExecutionState &state) {
+  AddressSpace &as = state.addressSpace.deviceMemory;
+  for (unsigned i = 0; i < objects.size(); i++) {
+    const MemoryObject *mo = objects[i];
+    const ObjectState *os = as.findObject(mo);
+    if (!os || os->readOnly)
+      continue;
+
+    bool concrete = true;
+    for (unsigned j = 0; j < os->size && concrete; j++)
+      concrete = os->isByteConcrete(j);
+    if (!concrete)
+      continue;
+
+    std::map<std::string, ObjectHolder> &versions = interned[mo];
+    std::string contents((const char*) os->concreteStore, os->size);
+    std::map<std::string, ObjectHolder>::iterator it =
+      versions.find(contents);
+    if (it == versions.end()) {
+      if (versions.size() >= MaxInternedVersions)
+        continue;
+      ObjectState *shared = new ObjectState(*os);
+      shared->setReadOnly(true);
+      it = versions.insert(std::make_pair(contents,
+                                          ObjectHolder(shared))).first;
+    }
+    as.bindSharedObject(mo, it->second);
+    ++stats::constantObjectsShared;
+  }
+}
+
+const ObjectState *ConstantMemory::thaw(ExecutionState &state,
+                                        const MemoryObject *mo,
+                                        const ObjectState *os) {
+  if (!os->readOnly)
+    return os;
+
+  // Objects the program declares constant are read-only too, and stay
+  // so.
+  std::map<const MemoryObject*,
+           std::map<std::string, ObjectHolder> >::iterator versions =
+    interned.find(mo);
+  if (versions == interned.end())
+    return os;
+  std::map<std::string, ObjectHolder>::iterator it =
+    versions->second.find(std::string((const char*) os->concreteStore,
+                                      os->size));
+  if (it == versions->second.end())
+    return os;
+  const ObjectState *shared = it->second;
+  if (shared != os)
+    return os;
+
+  // A frozen object is all concrete, so its bytes and updates are all
+  // there is to copy. (The copy constructor refuses read-only objects.)
+  ObjectState *copy = new ObjectState(mo, os->updates);
+  memcpy(copy->concreteStore, os->concreteStore, os->size);
+  state.addressSpace.deviceMemory.bindObject(mo, copy);
+  return copy;
+}
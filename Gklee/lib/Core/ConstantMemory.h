@@ -0,0 +1,67 @@
+//===-- ConstantMemory.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CONSTANTMEMORY_H
+#define KLEE_CONSTANTMEMORY_H
+
+#include "ObjectHolder.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace klee {
+  class ExecutionState;
+  class MemoryObject;
+  class ObjectState;
+
+  /// ConstantMemory - The __constant__ objects of the program, shared
+  /// read-only between the states while kernels run.
+  ///
+  /// Kernels cannot write constant memory, so when a state launches a
+  /// kernel each of its constant objects with concrete contents is
+  /// replaced by an interned read-only copy, one per distinct contents,
+  /// which the states with the same contents all point to. Host code may
+  /// write the objects again between launches; the state then gets a
+  /// writable copy of its own back.
+  class ConstantMemory {
+    /// The constant objects, ordered by address.
+    std::vector<const MemoryObject*> objects;
+
+    /// The interned copies of each object, by contents.
+    std::map<const MemoryObject*,
+             std::map<std::string, ObjectHolder> > interned;
+
+  public:
+    ConstantMemory() {}
+
+    void addObject(const MemoryObject *mo);
+
+    /// Find the constant object containing \a address.
+    ///
+    /// \return The object, or null if the address is not in constant
+    /// memory.
+    const MemoryObject *lookup(uint64_t address) const;
+
+    /// Replace the constant objects of \a state by their interned copies.
+    /// Objects with symbolic contents are left alone.
+    void freeze(ExecutionState &state);
+
+    /// Give \a state a writable copy of \a os, if it is an interned copy
+    /// of constant object \a mo.
+    ///
+    /// \return The object now bound for \a mo.
+    const ObjectState *thaw(ExecutionState &state, const MemoryObject *mo,
+                            const ObjectState *os);
+  };
+}
+
+#endif
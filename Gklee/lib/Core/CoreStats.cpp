@@ -12,6 +12,11 @@
 using namespace klee;
 
 Statistic stats::allocations("Allocations", "Alloc");
+Statistic stats::checkQueriesAbandoned("CheckQueriesAbandoned", "CQabandoned");
+Statistic stats::checkQueriesRecovered("CheckQueriesRecovered", "CQrecovered");
+Statistic stats::checkQueriesSkipped("CheckQueriesSkipped", "CQskipped");
+Statistic stats::concreteBurstInstructions("ConcreteBurstInstructions", "Iburst");
+Statistic stats::constantObjectsShared("ConstantObjectsShared", "COshared");
 Statistic stats::coveredInstructions("CoveredInstructions", "Icov");
 Statistic stats::falseBranches("FalseBranches", "Bf");
 Statistic stats::forkTime("ForkTime", "Ftime");
@@ -21,9 +26,14 @@ Statistic stats::instructionTime("InstructionTimes", "Itime");
 Statistic stats::instructions("Instructions", "I");
 Statistic stats::minDistToReturn("MinDistToReturn", "Rdist");
 Statistic stats::minDistToUncovered("MinDistToUncovered", "UCdist");
+Statistic stats::provenPairHits("ProvenPairHits", "PPhits");
+Statistic stats::provenPairMisses("ProvenPairMisses", "PPmisses");
 Statistic stats::reachableUncovered("ReachableUncovered", "IuncovReach");
 Statistic stats::resolveTime("ResolveTime", "Rtime");
 Statistic stats::solverTime("SolverTime", "Stime");
 Statistic stats::states("States", "States");
+Statistic stats::statesMerged("StatesMerged", "Smerged");
+Statistic stats::statesRestored("StatesRestored", "Srestored");
+Statistic stats::statesSpilled("StatesSpilled", "Sspilled");
 Statistic stats::trueBranches("TrueBranches", "Bt");
 Statistic stats::uncoveredInstructions("UncoveredInstructions", "Iuncov");
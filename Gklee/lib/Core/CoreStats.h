@@ -30,6 +30,34 @@ namespace stats {
   /// The number of process forks.
   extern Statistic forks;
 
+  /// The defect checker queries given up on under -check-time-budget:
+  /// cut off by their timeout, never asked because the checker's budget
+  /// was used up, and answered when retried at the end of the checker.
+  extern Statistic checkQueriesAbandoned;
+  extern Statistic checkQueriesSkipped;
+  extern Statistic checkQueriesRecovered;
+
+  /// The number of states merged away into another state.
+  extern Statistic statesMerged;
+
+  /// The number of times a state was written out to the spill directory
+  /// under memory pressure, and read back.
+  extern Statistic statesSpilled;
+  extern Statistic statesRestored;
+
+  /// The number of kernel instructions interpreted without going back to
+  /// the searcher (see -concrete-kernel-burst).
+  extern Statistic concreteBurstInstructions;
+
+  /// The number of constant objects a state was given the interned,
+  /// shared copy of at a kernel launch (see ConstantMemory).
+  extern Statistic constantObjectsShared;
+
+  /// The number of symbolic-config race and bank conflict checks answered
+  /// by an earlier proof for the same pair, and those that were not.
+  extern Statistic provenPairHits;
+  extern Statistic provenPairMisses;
+
   /// Number of states, this is a "fake" statistic used by istats, it
   /// isn't normally up-to-date.
   extern Statistic states;
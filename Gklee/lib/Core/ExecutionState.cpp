@@ -18,6 +18,7 @@
 
 #include "klee/logging.h"
 
+#include "CoreStats.h"
 #include "Memory.h"
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/Function.h"
@@ -27,8 +28,10 @@
 #include "llvm/Instructions.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <iterator>
 #include <cassert>
 #include <map>
 #include <set>
@@ -43,6 +46,11 @@ using namespace Gklee;
 namespace runtime { 
   cl::opt<bool>
   DebugLogStateMerge("debug-log-state-merge");
+
+  cl::opt<unsigned>
+  MaxMergeSelects("max-merge-selects",
+                  cl::desc("Do not merge two states if more than this many values differ between them (default=256)"),
+                  cl::init(256));
 }
 
 using namespace runtime;
@@ -98,12 +106,16 @@ StackFrame::~StackFrame() {
 
 /***/
 
+static unsigned lastLineage = 0;
+
 ExecutionState::ExecutionState(KFunction *kf) 
   : deviceSet(0),
     fakeState(false),
     fence(""),
     underConstrained(false),
     depth(0),
+    lineage(++lastLineage),
+    parentLineage(0),
     brMeta(NA, NULL),
     tinfo(kf->instructions),
     queryCost(0.),
@@ -111,6 +123,9 @@ ExecutionState::ExecutionState(KFunction *kf)
     forkStateBINum(0),
     kernelNum(0),
     BINum(0),
+    barrierMergePoint(0, 0),
+    spilled(false),
+    deviceInstructions(0),
     instsSinceCovNew(0),
     coveredNew(false),
     forkDisabled(false),
@@ -127,6 +142,8 @@ ExecutionState::ExecutionState(const std::vector<klee::ref<Expr> > &assumptions)
     fakeState(true),
     fence(""),
     underConstrained(false),
+    lineage(++lastLineage),
+    parentLineage(0),
     brMeta(NA, NULL),
     constraints(assumptions),
     queryCost(0.),
@@ -156,6 +173,8 @@ ExecutionState::ExecutionState(const ExecutionState& state)
     fakeState(state.fakeState),
     underConstrained(state.underConstrained),
     depth(state.depth),
+    lineage(state.lineage),
+    parentLineage(state.parentLineage),
     brMeta(state.brMeta),
     cTidSets(state.cTidSets),
     tinfo(state.tinfo),
@@ -172,6 +191,14 @@ ExecutionState::ExecutionState(const ExecutionState& state)
     forkStateBINum(state.forkStateBINum),
     kernelNum(state.kernelNum),
     BINum(state.BINum),
+    barrierMergePoint(state.barrierMergePoint),
+    spilled(false),
+    provenPairs(state.provenPairs),
+    atomicSummaries(state.atomicSummaries),
+    builtInSubstitution(state.builtInSubstitution),
+    timeline(state.timeline),
+    deviceInstructions(state.deviceInstructions),
+    launchOccupancy(state.launchOccupancy),
     pathOS(state.pathOS),
     symPathOS(state.symPathOS),
     instsSinceCovNew(state.instsSinceCovNew),
@@ -194,8 +221,11 @@ ExecutionState::ExecutionState(const ExecutionState& state)
 ExecutionState *ExecutionState::branch() {
   Gklee::Logging::enterFunc< std::string >( "" , __PRETTY_FUNCTION__ );  
   depth++;
+  parentLineage = lineage;
+  lineage = ++lastLineage;
 
   ExecutionState *falseState = new ExecutionState(*this);
+  falseState->lineage = ++lastLineage;
   falseState->coveredNew = false;
   falseState->coveredLines.clear();
 
@@ -382,29 +412,80 @@ std::ostream &klee::operator<<(std::ostream &os, const MemoryMap &mm) {
   return os;
 }
 
+bool ExecutionState::atBarrierMergePoint() {
+  // After the last thread passes a barrier, the checks consume the
+  // accesses of the interval and the schedule restarts at thread 0,
+  // with every thread having passed the same number of barriers.
+  if (!tinfo.is_GPU_mode || UseSymbolicConfig || tinfo.get_cur_tid() != 0)
+    return false;
+  if (tinfo.numBars.empty() || addressSpace.getNumPendingAccesses())
+    return false;
+
+  unsigned numBarriers = tinfo.numBars[0].first.size();
+  if (!numBarriers)
+    return false;
+  for (unsigned i = 1; i < tinfo.numBars.size(); i++) {
+    if (tinfo.numBars[i].first.size() != numBarriers)
+      return false;
+  }
+
+  return barrierMergePoint != std::make_pair(kernelNum, numBarriers);
+}
+
 bool ExecutionState::merge(const ExecutionState &b) {
-  /*if (DebugLogStateMerge)
+  if (DebugLogStateMerge)
     std::cerr << "-- attempting merge of A:" 
               << this << " with B:" << &b << "--\n";
-  if (pc != b.pc)
+
+  // The parametric flows keep their own constraints and trees, which
+  // cannot be merged.
+  if (UseSymbolicConfig || spilled || b.spilled)
     return false;
 
+  if (tinfo.is_GPU_mode != b.tinfo.is_GPU_mode
+      || tinfo.get_cur_tid() != b.tinfo.get_cur_tid()
+      || tinfo.PCs != b.tinfo.PCs
+      || tinfo.numBars.size() != b.tinfo.numBars.size()
+      || kernelNum != b.kernelNum || BINum != b.BINum
+      || fence != b.fence)
+    return false;
+  for (unsigned i = 0; i < tinfo.numBars.size(); i++) {
+    if (tinfo.numBars[i].first.size() != b.tinfo.numBars[i].first.size()
+        || tinfo.numBars[i].second != b.tinfo.numBars[i].second)
+      return false;
+  }
+
   // XXX is it even possible for these to differ? does it matter? probably
   // implies difference in object states?
   if (symbolics!=b.symbolics)
     return false;
 
-  {
-    std::vector<StackFrame>::const_iterator itA = stack.begin();
-    std::vector<StackFrame>::const_iterator itB = b.stack.begin();
-    while (itA!=stack.end() && itB!=b.stack.end()) {
+  if (stacks.size() != b.stacks.size())
+    return false;
+  for (unsigned i = 0; i < stacks.size(); i++) {
+    stack_ty::const_iterator itA = stacks[i].begin();
+    stack_ty::const_iterator itB = b.stacks[i].begin();
+    while (itA!=stacks[i].end() && itB!=b.stacks[i].end()) {
       // XXX vaargs?
       if (itA->caller!=itB->caller || itA->kf!=itB->kf)
         return false;
       ++itA;
       ++itB;
     }
-    if (itA!=stack.end() || itB!=b.stack.end())
+    if (itA!=stacks[i].end() || itB!=b.stacks[i].end())
+      return false;
+  }
+
+  if (cTidSets.size() != b.cTidSets.size())
+    return false;
+  for (unsigned i = 0; i < cTidSets.size(); i++) {
+    const CorrespondTid &ta = cTidSets[i];
+    const CorrespondTid &tb = b.cTidSets[i];
+    if (ta.rBid != tb.rBid || ta.rTid != tb.rTid
+        || ta.warpNum != tb.warpNum
+        || ta.syncEncounter != tb.syncEncounter
+        || ta.barrierEncounter != tb.barrierEncounter
+        || ta.inBranch != tb.inBranch)
       return false;
   }
 
@@ -439,51 +520,6 @@ bool ExecutionState::merge(const ExecutionState &b) {
     std::cerr << "]\n";
   }
 
-  // We cannot merge if addresses would resolve differently in the
-  // states. This means:
-  // 
-  // 1. Any objects created since the branch in either object must
-  // have been free'd.
-  //
-  // 2. We cannot have free'd any pre-existing object in one state
-  // and not the other
-
-  if (DebugLogStateMerge) {
-    std::cerr << "\tchecking object states\n";
-    std::cerr << "A: " << addressSpace.objects << "\n";
-    std::cerr << "B: " << b.addressSpace.objects << "\n";
-  }
-    
-  std::set<const MemoryObject*> mutated;
-  MemoryMap::iterator ai = addressSpace.objects.begin();
-  MemoryMap::iterator bi = b.addressSpace.objects.begin();
-  MemoryMap::iterator ae = addressSpace.objects.end();
-  MemoryMap::iterator be = b.addressSpace.objects.end();
-  for (; ai!=ae && bi!=be; ++ai, ++bi) {
-    if (ai->first != bi->first) {
-      if (DebugLogStateMerge) {
-        if (ai->first < bi->first) {
-          std::cerr << "\t\tB misses binding for: " << ai->first->id << "\n";
-        } else {
-          std::cerr << "\t\tA misses binding for: " << bi->first->id << "\n";
-        }
-      }
-      return false;
-    }
-    if (ai->second != bi->second) {
-      if (DebugLogStateMerge)
-        std::cerr << "\t\tmutated: " << ai->first->id << "\n";
-      mutated.insert(ai->first);
-    }
-  }
-  if (ai!=ae || bi!=be) {
-    if (DebugLogStateMerge)
-      std::cerr << "\t\tmappings differ\n";
-    return false;
-  }
-  
-  // // merge stack
-
   klee::ref<Expr> inA = ConstantExpr::alloc(1, Expr::Bool);
   klee::ref<Expr> inB = ConstantExpr::alloc(1, Expr::Bool);
   for (std::set< klee::ref<Expr> >::iterator it = aSuffix.begin(), 
@@ -493,54 +529,74 @@ bool ExecutionState::merge(const ExecutionState &b) {
          ie = bSuffix.end(); it != ie; ++it)
     inB = AndExpr::create(inB, *it);
 
+  // Count the selects the merge would introduce in the locals of every
+  // thread, the objects at every memory level, and the accesses recorded
+  // for the defect checks, and only merge when that stays cheap.
+  unsigned numSelects = 0;
+  for (unsigned i = 0; i < stacks.size(); i++) {
+    for (unsigned j = 0; j < stacks[i].size(); j++) {
+      const StackFrame &af = stacks[i][j];
+      const StackFrame &bf = b.stacks[i][j];
+      for (unsigned k=0; k<af.kf->numRegisters; k++) {
+        const klee::ref<Expr> &av = af.locals[k].value;
+        const klee::ref<Expr> &bv = bf.locals[k].value;
+        if (!av.isNull() && !bv.isNull() && av != bv)
+          numSelects++;
+      }
+    }
+  }
+
+  if (!addressSpace.merge(b.addressSpace, inA, false, numSelects)) {
+    if (DebugLogStateMerge)
+      std::cerr << "\t\tmemory or access sets differ in shape\n";
+    return false;
+  }
+  if (numSelects > MaxMergeSelects) {
+    if (DebugLogStateMerge)
+      std::cerr << "\t\ttoo many differing values: " << numSelects << "\n";
+    return false;
+  }
+
   // XXX should we have a preference as to which predicate to use?
   // it seems like it can make a difference, even though logically
   // they must contradict each other and so inA => !inB
 
-  std::vector<StackFrame>::iterator itA = stack.begin();
-  std::vector<StackFrame>::const_iterator itB = b.stack.begin();
-  for (; itA!=stack.end(); ++itA, ++itB) {
-    StackFrame &af = *itA;
-    const StackFrame &bf = *itB;
-    for (unsigned i=0; i<af.kf->numRegisters; i++) {
-      klee::ref<Expr> &av = af.locals[i].value;
-      const klee::ref<Expr> &bv = bf.locals[i].value;
-      if (av.isNull() || bv.isNull()) {
-        // if one is null then by implication (we are at same pc)
-        // we cannot reuse this local, so just ignore
-      } else {
-        av = SelectExpr::create(inA, av, bv);
+  for (unsigned i = 0; i < stacks.size(); i++) {
+    for (unsigned j = 0; j < stacks[i].size(); j++) {
+      StackFrame &af = stacks[i][j];
+      const StackFrame &bf = b.stacks[i][j];
+      for (unsigned k=0; k<af.kf->numRegisters; k++) {
+        CellValue &av = af.locals[k].value;
+        const klee::ref<Expr> &bv = bf.locals[k].value;
+        if (av.isNull() || bv.isNull()) {
+          // if one is null then by implication (we are at same pc)
+          // we cannot reuse this local, so just ignore
+        } else if (av.getExpr() != bv) {
+          av = SelectExpr::create(inA, av.getExpr(), bv);
+        }
       }
     }
   }
 
-  for (std::set<const MemoryObject*>::iterator it = mutated.begin(), 
-         ie = mutated.end(); it != ie; ++it) {
-    const MemoryObject *mo = *it;
-    const ObjectState *os = addressSpace.findObject(mo);
-    const ObjectState *otherOS = b.addressSpace.findObject(mo);
-    assert(os && !os->readOnly && 
-           "objects mutated but not writable in merging state");
-    assert(otherOS);
-
-    ObjectState *wos = addressSpace.getWriteable(mo, os);
-    for (unsigned i=0; i<mo->size; i++) {
-      klee::ref<Expr> av = wos->read8(i);
-      klee::ref<Expr> bv = otherOS->read8(i);
-      wos->write(i, SelectExpr::create(inA, av, bv));
-    }
-  }
+  addressSpace.merge(b.addressSpace, inA, true, numSelects);
 
   constraints = ConstraintManager();
   for (std::set< klee::ref<Expr> >::iterator it = commonConstraints.begin(), 
          ie = commonConstraints.end(); it != ie; ++it)
     constraints.addConstraint(*it);
   constraints.addConstraint(OrExpr::create(inA, inB));
+  // The merged constraints are weaker than either side's.
+  provenPairs = 0;
+  // The sides need not hold what their summaries last wrote.
+  atomicSummaries = 0;
+  builtInSubstitution = 0;
+
+  depth = std::min(depth, b.depth);
+  ++stats::statesMerged;
 
   return true;
-*/
-  return false;
 }
+
 void ExecutionState::dumpStack(std::ostream &out) const {
   for (unsigned i = 0; i < stacks.size(); i++) {
     unsigned idx = 0;
@@ -11,16 +11,20 @@
 #include "Common.h"
 
 #include "Executor.h"
+#include "ConstantMemory.h"
 #include "Context.h"
 #include "CoreStats.h"
 #include "ExternalDispatcher.h"
 #include "ImpliedValue.h"
 #include "Memory.h"
 #include "MemoryManager.h"
+#include "Occupancy.h"
 #include "PTree.h"
 #include "Searcher.h"
 #include "SeedInfo.h"
 #include "SpecialFunctionHandler.h"
+#include "StateFootprint.h"
+#include "StateSpiller.h"
 #include "StatsTracker.h"
 // #include "../FLA/StringSolver.h"
 #include "TimingSolver.h"
@@ -88,6 +92,11 @@
 #include <vector>
 #include <string>
 #include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include <sys/mman.h>
 
@@ -211,6 +220,11 @@ namespace runtime {
                      cl::desc("Only allow a single instruction to take this much time (default=0 (off))"),
                      cl::init(0));
   
+  cl::opt<unsigned>
+  ConcreteKernelBurst("concrete-kernel-burst",
+                      cl::desc("Interpret up to this many kernel instructions whose branch conditions, addresses and callees are concrete before going back to the searcher; this only skips the searcher, the instructions are not run natively (default=4096, 0=off)"),
+                      cl::init(4096));
+
   cl::opt<double>
   SeedTime("seed-time",
            cl::desc("Amount of time to dedicate to seeds, before normal search (default=0 (off))"),
@@ -236,6 +250,11 @@ namespace runtime {
            cl::desc("Only allow this many symbolic branches (0=off)"),
            cl::init(0));
   
+  cl::opt<unsigned>
+  TestSolverJobs("test-solver-jobs",
+                 cl::desc("Solve for the inputs of terminated states in up to this many background processes while exploration goes on (default=0 (off))"),
+                 cl::init(0));
+
   cl::opt<unsigned>
   MaxMemory("max-memory",
             cl::desc("Refuse to fork when more above this about of memory (in MB, 0=off)"),
@@ -246,15 +265,30 @@ namespace runtime {
             cl::desc("Inhibit forking at memory cap (vs. random terminate)"),
             cl::init(true));
 
+  cl::opt<bool>
+  SpillStates("spill-states",
+              cl::desc("Write the least recently run states to disk at the memory cap, instead of terminating them (requires -max-memory)"),
+              cl::init(false));
+
   cl::opt<bool>
   UseForkedSTP("use-forked-stp", 
                  cl::desc("Run STP in forked process"));
 
+  cl::opt<unsigned>
+  SolverWorkers("solver-workers",
+                cl::desc("Number of forked solver processes used to answer independent defect-check queries in parallel (0=off)"),
+                cl::init(0));
+
   cl::opt<bool>
   STPOptimizeDivides("stp-optimize-divides", 
                  cl::desc("Optimize constant divides into add/shift/multiplies before passing to STP"),
                  cl::init(true));
 
+  cl::opt<bool>
+  UsePortfolioSolver("use-portfolio-solver",
+                     cl::desc("Race STP with and without -stp-optimize-divides in forked processes and take the first answer"),
+                     cl::init(false));
+
   cl::opt<bool>
   PrintCondition("print-cond",
 		 cl::desc("Print out the path condition for debugging"),
@@ -300,6 +334,26 @@ namespace runtime {
             cl::desc("Prune the paths not leading to races"), 
             cl::init(false));
 
+  cl::opt<bool>
+  OutputTimeline("output-timeline",
+                 cl::desc("Model when the kernels, copies and "
+                          "synchronisations the host issues would run on "
+                          "the device, warn about copies and kernels which "
+                          "could overlap but do not and about unnecessary "
+                          "device synchronisations, and write each path's "
+                          "timeline to timelineN.json in Chrome trace "
+                          "format"),
+                 cl::init(false));
+
+  cl::opt<bool>
+  CheckOccupancy("check-occupancy",
+                 cl::desc("Estimate how many warps of each kernel launch "
+                          "an SM could hold and what limits them, warn "
+                          "about launches which cannot run, and report "
+                          "them with the defect rates (see -sm-* for the "
+                          "SM limits)"),
+                 cl::init(true));
+
   extern cl::opt<bool> ReuseCov;
   extern cl::opt<bool> IgnoreConcurBug;
   extern cl::opt<bool> CheckBC;
@@ -309,6 +363,7 @@ namespace runtime {
   extern cl::opt<bool> UnboundConfig;
   extern cl::opt<bool> CheckBarrierRedundant;
   extern cl::opt<bool> UseSymbolicConfig;  
+  extern cl::opt<unsigned> DevCap;
 }
 
 static void *theMMap = 0;
@@ -344,6 +399,12 @@ Solver *constructSolverChain(STPSolver *stpSolver,
   Gklee::Logging::enterFunc( std::string( "Constructing solver" ) , __PRETTY_FUNCTION__ ); 
   Solver *solver = stpSolver;
 
+  if (UsePortfolioSolver) {
+    std::vector<Solver*> alternates;
+    alternates.push_back(new STPSolver(false, !STPOptimizeDivides));
+    solver = createPortfolioSolver(stpSolver, alternates);
+  }
+
   if (optionIsSet(queryLoggingOptions,SOLVER_PC))
   {
     solver = createPCLoggingSolver(solver,
@@ -399,6 +460,10 @@ Executor::Executor(const InterpreterOptions &opts,
     kmodule(0),
     interpreterHandler(ih),
     searcher(0),
+    spiller(0),
+    constantMemory(new ConstantMemory()),
+    occupancyEstimator(0),
+    currentTestCase(0),
     is_GPU_mode(false),
     accumStore(false),
     atomicRes(0),
@@ -440,7 +505,9 @@ Executor::Executor(const InterpreterOptions &opts,
 
   Gklee::Logging::enterFunc( std::string( "Create STPSolver, postDomtree, memManager" ), __PRETTY_FUNCTION__ );
   concreteTotalTime = symTotalTime = 0.0f;
-  STPSolver *stpSolver = new STPSolver(UseForkedSTP, STPOptimizeDivides);
+  // The portfolio solver forks and enforces the timeout itself.
+  STPSolver *stpSolver = new STPSolver(UseForkedSTP && !UsePortfolioSolver,
+                                       STPOptimizeDivides);
   Solver *solver =
     constructSolverChain(stpSolver,
                          interpreterHandler->getOutputFilename(ALL_QUERIES_SMT2_FILE_NAME),
@@ -448,8 +515,10 @@ Executor::Executor(const InterpreterOptions &opts,
                          interpreterHandler->getOutputFilename(ALL_QUERIES_PC_FILE_NAME),
                          interpreterHandler->getOutputFilename(SOLVER_QUERIES_PC_FILE_NAME));
   this->solver = new TimingSolver(solver, stpSolver);
+  this->solver->batchWorkers = SolverWorkers;
   postDominator = (llvm::PostDominatorTree*)llvm::createPostDomTree();
   memory = new MemoryManager();
+  HierAddressSpace::constantMemory = constantMemory;
   Gklee::Logging::exitFunc();
 }
 
@@ -474,6 +543,7 @@ const Module *Executor::setModule(llvm::Module *module,
   specialFunctionHandler->prepare();
   kmodule->prepare(opts, interpreterHandler);
   specialFunctionHandler->bind();
+  CUDAIntrinsic::resolveCalls(kmodule);
 
   if (StatsTracker::useStatistics()) {
     statsTracker = 
@@ -482,11 +552,16 @@ const Module *Executor::setModule(llvm::Module *module,
                      userSearcherRequiresMD2U());
   }
   Gklee::Logging::exitFunc();
-  return module;
+  // The module may have been replaced by a cached copy.
+  return kmodule->module;
 }
 
 Executor::~Executor() {
   Gklee::Logging::enterFunc( std::string( "Deleting Executor" ), __PRETTY_FUNCTION__ );
+  // The interned constant objects refer to memory objects.
+  HierAddressSpace::constantMemory = 0;
+  delete constantMemory;
+  delete occupancyEstimator;
   delete memory;
   delete externalDispatcher;
   if (processTree)
@@ -591,6 +666,8 @@ void Executor::stepInstruction(ExecutionState &state) {
     statsTracker->stepInstruction(state);
 
   ++stats::instructions;
+  if (state.tinfo.is_GPU_mode)
+    ++state.deviceInstructions;
 
   state.setPrevPC(state.getPC());
   state.incPC();
@@ -1706,6 +1783,180 @@ static inline const llvm::fltSemantics * fpWidthToSemantics(unsigned width) {
   }
 }
 
+static inline int64_t signExtend(uint64_t value, Expr::Width width) {
+  return width == 64 ? (int64_t) value
+                     : (int64_t) (value << (64 - width)) >> (64 - width);
+}
+
+bool Executor::executeInline(ExecutionState &state, KInstruction *ki) {
+  // Under a symbolic configuration results carry the accum flag, which
+  // only expressions can hold.
+  if (UseSymbolicConfig)
+    return false;
+
+  Instruction *i = ki->inst;
+  switch (i->getOpcode()) {
+  case Instruction::PHI: {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
+    unsigned index = state.incomingBBIndex[state.tinfo.get_cur_tid()];
+#else
+    unsigned index = state.incomingBBIndex[state.tinfo.get_cur_tid()] * 2;
+#endif
+    getDestCell(state, ki) = eval(ki, index, state);
+    return true;
+  }
+
+  case Instruction::BitCast:
+    getDestCell(state, ki) = eval(ki, 0, state);
+    return true;
+
+  case Instruction::Select: {
+    uint64_t cond;
+    Expr::Width width;
+    if (!eval(ki, 0, state).value.getConcrete(cond, width))
+      return false;
+    getDestCell(state, ki) = eval(ki, cond ? 1 : 2, state);
+    return true;
+  }
+
+  case Instruction::Trunc:
+  case Instruction::ZExt:
+  case Instruction::SExt: {
+    uint64_t value;
+    Expr::Width width;
+    if (!eval(ki, 0, state).value.getConcrete(value, width))
+      return false;
+    Expr::Width to = ki->width;
+    if (to > 64)
+      return false;
+    if (i->getOpcode() == Instruction::SExt)
+      value = signExtend(value, width);
+    getDestCell(state, ki).value.setConcrete(bits64::truncateToNBits(value, to),
+                                             to);
+    return true;
+  }
+
+  case Instruction::ICmp: {
+    uint64_t left, right;
+    Expr::Width width, rightWidth;
+    if (!eval(ki, 0, state).value.getConcrete(left, width) ||
+        !eval(ki, 1, state).value.getConcrete(right, rightWidth))
+      return false;
+    bool result;
+    switch (cast<ICmpInst>(i)->getPredicate()) {
+    case ICmpInst::ICMP_EQ:  result = left == right; break;
+    case ICmpInst::ICMP_NE:  result = left != right; break;
+    case ICmpInst::ICMP_UGT: result = left > right; break;
+    case ICmpInst::ICMP_UGE: result = left >= right; break;
+    case ICmpInst::ICMP_ULT: result = left < right; break;
+    case ICmpInst::ICMP_ULE: result = left <= right; break;
+    case ICmpInst::ICMP_SGT:
+      result = signExtend(left, width) > signExtend(right, width); break;
+    case ICmpInst::ICMP_SGE:
+      result = signExtend(left, width) >= signExtend(right, width); break;
+    case ICmpInst::ICMP_SLT:
+      result = signExtend(left, width) < signExtend(right, width); break;
+    case ICmpInst::ICMP_SLE:
+      result = signExtend(left, width) <= signExtend(right, width); break;
+    default:
+      return false;
+    }
+    getDestCell(state, ki).value.setConcrete(result, Expr::Bool);
+    return true;
+  }
+
+  case Instruction::FAdd:
+  case Instruction::FSub:
+  case Instruction::FMul:
+  case Instruction::FDiv: {
+    uint64_t left, right;
+    Expr::Width width, rightWidth;
+    if (!eval(ki, 0, state).value.getConcrete(left, width) ||
+        !eval(ki, 1, state).value.getConcrete(right, rightWidth) ||
+        width != rightWidth || !fpWidthToSemantics(width))
+      return false;
+    // IEEE half, single and double values fit in an APFloat without
+    // touching the heap.
+    llvm::APFloat Res(llvm::APInt(width, left));
+    llvm::APFloat Right(llvm::APInt(width, right));
+    switch (i->getOpcode()) {
+    case Instruction::FAdd:
+      Res.add(Right, APFloat::rmNearestTiesToEven); break;
+    case Instruction::FSub:
+      Res.subtract(Right, APFloat::rmNearestTiesToEven); break;
+    case Instruction::FMul:
+      Res.multiply(Right, APFloat::rmNearestTiesToEven); break;
+    default:
+      Res.divide(Right, APFloat::rmNearestTiesToEven); break;
+    }
+    getDestCell(state, ki).value.setConcrete(
+      Res.bitcastToAPInt().getZExtValue(), width);
+    return true;
+  }
+
+  default:
+    break;
+  }
+
+  if (!i->isBinaryOp())
+    return false;
+
+  uint64_t left, right;
+  Expr::Width width, rightWidth;
+  if (!eval(ki, 0, state).value.getConcrete(left, width) ||
+      !eval(ki, 1, state).value.getConcrete(right, rightWidth) ||
+      width != rightWidth)
+    return false;
+
+  // Anything the expression builder would reject (division by zero,
+  // overlong shifts) is left to it.
+  uint64_t result;
+  int64_t sLeft = signExtend(left, width), sRight = signExtend(right, width);
+  bool minOverMinusOne = sRight == -1 && sLeft == signExtend(1ULL << (width - 1), width);
+  switch (i->getOpcode()) {
+  case Instruction::Add:  result = left + right; break;
+  case Instruction::Sub:  result = left - right; break;
+  case Instruction::Mul:  result = left * right; break;
+  case Instruction::And:  result = left & right; break;
+  case Instruction::Or:   result = left | right; break;
+  case Instruction::Xor:  result = left ^ right; break;
+  case Instruction::UDiv:
+    if (!right) return false;
+    result = left / right;
+    break;
+  case Instruction::URem:
+    if (!right) return false;
+    result = left % right;
+    break;
+  case Instruction::SDiv:
+    if (!right || minOverMinusOne) return false;
+    result = sLeft / sRight;
+    break;
+  case Instruction::SRem:
+    if (!right || minOverMinusOne) return false;
+    result = sLeft % sRight;
+    break;
+  case Instruction::Shl:
+    if (right >= width) return false;
+    result = left << right;
+    break;
+  case Instruction::LShr:
+    if (right >= width) return false;
+    result = left >> right;
+    break;
+  case Instruction::AShr:
+    if (right >= width) return false;
+    result = sLeft >> right;
+    break;
+  default:
+    return false;
+  }
+
+  getDestCell(state, ki).value.setConcrete(bits64::truncateToNBits(result, width),
+                                           width);
+  return true;
+}
+
 bool ExecutorUtil::isForkInstruction(Instruction *inst) {
   Gklee::Logging::enterFunc( *inst, __PRETTY_FUNCTION__ );  
   if (inst->getOpcode() == Instruction::Br) {
@@ -2018,7 +2269,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         if (t != Type::getVoidTy(getGlobalContext())) {
           // may need to do coercion due to bitcasts
           Expr::Width from = result->getWidth();
-          Expr::Width to = getWidthForLLVMType(t);
+          Expr::Width to = kcaller->width;
             
           if (from != to) {
             CallSite cs = (isa<InvokeInst>(caller) ? CallSite(cast<InvokeInst>(caller)) : 
@@ -2222,8 +2473,12 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     unsigned numArgs = cs.arg_size();
     Value *fp = cs.getCalledValue();
-    Function *f = getTargetFunction(fp, state);
-    Gklee::Logging::outItem( f->getName().str(), "target function" );
+    // Function aliases are per state; without any, the callee resolved
+    // when the module was prepared is the right one.
+    Function *f = state.fnAliases.empty() ? ki->target
+                                          : getTargetFunction(fp, state);
+    if (f)
+      Gklee::Logging::outItem( f->getName().str(), "target function" );
     // Skip debug intrinsics, we can't evaluate their metadata arguments.
     if (f && isDebugIntrinsic(f, kmodule))
       break;
@@ -2321,6 +2576,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     break;
   }
   case Instruction::PHI: {
+    if (executeInline(state, ki))
+      break;
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
     klee::ref<Expr> result = eval(ki, state.incomingBBIndex[state.tinfo.get_cur_tid()], state).value;
 #else
@@ -2334,6 +2591,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     // Special instructions
   case Instruction::Select: {
+    if (executeInline(state, ki))
+      break;
     SelectInst *SI = cast<SelectInst>(ki->inst);
     assert(SI->getCondition() == SI->getOperand(0) &&
            "Wrong operand index!");
@@ -2353,6 +2612,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   // Arithmetic / logical
 
   case Instruction::Add: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = AddExpr::create(left, right);
@@ -2363,6 +2624,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::Sub: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = SubExpr::create(left, right);
@@ -2373,6 +2636,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
  
   case Instruction::Mul: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = MulExpr::create(left, right);
@@ -2383,6 +2648,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::UDiv: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = UDivExpr::create(left, right);
@@ -2393,6 +2660,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::SDiv: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = SDivExpr::create(left, right);
@@ -2403,6 +2672,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::URem: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = URemExpr::create(left, right);
@@ -2413,6 +2684,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
  
   case Instruction::SRem: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = SRemExpr::create(left, right);
@@ -2423,6 +2696,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::And: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = AndExpr::create(left, right);
@@ -2433,6 +2708,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::Or: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = OrExpr::create(left, right);
@@ -2443,6 +2720,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::Xor: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = XorExpr::create(left, right);
@@ -2453,6 +2732,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::Shl: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = ShlExpr::create(left, right);
@@ -2463,6 +2744,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::LShr: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = LShrExpr::create(left, right);
@@ -2473,6 +2756,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::AShr: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> left = eval(ki, 0, state).value;
     klee::ref<Expr> right = eval(ki, 1, state).value;
     klee::ref<Expr> result = AShrExpr::create(left, right);
@@ -2485,6 +2770,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Compare
 
   case Instruction::ICmp: {
+    if (executeInline(state, ki))
+      break;
     CmpInst *ci = cast<CmpInst>(i);
     ICmpInst *ii = cast<ICmpInst>(ci);
  
@@ -2697,31 +2984,34 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
   // Conversion
   case Instruction::Trunc: {
-    CastInst *ci = cast<CastInst>(i);
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> tmp = eval(ki, 0, state).value; 
     klee::ref<Expr> result = ExtractExpr::create(tmp,
                                            0,
-                                           getWidthForLLVMType(ci->getType()));
+                                           ki->width);
     if (UseSymbolicConfig && tmp->accum)
       result->accum = true;
     bindLocal(ki, state, result);
     break;
   }
   case Instruction::ZExt: {
-    CastInst *ci = cast<CastInst>(i);
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> tmp = eval(ki, 0, state).value;
     klee::ref<Expr> result = ZExtExpr::create(tmp,
-                                        getWidthForLLVMType(ci->getType()));
+                                        ki->width);
     if (UseSymbolicConfig && tmp->accum) 
       result->accum = true;
     bindLocal(ki, state, result);
     break;
   }
   case Instruction::SExt: {
-    CastInst *ci = cast<CastInst>(i);
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> tmp = eval(ki, 0, state).value;
     klee::ref<Expr> result = SExtExpr::create(tmp,
-                                        getWidthForLLVMType(ci->getType()));
+                                        ki->width);
     if (UseSymbolicConfig && tmp->accum)
       result->accum = true;
     bindLocal(ki, state, result);
@@ -2729,8 +3019,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::IntToPtr: {
-    CastInst *ci = cast<CastInst>(i);
-    Expr::Width pType = getWidthForLLVMType(ci->getType());
+    Expr::Width pType = ki->width;
     klee::ref<Expr> arg = eval(ki, 0, state).value;
     klee::ref<Expr> tmp = ZExtExpr::create(arg, pType);
     if (UseSymbolicConfig && arg->accum)
@@ -2739,8 +3028,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     break;
   } 
   case Instruction::PtrToInt: {
-    CastInst *ci = cast<CastInst>(i);
-    Expr::Width iType = getWidthForLLVMType(ci->getType());
+    Expr::Width iType = ki->width;
     klee::ref<Expr> arg = eval(ki, 0, state).value;
     klee::ref<Expr> tmp = ZExtExpr::create(arg, iType);
     if (UseSymbolicConfig && arg->accum)
@@ -2750,6 +3038,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::BitCast: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<Expr> result = eval(ki, 0, state).value;
     bindLocal(ki, state, result);
     break;
@@ -2758,6 +3048,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Floating point instructions
 
   case Instruction::FAdd: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
                                         "floating point");
     klee::ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
@@ -2777,6 +3069,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FSub: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
                                         "floating point");
     klee::ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
@@ -2796,6 +3090,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
  
   case Instruction::FMul: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
                                         "floating point");
     klee::ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
@@ -2815,6 +3111,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FDiv: {
+    if (executeInline(state, ki))
+      break;
     klee::ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
                                         "floating point");
     klee::ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
@@ -2853,8 +3151,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FPTrunc: {
-    FPTruncInst *fi = cast<FPTruncInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     klee::ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || resultType > arg->getWidth()){
@@ -2871,8 +3168,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FPExt: {
-    FPExtInst *fi = cast<FPExtInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     klee::ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                         "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || arg->getWidth() > resultType){
@@ -2889,8 +3185,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FPToUI: {
-    FPToUIInst *fi = cast<FPToUIInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     klee::ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || resultType > 64){
@@ -2907,8 +3202,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FPToSI: {
-    FPToSIInst *fi = cast<FPToSIInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     klee::ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || resultType > 64){
@@ -2925,8 +3219,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::UIToFP: {
-    UIToFPInst *fi = cast<UIToFPInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     klee::ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     const llvm::fltSemantics *semantics = fpWidthToSemantics(resultType);
@@ -2942,8 +3235,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::SIToFP: {
-    SIToFPInst *fi = cast<SIToFPInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     klee::ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     const llvm::fltSemantics *semantics = fpWidthToSemantics(resultType);
@@ -3083,7 +3375,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     klee::ref<Expr> agg = eval(ki, 0, state).value;
 
-    klee::ref<Expr> result = ExtractExpr::create(agg, kgepi->offset*8, getWidthForLLVMType(i->getType()));
+    klee::ref<Expr> result = ExtractExpr::create(agg, kgepi->offset*8, ki->width);
 
     bindLocal(ki, state, result);
     break;
@@ -3287,6 +3579,11 @@ void Executor::executeCall(ExecutionState &state,
     if (f) {
       std::string kernelName = f->getName().str();
       state.tinfo.just_enter_GPU_mode = enterRealGPUKernel(kernelName, kernelSet);
+      if (OutputTimeline && state.tinfo.just_enter_GPU_mode)
+        recordKernelLaunch(state, ki, f, arguments);
+      if (CheckOccupancy && state.tinfo.just_enter_GPU_mode &&
+          !UseSymbolicConfig)
+        recordOccupancy(state, ki, f);
     }
   }
 
@@ -3485,6 +3782,8 @@ void Executor::updateStates(ExecutionState *current) {
       seedMap.erase(it3);
     Gklee::Logging::outItem< std::string >( "" , "removing ptree node from current state" );
     processTree->remove(es->ptreeNode);
+    if (spiller)
+      spiller->discard(*es);
     delete es;
   }
   removedStates.clear();
@@ -4011,6 +4310,8 @@ void Executor::handleEnterGPUMode(ExecutionState &state) {
   if (state.maxKernelSharedSize > 0) {
     initializeExternalSharedGlobals(state); 
   }
+  // kernels cannot write constant memory, so share it between states
+  constantMemory->freeze(state);
   // now synchronize the PCs of all the threads
   // the stacks of each thread should be equal to that of thread 0
   state.tinfo.synchronizePCs();
@@ -4060,6 +4361,103 @@ void Executor::handleEnterGPUMode(ExecutionState &state) {
   Gklee::Logging::exitFunc();
 }
 
+StreamTimeline *Executor::getTimeline(ExecutionState &state) {
+  if (state.timeline.isNull())
+    state.timeline = new StreamTimeline();
+  else if (state.timeline->refCount > 1)
+    state.timeline = new StreamTimeline(*state.timeline);
+  if (!state.tinfo.is_GPU_mode)
+    state.timeline->finishKernel(state.deviceInstructions);
+  return state.timeline.get();
+}
+
+void Executor::reportTimelineOperation(const StreamTimeline &timeline,
+                                       int index) {
+  const StreamTimeline::Operation &op = timeline.getOperation(index);
+  if (op.serializedBehind >= 0) {
+    const StreamTimeline::Operation &b =
+      timeline.getOperation(op.serializedBehind);
+    klee_warning_once(op.info, "%s at %s:%u waits for %s at %s:%u though "
+                      "they share no memory; issued on different streams "
+                      "they could overlap", op.name.c_str(),
+                      op.info->file.c_str(), op.info->line, b.name.c_str(),
+                      b.info->file.c_str(), b.info->line);
+  }
+  if (op.redundantSync >= 0) {
+    const StreamTimeline::Operation &sync =
+      timeline.getOperation(op.redundantSync);
+    klee_warning_once(sync.info, "cudaDeviceSynchronize at %s:%u is "
+                      "unnecessary: %s at %s:%u waits for the device anyway",
+                      sync.info->file.c_str(), sync.info->line,
+                      op.name.c_str(), op.info->file.c_str(), op.info->line);
+  }
+  if (op.kind == StreamTimeline::Wait && op.end == op.start &&
+      op.name == "cudaDeviceSynchronize")
+    klee_warning_once(op.info, "cudaDeviceSynchronize at %s:%u is "
+                      "unnecessary: the device is idle by then",
+                      op.info->file.c_str(), op.info->line);
+}
+
+void Executor::recordKernelLaunch(ExecutionState &state, KInstruction *ki,
+                                  Function *f,
+                                  std::vector< klee::ref<Expr> > &arguments) {
+  // The kernel may touch all of the objects its pointer arguments point
+  // into, and anything at all through one which cannot be resolved.
+  std::vector<StreamTimeline::Range> memory;
+  unsigned i = 0;
+  for (Function::arg_iterator ai = f->arg_begin(), ae = f->arg_end();
+       ai != ae && i < arguments.size(); ++ai, ++i) {
+    if (!ai->getType()->isPointerTy())
+      continue;
+    ObjectPair op;
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(arguments[i]);
+    if (CE && (state.addressSpace.resolveOne(CE, op, GPUConfig::DEVICE) ||
+               state.addressSpace.resolveOne(CE, op, GPUConfig::HOST)))
+      memory.push_back(StreamTimeline::Range(op.first->address,
+                                             op.first->address +
+                                             op.first->size));
+    else
+      memory.push_back(StreamTimeline::Range(0, ~0ULL));
+  }
+
+  StreamTimeline *timeline = getTimeline(state);
+  int index = timeline->launchKernel(f->getName().str(), ki->info, memory,
+                                     state.deviceInstructions);
+  reportTimelineOperation(*timeline, index);
+}
+
+void Executor::recordOccupancy(ExecutionState &state, KInstruction *ki,
+                               Function *f) {
+  if (!occupancyEstimator)
+    occupancyEstimator = new OccupancyEstimator(*kmodule->targetData, DevCap);
+  LaunchOccupancy o =
+    occupancyEstimator->estimate(f, ki->info, GPUConfig::num_blocks,
+                                 GPUConfig::block_size,
+                                 state.maxKernelSharedSize);
+  state.launchOccupancy.push_back(o);
+
+  if (o.limit == LaunchOccupancy::BlockSize)
+    klee_warning_once(ki, "kernel %s launched at %s:%u cannot run: blocks "
+                      "of %u threads are over the limit of %u",
+                      o.kernel.c_str(), ki->info->file.c_str(),
+                      ki->info->line, o.blockSize,
+                      occupancyEstimator->getMaxBlockThreads());
+  else if (o.fails() && o.limit == LaunchOccupancy::Registers)
+    klee_warning_once(ki, "kernel %s launched at %s:%u cannot run: a block "
+                      "of %u threads at %u registers each needs more than "
+                      "the %u of an SM", o.kernel.c_str(),
+                      ki->info->file.c_str(), ki->info->line, o.blockSize,
+                      o.registersPerThread,
+                      occupancyEstimator->getRegisters());
+  else if (o.fails() && o.limit == LaunchOccupancy::SharedMemory)
+    klee_warning_once(ki, "kernel %s launched at %s:%u cannot run: a block "
+                      "needs %llu bytes of shared memory, an SM has %u",
+                      o.kernel.c_str(), ki->info->file.c_str(),
+                      ki->info->line,
+                      (unsigned long long) (o.staticShared + o.dynamicShared),
+                      occupancyEstimator->getSharedMemory());
+}
+
 void Executor::updateConstantTable(unsigned kernelNum) {
   // update the constant table according to the externSharedSet 
   Gklee::Logging::enterFunc< std::string >( "", __PRETTY_FUNCTION__ );  
@@ -4119,6 +4517,127 @@ static std::string strip(std::string &in) {
    Gklee::Logging::exitFunc();
  }
 
+void Executor::scheduleGPUThreads(ExecutionState &state, KInstruction *ki) {
+  if (state.tinfo.just_enter_GPU_mode)
+    handleEnterGPUMode(state);
+
+  if (state.tinfo.is_GPU_mode) {
+    if (!UseSymbolicConfig) {
+      if (SimdSchedule) {
+        if (!state.tinfo.just_enter_GPU_mode) {
+          if (!kernelFunc)
+            kernelFunc = ki->inst->getParent()->getParent(); 
+          // Context switch to next thread 
+          contextSwitchToNextThread(state);
+          for (std::set<ExecutionState*>::iterator si = addedStates.begin(); 
+               si != addedStates.end(); si++) {
+            contextSwitchToNextThread(**si);
+          }
+        } else state.tinfo.just_enter_GPU_mode = false;
+      } else { // Pure Canonical Schedule
+        if (!state.tinfo.just_enter_GPU_mode) {
+          if (!kernelFunc)
+            kernelFunc = ki->inst->getParent()->getParent();
+          // If all threads end
+          if (state.tinfo.allEndKernel) {
+            kernelFunc = NULL;
+            state.tinfo.is_GPU_mode = false;
+            is_GPU_mode = false;
+            Logging::fgInfo( "exitGPU", std::string(""));
+            state.addressSpace.clearAccessSet();
+            state.addressSpace.clearInstAccessSet(true);
+            state.clearCorrespondTidSets();
+          }
+        } else state.tinfo.just_enter_GPU_mode = false;
+      }
+    } else { //SYMBOLIC CONFIG!
+      if (!state.tinfo.just_enter_GPU_mode) {
+        if (!kernelFunc) {
+          kernelFunc = ki->inst->getParent()->getParent(); 
+        }
+        // Context switch to next thread 
+        contextSwitchToNextThread(state);
+        for (std::set<ExecutionState*>::iterator si = addedStates.begin(); 
+             si != addedStates.end(); si++) {
+          contextSwitchToNextThread(**si);
+        }
+      } else state.tinfo.just_enter_GPU_mode = false;
+    }
+  }
+}
+
+bool Executor::isConcreteOperand(KInstruction *ki, unsigned index,
+                                 ExecutionState &state) const {
+  int vnumber = ki->operands[index];
+  // Constants and globals are always concrete.
+  if (vnumber < 0)
+    return true;
+  const CellValue &value = state.getCurStack().back().locals[vnumber].value;
+  return value.isInline() || isa<ConstantExpr>(value.getExpr());
+}
+
+bool Executor::inConcreteKernel(ExecutionState &state,
+                                KInstruction *lastKi) const {
+  // Calls (barriers in particular) go back to the searcher, so that the
+  // barrier-aware and merging searchers still see every barrier; so does
+  // every instruction at which the memory cap is checked.
+  if (haltExecution || !state.tinfo.is_GPU_mode || UseSymbolicConfig
+      || !addedStates.empty() || !removedStates.empty()
+      || isa<CallInst>(lastKi->inst)
+      || (stats::instructions & 0xFFFF) == 0)
+    return false;
+
+  // Only the operands an instruction may fork on need to be concrete:
+  // symbolic data flowing through arithmetic never leaves the state.
+  KInstruction *ki = state.getPC();
+  switch (ki->inst->getOpcode()) {
+  case Instruction::Br:
+    return cast<BranchInst>(ki->inst)->isUnconditional()
+      || isConcreteOperand(ki, 0, state);
+  case Instruction::Switch:
+  case Instruction::IndirectBr:
+  case Instruction::Load:
+  case Instruction::Call:
+    return isConcreteOperand(ki, 0, state);
+  case Instruction::Store:
+    return isConcreteOperand(ki, 1, state);
+  case Instruction::Invoke:
+    return false;
+  default:
+    return true;
+  }
+}
+
+namespace {
+  /// Orders states for killing at the memory cap: those that have not
+  /// covered new code first, then the ones holding the most memory.
+  struct HeavierState {
+    bool operator()(const std::pair<uint64_t, ExecutionState*> &a,
+                    const std::pair<uint64_t, ExecutionState*> &b) const {
+      if (a.second->coveredNew != b.second->coveredNew)
+        return !a.second->coveredNew;
+      return a.first > b.first;
+    }
+  };
+}
+
+static void dumpStateFootprints(const std::map<unsigned,
+                                               StateFootprint> &kernels) {
+  for (std::map<unsigned, StateFootprint>::const_iterator
+         it = kernels.begin(), ie = kernels.end(); it != ie; ++it) {
+    std::ostringstream os;
+    os << "kernel " << it->first << ": "
+       << (it->second.total() >> 20) << " MB (";
+    for (unsigned i = 0; i < StateFootprint::NumKinds; i++) {
+      StateFootprint::Kind kind = (StateFootprint::Kind) i;
+      os << (i ? ", " : "") << StateFootprint::getName(kind) << " "
+         << (it->second.bytes[i] >> 20);
+    }
+    os << ")";
+    klee_message("%s", os.str().c_str());
+  }
+}
+
 void Executor::run(ExecutionState &initialState) {
 
   Gklee::Logging::enterFunc( initialState.getPC()->info->file , __PRETTY_FUNCTION__ );
@@ -4130,6 +4649,8 @@ void Executor::run(ExecutionState &initialState) {
   // Delay init till now so that ticks don't accrue during
   // optimization and such.
   initTimers();
+  if (TestSolverJobs)
+    addTimer(new TestCaseTimer(this), .1);
 
   if (ReducePath.size() > 0)
     PR_info.init(ReducePath, PRUseDep);
@@ -4202,10 +4723,16 @@ void Executor::run(ExecutionState &initialState) {
   }
 
   searcher = constructUserSearcher(*this);
+  if (SpillStates && MaxMemory)
+    spiller = new StateSpiller(interpreterHandler->getOutputFilename("spill"));
 
   searcher->update(0, states, std::set<ExecutionState*>());
   while (!states.empty() && !haltExecution) {
   ExecutionState &state = searcher->selectState();
+    if (spiller) {
+      spiller->restore(state);
+      spiller->touch(state);
+    }
     // update the constant table 
     if (state.tinfo.is_GPU_mode 
          && externSharedSet.size() > 0) {
@@ -4230,55 +4757,25 @@ void Executor::run(ExecutionState &initialState) {
     }
     stepInstruction(state);
     executeInstruction(state, ki);
-    if (state.tinfo.just_enter_GPU_mode)
-      handleEnterGPUMode(state);
+    scheduleGPUThreads(state, ki);
+    processTimers(&state, MaxInstructionTime);
 
-    if (state.tinfo.is_GPU_mode) {
-      if (!UseSymbolicConfig) {
-        if (SimdSchedule) {
-          if (!state.tinfo.just_enter_GPU_mode) {
-            if (!kernelFunc)
-              kernelFunc = ki->inst->getParent()->getParent(); 
-            // Context switch to next thread 
-            contextSwitchToNextThread(state);
-            for (std::set<ExecutionState*>::iterator si = addedStates.begin(); 
-                 si != addedStates.end(); si++) {
-              contextSwitchToNextThread(**si);
-            }
-          } else state.tinfo.just_enter_GPU_mode = false;
-        } else { // Pure Canonical Schedule
-          if (!state.tinfo.just_enter_GPU_mode) {
-            if (!kernelFunc)
-              kernelFunc = ki->inst->getParent()->getParent();
-            // If all threads end
-            if (state.tinfo.allEndKernel) {
-              kernelFunc = NULL;
-              state.tinfo.is_GPU_mode = false;
-              is_GPU_mode = false;
-	      Logging::fgInfo( "exitGPU", std::string(""));
-              state.addressSpace.clearAccessSet();
-              state.addressSpace.clearInstAccessSet(true);
-              state.clearCorrespondTidSets();
-            }
-          } else state.tinfo.just_enter_GPU_mode = false;
-        }
-      } else { //SYMBOLIC CONFIG!
-        if (!state.tinfo.just_enter_GPU_mode) {
-          if (!kernelFunc) {
-            kernelFunc = ki->inst->getParent()->getParent(); 
-          }
-          // Context switch to next thread 
-          contextSwitchToNextThread(state);
-          for (std::set<ExecutionState*>::iterator si = addedStates.begin(); 
-               si != addedStates.end(); si++) {
-            contextSwitchToNextThread(**si);
-          }
-        } else state.tinfo.just_enter_GPU_mode = false;
-      }
+    // An instruction whose branch condition, address or callee is
+    // concrete cannot fork, so keep running the kernel here instead of
+    // going back to the searcher after every instruction. Each one is
+    // still interpreted; concrete kernels are not compiled or run
+    // natively.
+    for (unsigned burst = 1;
+         burst < ConcreteKernelBurst && inConcreteKernel(state, ki);
+         ++burst) {
+      ki = state.getPC();
+      stepInstruction(state);
+      executeInstruction(state, ki);
+      scheduleGPUThreads(state, ki);
+      processTimers(&state, MaxInstructionTime);
+      ++stats::concreteBurstInstructions;
     }
 
-    processTimers(&state, MaxInstructionTime);
-
     if (MaxMemory) {
       if ((stats::instructions & 0xFFFF) == 0) {
         // We need to avoid calling GetMallocUsage() often because it
@@ -4287,7 +4784,19 @@ void Executor::run(ExecutionState &initialState) {
         unsigned mbs = sys::Process::GetTotalMemoryUsage() >> 20;
         
         if (mbs > MaxMemory) {
-          if (mbs > MaxMemory + 100) {
+          // Spilling states keeps them, so do it before resorting to
+          // killing.
+          unsigned numSpilled = 0;
+          if (spiller) {
+            unsigned numStates = states.size();
+            numSpilled = spiller->spillColdest(states, &state,
+                                               std::max(1U, numStates - numStates*MaxMemory/mbs));
+            if (numSpilled)
+              klee_message("spilled %d states to disk (over memory cap)",
+                           numSpilled);
+          }
+
+          if (mbs > MaxMemory + 100 && !numSpilled) {
             // just guess at how many to kill
             unsigned numStates = states.size();
             unsigned toKill = std::max(1U, numStates - numStates*MaxMemory/mbs);
@@ -4296,18 +4805,15 @@ void Executor::run(ExecutionState &initialState) {
               klee_warning("killing %d states (over memory cap)",
                            toKill);
 
-            std::vector<ExecutionState*> arr(states.begin(), states.end());
-            for (unsigned i=0,N=arr.size(); N && i<toKill; ++i,--N) {
-              unsigned idx = rand() % N;
-
-              // Make two pulls to try and not hit a state that
-              // covered new code.
-              if (arr[idx]->coveredNew)
-                idx = rand() % N;
-
-              std::swap(arr[idx], arr[N-1]);
-              terminateStateEarly(*arr[N-1], "memory limit");
-            }
+            // Kill the states which hold the most memory, sparing those
+            // that covered new code for as long as there are others.
+            std::vector< std::pair<uint64_t, ExecutionState*> > arr;
+            std::map<unsigned, StateFootprint> kernels;
+            StateFootprint::computeByKernel(states, kernels, &arr);
+            std::sort(arr.begin(), arr.end(), HeavierState());
+            dumpStateFootprints(kernels);
+            for (unsigned i = 0; i < arr.size() && i < toKill; ++i)
+              terminateStateEarly(*arr[i].second, "memory limit");
           }
           atMemoryLimit = true;
         } else {
@@ -4323,17 +4829,24 @@ void Executor::run(ExecutionState &initialState) {
   searcher = 0;
   
  dump:
+  collectTestCases(0);
+  if (!atomicHotspots.empty())
+    dumpAtomicHotspots();
   if (DumpStatesOnHalt && !states.empty()) {
     std::cerr << "KLEE: halting execution, dumping remaining states\n";
     for (std::set<ExecutionState*>::iterator
            it = states.begin(), ie = states.end();
          it != ie; ++it) {
       ExecutionState &state = **it;
+      if (spiller)
+        spiller->restore(state);
       stepInstruction(state); // keep stats rolling
       terminateStateEarly(state, "execution halting");
     }
     updateStates(0);
   }
+  delete spiller;
+  spiller = 0;
   Gklee::Logging::exitFunc();
 }
 
@@ -4587,6 +5100,31 @@ void Executor::concludeRateStatistics(ExecutionState &state) {
       std::cout << "+++++++++++++++++ end +++++++++++++++++" << std::endl;
     }
   }
+  if (CheckOccupancy && !state.launchOccupancy.empty()) {
+    if(!Emacs) std::cout << "+++++++++++++++++ Occupancy: +++++++++++++++++" << std::endl;
+    for (unsigned i = 0; i < state.launchOccupancy.size(); i++) {
+      const LaunchOccupancy &o = state.launchOccupancy[i];
+      const char *limit = LaunchOccupancy::getLimitName(o.limit);
+      if(Emacs){
+        std::cout << "OC:" << pathNum << ":" << o.kernel << ":" <<
+          o.numBlocks << ":" << o.blockSize << ":" <<
+          o.registersPerThread << ":" << o.staticShared + o.dynamicShared << ":" <<
+          o.warpsPerSM << ":" << o.maxWarpsPerSM << ":" <<
+          o.getOccupancy() << ":" << limit << std::endl;
+      }else{
+        GKLEE_INFO2 << "The Occupancy of kernel " << o.kernel << "<<<" << o.numBlocks
+                    << ", " << o.blockSize << ">>> at path " << pathNum << " : "
+                    << o.getOccupancy() << "%" << ", <warpsPerSM, maxWarpsPerSM> : " << "<"
+                    << o.warpsPerSM << ", " << o.maxWarpsPerSM << ">, limited by " << limit
+                    << ", <regsPerThread, sharedPerBlock> : " << "<"
+                    << o.registersPerThread << ", " << o.staticShared + o.dynamicShared << ">";
+        if (o.spilledRegisters)
+          std::cout << ", " << o.spilledRegisters << " registers spilled";
+        std::cout << "\n";
+      }
+    }
+    if(!Emacs) std::cout << "+++++++++++++++++ end +++++++++++++++++" << std::endl;
+  }
   //if (CheckRace) {
   //  state.addressSpace.getRaceRate();
   //}
@@ -4610,13 +5148,287 @@ void Executor::processPerformDefectTestCase(ExecutionState &state) {
   Gklee::Logging::exitFunc();
 }
 
+static bool writeAll(int fd, const char *data, size_t size) {
+  while (size) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+namespace klee {
+  /// Writes the test cases solved in the background as they come in.
+  class TestCaseTimer : public Executor::Timer {
+    Executor *executor;
+
+  public:
+    TestCaseTimer(Executor *_executor) : executor(_executor) {}
+    ~TestCaseTimer() {}
+
+    void run() { executor->collectTestCases(~0u); }
+  };
+}
+
+/// Hand a test case to the handler, in a buffer the handler can append
+/// the extension of the defect test to.
+static void processTestCase(InterpreterHandler *handler,
+                            const ExecutionState &state, const char *message,
+                            const char *suffix, const char *performSuffix) {
+  char buf[256];
+  if (performSuffix)
+    snprintf(buf, sizeof(buf) - 16, "%s", performSuffix);
+  handler->processTestCase(state, message, suffix, performSuffix ? buf : 0);
+}
+
+/// Queue a test case behind those pending; it is written, and solved
+/// for if need be, once they are.
+static Executor::PendingTestCase *
+newPendingTestCase(const ExecutionState &state, const char *message,
+                   const char *suffix, const char *performSuffix) {
+  Executor::PendingTestCase *ptc = new Executor::PendingTestCase();
+  ptc->state = new ExecutionState(state);
+  ptc->pid = -1;
+  ptc->fd = -1;
+  ptc->background = false;
+  ptc->hasMessage = message != 0;
+  if (message)
+    ptc->message = message;
+  if (suffix)
+    ptc->suffix = suffix;
+  if (performSuffix)
+    ptc->performSuffix = performSuffix;
+  ptc->solved = false;
+  return ptc;
+}
+
+void Executor::emitTestCase(ExecutionState &state, const char *message,
+                            const char *suffix, const char *performSuffix) {
+  // Once halting, finish the remaining tests directly; this is the only
+  // place, besides the end of the run, which waits for the children.
+  if (haltExecution) {
+    collectTestCases(0);
+    processTestCase(interpreterHandler, state, message, suffix,
+                    performSuffix);
+    return;
+  }
+
+  // Solving in the background pays off only when there is something to
+  // solve for. The tests still pending go first, so that the numbering
+  // is that of the order the states terminated in.
+  if (!TestSolverJobs || state.symbolics.empty()) {
+    collectTestCases(~0u);
+    if (haltExecution)
+      return;
+    if (pendingTestCases.empty())
+      processTestCase(interpreterHandler, state, message, suffix,
+                      performSuffix);
+    else
+      pendingTestCases.push_back(newPendingTestCase(state, message, suffix,
+                                                    performSuffix));
+    return;
+  }
+
+  // Keep the number of solves in flight bounded. Writing the tests which
+  // are done may reach -stop-after-n-tests, in which case this state,
+  // which terminated after the last test written, gets none.
+  collectTestCases(TestSolverJobs - 1);
+  if (haltExecution)
+    return;
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    pendingTestCases.push_back(newPendingTestCase(state, message, suffix,
+                                                  performSuffix));
+    return;
+  }
+
+  // The test writer and statistics threads hold ForkGuards, so the child
+  // does not inherit a lock either of them held.
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    pendingTestCases.push_back(newPendingTestCase(state, message, suffix,
+                                                  performSuffix));
+    return;
+  }
+
+  if (pid == 0) {
+    // The child solves on its own copy of everything, so nothing is
+    // shared with the interpreter. It writes whether it succeeded and
+    // then the bytes of each symbolic object, each preceded by its size.
+    close(fds[0]);
+    reinitializeSolverSharedMemory();
+    std::vector< std::pair<std::string, std::vector<unsigned char> > > res;
+    std::string out(1, getSymbolicSolution(state, res) ? 1 : 0);
+    for (unsigned i = 0; i != res.size(); ++i) {
+      uint32_t size = res[i].second.size();
+      out.append((const char*) &size, sizeof(size));
+      out.append(res[i].second.begin(), res[i].second.end());
+    }
+    _exit(writeAll(fds[1], out.data(), out.size()) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  PendingTestCase *ptc = newPendingTestCase(state, message, suffix,
+                                            performSuffix);
+  ptc->pid = pid;
+  ptc->fd = fds[0];
+  ptc->background = true;
+  fcntl(ptc->fd, F_SETFL, fcntl(ptc->fd, F_GETFL) | O_NONBLOCK);
+  pendingTestCases.push_back(ptc);
+}
+
+void Executor::collectTestCases(unsigned maxPending) {
+  pollTestCases(false);
+  for (;;) {
+    writeReadyTestCases();
+
+    unsigned solving = 0;
+    for (std::deque<PendingTestCase*>::iterator it = pendingTestCases.begin(),
+           ie = pendingTestCases.end(); it != ie; ++it)
+      if ((*it)->pid >= 0)
+        ++solving;
+    if (solving <= maxPending)
+      break;
+    pollTestCases(true);
+  }
+}
+
+void Executor::pollTestCases(bool wait) {
+  std::vector<struct pollfd> fds;
+  std::vector<PendingTestCase*> readers;
+  for (std::deque<PendingTestCase*>::iterator it = pendingTestCases.begin(),
+         ie = pendingTestCases.end(); it != ie; ++it) {
+    if ((*it)->fd < 0)
+      continue;
+    struct pollfd pfd;
+    pfd.fd = (*it)->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    fds.push_back(pfd);
+    readers.push_back(*it);
+  }
+
+  // The pipes are non-blocking, so a child which is still writing is
+  // read as far as it got.
+  if (!fds.empty()) {
+    if (poll(&fds[0], fds.size(), wait ? -1 : 0) > 0) {
+      for (unsigned i = 0; i != fds.size(); ++i) {
+        if (!fds[i].revents)
+          continue;
+        PendingTestCase *ptc = readers[i];
+        for (;;) {
+          char buf[4096];
+          ssize_t n = read(ptc->fd, buf, sizeof(buf));
+          if (n > 0) {
+            ptc->input.append(buf, n);
+            continue;
+          }
+          if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            break;
+          if (n < 0)
+            ptc->input.clear();
+          close(ptc->fd);
+          ptc->fd = -1;
+          break;
+        }
+      }
+    }
+    wait = false;
+  }
+
+  // A child which closed its pipe is exiting, so waiting for it (when
+  // there is nothing else to wait for) is short.
+  for (std::deque<PendingTestCase*>::iterator it = pendingTestCases.begin(),
+         ie = pendingTestCases.end(); it != ie; ++it) {
+    PendingTestCase *ptc = *it;
+    if (ptc->fd >= 0 || ptc->pid < 0)
+      continue;
+    int res = waitpid(ptc->pid, 0, wait ? 0 : WNOHANG);
+    if (res == ptc->pid || (res < 0 && errno != EINTR)) {
+      ptc->pid = -1;
+      wait = false;
+    }
+  }
+}
+
+void Executor::writeReadyTestCases() {
+  while (!pendingTestCases.empty() && pendingTestCases.front()->pid < 0) {
+    PendingTestCase *ptc = pendingTestCases.front();
+    pendingTestCases.pop_front();
+
+    const ExecutionState &state = *ptc->state;
+    const std::string &in = ptc->input;
+    bool ok = !in.empty();
+    ptc->solved = ok && in[0];
+    for (unsigned i = 0, pos = 1; ok && ptc->solved && 
+           i != state.symbolics.size(); ++i) {
+      uint32_t size;
+      if (pos + sizeof(size) > in.size()) {
+        ok = false;
+        break;
+      }
+      memcpy(&size, &in[pos], sizeof(size));
+      pos += sizeof(size);
+      if (pos + size > in.size()) {
+        ok = false;
+        break;
+      }
+      ptc->solution.push_back(
+        std::make_pair(state.symbolics[i].first->name,
+                       std::vector<unsigned char>(in.begin() + pos,
+                                                  in.begin() + pos + size)));
+      pos += size;
+    }
+
+    // Writing the test can reach -stop-after-n-tests; states which
+    // terminated after that point get no test, as if solved in order.
+    bool wasHalted = haltExecution;
+    if (ok) {
+      currentTestCase = ptc;
+    } else if (ptc->background) {
+      klee_warning("background solver failed, solving again");
+    }
+    processTestCase(interpreterHandler, state,
+                    ptc->hasMessage ? ptc->message.c_str() : 0,
+                    ptc->suffix.empty() ? 0 : ptc->suffix.c_str(),
+                    ptc->performSuffix.empty() ? 0 :
+                    ptc->performSuffix.c_str());
+    currentTestCase = 0;
+    delete ptc->state;
+    delete ptc;
+
+    if (!wasHalted && haltExecution) {
+      while (!pendingTestCases.empty()) {
+        PendingTestCase *dropped = pendingTestCases.front();
+        pendingTestCases.pop_front();
+        if (dropped->fd >= 0)
+          close(dropped->fd);
+        if (dropped->pid >= 0) {
+          kill(dropped->pid, SIGKILL);
+          while (waitpid(dropped->pid, 0, 0) < 0 && errno == EINTR)
+            ;
+        }
+        delete dropped->state;
+        delete dropped;
+      }
+    }
+  }
+}
+
 void Executor::terminateStateEarly(ExecutionState &state, 
                                    const Twine &message) {
   Gklee::Logging::enterFunc< std::string >( "", __PRETTY_FUNCTION__ );  
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state))) {
-    interpreterHandler->processTestCase(state, (message + "\n").str().c_str(),
-                                          "early");
+    emitTestCase(state, (message + "\n").str().c_str(), "early");
     processPerformDefectTestCase(state);
   }
   if (!UseSymbolicConfig)
@@ -4630,7 +5442,7 @@ void Executor::terminateStateOnExit(ExecutionState &state) {
   Gklee::Logging::enterFunc< std::string >( "", __PRETTY_FUNCTION__ );  
   if (!OnlyOutputStatesCoveringNew || state.coveredNew || 
       (AlwaysOutputSeeds && seedMap.count(&state))) {
-    interpreterHandler->processTestCase(state, 0, 0);
+    emitTestCase(state, 0, 0);
     processPerformDefectTestCase(state);
 
     // by Guodong; print out the path condition
@@ -4642,6 +5454,16 @@ void Executor::terminateStateOnExit(ExecutionState &state) {
 	(*ii)->dump();
     }
   }
+  if (!state.timeline.isNull()) {
+    static unsigned timelineIndex = 1;
+    char name[32];
+    sprintf(name, "timeline%06d.json", timelineIndex++);
+    std::ostream *os = interpreterHandler->openOutputFile(name);
+    if (os) {
+      getTimeline(state)->write(*os);
+      delete os;
+    }
+  }
   if (!UseSymbolicConfig)
     concludeRateStatistics(state);
   concludeExploredTime(state);
@@ -4708,7 +5530,7 @@ void Executor::terminateStateOnError(ExecutionState &state,
     std::string info_str = info.str();
     if (info_str != "")
       msg << "Info: \n" << info_str;
-    interpreterHandler->processTestCase(state, msg.str().c_str(), suffix);
+    emitTestCase(state, msg.str().c_str(), suffix);
     processPerformDefectTestCase(state);
   }
   if (!UseSymbolicConfig)
@@ -4828,7 +5650,7 @@ void Executor::callExternalFunction(ExecutionState &state,
   LLVM_TYPE_Q Type *resultType = target->inst->getType();
   if (resultType != Type::getVoidTy(getGlobalContext())) {
     klee::ref<Expr> e = ConstantExpr::fromMemory((void*) args, 
-                                           getWidthForLLVMType(resultType));
+                                           target->width);
     bindLocal(target, state, e);
   }
   Gklee::Logging::exitFunc();
@@ -5356,6 +6178,11 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
                                    std::pair<std::string,
                                    std::vector<unsigned char> > >
                                    &res) {
+  if (currentTestCase && &state == currentTestCase->state) {
+    res = currentTestCase->solution;
+    return currentTestCase->solved;
+  }
+
   Gklee::Logging::enterFunc< std::string >( "", __PRETTY_FUNCTION__ );  
   solver->setTimeout(stpTimeout);
 
@@ -21,12 +21,14 @@
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/KModule.h"
 #include "llvm/Support/CallSite.h"
+#include <deque>
 #include <vector>
 #include <string>
 #include <map>
 #include <set>
 
 #include "CUDA.h"
+#include "CUDAIntrinsics.h"
 #include "PathReduction.h"
 #include "klee/logging.h"
 
@@ -49,6 +51,7 @@ namespace llvm {
 namespace klee {
   class Array;
   struct Cell;
+  class ConstantMemory;
   class ExecutionState;
   class ExternalDispatcher;
   class Expr;
@@ -60,10 +63,12 @@ namespace klee {
   class MemoryManager;
   class MemoryObject;
   class ObjectState;
+  class OccupancyEstimator;
   class PTree;
   class Searcher;
   class SeedInfo;
   class SpecialFunctionHandler;
+  class StateSpiller;
   struct StackFrame;
   class StatsTracker;
   class TimingSolver;
@@ -130,6 +135,7 @@ class Executor : public Interpreter {
   friend class WeightedRandomSearcher;
   friend class SpecialFunctionHandler;
   friend class StatsTracker;
+  friend class TestCaseTimer;
 
 public:
   class Timer {
@@ -166,6 +172,13 @@ public:
                  ExecutionState &state, 
                  klee::ref<Expr> value);
 
+  /// Execute \a ki directly on the register cells, keeping concrete
+  /// results inline instead of building expressions for them.
+  ///
+  /// \return False if the instruction or its operands need the generic
+  /// path.
+  bool executeInline(ExecutionState &state, KInstruction *ki);
+
   ObjectState *bindObjectInState(ExecutionState &state, 
                                  const MemoryObject *mo,
                                  bool isLocal, const Array *array = 0);
@@ -219,11 +232,19 @@ private:
   KModule *kmodule;
   InterpreterHandler *interpreterHandler;
   Searcher *searcher;
+  StateSpiller *spiller;
+  ConstantMemory *constantMemory;
+  /// Created at the first kernel launch (with -check-occupancy).
+  OccupancyEstimator *occupancyEstimator;
   bool is_GPU_mode; // For convenience, some member functions 
                     // need this...
   bool accumStore;
   std::map<llvm::Instruction*, MemoryAccess> accumTaintSet; 
   klee::ref<Expr> atomicRes;
+  /// For each atomic instruction, the number of times it was executed
+  /// and the most updates one of its summaries folded (only kept with
+  /// -summarize-atomics).
+  std::map<const KInstruction*, std::pair<uint64_t, unsigned> > atomicHotspots;
   std::set<std::string> kernelSet;     // global function set  
   std::set<std::string> builtInSet;    // builtIn variables set 
   llvm::Function *kernelFunc; 
@@ -249,6 +270,36 @@ private:
   /// \invariant \ref addedStates and \ref removedStates are disjoint.
   std::set<ExecutionState*> removedStates;
 
+  /// A terminated state whose test case waits for those before it, and
+  /// whose inputs may be solved for in a child process (see
+  /// -test-solver-jobs).
+  struct PendingTestCase {
+    /// A copy of the state as it terminated.
+    ExecutionState *state;
+    /// The child, or -1 once it is reaped or if the test is solved when
+    /// written (no symbolics, or no child could be started).
+    int pid;
+    /// The read end of the pipe the child writes the solution to, or -1
+    /// once the child closed it.
+    int fd;
+    /// Whether a child solved for the inputs.
+    bool background;
+    /// What the child wrote so far.
+    std::string input;
+    bool hasMessage;
+    std::string message, suffix, performSuffix;
+    bool solved;
+    std::vector< std::pair<std::string, std::vector<unsigned char> > > solution;
+  };
+
+  /// Test cases waiting for their solutions, in the order the states
+  /// terminated, which is the order they are written in.
+  std::deque<PendingTestCase*> pendingTestCases;
+
+  /// The pending test case being written, if any; getSymbolicSolution
+  /// answers with its solution.
+  PendingTestCase *currentTestCase;
+
   /// When non-empty the Executor is running in "seed" mode. The
   /// states in this map will be executed in an arbitrary order
   /// (outside the normal search interface) until they terminate. When
@@ -345,6 +396,23 @@ private:
 
   void configurateGPUKernelSet();
 
+  /// Advance the thread schedule of \a state after it executed \a ki,
+  /// entering and leaving GPU mode as needed.
+  void scheduleGPUThreads(ExecutionState &state, KInstruction *ki);
+
+  /// Whether operand \a index of \a ki is concrete in \a state.
+  bool isConcreteOperand(KInstruction *ki, unsigned index,
+                         ExecutionState &state) const;
+
+  /// Whether \a state, which just executed \a lastKi, may go on running
+  /// without consulting the searcher: it is in a kernel, nothing was
+  /// forked or terminated, and its next instruction cannot fork because
+  /// every operand it could fork on is concrete. Such instructions are
+  /// still interpreted one by one (there is no native or JIT path), only
+  /// without a searcher round trip in between.
+  bool inConcreteKernel(ExecutionState &state,
+                        KInstruction *lastKi) const;
+
   void run(ExecutionState &initialState);
 
   // Given a concrete object in our [klee's] address space, add it to 
@@ -526,6 +594,20 @@ private:
   void concludeRateStatistics(ExecutionState &state); 
   // generate the test cases for non-mc, bc, vm...
   void processPerformDefectTestCase(ExecutionState &state);
+  // write the test case for a terminated state, possibly solving for
+  // its inputs in the background; tests are always numbered in the
+  // order they are emitted, and a defect test (performSuffix) shares the
+  // number of the test emitted before it
+  void emitTestCase(ExecutionState &state, const char *message,
+                    const char *suffix, const char *performSuffix = 0);
+  // write the pending test cases which are solved, oldest first, and
+  // wait until no more than maxPending children are still solving
+  void collectTestCases(unsigned maxPending);
+  // read what the children wrote and reap those which exited; if wait,
+  // block until at least one of them makes progress
+  void pollTestCases(bool wait);
+  // write the pending test cases at the front whose children are done
+  void writeReadyTestCases();
   // call exit handler and terminate state
   void terminateStateEarly(ExecutionState &state, const llvm::Twine &message);
   // call exit handler and terminate state
@@ -657,8 +739,41 @@ public:
                             std::vector< klee::ref<Expr> > &arguments, 
                             unsigned seqNum); 
 
+  /// Apply a commutative atomic whose result is unused by folding it
+  /// into the state's summary for the location.
+  ///
+  /// \return False if the atomic cannot be summarized, in which case
+  /// nothing was done.
+  bool summarizeAtomic(ExecutionState &state, KInstruction *target,
+                       CUDAIntrinsic::Kind kind, const std::string &fName,
+                       std::vector< klee::ref<Expr> > &arguments,
+                       unsigned seqNum);
+
+  /// Report the atomic instructions executed the most.
+  void dumpAtomicHotspots();
+
+  /// Get the timeline of \a state, its own copy to be added to, with the
+  /// kernel last launched finished once the state has left it.
+  StreamTimeline *getTimeline(ExecutionState &state);
+
+  /// Warn about what operation \a index of \a timeline shows: a copy and
+  /// a kernel which could overlap but do not, or a device
+  /// synchronisation which is not needed.
+  void reportTimelineOperation(const StreamTimeline &timeline, int index);
+
+  /// Record the launch of kernel \a f with \a arguments on the timeline.
+  void recordKernelLaunch(ExecutionState &state, KInstruction *ki,
+                          llvm::Function *f,
+                          std::vector< klee::ref<Expr> > &arguments);
+
+  /// Work out the occupancy of the launch of kernel \a f with the
+  /// current configuration, and warn if it cannot run at all.
+  void recordOccupancy(ExecutionState &state, KInstruction *ki,
+                       llvm::Function *f);
+
   bool executeCUDAAtomic(ExecutionState &state,
-                         KInstruction *target, std::string fName,
+                         KInstruction *target, 
+                         CUDAIntrinsic::Kind kind, std::string fName,
                          std::vector< klee::ref<Expr> > &arguments, 
                          unsigned seqNum); 
 
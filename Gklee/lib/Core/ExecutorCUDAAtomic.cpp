@@ -13,6 +13,7 @@
 #include "CUDAIntrinsics.h"
 #include "TimingSolver.h"
 
+#include "llvm/Instructions.h"
 #include "llvm/Support/CommandLine.h"
 #include "klee/Internal/Module/InstructionInfoTable.h"
 #include "klee/ExecutionState.h"
@@ -23,9 +24,24 @@
 #endif
 #include <math.h>
 
+#include <algorithm>
+
 using namespace llvm;
 using namespace klee;
 
+namespace runtime {
+  cl::opt<bool>
+  SummarizeAtomics("summarize-atomics",
+                   cl::desc("Fold the commutative atomics (integer add, "
+                            "and, or, xor, min, max) of a barrier interval "
+                            "whose results are unused into one balanced "
+                            "expression per location, and report the "
+                            "busiest atomics"),
+                   cl::init(false));
+}
+
+using namespace runtime;
+
 static inline const llvm::fltSemantics * fpWidthToSemantics(unsigned width) {
   switch(width) {
   case Expr::Int16:
@@ -271,36 +287,233 @@ void Executor::executeAtomicBitWise(ExecutionState &state,
   else 
     Res = XorExpr::create(atomicRes, arguments[1]);
 
-  executeMemoryOperation(state, true, base, atomicRes, 
+  executeMemoryOperation(state, true, base, Res, 
+                         target, seqNum, true);
+  bindLocal(target, state, atomicRes);
+}
+
+static klee::ref<Expr> combineAtomic(AtomicSummaries::Op op,
+                                     klee::ref<Expr> a, klee::ref<Expr> b) {
+  switch (op) {
+  case AtomicSummaries::Add:
+    return AddExpr::create(a, b);
+  case AtomicSummaries::And:
+    return AndExpr::create(a, b);
+  case AtomicSummaries::Or:
+    return OrExpr::create(a, b);
+  case AtomicSummaries::Xor:
+    return XorExpr::create(a, b);
+  case AtomicSummaries::SMin:
+    return SelectExpr::create(SleExpr::create(a, b), a, b);
+  case AtomicSummaries::SMax:
+    return SelectExpr::create(SgeExpr::create(a, b), a, b);
+  case AtomicSummaries::UMin:
+    return SelectExpr::create(UleExpr::create(a, b), a, b);
+  case AtomicSummaries::UMax:
+    return SelectExpr::create(UgeExpr::create(a, b), a, b);
+  }
+  assert(0 && "invalid atomic operation");
+  return a;
+}
+
+/// Whether \a v is only handed back to the caller: returned directly, or,
+/// as clang emits at -O0, stored to a slot whose loads are all returned.
+static bool isOnlyReturned(Value *v) {
+  for (Value::use_iterator ui = v->use_begin(), ue = v->use_end();
+       ui != ue; ++ui) {
+    if (isa<ReturnInst>(*ui))
+      continue;
+    StoreInst *si = dyn_cast<StoreInst>(*ui);
+    AllocaInst *slot = si && si->getValueOperand() == v ?
+      dyn_cast<AllocaInst>(si->getPointerOperand()) : 0;
+    if (!slot)
+      return false;
+    for (Value::use_iterator su = slot->use_begin(), se = slot->use_end();
+         su != se; ++su) {
+      if (isa<StoreInst>(*su))
+        continue;
+      LoadInst *li = dyn_cast<LoadInst>(*su);
+      if (!li)
+        return false;
+      for (Value::use_iterator li_ui = li->use_begin(),
+             li_ue = li->use_end(); li_ui != li_ue; ++li_ui)
+        if (!isa<ReturnInst>(*li_ui))
+          return false;
+    }
+  }
+  return true;
+}
+
+/// Whether the result of the atomic call \a target is never read. The
+/// intrinsics are called from wrappers such as atomicAdd in the CUDA
+/// headers, which return the result and are not inlined at -O0, so
+/// follow the result up the stack for as long as it is only returned.
+static bool isAtomicResultUnused(ExecutionState &state, KInstruction *target) {
+  ExecutionState::stack_ty &stack = state.getCurStack();
+  Instruction *inst = target->inst;
+  for (unsigned i = stack.size(); i--; ) {
+    if (inst->use_empty())
+      return true;
+    if (!isOnlyReturned(inst) || !stack[i].caller)
+      return false;
+    inst = stack[i].caller->inst;
+  }
+  return false;
+}
+
+bool Executor::summarizeAtomic(ExecutionState &state, KInstruction *target,
+                               CUDAIntrinsic::Kind kind,
+                               const std::string &fName,
+                               std::vector< klee::ref<Expr> > &arguments,
+                               unsigned seqNum) {
+  // Only the final value of the location is summarized, not what each
+  // thread saw, and only at a location known without asking the solver.
+  if (!isa<ConstantExpr>(arguments[0]) || !isAtomicResultUnused(state, target))
+    return false;
+
+  AtomicSummaries::Op op;
+  switch (kind) {
+  case CUDAIntrinsic::AtomicAdd:
+    // Floating-point addition does not associate.
+    if (fName.find("fAtomicAdd") != std::string::npos)
+      return false;
+    op = AtomicSummaries::Add;
+    break;
+  case CUDAIntrinsic::AtomicMin:
+    op = fName.find("uAtomicMin") != std::string::npos ?
+      AtomicSummaries::UMin : AtomicSummaries::SMin;
+    break;
+  case CUDAIntrinsic::AtomicMax:
+    op = fName.find("uAtomicMax") != std::string::npos ?
+      AtomicSummaries::UMax : AtomicSummaries::SMax;
+    break;
+  case CUDAIntrinsic::AtomicBitWise:
+    if (fName.find("And") != std::string::npos)
+      op = AtomicSummaries::And;
+    else if (fName.find("Or") != std::string::npos)
+      op = AtomicSummaries::Or;
+    else
+      op = AtomicSummaries::Xor;
+    break;
+  default:
+    return false;
+  }
+
+  // Load the value from addr
+  klee::ref<Expr> base = arguments[0];
+  CallInst *ci = static_cast<CallInst*>(target->inst);
+
+  updateCType(state, ci->getArgOperand(0), base, state.tinfo.is_GPU_mode);
+  executeMemoryOperation(state, false, base, 0, 
+                         target, seqNum, true);     
+
+  if (state.atomicSummaries.isNull())
+    state.atomicSummaries = new AtomicSummaries();
+  else if (state.atomicSummaries->refCount > 1)
+    state.atomicSummaries = new AtomicSummaries(*state.atomicSummaries);
+
+  AtomicSummaries::Key key;
+  key.op = op;
+  key.address = base;
+  AtomicSummaries::Summary &summary = state.atomicSummaries->summaries[key];
+  // Something other than this summary has written the location since,
+  // so start again from what it holds now.
+  if (summary.written.isNull() || summary.written != atomicRes) {
+    summary = AtomicSummaries::Summary();
+    summary.base = atomicRes;
+  }
+
+  // Merge equal-sized folds, as a binary counter carries.
+  klee::ref<Expr> operand = arguments[1];
+  unsigned size = 1;
+  while (!summary.partials.empty() && summary.partials.back().first == size) {
+    operand = combineAtomic(op, summary.partials.back().second, operand);
+    size *= 2;
+    summary.partials.pop_back();
+  }
+  summary.partials.push_back(std::make_pair(size, operand));
+  ++summary.count;
+
+  klee::ref<Expr> folded = summary.partials.back().second;
+  for (unsigned i = summary.partials.size() - 1; i--; )
+    folded = combineAtomic(op, summary.partials[i].second, folded);
+  summary.written = combineAtomic(op, summary.base, folded);
+
+  // Store back to original place 
+  executeMemoryOperation(state, true, base, summary.written, 
                          target, seqNum, true);
   bindLocal(target, state, atomicRes);
+
+  std::pair<uint64_t, unsigned> &hotspot = atomicHotspots[target];
+  hotspot.second = std::max(hotspot.second, summary.count);
+  return true;
+}
+
+namespace {
+  struct BusierAtomic {
+    typedef std::pair<const KInstruction*, 
+                      std::pair<uint64_t, unsigned> > value_type;
+
+    bool operator()(const value_type &a, const value_type &b) const {
+      return a.second.first > b.second.first;
+    }
+  };
+}
+
+void Executor::dumpAtomicHotspots() {
+  std::vector<BusierAtomic::value_type> hotspots(atomicHotspots.begin(),
+                                                 atomicHotspots.end());
+  std::sort(hotspots.begin(), hotspots.end(), BusierAtomic());
+
+  for (unsigned i = 0; i < hotspots.size() && i < 5; i++) {
+    const InstructionInfo &ii = *hotspots[i].first->info;
+    klee_message("atomic hotspot: %s:%u executed %llu times, "
+                 "folded up to %u updates", ii.file.c_str(), ii.line,
+                 (unsigned long long) hotspots[i].second.first,
+                 hotspots[i].second.second);
+  }
 }
 
 bool Executor::executeCUDAAtomic(ExecutionState &state,
-                                 KInstruction *target, std::string fName,
+                                 KInstruction *target, 
+                                 CUDAIntrinsic::Kind kind, std::string fName,
                                  std::vector< klee::ref<Expr> > &arguments, 
                                  unsigned seqNum) {
-  bool intrinsicFound = true;
+  if (SummarizeAtomics && kind >= CUDAIntrinsic::AtomicAdd &&
+      kind <= CUDAIntrinsic::AtomicBitWise) {
+    ++atomicHotspots[target].first;
+    if (summarizeAtomic(state, target, kind, fName, arguments, seqNum))
+      return true;
+  }
 
-  if (fName.find("AtomicAdd") != std::string::npos) {
+  switch (kind) {
+  case CUDAIntrinsic::AtomicAdd:
     executeAtomicAdd(state, target, fName, arguments, seqNum);
-  } else if (fName.find("AtomicExch") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::AtomicExch:
     executeAtomicExch(state, target, arguments, seqNum);
-  } else if (fName.find("AtomicMin") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::AtomicMin:
     executeAtomicMin(state, target, fName, arguments, seqNum);
-  } else if (fName.find("AtomicMax") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::AtomicMax:
     executeAtomicMax(state, target, fName, arguments, seqNum);
-  } else if (fName.find("AtomicInc") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::AtomicInc:
     executeAtomicInc(state, target, arguments, seqNum);
-  } else if (fName.find("AtomicDec") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::AtomicDec:
     executeAtomicDec(state, target, arguments, seqNum);
-  } else if (fName.find("AtomicCAS") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::AtomicCAS:
     executeAtomicCAS(state, target, arguments, seqNum);
-  } else if (fName.find("AtomicAnd") != std::string::npos
-              || fName.find("AtomicOr") != std::string::npos
-                || fName.find("AtomicXor") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::AtomicBitWise:
     executeAtomicBitWise(state, target, fName, arguments, seqNum);
-  } else intrinsicFound = false;
+    break;
+  default:
+    return false;
+  }
 
-  return intrinsicFound;
+  return true;
 }
@@ -162,6 +162,7 @@ void Executor::encounterBarrier(ExecutionState &state,
     }
 
     if (CheckBC) {
+      solver->queryClient = TimingSolver::BankConflictCheckClient;
       if (!UseSymbolicConfig)
         state.addressSpace.hasBankConflict(*this, state, state.cTidSets, DevCap);
       else {
@@ -171,6 +172,7 @@ void Executor::encounterBarrier(ExecutionState &state,
     }
 
     if (CheckMC) {
+      solver->queryClient = TimingSolver::CoalescingCheckClient;
       if (!UseSymbolicConfig)
         state.addressSpace.hasMemoryCoalescing(*this, state, state.cTidSets, DevCap);
       else { 
@@ -189,6 +191,7 @@ void Executor::encounterBarrier(ExecutionState &state,
     }
 
     if (CheckVolatile) {
+      solver->queryClient = TimingSolver::VolatileCheckClient;
       if (!UseSymbolicConfig)
         state.addressSpace.hasVolatileMissing(*this, state, state.cTidSets);
       else { 
@@ -197,6 +200,7 @@ void Executor::encounterBarrier(ExecutionState &state,
       }
     }
 
+    solver->queryClient = TimingSolver::RaceCheckClient;
     if (!UseSymbolicConfig) {
       // check races on shared memory 
       klee::ref<Expr> shareRaceCond = klee::ConstantExpr::create(1, Expr::Bool);
@@ -225,6 +229,19 @@ void Executor::encounterBarrier(ExecutionState &state,
       }
     }
 
+    solver->queryClient = TimingSolver::ExecutionClient;
+
+    std::vector<unsigned> lost;
+    solver->takeUnanswered(lost);
+    for (unsigned i = 0; i < lost.size(); i++) {
+      if (lost[i])
+        GKLEE_INFO << "The solver time budget of the " 
+                   << TimingSolver::getClientName((TimingSolver::QueryClient) i) 
+                   << " ran out with " << lost[i] 
+                   << " queries unanswered; defects may have been missed" 
+                   << std::endl;
+    }
+
     if (!is_end_GPU_barrier) {
       bc_cov_monitor.atBarrier(state.getKernelNum(), BINum);
     }
@@ -241,6 +258,9 @@ void Executor::encounterBarrier(ExecutionState &state,
     }
     state.addressSpace.clearAccessSet();
     state.addressSpace.clearInstAccessSet(true);
+    state.atomicSummaries = 0;
+    solver->clearPrefetched();
+    state.builtInSubstitution = 0;
   }
 
   if (!UseSymbolicConfig) {
@@ -1284,6 +1304,19 @@ static void executeParFPConversionOpIntrinsic(Executor &executor, ExecutionState
 
 #define NELEMS(array) (sizeof(array)/sizeof(array[0]))
 
+static const char *CUDASync[] = {
+  "__syncthreads",
+  "__syncthreads_count",
+  "__syncthreads_and",
+  "__syncthreads_or"
+};
+
+static const char *CUDAMemfence[] = {
+  "__threadfence",
+  "__threadfence_block",
+  "__threadfence_system"
+};
+
 static bool particularMul(std::string fName) {
   return (fName.find("mulhi") != std::string::npos 
            || fName.find("mul64hi") != std::string::npos
@@ -1336,54 +1369,170 @@ static bool particularFloatConversion(std::string fName) {
                    || fName.find("fmod") != std::string::npos);
 }
 
+static bool contains(const std::string &fName, const char *s) {
+  return fName.find(s) != std::string::npos;
+}
+
+CUDAIntrinsic::Kind CUDAIntrinsic::classify(const std::string &fName) {
+  // Arithmetic
+  if (particularMul(fName))
+    return MulHi;
+  if (contains(fName, "sad"))
+    return Sad;
+  if (contains(fName, "fdivide"))
+    return FDivide;
+  if (particularTriangleOp(fName))
+    return Triangle;
+  if (particularExponentialOp(fName))
+    return Exponential;
+  if (particularComparisonOp(fName))
+    return Comparison;
+  if (contains(fName, "__fadd_") || contains(fName, "__dadd_"))
+    return FloatAdd;
+  if (contains(fName, "__fmul_") || contains(fName, "__dmul_"))
+    return FloatMul;
+  if (contains(fName, "fma"))
+    return FloatFma;
+  if (contains(fName, "rcp"))
+    return FloatRcp;
+  if (contains(fName, "sqrt"))
+    return FloatSqrt;
+  if (contains(fName, "__fdiv_") || contains(fName, "__ddiv_"))
+    return FloatDiv;
+  if (particularBitWiseOp(fName))
+    return BitWise;
+  if (contains(fName, "hadd"))
+    return ParAdd;
+  if (contains(fName, "abs"))
+    return Abs;
+  if (particularFloatConversion(fName))
+    return FPConversion;
+
+  // Conversion
+  if (contains(fName, "float2int") || contains(fName, "float2ll")
+       || contains(fName, "double2int") || contains(fName, "double2ll"))
+    return FPToSI;
+  if (contains(fName, "float2half") || contains(fName, "float2uint")
+       || contains(fName, "float2ull") || contains(fName, "double2uint")
+       || contains(fName, "double2ull"))
+    return FPToUI;
+  if (contains(fName, "int2float") || contains(fName, "ll2float")
+       || contains(fName, "int2double") || contains(fName, "ll2double"))
+    return SIToFP;
+  if (contains(fName, "half2float") || contains(fName, "uint2float")
+       || contains(fName, "ull2float") || contains(fName, "uint2double")
+       || contains(fName, "ull2double"))
+    return UIToFP;
+  if (contains(fName, "double2hiint") || contains(fName, "double2loint"))
+    return FPToHiOrLoInt;
+  if (contains(fName, "hiloint2double"))
+    return HiLoIntToFP;
+  if (contains(fName, "float_as_int") || contains(fName, "double_as_longlong"))
+    return FPAsInt;
+  if (contains(fName, "int_as_float") || contains(fName, "longlong_as_double"))
+    return IntAsFP;
+
+  // Atomics
+  if (contains(fName, "AtomicAdd"))
+    return AtomicAdd;
+  if (contains(fName, "AtomicExch"))
+    return AtomicExch;
+  if (contains(fName, "AtomicMin"))
+    return AtomicMin;
+  if (contains(fName, "AtomicMax"))
+    return AtomicMax;
+  if (contains(fName, "AtomicInc"))
+    return AtomicInc;
+  if (contains(fName, "AtomicDec"))
+    return AtomicDec;
+  if (contains(fName, "AtomicCAS"))
+    return AtomicCAS;
+  if (contains(fName, "AtomicAnd") || contains(fName, "AtomicOr")
+       || contains(fName, "AtomicXor"))
+    return AtomicBitWise;
+
+  for (unsigned i = 0; i < NELEMS(CUDAMemfence); i++)
+    if (contains(fName, CUDAMemfence[i]))
+      return Memfence;
+  for (unsigned i = 0; i < NELEMS(CUDASync); i++)
+    if (contains(fName, CUDASync[i]))
+      return Barrier;
+
+  return None;
+}
+
+void CUDAIntrinsic::resolveCalls(KModule *kmodule) {
+  for (std::vector<KFunction*>::iterator it = kmodule->functions.begin(),
+         ie = kmodule->functions.end(); it != ie; ++it) {
+    KFunction *kf = *it;
+    for (unsigned i = 0; i < kf->numInstructions; ++i) {
+      KInstruction *ki = kf->instructions[i];
+      if (ki->target && ki->target->isDeclaration())
+        ki->cudaIntrinsic = classify(ki->target->getName().str());
+    }
+  }
+}
+
 static bool executeCUDAArithmetic(Executor &executor, 
                                   ExecutionState &state,
                                   KInstruction *target, 
-                                  Function *f,
+                                  CUDAIntrinsic::Kind kind,
+                                  std::string fName,
                                   std::vector< klee::ref<Expr> > &arguments) {
-  std::string fName = f->getName().str();
-  bool intrinsicFound = true;
-
-  if (particularMul(fName)) {
+  switch (kind) {
+  case CUDAIntrinsic::MulHi:
     executeMulHiIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("sad") != std::string::npos) { 
+    break;
+  case CUDAIntrinsic::Sad:
     executeSadIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("fdivide") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::FDivide:
     executeFDivideIntrinsic(executor, state, target, fName, arguments);
-  } else if (particularTriangleOp(fName)) {
+    break;
+  case CUDAIntrinsic::Triangle:
     executeParTriangleOpIntrinsic(executor, state, target, fName, arguments);
-  } else if (particularExponentialOp(fName)) {
+    break;
+  case CUDAIntrinsic::Exponential:
     executeParExponentialOpIntrinsic(executor, state, target, fName, arguments);
-  } else if (particularComparisonOp(fName)) {
+    break;
+  case CUDAIntrinsic::Comparison:
     executeParComparisonOpIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("__fadd_") != std::string::npos
-              || fName.find("__dadd_") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::FloatAdd:
     executeFloatAddIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("__fmul_") != std::string::npos
-              || fName.find("__dmul_") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::FloatMul:
     executeFloatMulIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("fma") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::FloatFma:
     executeFloatFmaIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("rcp") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::FloatRcp:
     executeFloatRcpIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("sqrt") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::FloatSqrt:
     executeFloatSqrtIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("__fdiv_") != std::string::npos 
-              || fName.find("__ddiv_") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::FloatDiv:
     executeFloatDivIntrinsic(executor, state, target, fName, arguments);
-  } else if (particularBitWiseOp(fName)) {
+    break;
+  case CUDAIntrinsic::BitWise:
     executeParBitWiseOpIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("hadd") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::ParAdd:
     executeParAddOpIntrinsic(executor, state, target, fName, arguments);
-  } else if (fName.find("abs") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::Abs:
     executeAbsOpIntrinsic(executor, state, target, fName, arguments);
-  } else if (particularFloatConversion(fName)) {
+    break;
+  case CUDAIntrinsic::FPConversion:
     executeParFPConversionOpIntrinsic(executor, state, target, fName, arguments);
-  } else { 
-    intrinsicFound = false;
+    break;
+  default:
+    return false;
   }
 
-  return intrinsicFound;
+  return true;
 } 
 
 static void executeCUDAFPToSI(Executor &executor, ExecutionState &state, 
@@ -1484,37 +1633,26 @@ static void executeCUDAFPToHiOrLoInt(Executor &executor, ExecutionState &state,
 static bool executeCUDAConversion(Executor &executor, 
                                   ExecutionState &state,
                                   KInstruction *target, 
-                                  Function *f,
+                                  CUDAIntrinsic::Kind kind,
+                                  std::string fName,
                                   std::vector< klee::ref<Expr> > &arguments) {
-  bool intrinsicFound = true;
-  std::string fName = f->getName().str();
-
-  if (fName.find("float2int") != std::string::npos
-       || fName.find("float2ll") != std::string::npos
-         || fName.find("double2int") != std::string::npos 
-           || fName.find("double2ll") != std::string::npos) {
+  switch (kind) {
+  case CUDAIntrinsic::FPToSI:
     executeCUDAFPToSI(executor, state, target, fName, arguments);
-  } else if (fName.find("float2half") != std::string::npos 
-              || fName.find("float2uint") != std::string::npos
-                || fName.find("float2ull") != std::string::npos
-                  || fName.find("double2uint") != std::string::npos
-                    || fName.find("double2ull") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::FPToUI:
     executeCUDAFPToUI(executor, state, target, fName, arguments);
-  } else if (fName.find("int2float") != std::string::npos
-              || fName.find("ll2float") != std::string::npos
-                || fName.find("int2double") != std::string::npos
-                  || fName.find("ll2double") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::SIToFP:
     executeCUDASIToFP(executor, state, target, fName, arguments);
-  } else if (fName.find("half2float") != std::string::npos 
-              || fName.find("uint2float") != std::string::npos
-                || fName.find("ull2float") != std::string::npos
-                  || fName.find("uint2double") != std::string::npos
-                    || fName.find("ull2double") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::UIToFP:
     executeCUDAUIToFP(executor, state, target, fName, arguments);
-  } else if (fName.find("double2hiint") != std::string::npos
-              || fName.find("double2loint") != std::string::npos) {
+    break;
+  case CUDAIntrinsic::FPToHiOrLoInt:
     executeCUDAFPToHiOrLoInt(executor, state, target, fName, arguments);
-  } else if (fName.find("hiloint2double") != std::string::npos) { // hiloint2double
+    break;
+  case CUDAIntrinsic::HiLoIntToFP: { // hiloint2double
     llvm::APInt tmp(64, 0);
     klee::ref<klee::ConstantExpr> va = executor.toConstantPublic(state, arguments[0], 
                                                            "hiloint2double op"); 
@@ -1529,15 +1667,17 @@ static bool executeCUDAConversion(Executor &executor,
 
     llvm::APFloat fp(tmp);
     executor.bindLocal(target, state, klee::ConstantExpr::alloc(fp.bitcastToAPInt()));
-  } else if (fName.find("float_as_int") != std::string::npos
-              || fName.find("double_as_longlong") != std::string::npos) {
+    break;
+  }
+  case CUDAIntrinsic::FPAsInt: {
     klee::ref<klee::ConstantExpr> va = executor.toConstantPublic(state, arguments[0], 
                                                            "bitcast to int or longlong");
     if (!fpWidthToSemantics(va->getWidth()))
       executor.terminateStateOnExecErrorPublic(state, "Unsupported bitcast operation");
     executor.bindLocal(target, state, klee::ConstantExpr::alloc(va->getAPValue()));
-  } else if (fName.find("int_as_float") != std::string::npos 
-              || fName.find("longlong_as_double") != std::string::npos) {
+    break;
+  }
+  case CUDAIntrinsic::IntAsFP: {
     CallSite cs(target->inst);
     Value *fp = cs.getCalledValue();
     Expr::Width resultType = executor.getWidthForLLVMType(fp->getType());
@@ -1548,10 +1688,13 @@ static bool executeCUDAConversion(Executor &executor,
                                                            "bitcast to fp");
     llvm::APFloat FP(va->getAPValue());
     executor.bindLocal(target, state, klee::ConstantExpr::alloc(FP.bitcastToAPInt()));
-  } 
-  else intrinsicFound = false;
+    break;
+  }
+  default:
+    return false;
+  }
 
-  return intrinsicFound;
+  return true;
 }
 
 void Executor::executeCUDAIntrinsics(ExecutionState &state, KInstruction *target, 
@@ -1563,38 +1706,41 @@ void Executor::executeCUDAIntrinsics(ExecutionState &state, KInstruction *target
 
   // Some functions in host code are also able to reuse those functions
   if (state.tinfo.is_GPU_mode) {
-    if (executeCUDAArithmetic(*this, state, target, f, arguments)){
+    // The handler of a direct call was found when the module was
+    // prepared; calls through pointers or aliases are classified here.
+    CUDAIntrinsic::Kind kind = 
+      (f == target->target && target->cudaIntrinsic != CUDAIntrinsic::Unresolved)
+      ? (CUDAIntrinsic::Kind) target->cudaIntrinsic 
+      : CUDAIntrinsic::classify(fName);
+
+    if (executeCUDAArithmetic(*this, state, target, kind, fName, arguments)){
       Gklee::Logging::exitFunc();
       return;
     }
 
-    if (executeCUDAConversion(*this, state, target, f, arguments)){
+    if (executeCUDAConversion(*this, state, target, kind, fName, arguments)){
       Gklee::Logging::exitFunc();
       return;
     }
 
-    if (executeCUDAAtomic(state, target, fName, arguments, seqNum)) {
+    if (executeCUDAAtomic(state, target, kind, fName, arguments, seqNum)) {
       Gklee::Logging::exitFunc();
       return;
     }
 
-    for (unsigned i = 0; i < NELEMS(CUDAMemfence); i++) {
-      if (fName.find(CUDAMemfence[i]) != std::string::npos) {
-        // No need to write function body for thread_fence intrinsics
-        handleMemfence(state, target);
-	Gklee::Logging::exitFunc();
-        return; 
-      }
+    if (kind == CUDAIntrinsic::Memfence) {
+      // No need to write function body for thread_fence intrinsics
+      handleMemfence(state, target);
+      Gklee::Logging::exitFunc();
+      return; 
     }
    
-    for (unsigned i = 0; i < NELEMS(CUDASync); i++) {
-      if (fName.find(CUDASync[i]) != std::string::npos) {
-	 //TODO flow experiment
-        handleBarrier(state, target);
-	 //TODO flow experiment
-	Gklee::Logging::exitFunc();
-        return; 
-      }
+    if (kind == CUDAIntrinsic::Barrier) {
+      //TODO flow experiment
+      handleBarrier(state, target);
+      //TODO flow experiment
+      Gklee::Logging::exitFunc();
+      return; 
     }
   }
 
@@ -9,6 +9,7 @@
 
 #include "Executor.h"
 #include "AddressSpace.h"
+#include "ConstantMemory.h"
 #include "CoreStats.h"
 #include "Memory.h"
 #include "TimingSolver.h"
@@ -115,6 +116,12 @@ bool AddressSpaceUtil::evaluateQueryMustBeFalse(Executor &executor, ExecutionSta
   return success;
 }
 
+void AddressSpaceUtil::prefetchQueries(Executor &executor, ExecutionState &state, 
+                                       std::vector< klee::ref<Expr> > &exprs) {
+  if (exprs.size() > 1)
+    executor.solver->prefetch(state, exprs);
+}
+
 bool AddressSpaceUtil::isTwoInstIdentical(llvm::Instruction *inst1, 
                                           llvm::Instruction *inst2) {
   std::string func1Name = inst1->getParent()->getParent()->getName().str();
@@ -283,11 +290,8 @@ AddressSpace &AddressSpace::operator=(const AddressSpace& b) {
 // Conflict checking
 //****************************************************************************************************
 
-// return true if a conflict is found
-bool checkConflictExprs(Executor &executor, ExecutionState &state, 
-                        klee::ref<Expr> &raceCond, unsigned &queryNum, 
-                        klee::ref<Expr> &addr1, Expr::Width width1, 
-                        klee::ref<Expr> &addr2, Expr::Width width2) {
+static klee::ref<Expr> constructConflictExpr(klee::ref<Expr> &addr1, Expr::Width width1, 
+                                             klee::ref<Expr> &addr2, Expr::Width width2) {
   unsigned boffset1 = (width1 - 1) >> 3; 
   klee::ref<Expr> hbound1 =  boffset1 == 0 ? addr1 : 
     AddExpr::create(addr1, klee::ConstantExpr::create(boffset1, addr1->getWidth()));
@@ -300,7 +304,42 @@ bool checkConflictExprs(Executor &executor, ExecutionState &state,
 				    UleExpr::create(addr2, hbound1));
   klee::ref<Expr> expr2 = AndExpr::create(UleExpr::create(addr2, addr1),
 				    UleExpr::create(addr1, hbound2));
-  klee::ref<Expr> expr = OrExpr::create(expr1, expr2);
+  return OrExpr::create(expr1, expr2);
+}
+
+// Announce, in the order the checkers below ask them, the conflict queries 
+// about the pairs of vec1 x vec2 (or the upper triangle of vec1 if sameVec). 
+// The solver evaluates them a window at a time as the checker reaches them, 
+// so nothing past the window of the first race is solved, and the first 
+// reported defect is the same as without prefetching.
+static void prefetchConflictExprs(Executor &executor, ExecutionState &state, 
+                                  const MemoryAccessVec &vec1, 
+                                  const MemoryAccessVec &vec2, bool sameVec) {
+  if (executor.solver->batchWorkers < 2)
+    return;
+
+  std::vector< klee::ref<Expr> > exprs;
+  for (MemoryAccessVec::const_iterator ii = vec1.begin(); ii != vec1.end(); ii++) {
+    MemoryAccessVec::const_iterator jj = sameVec ? ii + 1 : vec2.begin();
+    MemoryAccessVec::const_iterator je = sameVec ? vec1.end() : vec2.end();
+    for (; jj != je; jj++) {
+      if (ii->tid == jj->tid || isBothAtomic(*ii, *jj))
+        continue;
+      klee::ref<Expr> addr1 = ii->offset;
+      klee::ref<Expr> addr2 = jj->offset;
+      exprs.push_back(EqExpr::create(ii->mo->getBaseExpr(), jj->mo->getBaseExpr()));
+      exprs.push_back(constructConflictExpr(addr1, ii->width, addr2, jj->width));
+    }
+  }
+  AddressSpaceUtil::prefetchQueries(executor, state, exprs);
+}
+
+// return true if a conflict is found
+bool checkConflictExprs(Executor &executor, ExecutionState &state, 
+                        klee::ref<Expr> &raceCond, unsigned &queryNum, 
+                        klee::ref<Expr> &addr1, Expr::Width width1, 
+                        klee::ref<Expr> &addr2, Expr::Width width2) {
+  klee::ref<Expr> expr = constructConflictExpr(addr1, width1, addr2, width2);
 
   // the fast path
   if (klee::ConstantExpr *CE = dyn_cast<klee::ConstantExpr>(expr)) {
@@ -348,6 +387,7 @@ static bool checkVolatileMissing(Executor &executor, ExecutionState &state,
                                  unsigned mark, klee::ref<Expr> &vmCond) {
     bool vmissing = false;
     unsigned vmQueryNum = 0;
+    prefetchConflictExprs(executor, state, writeVec, readVec, false);
   
     // check the potential Read-Write sharing first 
     for (MemoryAccessVec::const_iterator ii = writeVec.begin(); ii != writeVec.end(); ii++) {
@@ -384,6 +424,10 @@ static bool checkVolatileMissing(Executor &executor, ExecutionState &state,
       }
     }
 
+    // Look again if queries that ran out of time got an answer on retry.
+    if (!vmissing && executor.solver->retryAbandoned())
+      return checkVolatileMissing(executor, state, readVec, writeVec, mark, vmCond);
+
     return vmissing;
 }
 
@@ -487,6 +531,7 @@ static bool checkWWRace(Executor &executor, ExecutionState &state,
     Gklee::Logging::exitFunc();
     return false;
   }
+  prefetchConflictExprs(executor, state, vec1, withinwarp ? vec1 : vec2, withinwarp);
   
   if (withinwarp) {
     for (MemoryAccessVec::iterator ii = vec1.begin(); ii != vec1.end(); ii++) {
@@ -554,6 +599,9 @@ static bool checkWWRace(Executor &executor, ExecutionState &state,
     }
   }
   Gklee::Logging::exitFunc();
+  // Look again if queries that ran out of time got an answer on retry.
+  if (executor.solver->retryAbandoned())
+    return checkWWRace(executor, state, vec1, vec2, withinwarp, raceCond, queryNum);
   return false;
 }
 
@@ -566,6 +614,7 @@ static bool checkRWRace(Executor &executor, ExecutionState &state,
     Gklee::Logging::exitFunc();
     return false;
   }
+  prefetchConflictExprs(executor, state, vec1, vec2, false);
   
   // Definitely different warps...
   for (MemoryAccessVec::iterator ii = vec1.begin(); ii != vec1.end(); ii++) {
@@ -598,6 +647,9 @@ static bool checkRWRace(Executor &executor, ExecutionState &state,
     }
   }
   Gklee::Logging::exitFunc();
+  // Look again if queries that ran out of time got an answer on retry.
+  if (executor.solver->retryAbandoned())
+    return checkRWRace(executor, state, vec1, vec2, raceCond, queryNum);
   return false;
 }
 
@@ -630,6 +682,7 @@ static bool checkWWRacePureCS(Executor &executor, ExecutionState &state,
                               bool withinBlock, klee::ref<Expr> &raceCond, 
                               unsigned &queryNum) {
   Gklee::Logging::enterFunc( raceCond , __PRETTY_FUNCTION__ );
+  prefetchConflictExprs(executor, state, vec1, vec2, &vec1 == &vec2);
   if (withinBlock) {
     for (MemoryAccessVec::iterator ii = vec1.begin(); ii != vec1.end(); ii++) {
       klee::ref<Expr> base1 = ii->mo->getBaseExpr();
@@ -720,6 +773,9 @@ static bool checkWWRacePureCS(Executor &executor, ExecutionState &state,
     }
   }
   Gklee::Logging::exitFunc();
+  // Look again if queries that ran out of time got an answer on retry.
+  if (executor.solver->retryAbandoned())
+    return checkWWRacePureCS(executor, state, vec1, vec2, withinBlock, raceCond, queryNum);
   return false;
 }
 
@@ -728,6 +784,7 @@ static bool checkRWRacePureCS(Executor &executor, ExecutionState &state,
                               bool withinBlock, klee::ref<Expr> &raceCond, unsigned &queryNum) {
   // check the Read-Write conflict first 
   Gklee::Logging::enterFunc( raceCond , __PRETTY_FUNCTION__ );
+  prefetchConflictExprs(executor, state, vec1, vec2, false);
   for (MemoryAccessVec::iterator ii = vec1.begin(); ii != vec1.end(); ii++) {
     klee::ref<Expr> base1 = ii->mo->getBaseExpr();
     klee::ref<Expr> offset1 = ii->offset;
@@ -761,6 +818,9 @@ static bool checkRWRacePureCS(Executor &executor, ExecutionState &state,
     }
   }
   Gklee::Logging::exitFunc();
+  // Look again if queries that ran out of time got an answer on retry.
+  if (executor.solver->retryAbandoned())
+    return checkRWRacePureCS(executor, state, vec1, vec2, withinBlock, raceCond, queryNum);
   return false;
 }
 
@@ -937,6 +997,11 @@ bool AddressSpace::checkDivergeBranchRace(Executor &executor, ExecutionState &st
       }
     }
   }
+  // Look again if queries that ran out of time got an answer on retry.
+  if (executor.solver->retryAbandoned())
+    return checkDivergeBranchRace(executor, state, vec1, vec2, cTidSets, accessSets, 
+                                  warpsBranchDivRegionSets, sameInstSets, 
+                                  isWW, raceCond, queryNum);
   return false;
 }
 
@@ -2090,10 +2155,32 @@ void HierAddressSpace::insertInst(bool is_GPU_mode, unsigned bid, unsigned tid,
 
 //******************************************************************************************
 
+const ConstantMemory *HierAddressSpace::constantMemory = 0;
+
+/// Resolve \a address if it is in constant memory, without searching the
+/// device memory map.
+static bool resolveConstant(AddressSpace &deviceMemory,
+                            const klee::ref<ConstantExpr> &address,
+                            ObjectPair &result) {
+  const MemoryObject *mo =
+    HierAddressSpace::constantMemory->lookup(address->getZExtValue());
+  if (!mo)
+    return false;
+  const ObjectState *os = deviceMemory.findObject(mo);
+  if (!os)
+    return false;
+  result = std::make_pair(mo, os);
+  return true;
+}
+
 bool HierAddressSpace::resolveOne(const klee::ref<ConstantExpr> &addr, 
 				  ObjectPair &result, 
 				  GPUConfig::CTYPE ctype,
 				  unsigned b_t_index) {
+  if (constantMemory
+      && (ctype == GPUConfig::DEVICE || ctype == GPUConfig::CONSTANT)
+      && resolveConstant(deviceMemory, addr, result))
+    return true;
   return getAddressSpace(ctype, b_t_index).resolveOne(addr, result);
 }
 
@@ -2104,6 +2191,15 @@ bool HierAddressSpace::resolveOne(ExecutionState &state,
 				  bool &success,
 				  GPUConfig::CTYPE ctype,
 				  unsigned b_t_index) {
+  if (constantMemory
+      && (ctype == GPUConfig::DEVICE || ctype == GPUConfig::CONSTANT)) {
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(address)) {
+      if (resolveConstant(deviceMemory, CE, result)) {
+        success = true;
+        return true;
+      }
+    }
+  }
   ExecutorUtil::copyOutConstraintUnderSymbolic(state);
   bool res = getAddressSpace(ctype, b_t_index).resolveOne(state, solver, address, result, success);
   ExecutorUtil::copyBackConstraintUnderSymbolic(state);
@@ -2170,6 +2266,75 @@ void HierAddressSpace::clearAccessSet(char mask) {
   }
 }
 
+unsigned HierAddressSpace::getNumPendingAccesses() const {
+  unsigned num = deviceMemory.readSet.size() + deviceMemory.writeSet.size();
+  for (unsigned k = 0; k < sharedMemories.size(); k++)
+    num += sharedMemories[k].readSet.size() + sharedMemories[k].writeSet.size();
+  return num;
+}
+
+static bool sameInstAccessSet(const InstAccessSet &a, const InstAccessSet &b) {
+  if (a.size() != b.size())
+    return false;
+  for (unsigned i = 0; i < a.size(); i++) {
+    if (a[i].bid != b[i].bid || a[i].tid != b[i].tid
+        || a[i].inst != b[i].inst || a[i].isBr != b[i].isBr)
+      return false;
+  }
+  return true;
+}
+
+bool HierAddressSpace::merge(const HierAddressSpace &b, klee::ref<Expr> inA,
+                             bool apply, unsigned &numSelects) {
+  // The divergence analysis reads the instruction traces of the threads,
+  // so both states must have executed the same instructions; the
+  // branch regions are only kept until the next barrier, and merging
+  // happens after one.
+  if (instAccessSets.size() != b.instAccessSets.size()
+      || bbAccessSets.size() != b.bbAccessSets.size()
+      || divRegionSets.size() != b.divRegionSets.size()
+      || sameInstVecSets != b.sameInstVecSets
+      || !branchDivRegionSets.empty() || !b.branchDivRegionSets.empty())
+    return false;
+  for (unsigned i = 0; i < instAccessSets.size(); i++) {
+    if (!sameInstAccessSet(instAccessSets[i], b.instAccessSets[i]))
+      return false;
+  }
+  for (unsigned i = 0; i < bbAccessSets.size(); i++) {
+    if (!bbAccessSets[i].empty() || !b.bbAccessSets[i].empty())
+      return false;
+  }
+  for (unsigned i = 0; i < divRegionSets.size(); i++) {
+    if (!divRegionSets[i].empty() || !b.divRegionSets[i].empty())
+      return false;
+  }
+  for (unsigned i = 0; i < warpsBranchDivRegionSets.size(); i++) {
+    if (!warpsBranchDivRegionSets[i].empty())
+      return false;
+  }
+  for (unsigned i = 0; i < b.warpsBranchDivRegionSets.size(); i++) {
+    if (!b.warpsBranchDivRegionSets[i].empty())
+      return false;
+  }
+
+  if (sharedMemories.size() != b.sharedMemories.size()
+      || localMemories.size() != b.localMemories.size())
+    return false;
+
+  if (!cpuMemory.merge(b.cpuMemory, inA, apply, numSelects)
+      || !deviceMemory.merge(b.deviceMemory, inA, apply, numSelects))
+    return false;
+  for (unsigned k = 0; k < sharedMemories.size(); k++) {
+    if (!sharedMemories[k].merge(b.sharedMemories[k], inA, apply, numSelects))
+      return false;
+  }
+  for (unsigned k = 0; k < localMemories.size(); k++) {
+    if (!localMemories[k].merge(b.localMemories[k], inA, apply, numSelects))
+      return false;
+  }
+  return true;
+}
+
 void HierAddressSpace::clearInstAccessSet(bool clearAll) {
   for (unsigned i = 0; i<instAccessSets.size(); i++) {
     if (clearAll)
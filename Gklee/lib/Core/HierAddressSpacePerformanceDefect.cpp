@@ -29,6 +29,55 @@ static void updateWarpDefVec(WarpDefVec &, MemoryAccessVec &,
 
 static void dumpTmpMemorySet(MemoryAccessVec &);
 
+// Batch the bank conflict queries asked by checkBankConflictCap1x/Cap2x 
+// for every pair of accesses within a (half) warp.
+static void prefetchBankConflictExprs(Executor &executor, ExecutionState &state, 
+                                      const MemoryAccessVec &bcRWSet, unsigned BankNum, 
+                                      bool isWrite, bool cap2x) {
+  if (executor.solver->batchWorkers < 2)
+    return;
+
+  std::vector< klee::ref<Expr> > exprs;
+  for (MemoryAccessVec::const_iterator ii = bcRWSet.begin(); ii != bcRWSet.end(); ii++) {
+    klee::ref<Expr> addr1 = ii->offset;
+    klee::ref<Expr> bankSize = ConstantExpr::create(BankNum * 4, addr1->getWidth());
+    klee::ref<Expr> wordSize = ConstantExpr::create(4, addr1->getWidth());
+    klee::ref<Expr> b1 = UDivExpr::create(URemExpr::create(addr1, bankSize), wordSize);
+    for (MemoryAccessVec::const_iterator jj = ii + 1; jj != bcRWSet.end(); jj++) {
+      klee::ref<Expr> addr2 = jj->offset;
+      klee::ref<Expr> b2 = UDivExpr::create(URemExpr::create(addr2, bankSize), wordSize);
+      if (cap2x) {
+        klee::ref<Expr> a1 = UDivExpr::create(addr1, wordSize);
+        klee::ref<Expr> a2 = UDivExpr::create(addr2, wordSize);
+        exprs.push_back(EqExpr::create(a1, a2));
+        exprs.push_back(AndExpr::create(NeExpr::create(a1, a2), EqExpr::create(b1, b2)));
+      } else if (isWrite) {
+        exprs.push_back(EqExpr::create(b1, b2));
+      } else {
+        exprs.push_back(EqExpr::create(addr1, addr2));
+        exprs.push_back(AndExpr::create(NeExpr::create(addr1, addr2), EqExpr::create(b1, b2)));
+      }
+    }
+  }
+  AddressSpaceUtil::prefetchQueries(executor, state, exprs);
+}
+
+// Batch the "same segment as the first access" queries, which are all the 
+// coalescing checkers ask when a warp is coalesced.
+static void prefetchSegmentExprs(Executor &executor, ExecutionState &state, 
+                                 const MemoryAccessVec &tmpRWSet, 
+                                 klee::ref<Expr> &segSizeExpr) {
+  if (executor.solver->batchWorkers < 2 || tmpRWSet.empty())
+    return;
+
+  std::vector< klee::ref<Expr> > exprs;
+  klee::ref<Expr> segNumExpr = UDivExpr::create(tmpRWSet[0].offset, segSizeExpr);
+  for (unsigned i = 1; i < tmpRWSet.size(); i++)
+    exprs.push_back(EqExpr::create(segNumExpr, 
+                                   UDivExpr::create(tmpRWSet[i].offset, segSizeExpr)));
+  AddressSpaceUtil::prefetchQueries(executor, state, exprs);
+}
+
 // return true if bank conflict exists...
 static bool checkReadBankConflictExprsCap1x(klee::ref<Expr> &addr1, klee::ref<Expr> &addr2, 
                                             Executor &executor, ExecutionState &state, 
@@ -166,28 +215,33 @@ static bool checkBankConflictCap1x(Executor &executor, ExecutionState &state,
                                         GPUConfig::warpsize/2);
 
     updateWarpDefVecConsider(bcWDVec, bcRWSet, cTidSets, isWrite);
-
-    for (MemoryAccessVec::const_iterator ii = bcRWSet.begin(); 
-         ii != bcRWSet.end(); ii++) {
-      klee::ref<Expr> addr1 =  ii->offset;
-      MemoryAccessVec::const_iterator jj = ii;
-      jj++;
-      for (; jj != bcRWSet.end(); jj++) {
-        klee::ref<Expr> addr2 = jj->offset;
-        klee::ref<Expr> bankSeq;
-        bool hasConflict = isWrite ?
-                        checkWriteBankConflictExprsCap1x(addr1, addr2, executor, state, GPUConfig::warpsize/2, bankSeq, bcCond, queryNum) :
-                        checkReadBankConflictExprsCap1x(addr1, addr2, executor, state, GPUConfig::warpsize/2, bankSeq, bcCond, queryNum);
-        if (hasConflict) {
-          dumpBankConflictCap1x(executor, state, bcCond, 
-                                *ii, *jj, isWrite, bankSeq);
-          hasBC = true;
-          break;
+    prefetchBankConflictExprs(executor, state, bcRWSet, GPUConfig::warpsize/2, 
+                              isWrite, false);
+
+    // Look again if queries that ran out of time got an answer on retry.
+    do {
+      for (MemoryAccessVec::const_iterator ii = bcRWSet.begin(); 
+           ii != bcRWSet.end(); ii++) {
+        klee::ref<Expr> addr1 =  ii->offset;
+        MemoryAccessVec::const_iterator jj = ii;
+        jj++;
+        for (; jj != bcRWSet.end(); jj++) {
+          klee::ref<Expr> addr2 = jj->offset;
+          klee::ref<Expr> bankSeq;
+          bool hasConflict = isWrite ?
+                          checkWriteBankConflictExprsCap1x(addr1, addr2, executor, state, GPUConfig::warpsize/2, bankSeq, bcCond, queryNum) :
+                          checkReadBankConflictExprsCap1x(addr1, addr2, executor, state, GPUConfig::warpsize/2, bankSeq, bcCond, queryNum);
+          if (hasConflict) {
+            dumpBankConflictCap1x(executor, state, bcCond, 
+                                  *ii, *jj, isWrite, bankSeq);
+            hasBC = true;
+            break;
+          }
         }
-      }
 
-      if (hasBC) break;
-    }
+        if (hasBC) break;
+      }
+    } while (!hasBC && executor.solver->retryAbandoned());
 
     if (hasBC) {
       updateWarpDefVec(bcWDVec, bcRWSet, cTidSets, 1, isWrite);
@@ -242,28 +296,33 @@ static bool checkBankConflictCap2x(Executor &executor, ExecutionState &state,
                       instAccessSets, divRegionSets, sameInstSets,
                       GPUConfig::warpsize);
     updateWarpDefVecConsider(bcWDVec, bcRWSet, cTidSets, isWrite);
+    prefetchBankConflictExprs(executor, state, bcRWSet, GPUConfig::warpsize, 
+                              isWrite, true);
     bool hasViolation = false;
 
-    for (MemoryAccessVec::const_iterator ii = bcRWSet.begin(); ii != bcRWSet.end(); ii++) {
-      klee::ref<Expr> addr1 = ii->offset;
-      MemoryAccessVec::const_iterator jj = ii;
-      jj++;
-      for (; jj != bcRWSet.end(); jj++) {
-        klee::ref<Expr> addr2 = jj->offset;
-        klee::ref<Expr> bankSeq;
-        bool hasConflict = checkBankConflictExprsCap2x(addr1, addr2, executor, state, 
-                                                       GPUConfig::warpsize, bankSeq, 
-                                                       bcCond, queryNum); 
-
-        if (hasConflict) {
-          dumpBankConflictCap2x(executor, state, bcCond, 
-                                *ii, *jj, isWrite, bankSeq);
-          hasViolation = true;
-          hasBC = true;
+    // Look again if queries that ran out of time got an answer on retry.
+    do {
+      for (MemoryAccessVec::const_iterator ii = bcRWSet.begin(); ii != bcRWSet.end(); ii++) {
+        klee::ref<Expr> addr1 = ii->offset;
+        MemoryAccessVec::const_iterator jj = ii;
+        jj++;
+        for (; jj != bcRWSet.end(); jj++) {
+          klee::ref<Expr> addr2 = jj->offset;
+          klee::ref<Expr> bankSeq;
+          bool hasConflict = checkBankConflictExprsCap2x(addr1, addr2, executor, state, 
+                                                         GPUConfig::warpsize, bankSeq, 
+                                                         bcCond, queryNum); 
+
+          if (hasConflict) {
+            dumpBankConflictCap2x(executor, state, bcCond, 
+                                  *ii, *jj, isWrite, bankSeq);
+            hasViolation = true;
+            hasBC = true;
+          }
         }
+        if (hasBC) break; 
       }
-      if (hasBC) break; 
-    }
+    } while (!hasBC && executor.solver->retryAbandoned());
 
     if (hasViolation) {
       updateWarpDefVec(bcWDVec, bcRWSet, cTidSets, 1, isWrite);
@@ -484,6 +543,24 @@ static bool checkMemoryCoalescingCap0Size(Executor &executor, ExecutionState &st
   unsigned segWarpNum = 0; // The number of different segments all threads in a half 
                            // warp will access 
 
+  if (executor.solver->batchWorkers > 1) {
+    std::vector< klee::ref<Expr> > exprs;
+    klee::ref<Expr> firstSegNumExpr = UDivExpr::create(tmpRWSet[0].offset, segSizeExpr);
+    klee::ref<Expr> wordSizeExpr = ConstantExpr::create(wordsize, baseAddr->getWidth());
+    klee::ref<Expr> threadNumExpr = ConstantExpr::create(threadNum, baseAddr->getWidth());
+    for (unsigned i = 0; i < tmpRWSet.size(); i++) {
+      if (i > 0)
+        exprs.push_back(EqExpr::create(firstSegNumExpr, 
+                                       UDivExpr::create(tmpRWSet[i].offset, segSizeExpr)));
+      klee::ref<Expr> remExpr = URemExpr::create(tmpRWSet[i].offset, segSizeExpr);  
+      klee::ref<Expr> tidExpr = ConstantExpr::create(cTidSets[tmpRWSet[i].tid].rTid, 
+                                                     baseAddr->getWidth());
+      exprs.push_back(EqExpr::create(URemExpr::create(tidExpr, threadNumExpr), 
+                                     UDivExpr::create(remExpr, wordSizeExpr)));
+    }
+    AddressSpaceUtil::prefetchQueries(executor, state, exprs);
+  }
+
   for (unsigned i = 0; i < tmpRWSet.size(); i++) {
     klee::ref<Expr> tmpSegNumExpr = UDivExpr::create(tmpRWSet[i].offset, segSizeExpr);
     if (segWarpNum == 0) {
@@ -536,6 +613,12 @@ static bool checkMemoryCoalescingCap0Size(Executor &executor, ExecutionState &st
       }
     }
   } 
+  // Look again if queries that ran out of time got an answer on retry.
+  if (!hasViolation && executor.solver->retryAbandoned())
+    return checkMemoryCoalescingCap0Size(executor, state, tmpRWSet, cTidSets, 
+                                         halfWarpNum, segSize, threadNum, 
+                                         wordsize, noMCCond, queryNum);
+
   // The memory coalescing fulfills...
   if (!hasViolation) {
     dumpMemoryCoalescingCap0Success(tmpRWSet, lbound, ubound, halfWarpNum, wordsize);
@@ -751,6 +834,7 @@ static bool checkMemoryCoalescingCap1(Executor &executor, ExecutionState &state,
     }
     klee::ref<Expr> baseAddr = tmpRWSet[0].mo->getBaseExpr();
     klee::ref<Expr> segSizeExpr = ConstantExpr::create(segSize, baseAddr->getWidth());    
+    prefetchSegmentExprs(executor, state, tmpRWSet, segSizeExpr);
     std::vector < klee::ref<Expr> > segNumExprVec;
     std::vector < klee::ref<Expr> > lboundVec;
     std::vector < klee::ref<Expr> > uboundVec; 
@@ -759,67 +843,75 @@ static bool checkMemoryCoalescingCap1(Executor &executor, ExecutionState &state,
     unsigned segWarpNum = 0; // The number of different segments all threads in a half 
                              // warp will access 
 
-    for (unsigned i = 0; i < tmpRWSet.size(); i++) {
-      // Ensure the access is in bound of the segment...
-      klee::ref<Expr> tmpSegNumExpr = UDivExpr::create(tmpRWSet[i].offset, segSizeExpr);
-
-      if (segWarpNum == 0) {
-        segWarpNum++;
-        segNumExprVec.push_back(tmpSegNumExpr);
-        lboundVec.push_back(tmpRWSet[i].offset);
-        uboundVec.push_back(tmpRWSet[i].offset);
-        threadNumVec.push_back(1);
-      } else {
-        unsigned diffNum = 0;
-        unsigned j = 0;
-        bool result = false;
-        bool success = false;
-
-        for (; j < segNumExprVec.size(); j++) {
-          klee::ref<Expr> cond = EqExpr::create(segNumExprVec[j], tmpSegNumExpr);
-          bool unknown = false;
-          success = AddressSpaceUtil::evaluateQueryMustBeTrue(executor, state, cond, result, unknown);
-          queryNum++;
-          if (success) {
-            if (!result) {
-              if (unknown) noMCCond = AndExpr::create(noMCCond, Expr::createIsZero(cond)); 
-              diffNum++; 
-            }
-            else break;
-          }
-        }
-        
-        if (diffNum == segNumExprVec.size()) {
-          hasViolation = true;
+    // Look again if queries that ran out of time got an answer on retry.
+    do {
+      segNumExprVec.clear();
+      lboundVec.clear();
+      uboundVec.clear();
+      threadNumVec.clear();
+      segWarpNum = 0;
+      for (unsigned i = 0; i < tmpRWSet.size(); i++) {
+        // Ensure the access is in bound of the segment...
+        klee::ref<Expr> tmpSegNumExpr = UDivExpr::create(tmpRWSet[i].offset, segSizeExpr);
+
+        if (segWarpNum == 0) {
+          segWarpNum++;
           segNumExprVec.push_back(tmpSegNumExpr);
           lboundVec.push_back(tmpRWSet[i].offset);
           uboundVec.push_back(tmpRWSet[i].offset);
           threadNumVec.push_back(1);
-          segWarpNum++;
-        }
-        else {
-          // update the lbound and ubound
-          bool unknown = false;
-          klee::ref<Expr> ucond = UgtExpr::create(tmpRWSet[i].offset, uboundVec[j]); 
-          success = AddressSpaceUtil::evaluateQueryMustBeTrue(executor, state, ucond, result, unknown);
-          queryNum++;
-          if (success) {
-            if (result)
-              uboundVec[j] = tmpRWSet[i].offset;
-          }
+        } else {
+          unsigned diffNum = 0;
+          unsigned j = 0;
+          bool result = false;
+          bool success = false;
 
-          klee::ref<Expr> lcond = UltExpr::create(tmpRWSet[i].offset, lboundVec[j]); 
-          success = AddressSpaceUtil::evaluateQueryMustBeTrue(executor, state, lcond, result, unknown);
-          queryNum++;
-          if (success) {
-            if (result)
-              lboundVec[j] = tmpRWSet[i].offset;
+          for (; j < segNumExprVec.size(); j++) {
+            klee::ref<Expr> cond = EqExpr::create(segNumExprVec[j], tmpSegNumExpr);
+            bool unknown = false;
+            success = AddressSpaceUtil::evaluateQueryMustBeTrue(executor, state, cond, result, unknown);
+            queryNum++;
+            if (success) {
+              if (!result) {
+                if (unknown) noMCCond = AndExpr::create(noMCCond, Expr::createIsZero(cond)); 
+                diffNum++; 
+              }
+              else break;
+            }
+          }
+        
+          if (diffNum == segNumExprVec.size()) {
+            hasViolation = true;
+            segNumExprVec.push_back(tmpSegNumExpr);
+            lboundVec.push_back(tmpRWSet[i].offset);
+            uboundVec.push_back(tmpRWSet[i].offset);
+            threadNumVec.push_back(1);
+            segWarpNum++;
           }
+          else {
+            // update the lbound and ubound
+            bool unknown = false;
+            klee::ref<Expr> ucond = UgtExpr::create(tmpRWSet[i].offset, uboundVec[j]); 
+            success = AddressSpaceUtil::evaluateQueryMustBeTrue(executor, state, ucond, result, unknown);
+            queryNum++;
+            if (success) {
+              if (result)
+                uboundVec[j] = tmpRWSet[i].offset;
+            }
+
+            klee::ref<Expr> lcond = UltExpr::create(tmpRWSet[i].offset, lboundVec[j]); 
+            success = AddressSpaceUtil::evaluateQueryMustBeTrue(executor, state, lcond, result, unknown);
+            queryNum++;
+            if (success) {
+              if (result)
+                lboundVec[j] = tmpRWSet[i].offset;
+            }
           
-          threadNumVec[j]++;
+            threadNumVec[j]++;
+          }
         }
       }
-    }
+    } while (executor.solver->retryAbandoned());
     // For the left threads...
     for (unsigned k = 0; k < segNumExprVec.size(); k++)
       dumpMemoryCoalescingCap1(executor, state, segSize, segSizeExpr, segNumExprVec[k], 
@@ -973,52 +1065,62 @@ static bool checkMemoryCoalescingCap2(Executor &executor, ExecutionState &state,
                                // warp will access 
 
       MemoryAccessVec &tmpReqSet = reqSets[k];
-      for (unsigned i = 0; i < tmpReqSet.size(); i++) {
-        // ensure the access is in bound of segment...
-        klee::ref<Expr> tmpSegNumExpr = UDivExpr::create(tmpReqSet[i].offset, segSizeExpr);
-
-        if (segWarpNum == 0) {
-          segWarpNum++;
-          segNumExprVec.push_back(tmpSegNumExpr);
-          lbound = MulExpr::create(segSizeExpr, tmpSegNumExpr); 
-          ubound = AddExpr::create(lbound, segSizeExpr); 
-          lboundVec.push_back(lbound);
-          uboundVec.push_back(ubound);
-          threadNumVec.push_back(1);
-        } else {
-          unsigned diffNum = 0;
-          bool result = false;
-          bool success = false;
-          unsigned j = 0;
-
-          for (; j < segNumExprVec.size(); j++) {
-            klee::ref<Expr> cond = EqExpr::create(segNumExprVec[j], tmpSegNumExpr);
-            bool unknown = false;
-            success = AddressSpaceUtil::evaluateQueryMustBeTrue(executor, state, cond, result, unknown);
-            queryNum++;
-            if (success) {
-              if (!result) {
-                if (unknown) noMCCond = AndExpr::create(noMCCond, Expr::createIsZero(cond));
-                diffNum++;
-              }
-              else break;
-            }
-          }
-
-          if (diffNum == segNumExprVec.size()) {
-            hasViolation = true;
+      prefetchSegmentExprs(executor, state, tmpReqSet, segSizeExpr);
+
+      // Look again if queries that ran out of time got an answer on retry.
+      do {
+        segNumExprVec.clear();
+        lboundVec.clear();
+        uboundVec.clear();
+        threadNumVec.clear();
+        segWarpNum = 0;
+        for (unsigned i = 0; i < tmpReqSet.size(); i++) {
+          // ensure the access is in bound of segment...
+          klee::ref<Expr> tmpSegNumExpr = UDivExpr::create(tmpReqSet[i].offset, segSizeExpr);
+
+          if (segWarpNum == 0) {
+            segWarpNum++;
             segNumExprVec.push_back(tmpSegNumExpr);
             lbound = MulExpr::create(segSizeExpr, tmpSegNumExpr); 
             ubound = AddExpr::create(lbound, segSizeExpr); 
             lboundVec.push_back(lbound);
             uboundVec.push_back(ubound);
             threadNumVec.push_back(1);
-            segWarpNum++;
           } else {
-            threadNumVec[j]++;
+            unsigned diffNum = 0;
+            bool result = false;
+            bool success = false;
+            unsigned j = 0;
+
+            for (; j < segNumExprVec.size(); j++) {
+              klee::ref<Expr> cond = EqExpr::create(segNumExprVec[j], tmpSegNumExpr);
+              bool unknown = false;
+              success = AddressSpaceUtil::evaluateQueryMustBeTrue(executor, state, cond, result, unknown);
+              queryNum++;
+              if (success) {
+                if (!result) {
+                  if (unknown) noMCCond = AndExpr::create(noMCCond, Expr::createIsZero(cond));
+                  diffNum++;
+                }
+                else break;
+              }
+            }
+
+            if (diffNum == segNumExprVec.size()) {
+              hasViolation = true;
+              segNumExprVec.push_back(tmpSegNumExpr);
+              lbound = MulExpr::create(segSizeExpr, tmpSegNumExpr); 
+              ubound = AddExpr::create(lbound, segSizeExpr); 
+              lboundVec.push_back(lbound);
+              uboundVec.push_back(ubound);
+              threadNumVec.push_back(1);
+              segWarpNum++;
+            } else {
+              threadNumVec[j]++;
+            }
           }
         }
-      }
+      } while (executor.solver->retryAbandoned());
 
       dumpMemoryCoalescingCap2Begin(warpNum, wordsize, k, reqNum);
       for (unsigned m = 0; m < segNumExprVec.size(); m++) {
@@ -128,6 +128,20 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   makeSymbolic();
 }
 
+ObjectState::ObjectState(const MemoryObject *mo, const UpdateList &_updates)
+  : copyOnWriteOwner(0),
+    refCount(0),
+    object(mo),
+    concreteStore(new uint8_t[mo->size]),
+    concreteMask(0),
+    flushMask(0),
+    knownSymbolics(0),
+    updates(_updates),
+    size(mo->size),
+    readOnly(false) {
+  mo->refCount++;
+}
+
 ObjectState::ObjectState(const ObjectState &os) 
   : copyOnWriteOwner(0),
     refCount(0),
@@ -185,6 +185,10 @@ private:
   friend class ObjectHolder;
   unsigned refCount;
 
+  friend class StateSpiller;
+  friend class StateFootprint;
+  friend class ConstantMemory;
+
   const MemoryObject *object;
 
   uint8_t *concreteStore;
@@ -214,6 +218,10 @@ public:
   /// contents.
   ObjectState(const MemoryObject *mo, const Array *array);
 
+  /// Create a new object state for the given memory object over the given
+  /// updates. Its contents are undefined, as with the first constructor.
+  ObjectState(const MemoryObject *mo, const UpdateList &updates);
+
   ObjectState(const ObjectState &os);
   ~ObjectState();
 
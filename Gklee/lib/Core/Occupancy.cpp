@@ -0,0 +1,453 @@
+//===-- Occupancy.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Occupancy.h"
+
+#include "klee/GPUConfig.h"
+
+#include "llvm/Constants.h"
+#include "llvm/DataLayout.h"
+#include "llvm/Function.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/Instructions.h"
+#include "llvm/Support/CFG.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+  cl::opt<unsigned>
+  SMMaxWarps("sm-max-warps",
+             cl::desc("Warps an SM holds at once, for the occupancy report "
+                      "(default=0, from -device-capability)"),
+             cl::init(0));
+
+  cl::opt<unsigned>
+  SMMaxBlocks("sm-max-blocks",
+              cl::desc("Blocks an SM holds at once, for the occupancy "
+                       "report (default=0, from -device-capability)"),
+              cl::init(0));
+
+  cl::opt<unsigned>
+  SMMaxBlockThreads("sm-max-block-threads",
+                    cl::desc("Threads a block may have, for the occupancy "
+                             "report (default=0, from -device-capability)"),
+                    cl::init(0));
+
+  cl::opt<unsigned>
+  SMRegisters("sm-registers",
+              cl::desc("32-bit registers of an SM, for the occupancy "
+                       "report (default=0, from -device-capability)"),
+              cl::init(0));
+
+  cl::opt<unsigned>
+  SMMaxThreadRegisters("sm-max-thread-registers",
+                       cl::desc("Registers a thread may have before the "
+                                "rest are spilled, for the occupancy report "
+                                "(default=0, from -device-capability)"),
+                       cl::init(0));
+
+  cl::opt<unsigned>
+  SMSharedMemory("sm-shared-memory",
+                 cl::desc("Bytes of shared memory of an SM, for the "
+                          "occupancy report (default=0, from "
+                          "-device-capability)"),
+                 cl::init(0));
+
+  cl::opt<unsigned>
+  OccupancyRegisters("occupancy-registers",
+                     cl::desc("Registers per thread of every kernel, as "
+                              "reported by ptxas -v, instead of estimating "
+                              "them from the IR (default=0)"),
+                     cl::init(0));
+}
+
+/***/
+
+const char *LaunchOccupancy::getLimitName(Limit limit) {
+  switch (limit) {
+  case Warps:
+    return "warps";
+  case Blocks:
+    return "blocks";
+  case Registers:
+    return "registers";
+  case SharedMemory:
+    return "shared memory";
+  case Grid:
+    return "grid size";
+  case BlockSize:
+    return "block size";
+  }
+  return "unknown";
+}
+
+/***/
+
+static uint64_t roundUp(uint64_t value, unsigned unit) {
+  return unit ? (value + unit - 1) / unit * unit : value;
+}
+
+OccupancyEstimator::OccupancyEstimator(const DataLayout &_dataLayout,
+                                       unsigned devCap)
+  : dataLayout(_dataLayout) {
+  if (devCap == 0) {
+    // 1.0 and 1.1
+    maxWarps = 24;
+    maxBlocks = 8;
+    maxBlockThreads = 512;
+    registers = 8192;
+    maxThreadRegisters = 124;
+    registerUnit = 256;
+    registersPerBlock = true;
+    sharedMemory = 16384;
+    sharedUnit = 512;
+  } else if (devCap == 1) {
+    // 1.2 and 1.3
+    maxWarps = 32;
+    maxBlocks = 8;
+    maxBlockThreads = 512;
+    registers = 16384;
+    maxThreadRegisters = 124;
+    registerUnit = 512;
+    registersPerBlock = true;
+    sharedMemory = 16384;
+    sharedUnit = 512;
+  } else {
+    // 2.x, with 48KB of shared memory and 16KB of L1.
+    maxWarps = 48;
+    maxBlocks = 8;
+    maxBlockThreads = 1024;
+    registers = 32768;
+    maxThreadRegisters = 63;
+    registerUnit = 64;
+    registersPerBlock = false;
+    sharedMemory = 49152;
+    sharedUnit = 128;
+  }
+
+  if (SMMaxWarps)
+    maxWarps = SMMaxWarps;
+  if (SMMaxBlocks)
+    maxBlocks = SMMaxBlocks;
+  if (SMMaxBlockThreads)
+    maxBlockThreads = SMMaxBlockThreads;
+  if (SMRegisters)
+    registers = SMRegisters;
+  if (SMMaxThreadRegisters)
+    maxThreadRegisters = SMMaxThreadRegisters;
+  if (SMSharedMemory)
+    sharedMemory = SMSharedMemory;
+}
+
+/***/
+
+namespace {
+  typedef std::set<const Value*> ValueSet;
+
+  /// The variables of a function which would live in registers, with
+  /// the registers each takes: the first class values its instructions
+  /// produce, and the scalar allocas only ever loaded and stored, which
+  /// the stores define and the loads use. Other allocas live in local
+  /// memory. Arguments are left out, as kernel parameters are read from
+  /// parameter memory.
+  class RegisterVariables {
+    const DataLayout &dataLayout;
+    std::set<const AllocaInst*> scalars;
+    std::map<const Value*, unsigned> sizes;
+
+    unsigned getRegisters(Type *type) const {
+      if (!type->isFirstClassType() || type->isLabelTy() ||
+          type->isMetadataTy())
+        return 0;
+      return (dataLayout.getTypeSizeInBits(type) + 31) / 32;
+    }
+
+    static bool isScalar(const AllocaInst *ai) {
+      if (ai->isArrayAllocation() ||
+          !ai->getAllocatedType()->isSingleValueType())
+        return false;
+      for (Value::const_use_iterator ui = ai->use_begin(),
+             ue = ai->use_end(); ui != ue; ++ui) {
+        if (const LoadInst *li = dyn_cast<LoadInst>(*ui)) {
+          if (li->isVolatile())
+            return false;
+        } else if (const StoreInst *si = dyn_cast<StoreInst>(*ui)) {
+          if (si->isVolatile() || si->getValueOperand() == ai)
+            return false;
+        } else {
+          return false;
+        }
+      }
+      return true;
+    }
+
+  public:
+    RegisterVariables(const DataLayout &_dataLayout, const Function *f)
+      : dataLayout(_dataLayout) {
+      for (Function::const_iterator bb = f->begin(), be = f->end();
+           bb != be; ++bb)
+        for (BasicBlock::const_iterator i = bb->begin(), ie = bb->end();
+             i != ie; ++i) {
+          if (const AllocaInst *ai = dyn_cast<AllocaInst>(i)) {
+            if (isScalar(ai)) {
+              scalars.insert(ai);
+              sizes[ai] = getRegisters(ai->getAllocatedType());
+            }
+          } else if (unsigned n = getRegisters(i->getType())) {
+            sizes[i] = n;
+          }
+        }
+    }
+
+    unsigned getSize(const Value *v) const {
+      std::map<const Value*, unsigned>::const_iterator it = sizes.find(v);
+      return it == sizes.end() ? 0 : it->second;
+    }
+
+    bool isVariable(const Value *v) const { return sizes.count(v); }
+
+    /// The variable \a i defines, if any.
+    const Value *getDef(const Instruction *i) const {
+      if (const StoreInst *si = dyn_cast<StoreInst>(i)) {
+        const AllocaInst *ai = dyn_cast<AllocaInst>(si->getPointerOperand());
+        return ai && scalars.count(ai) ? ai : 0;
+      }
+      return isVariable(i) ? i : 0;
+    }
+
+    /// The variables \a i reads; those of a phi node are read on the
+    /// incoming edges instead.
+    void getUses(const Instruction *i, std::vector<const Value*> &uses) const {
+      uses.clear();
+      if (isa<PHINode>(i))
+        return;
+      const StoreInst *si = dyn_cast<StoreInst>(i);
+      for (User::const_op_iterator oi = i->op_begin(), oe = i->op_end();
+           oi != oe; ++oi) {
+        const Value *v = *oi;
+        if (isVariable(v) && !(si && v == si->getPointerOperand()))
+          uses.push_back(v);
+      }
+    }
+  };
+}
+
+unsigned OccupancyEstimator::getRegisterPressure(const Function *f) {
+  std::map<const Function*, unsigned>::iterator it = registerPressure.find(f);
+  if (it != registerPressure.end())
+    return it->second;
+  // A recursive call adds nothing to what its caller already needs.
+  registerPressure[f] = 0;
+  if (f->isDeclaration())
+    return 0;
+
+  RegisterVariables vars(dataLayout, f);
+  std::vector<const Value*> uses;
+
+  // The upward exposed uses and the definitions of each block.
+  std::map<const BasicBlock*, ValueSet> blockUses, blockDefs;
+  for (Function::const_iterator bb = f->begin(), be = f->end();
+       bb != be; ++bb) {
+    ValueSet &bu = blockUses[bb], &bd = blockDefs[bb];
+    for (BasicBlock::const_iterator i = bb->begin(), ie = bb->end();
+         i != ie; ++i) {
+      vars.getUses(i, uses);
+      for (unsigned j = 0; j < uses.size(); j++)
+        if (!bd.count(uses[j]))
+          bu.insert(uses[j]);
+      if (const Value *def = vars.getDef(i))
+        bd.insert(def);
+    }
+  }
+
+  // Backward liveness, to a fixed point.
+  std::map<const BasicBlock*, ValueSet> liveIn, liveOut;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (Function::const_iterator bb = f->end(), be = f->begin();
+         bb != be;) {
+      --bb;
+      ValueSet out;
+      for (succ_const_iterator si = succ_begin(bb), se = succ_end(bb);
+           si != se; ++si) {
+        const ValueSet &in = liveIn[*si];
+        out.insert(in.begin(), in.end());
+        for (BasicBlock::const_iterator i = si->begin();
+             const PHINode *phi = dyn_cast<PHINode>(i); ++i) {
+          const Value *v = phi->getIncomingValueForBlock(bb);
+          if (vars.isVariable(v))
+            out.insert(v);
+        }
+      }
+      const ValueSet &bd = blockDefs[bb];
+      ValueSet in = blockUses[bb];
+      for (ValueSet::iterator vi = out.begin(), ve = out.end(); vi != ve; ++vi)
+        if (!bd.count(*vi))
+          in.insert(*vi);
+      if (in != liveIn[bb]) {
+        liveIn[bb].swap(in);
+        changed = true;
+      }
+      liveOut[bb].swap(out);
+    }
+  }
+
+  // Walk each block backwards from what is live out of it. An
+  // instruction needs the registers live across it, those of its result
+  // even if it is never used, and those of the function it calls.
+  unsigned pressure = 0;
+  for (Function::const_iterator bb = f->begin(), be = f->end();
+       bb != be; ++bb) {
+    ValueSet live = liveOut[bb];
+    unsigned liveSize = 0;
+    for (ValueSet::iterator vi = live.begin(), ve = live.end(); vi != ve; ++vi)
+      liveSize += vars.getSize(*vi);
+
+    for (BasicBlock::const_iterator i = bb->end(), ie = bb->begin();
+         i != ie;) {
+      --i;
+      if (isa<PHINode>(i))
+        break;
+      const Value *def = vars.getDef(i);
+      if (def && live.erase(def))
+        liveSize -= vars.getSize(def);
+      unsigned needed = liveSize + (def ? vars.getSize(def) : 0);
+      if (const CallInst *ci = dyn_cast<CallInst>(i))
+        if (const Function *callee = ci->getCalledFunction())
+          needed = std::max(needed,
+                            liveSize + getRegisterPressure(callee));
+      pressure = std::max(pressure, needed);
+
+      vars.getUses(i, uses);
+      for (unsigned j = 0; j < uses.size(); j++)
+        if (live.insert(uses[j]).second)
+          liveSize += vars.getSize(uses[j]);
+    }
+    pressure = std::max(pressure, liveSize);
+  }
+
+  registerPressure[f] = pressure;
+  return pressure;
+}
+
+static void collectSharedGlobals(const Value *v,
+                                 std::set<const GlobalVariable*> &globals) {
+  if (const GlobalVariable *gv = dyn_cast<GlobalVariable>(v)) {
+    if (gv->hasSection() && gv->getSection() == "__shared__")
+      globals.insert(gv);
+  } else if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(v)) {
+    for (User::const_op_iterator oi = ce->op_begin(), oe = ce->op_end();
+         oi != oe; ++oi)
+      collectSharedGlobals(*oi, globals);
+  }
+}
+
+uint64_t OccupancyEstimator::getStaticShared(const Function *kernel) {
+  std::map<const Function*, uint64_t>::iterator it = staticShared.find(kernel);
+  if (it != staticShared.end())
+    return it->second;
+
+  // The __shared__ variables of the kernel and the functions it calls,
+  // each counted once.
+  std::set<const GlobalVariable*> globals;
+  std::set<const Function*> visited;
+  std::vector<const Function*> stack(1, kernel);
+  visited.insert(kernel);
+  while (!stack.empty()) {
+    const Function *f = stack.back();
+    stack.pop_back();
+    for (Function::const_iterator bb = f->begin(), be = f->end();
+         bb != be; ++bb)
+      for (BasicBlock::const_iterator i = bb->begin(), ie = bb->end();
+           i != ie; ++i)
+        for (User::const_op_iterator oi = i->op_begin(), oe = i->op_end();
+             oi != oe; ++oi) {
+          const Function *callee = dyn_cast<Function>(*oi);
+          if (callee && !callee->isDeclaration() &&
+              visited.insert(callee).second)
+            stack.push_back(callee);
+          else
+            collectSharedGlobals(*oi, globals);
+        }
+  }
+
+  uint64_t size = 0;
+  for (std::set<const GlobalVariable*>::iterator gi = globals.begin(),
+         ge = globals.end(); gi != ge; ++gi)
+    size += dataLayout.getTypeAllocSize((*gi)->getType()->getElementType());
+  staticShared[kernel] = size;
+  return size;
+}
+
+LaunchOccupancy OccupancyEstimator::estimate(const Function *kernel,
+                                             const InstructionInfo *info,
+                                             unsigned numBlocks,
+                                             unsigned blockSize,
+                                             uint64_t dynamicShared) {
+  LaunchOccupancy o;
+  o.kernel = kernel->getName().str();
+  o.info = info;
+  o.numBlocks = numBlocks;
+  o.blockSize = blockSize;
+  o.staticShared = getStaticShared(kernel);
+  o.dynamicShared = dynamicShared;
+  o.maxWarpsPerSM = maxWarps;
+
+  unsigned needed = OccupancyRegisters ? (unsigned) OccupancyRegisters
+                                       : getRegisterPressure(kernel);
+  o.registersPerThread = std::max(1u, std::min(needed, maxThreadRegisters));
+  o.spilledRegisters = needed - std::min(needed, maxThreadRegisters);
+
+  unsigned warpSize = GPUConfig::warpsize;
+  unsigned warpsPerBlock = (std::max(blockSize, 1u) + warpSize - 1) / warpSize;
+  unsigned byRegisters;
+  if (registersPerBlock) {
+    uint64_t perBlock = roundUp(roundUp(warpsPerBlock, 2) * warpSize
+                                * o.registersPerThread, registerUnit);
+    byRegisters = registers / perBlock;
+  } else {
+    uint64_t perWarp = roundUp(warpSize * o.registersPerThread,
+                               registerUnit);
+    byRegisters = registers / perWarp / warpsPerBlock;
+  }
+  uint64_t shared = roundUp(o.staticShared + dynamicShared, sharedUnit);
+
+  // Ties go to the first limit, so a full SM is put down to its warps.
+  o.blocksPerSM = maxWarps / warpsPerBlock;
+  o.limit = LaunchOccupancy::Warps;
+  if (maxBlocks < o.blocksPerSM) {
+    o.blocksPerSM = maxBlocks;
+    o.limit = LaunchOccupancy::Blocks;
+  }
+  if (byRegisters < o.blocksPerSM) {
+    o.blocksPerSM = byRegisters;
+    o.limit = LaunchOccupancy::Registers;
+  }
+  if (shared && sharedMemory / shared < o.blocksPerSM) {
+    o.blocksPerSM = sharedMemory / shared;
+    o.limit = LaunchOccupancy::SharedMemory;
+  }
+  if (numBlocks < o.blocksPerSM) {
+    o.blocksPerSM = numBlocks;
+    o.limit = LaunchOccupancy::Grid;
+  }
+  if (blockSize > maxBlockThreads) {
+    o.blocksPerSM = 0;
+    o.limit = LaunchOccupancy::BlockSize;
+  }
+  o.warpsPerSM = o.blocksPerSM * warpsPerBlock;
+  return o;
+}
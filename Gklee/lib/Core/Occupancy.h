@@ -0,0 +1,106 @@
+//===-- Occupancy.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_OCCUPANCY_H
+#define KLEE_OCCUPANCY_H
+
+#include <map>
+#include <string>
+
+#include <stdint.h>
+
+namespace llvm {
+  class DataLayout;
+  class Function;
+}
+
+namespace klee {
+  struct InstructionInfo;
+
+  /// LaunchOccupancy - How many warps of one kernel launch a streaming
+  /// multiprocessor (SM) could hold at once, and the resource which keeps
+  /// it from holding more.
+  struct LaunchOccupancy {
+    enum Limit {
+      /// The SM has no warp slots left.
+      Warps,
+      /// The SM has no block slots left.
+      Blocks,
+      Registers,
+      SharedMemory,
+      /// The grid has fewer blocks than the SM could hold.
+      Grid,
+      /// A block has more threads than a launch allows.
+      BlockSize
+    };
+
+    std::string kernel;
+    /// The host call which launched the kernel.
+    const InstructionInfo *info;
+    unsigned numBlocks, blockSize;
+    /// Estimated from the kernel's live ranges unless given with
+    /// -occupancy-registers. Registers beyond what a thread may have
+    /// are spilled to local memory.
+    unsigned registersPerThread, spilledRegisters;
+    /// Per block, in bytes: the __shared__ variables the kernel uses,
+    /// and the extern __shared__ size given at the launch.
+    uint64_t staticShared, dynamicShared;
+    unsigned blocksPerSM, warpsPerSM, maxWarpsPerSM;
+    Limit limit;
+
+    /// The launch cannot run at all: a block does not fit on an SM.
+    bool fails() const { return blocksPerSM == 0; }
+    unsigned getOccupancy() const {
+      return maxWarpsPerSM ? warpsPerSM * 100 / maxWarpsPerSM : 0;
+    }
+
+    static const char *getLimitName(Limit limit);
+  };
+
+  /// OccupancyEstimator - Works out the theoretical occupancy of kernel
+  /// launches for an SM with the limits of -device-capability, each of
+  /// which can be overridden with the -sm-* options.
+  ///
+  /// The registers a thread needs are taken to be the most values the
+  /// kernel's IR keeps live at once, counting scalar locals which are
+  /// only loaded and stored as values, as register allocation would
+  /// leave them, and adding what a called function needs to what is live
+  /// across the call.
+  class OccupancyEstimator {
+    const llvm::DataLayout &dataLayout;
+
+    unsigned maxWarps, maxBlocks, maxBlockThreads;
+    unsigned registers, maxThreadRegisters;
+    /// Registers are handed out in units of registerUnit, to each warp or,
+    /// if registersPerBlock, to each block rounded to a pair of warps.
+    unsigned registerUnit;
+    bool registersPerBlock;
+    unsigned sharedMemory, sharedUnit;
+
+    std::map<const llvm::Function*, unsigned> registerPressure;
+    std::map<const llvm::Function*, uint64_t> staticShared;
+
+    unsigned getRegisterPressure(const llvm::Function *f);
+    uint64_t getStaticShared(const llvm::Function *kernel);
+
+  public:
+    OccupancyEstimator(const llvm::DataLayout &dataLayout, unsigned devCap);
+
+    LaunchOccupancy estimate(const llvm::Function *kernel,
+                             const InstructionInfo *info,
+                             unsigned numBlocks, unsigned blockSize,
+                             uint64_t dynamicShared);
+
+    unsigned getMaxBlockThreads() const { return maxBlockThreads; }
+    unsigned getRegisters() const { return registers; }
+    unsigned getSharedMemory() const { return sharedMemory; }
+  };
+}
+
+#endif
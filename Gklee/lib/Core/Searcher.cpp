@@ -208,6 +208,105 @@ bool WeightedRandomSearcher::empty() {
 
 ///
 
+BarrierAwareSearcher::BarrierAwareSearcher(Executor &_executor)
+  : executor(_executor),
+    nextSeq(0) {
+}
+
+double BarrierAwareSearcher::getPriority(ExecutionState *es) {
+  unsigned kernelNum = es->getKernelNum();
+  // Among otherwise equal states, favour those further into the program,
+  // whose kernels are less likely to have been explored.
+  double priority = 1. - 1. / (1 + kernelNum);
+
+  if (!es->tinfo.is_GPU_mode || !executor.bc_cov_monitor.hasCovInfo(kernelNum))
+    return priority;
+  priority += 2;
+
+  // The more accesses wait for the checks, the sooner they should run;
+  // the bonus stays below that of covering an instruction for the thread.
+  if (unsigned pending = es->addressSpace.getNumPendingAccesses())
+    priority += 2 + 2. * pending / (pending + 16);
+
+  BICovInfo &covInfo = executor.bc_cov_monitor.getCovInfo(kernelNum);
+  unsigned tid = es->tinfo.get_cur_tid();
+  unsigned BI_index = es->tinfo.getNumBars(tid);
+  if (BI_index >= covInfo.infos.size()) {
+    // nobody has reached this barrier interval yet
+    return priority + 24;
+  }
+
+  CovInfo &info = covInfo.getCurInfo(BI_index);
+  llvm::Instruction *inst = es->getPC()->inst;
+  if (!info.coveredInsts.count(inst))
+    priority += 16;
+  if (tid < info.visitedInsts.size() && !info.visitedInsts[tid].count(inst))
+    priority += 8;
+  return priority;
+}
+
+void BarrierAwareSearcher::insert(ExecutionState *es, unsigned seq) {
+  priority_ty p(getPriority(es), seq);
+  priorities[es] = p;
+  queue.insert(std::make_pair(p, es));
+}
+
+unsigned BarrierAwareSearcher::remove(ExecutionState *es) {
+  std::map<ExecutionState*, priority_ty>::iterator it = priorities.find(es);
+  assert(it != priorities.end() && "invalid state removed");
+  unsigned seq = it->second.second;
+  queue.erase(std::make_pair(it->second, es));
+  priorities.erase(it);
+  return seq;
+}
+
+ExecutionState &BarrierAwareSearcher::selectState() {
+  return *queue.rbegin()->second;
+}
+
+void BarrierAwareSearcher::rerankKernel(unsigned kernelNum) {
+  std::vector<ExecutionState*> affected;
+  for (std::map<ExecutionState*, priority_ty>::iterator
+         it = priorities.begin(), ie = priorities.end(); it != ie; ++it)
+    if (it->first->getKernelNum() == kernelNum)
+      affected.push_back(it->first);
+  for (unsigned i = 0; i < affected.size(); i++)
+    insert(affected[i], remove(affected[i]));
+}
+
+void BarrierAwareSearcher::update(ExecutionState *current,
+                                  const std::set<ExecutionState*> &addedStates,
+                                  const std::set<ExecutionState*> &removedStates) {
+  // The current state moved, so its priority may have changed.
+  if (current && !removedStates.count(current) && priorities.count(current)) {
+    insert(current, remove(current));
+
+    // Once a state's checks at a barrier complete, the next interval
+    // counts as reached, and its coverage starts over, for every state of
+    // the kernel.
+    unsigned kernelNum = current->getKernelNum();
+    if (executor.bc_cov_monitor.hasCovInfo(kernelNum)) {
+      BICovInfo &covInfo = executor.bc_cov_monitor.getCovInfo(kernelNum);
+      unsigned num = covInfo.infos.size();
+      unsigned &known = numIntervals[kernelNum];
+      if (num != known) {
+        known = num;
+        rerankKernel(kernelNum);
+      }
+    }
+  }
+
+  for (std::set<ExecutionState*>::const_iterator it = addedStates.begin(),
+         ie = addedStates.end(); it != ie; ++it)
+    insert(*it, nextSeq++);
+
+  for (std::set<ExecutionState*>::const_iterator it = removedStates.begin(),
+         ie = removedStates.end(); it != ie; ++it)
+    remove(*it);
+}
+
+///
+
 RandomPathSearcher::RandomPathSearcher(Executor &_executor)
   : executor(_executor) {
 }
@@ -260,7 +359,29 @@ BumpMergingSearcher::~BumpMergingSearcher() {
 
 ///
 
+// Besides calls to klee_merge, states merge where all threads have just
+// passed the same __syncthreads barrier; the merge point is then the next
+// instruction of the first thread.
+static Instruction *getBarrierMergePoint(ExecutionState &es) {
+  if (es.atBarrierMergePoint())
+    return es.getPC()->inst;
+  return 0;
+}
+
+// Step a state past its merge point: over the klee_merge call, or past the
+// barrier, so that it is not parked there again.
+static void leaveMergePoint(ExecutionState &es) {
+  if (es.atBarrierMergePoint())
+    es.barrierMergePoint = std::make_pair(es.kernelNum,
+                                          (unsigned) es.tinfo.numBars[0].first.size());
+  else
+    es.incPC();
+}
+
 Instruction *BumpMergingSearcher::getMergePoint(ExecutionState &es) {  
+  if (Instruction *i = getBarrierMergePoint(es))
+    return i;
+
   if (mergeFunction) {
     Instruction *i = es.getPC()->inst;
 
@@ -282,7 +403,7 @@ entry:
       statesAtMerge.begin();
     ExecutionState *es = it->second;
     statesAtMerge.erase(it);
-    es->incPC();
+    leaveMergePoint(*es);
 
     baseSearcher->addState(es);
   }
@@ -306,7 +427,7 @@ entry:
         executor.terminateState(es);
       } else {
         it->second = &es; // the bump
-        mergeWith->incPC();
+        leaveMergePoint(*mergeWith);
 
         baseSearcher->addState(mergeWith);
       }
@@ -339,6 +460,9 @@ MergingSearcher::~MergingSearcher() {
 ///
 
 Instruction *MergingSearcher::getMergePoint(ExecutionState &es) {
+  if (Instruction *i = getBarrierMergePoint(es))
+    return i;
+
   if (mergeFunction) {
     Instruction *i = es.getPC()->inst;
 
@@ -421,7 +545,7 @@ ExecutionState &MergingSearcher::selectState() {
 
       // step past merge and toss base back in pool
       statesAtMerge.erase(statesAtMerge.find(base));
-      base->incPC();
+      leaveMergePoint(*base);
       baseSearcher->addState(base);
     }  
   }
@@ -138,6 +138,40 @@ namespace klee {
     }
   };
 
+  /// BarrierAwareSearcher - Prefer GPU states which are about to cover
+  /// something new in their barrier interval, then those with the most
+  /// accesses waiting for the defect checks at the next barrier, then
+  /// states in kernels over host-side states. Ties go to the newest state.
+  class BarrierAwareSearcher : public Searcher {
+    typedef std::pair<double, unsigned> priority_ty;
+
+    Executor &executor;
+    std::set< std::pair<priority_ty, ExecutionState*> > queue;
+    std::map<ExecutionState*, priority_ty> priorities;
+    unsigned nextSeq;
+    /// The barrier intervals each kernel had reached when its states were
+    /// last ranked.
+    std::map<unsigned, unsigned> numIntervals;
+
+    double getPriority(ExecutionState*);
+    void insert(ExecutionState*, unsigned seq);
+    unsigned remove(ExecutionState*);
+    /// Rank again every state in kernel \a kernelNum.
+    void rerankKernel(unsigned kernelNum);
+
+  public:
+    BarrierAwareSearcher(Executor &executor);
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::set<ExecutionState*> &addedStates,
+                const std::set<ExecutionState*> &removedStates);
+    bool empty() { return queue.empty(); }
+    void printName(std::ostream &os) {
+      os << "BarrierAwareSearcher\n";
+    }
+  };
+
   class RandomPathSearcher : public Searcher {
     Executor &executor;
 
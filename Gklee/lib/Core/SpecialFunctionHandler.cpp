@@ -20,6 +20,7 @@
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/KModule.h"
 
+#include "ConstantMemory.h"
 #include "Executor.h"
 #include "CUDA.h"
 
@@ -35,6 +36,7 @@
 #endif
 
 #include <errno.h>
+#include <string.h>
 
 using namespace llvm;
 using namespace klee;
@@ -43,6 +45,7 @@ using namespace klee;
 namespace runtime {
   extern cl::opt<bool> UseSymbolicConfig;
   extern cl::opt<bool> Emacs;
+  extern cl::opt<bool> OutputTimeline;
 }
 
 using namespace runtime;
@@ -134,6 +137,14 @@ HandlerInfo handlerInfo[] = {
   add("__clear_device", handleClearDevice, false),
   add("__set_host", handleSetHost, false),
   add("__clear_host", handleClearHost, false),
+  add("__timeline_copy", handleTimelineCopy, false),
+  add("__timeline_memset", handleTimelineMemset, false),
+  add("__timeline_device_sync", handleTimelineDeviceSync, false),
+  add("__timeline_stream_sync", handleTimelineStreamSync, false),
+  add("__timeline_event_record", handleTimelineEventRecord, false),
+  add("__timeline_event_sync", handleTimelineEventSync, false),
+  add("__timeline_stream_wait_event", handleTimelineStreamWaitEvent, false),
+  add("__timeline_elapsed_time", handleTimelineElapsedTime, true),
 
 #undef addDNR
 #undef add  
@@ -731,6 +742,8 @@ void SpecialFunctionHandler::handleMakeSymbolic(ExecutionState &state,
     const ObjectState *old = it->first.second;
     ExecutionState *s = it->second;
     
+    if (old->readOnly && !s->tinfo.is_GPU_mode)
+      old = executor.constantMemory->thaw(*s, mo, old);
     if (old->readOnly) {
       executor.terminateStateOnError(*s,
                                      "cannot make readonly object symbolic", 
@@ -854,9 +867,17 @@ void SpecialFunctionHandler::handleSetCUDAConfiguration(ExecutionState &state,
     state.reconfigGPU();
   }
 
-  // Handle the other arguments ...
+  // Handle the other arguments: a launch without an extern __shared__
+  // size has none, whatever the previous launch asked for ...
   if (arguments.size() > 4)
     state.maxKernelSharedSize = dyn_cast<ConstantExpr>(arguments[4])->getZExtValue();   
+  else
+    state.maxKernelSharedSize = 0;
+
+  // ... and the stream, when the launch names one
+  if (OutputTimeline && arguments.size() > 5)
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(arguments[5]))
+      executor.getTimeline(state)->configureLaunch(CE->getZExtValue());
 
   state.tinfo.kernel_call = true;
   // clear address sets
@@ -887,3 +908,164 @@ void SpecialFunctionHandler::handleClearHost(ExecutionState &state,
                                              std::vector<klee::ref<Expr> > &arguments) {
   state.deviceSet = 0;
 }
+
+/***/
+
+/// The value of \a e if it is concrete, or \a otherwise. The timeline
+/// is only a model, so it does not constrain the path.
+static uint64_t getTimelineValue(klee::ref<Expr> e, uint64_t otherwise) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e))
+    return CE->getZExtValue();
+  return otherwise;
+}
+
+/// The timeline hooks are called by the runtime library; place what they
+/// record at the program's call into it.
+static const InstructionInfo *getTimelineCallSite(ExecutionState &state,
+                                                  KInstruction *target) {
+  KInstIterator caller = state.getCurStack().back().caller;
+  return caller ? caller->info : target->info;
+}
+
+static bool isDeviceAddress(ExecutionState &state, klee::ref<Expr> address) {
+  ObjectPair op;
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(address);
+  return CE && state.addressSpace.resolveOne(CE, op, GPUConfig::DEVICE);
+}
+
+/// The memory [address, address + size), or all of it if the address is
+/// not known.
+static StreamTimeline::Range getTimelineRange(klee::ref<Expr> address,
+                                              uint64_t size) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(address))
+    return StreamTimeline::Range(CE->getZExtValue(),
+                                 CE->getZExtValue() + size);
+  return StreamTimeline::Range(0, ~0ULL);
+}
+
+void SpecialFunctionHandler::handleTimelineCopy(ExecutionState &state,
+                                                KInstruction *target,
+                                                std::vector<klee::ref<Expr> > &arguments) {
+  assert(arguments.size() == 6 && "invalid number of arguments to __timeline_copy");
+  if (!OutputTimeline)
+    return;
+
+  uint64_t count = getTimelineValue(arguments[2], 0);
+  // cudaMemcpyHostToHost, HostToDevice, DeviceToHost, DeviceToDevice and
+  // Default, which leaves it to the addresses.
+  uint64_t kind = getTimelineValue(arguments[3], 0);
+  if (kind == 4)
+    kind = (isDeviceAddress(state, arguments[0]) ? 1 : 0)
+      + (isDeviceAddress(state, arguments[1]) ? 2 : 0);
+  // Host to host copies do not involve the device.
+  if (kind == 0 || kind > 3)
+    return;
+
+  static const StreamTimeline::Kind kinds[] = {
+    StreamTimeline::CopyOnDevice, StreamTimeline::CopyToDevice,
+    StreamTimeline::CopyToHost, StreamTimeline::CopyOnDevice
+  };
+  static const char *directions[] = { "", " HtoD", " DtoH", " DtoD" };
+  bool async = getTimelineValue(arguments[5], 0);
+  std::string name = std::string(async ? "cudaMemcpyAsync" : "cudaMemcpy")
+    + directions[kind];
+
+  std::vector<StreamTimeline::Range> memory;
+  memory.push_back(getTimelineRange(arguments[0], count));
+  memory.push_back(getTimelineRange(arguments[1], count));
+  StreamTimeline *timeline = executor.getTimeline(state);
+  int index = timeline->copy(kinds[kind], name,
+                             getTimelineCallSite(state, target),
+                             getTimelineValue(arguments[4], 0), count,
+                             memory, !async);
+  executor.reportTimelineOperation(*timeline, index);
+}
+
+void SpecialFunctionHandler::handleTimelineMemset(ExecutionState &state,
+                                                  KInstruction *target,
+                                                  std::vector<klee::ref<Expr> > &arguments) {
+  assert(arguments.size() == 4 && "invalid number of arguments to __timeline_memset");
+  if (!OutputTimeline)
+    return;
+
+  uint64_t count = getTimelineValue(arguments[1], 0);
+  bool async = getTimelineValue(arguments[3], 0);
+  std::vector<StreamTimeline::Range> memory;
+  memory.push_back(getTimelineRange(arguments[0], count));
+  StreamTimeline *timeline = executor.getTimeline(state);
+  int index = timeline->copy(StreamTimeline::Memset,
+                             async ? "cudaMemsetAsync" : "cudaMemset",
+                             getTimelineCallSite(state, target),
+                             getTimelineValue(arguments[2], 0), count,
+                             memory, !async);
+  executor.reportTimelineOperation(*timeline, index);
+}
+
+void SpecialFunctionHandler::handleTimelineDeviceSync(ExecutionState &state,
+                                                      KInstruction *target,
+                                                      std::vector<klee::ref<Expr> > &arguments) {
+  if (!OutputTimeline)
+    return;
+
+  StreamTimeline *timeline = executor.getTimeline(state);
+  int index =
+    timeline->synchronizeDevice(getTimelineCallSite(state, target));
+  executor.reportTimelineOperation(*timeline, index);
+}
+
+void SpecialFunctionHandler::handleTimelineStreamSync(ExecutionState &state,
+                                                      KInstruction *target,
+                                                      std::vector<klee::ref<Expr> > &arguments) {
+  assert(arguments.size() == 1 && "invalid number of arguments to __timeline_stream_sync");
+  if (!OutputTimeline)
+    return;
+
+  executor.getTimeline(state)->synchronizeStream(
+    getTimelineCallSite(state, target), getTimelineValue(arguments[0], 0));
+}
+
+void SpecialFunctionHandler::handleTimelineEventRecord(ExecutionState &state,
+                                                       KInstruction *target,
+                                                       std::vector<klee::ref<Expr> > &arguments) {
+  assert(arguments.size() == 2 && "invalid number of arguments to __timeline_event_record");
+  if (!OutputTimeline)
+    return;
+
+  executor.getTimeline(state)->recordEvent(getTimelineValue(arguments[0], 0),
+                                           getTimelineValue(arguments[1], 0));
+}
+
+void SpecialFunctionHandler::handleTimelineEventSync(ExecutionState &state,
+                                                     KInstruction *target,
+                                                     std::vector<klee::ref<Expr> > &arguments) {
+  assert(arguments.size() == 1 && "invalid number of arguments to __timeline_event_sync");
+  if (!OutputTimeline)
+    return;
+
+  executor.getTimeline(state)->synchronizeEvent(
+    getTimelineCallSite(state, target), getTimelineValue(arguments[0], 0));
+}
+
+void SpecialFunctionHandler::handleTimelineStreamWaitEvent(ExecutionState &state,
+                                                           KInstruction *target,
+                                                           std::vector<klee::ref<Expr> > &arguments) {
+  assert(arguments.size() == 2 && "invalid number of arguments to __timeline_stream_wait_event");
+  if (!OutputTimeline)
+    return;
+
+  executor.getTimeline(state)->waitEvent(getTimelineValue(arguments[0], 0),
+                                         getTimelineValue(arguments[1], 0));
+}
+
+void SpecialFunctionHandler::handleTimelineElapsedTime(ExecutionState &state,
+                                                       KInstruction *target,
+                                                       std::vector<klee::ref<Expr> > &arguments) {
+  assert(arguments.size() == 2 && "invalid number of arguments to __timeline_elapsed_time");
+  float ms = 0;
+  if (!state.timeline.isNull())
+    ms = state.timeline->getElapsedTime(getTimelineValue(arguments[0], 0),
+                                        getTimelineValue(arguments[1], 0));
+  uint32_t bits;
+  memcpy(&bits, &ms, sizeof bits);
+  executor.bindLocal(target, state, ConstantExpr::create(bits, Expr::Int32));
+}
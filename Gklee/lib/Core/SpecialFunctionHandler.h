@@ -109,6 +109,15 @@ namespace klee {
     HANDLER(handleSetHost);
     HANDLER(handleClearHost);
 
+    HANDLER(handleTimelineCopy);
+    HANDLER(handleTimelineMemset);
+    HANDLER(handleTimelineDeviceSync);
+    HANDLER(handleTimelineStreamSync);
+    HANDLER(handleTimelineEventRecord);
+    HANDLER(handleTimelineEventSync);
+    HANDLER(handleTimelineStreamWaitEvent);
+    HANDLER(handleTimelineElapsedTime);
+
 #undef HANDLER
   };
 } // End klee namespace
@@ -0,0 +1,211 @@
+//===-- StateFootprint.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StateFootprint.h"
+
+#include "AddressSpace.h"
+#include "Memory.h"
+#include "ParametricTree.h"
+
+#include "klee/ExecutionState.h"
+#include "klee/Expr.h"
+#include "klee/Internal/Module/Cell.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <vector>
+
+using namespace klee;
+
+/***/
+
+static uint64_t getBitArrayBytes(unsigned size) {
+  return sizeof(BitArray) + ((size + 31) / 32) * sizeof(uint32_t);
+}
+
+static uint64_t getAccessBytes(const MemoryAccessVec &accesses) {
+  // Each access holds a private copy of its memory object.
+  return accesses.size() * (sizeof(MemoryAccess) + sizeof(MemoryObject));
+}
+
+static uint64_t getAccessBytes(const std::vector<MemoryAccessVec> &sets) {
+  uint64_t bytes = 0;
+  for (unsigned i = 0; i < sets.size(); i++)
+    bytes += getAccessBytes(sets[i]);
+  return bytes;
+}
+
+/// Count the nodes of the DAG under \a e not already in \a visited.
+static uint64_t getExprBytes(const klee::ref<Expr> &e,
+                             ExprHashSet &visited) {
+  uint64_t bytes = 0;
+  std::vector< klee::ref<Expr> > stack;
+  stack.push_back(e);
+  while (!stack.empty()) {
+    klee::ref<Expr> cur = stack.back();
+    stack.pop_back();
+    if (!visited.insert(cur).second)
+      continue;
+    unsigned numKids = cur->getNumKids();
+    bytes += sizeof(Expr) + numKids * sizeof(klee::ref<Expr>);
+    for (unsigned i = 0; i < numKids; i++)
+      stack.push_back(cur->getKid(i));
+  }
+  return bytes;
+}
+
+/***/
+
+struct StateFootprint::Counted {
+  ExprHashSet exprs;
+  std::set<const UpdateNode*> updates;
+};
+
+uint64_t StateFootprint::total() const {
+  uint64_t sum = 0;
+  for (unsigned i = 0; i < NumKinds; i++)
+    sum += bytes[i];
+  return sum;
+}
+
+const char *StateFootprint::getName(Kind kind) {
+  switch (kind) {
+  case ObjectStates: return "object states";
+  case Exprs:        return "expressions";
+  case Stacks:       return "stacks";
+  case AccessSets:   return "access sets";
+  case ParaTrees:    return "para trees";
+  default:           return "unknown";
+  }
+}
+
+uint64_t StateFootprint::getObjectStateBytes(const ObjectState *os,
+                                             Counted &counted) {
+  uint64_t bytes = sizeof(ObjectState);
+  if (os->concreteStore)
+    bytes += os->size;
+  if (os->concreteMask)
+    bytes += getBitArrayBytes(os->size);
+  if (os->flushMask)
+    bytes += getBitArrayBytes(os->size);
+  if (os->knownSymbolics)
+    bytes += os->size * sizeof(klee::ref<Expr>);
+  if (os->refCount > 1)
+    bytes /= os->refCount;
+
+  // Update lists share their tails between the objects forked from one
+  // another; past the first node already counted, the rest is too.
+  for (const UpdateNode *un = os->updates.head;
+       un && counted.updates.insert(un).second; un = un->next)
+    bytes += sizeof(UpdateNode);
+  return bytes;
+}
+
+uint64_t StateFootprint::getAddressSpaceBytes(const AddressSpace &as,
+                                              uint64_t &accessBytes,
+                                              Counted &counted) {
+  uint64_t bytes = 0;
+  for (MemoryMap::iterator it = as.objects.begin(), ie = as.objects.end();
+       it != ie; ++it) {
+    const ObjectState *os = it->second;
+    bytes += getObjectStateBytes(os, counted);
+  }
+
+  accessBytes += getAccessBytes(as.readSet);
+  accessBytes += getAccessBytes(as.writeSet);
+  accessBytes += getAccessBytes(as.accumWriteSets);
+  accessBytes += getAccessBytes(as.symGlobalReadSets);
+  accessBytes += getAccessBytes(as.symGlobalWriteSets);
+  for (unsigned i = 0; i < as.MemAccessSets.size(); i++) {
+    const MemoryAccessSetVec &sets = as.MemAccessSets[i];
+    for (unsigned j = 0; j < sets.size(); j++) {
+      accessBytes += getAccessBytes(sets[j].readVecSet);
+      accessBytes += getAccessBytes(sets[j].writeVecSet);
+    }
+  }
+  for (unsigned i = 0; i < as.MemAccessSetsPureCS.size(); i++) {
+    const MemoryAccessSetVecPureCS &sets = as.MemAccessSetsPureCS[i];
+    for (unsigned j = 0; j < sets.size(); j++) {
+      accessBytes += getAccessBytes(sets[j].readSet);
+      accessBytes += getAccessBytes(sets[j].writeSet);
+    }
+  }
+  return bytes;
+}
+
+StateFootprint StateFootprint::compute(const ExecutionState &state) {
+  Counted counted;
+  return compute(state, counted);
+}
+
+StateFootprint StateFootprint::compute(const ExecutionState &state,
+                                       Counted &counted) {
+  StateFootprint fp;
+
+  const HierAddressSpace &has = state.addressSpace;
+  uint64_t &accessBytes = fp.bytes[AccessSets];
+  fp.bytes[ObjectStates] += getAddressSpaceBytes(has.cpuMemory, accessBytes,
+                                                 counted);
+  fp.bytes[ObjectStates] += getAddressSpaceBytes(has.deviceMemory,
+                                                 accessBytes, counted);
+  for (unsigned i = 0; i < has.sharedMemories.size(); i++)
+    fp.bytes[ObjectStates] += getAddressSpaceBytes(has.sharedMemories[i],
+                                                   accessBytes, counted);
+  for (unsigned i = 0; i < has.localMemories.size(); i++)
+    fp.bytes[ObjectStates] += getAddressSpaceBytes(has.localMemories[i],
+                                                   accessBytes, counted);
+
+  for (ConstraintManager::constraint_iterator it = state.constraints.begin(),
+         ie = state.constraints.end(); it != ie; ++it)
+    fp.bytes[Exprs] += getExprBytes(*it, counted.exprs);
+  for (ConstraintManager::constraint_iterator
+         it = state.paraConstraints.begin(),
+         ie = state.paraConstraints.end(); it != ie; ++it)
+    fp.bytes[Exprs] += getExprBytes(*it, counted.exprs);
+
+  for (unsigned i = 0; i < state.stacks.size(); i++) {
+    const ExecutionState::stack_ty &stack = state.stacks[i];
+    for (unsigned j = 0; j < stack.size(); j++) {
+      const StackFrame &sf = stack[j];
+      fp.bytes[Stacks] += sizeof(StackFrame)
+        + sf.allocas.size() * sizeof(const MemoryObject*);
+      if (sf.locals)
+        fp.bytes[Stacks] += sf.kf->numRegisters * sizeof(Cell);
+    }
+  }
+
+  for (unsigned i = 0; i < state.paraTreeSets.size(); i++) {
+    const ParaTreeSet &set = state.paraTreeSets[i];
+    for (unsigned j = 0; j < set.size(); j++)
+      for (unsigned k = 0; k < set[j].size(); k++)
+        fp.bytes[ParaTrees] += sizeof(ParaTree)
+          + set[j][k].getNodeNum() * sizeof(ParaTreeNode);
+  }
+
+  return fp;
+}
+
+void StateFootprint::computeByKernel(const std::set<ExecutionState*> &states,
+                                     std::map<unsigned, StateFootprint>
+                                       &kernels,
+                                     std::vector< std::pair<uint64_t,
+                                       ExecutionState*> > *totals) {
+  // What one state shares with others is counted in the group once; a
+  // state's own total, which ranks it for killing, counts all it holds.
+  Counted group;
+  // Spilled states hold next to nothing until they are restored.
+  for (std::set<ExecutionState*>::const_iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it) {
+    if ((*it)->spilled)
+      continue;
+    kernels[(*it)->kernelNum] += compute(**it, group);
+    if (totals)
+      totals->push_back(std::make_pair(compute(**it).total(), *it));
+  }
+}
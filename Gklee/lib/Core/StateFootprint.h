@@ -0,0 +1,92 @@
+//===-- StateFootprint.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_STATEFOOTPRINT_H
+#define KLEE_STATEFOOTPRINT_H
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+namespace klee {
+  class AddressSpace;
+  class ExecutionState;
+  class ObjectState;
+
+  /// StateFootprint - An estimate of the heap held by a state, or a group
+  /// of states, broken down by the subsystem holding it.
+  ///
+  /// Memory shared copy-on-write between states (object states, access
+  /// sets) is split evenly between its owners. Expression and update list
+  /// nodes are counted once: once per state in a state's footprint, and
+  /// once across the group in a group's.
+  class StateFootprint {
+  public:
+    enum Kind {
+      /// The contents of the memory objects in all the address spaces.
+      ObjectStates,
+      /// The constraints, as expression DAGs.
+      Exprs,
+      /// The stack frames and registers of all the threads.
+      Stacks,
+      /// The recorded accesses kept for the defect checks.
+      AccessSets,
+      /// The parametric flow trees.
+      ParaTrees,
+      NumKinds
+    };
+
+    uint64_t bytes[NumKinds];
+
+    StateFootprint() { clear(); }
+
+    void clear() {
+      for (unsigned i = 0; i < NumKinds; i++)
+        bytes[i] = 0;
+    }
+
+    uint64_t total() const;
+
+    StateFootprint &operator+=(const StateFootprint &b) {
+      for (unsigned i = 0; i < NumKinds; i++)
+        bytes[i] += b.bytes[i];
+      return *this;
+    }
+
+    static const char *getName(Kind kind);
+
+    /// Estimate the footprint of \a state.
+    static StateFootprint compute(const ExecutionState &state);
+
+    /// Sum the footprints of \a states by the kernel each is in (0 before
+    /// the first launch) into \a kernels. Spilled states are skipped. If
+    /// \a totals is given, also append the total of each state counted.
+    static void computeByKernel(const std::set<ExecutionState*> &states,
+                                std::map<unsigned, StateFootprint> &kernels,
+                                std::vector< std::pair<uint64_t,
+                                  ExecutionState*> > *totals = 0);
+
+  private:
+    /// The expression and update list nodes already counted.
+    struct Counted;
+
+    static StateFootprint compute(const ExecutionState &state,
+                                  Counted &counted);
+    static uint64_t getObjectStateBytes(const ObjectState *os,
+                                        Counted &counted);
+    static uint64_t getAddressSpaceBytes(const AddressSpace &as,
+                                         uint64_t &accessBytes,
+                                         Counted &counted);
+  };
+}
+
+#endif
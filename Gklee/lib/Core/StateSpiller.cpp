@@ -0,0 +1,696 @@
+//===-- StateSpiller.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StateSpiller.h"
+
+#include "AddressSpace.h"
+#include "Common.h"
+#include "CoreStats.h"
+#include "Memory.h"
+
+#include "klee/ExecutionState.h"
+#include "klee/Expr.h"
+#include "klee/Internal/Module/Cell.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/util/BitArray.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace klee;
+
+/***/
+
+static const char spill_magic[8] = { 'G', 'K', 'S', 'P', 'I', 'L', 'L', '1' };
+
+enum SpillTag {
+  EndTag = 0,
+  ExprTag,
+  UpdateNodeTag
+};
+
+// The address space levels an object may be bound in.
+enum SpillLevel {
+  CPULevel = 0,
+  DeviceLevel,
+  SharedLevel,
+  LocalLevel
+};
+
+namespace {
+
+  /// Encodes a state as a table of expressions and update nodes, each
+  /// written once, followed by a body which refers to the table by index.
+  /// Numbers are written as unsigned LEB128.
+  class SpillWriter {
+    std::map<const Expr*, unsigned> exprIds;
+    std::map<const UpdateNode*, unsigned> nodeIds;
+
+    static void writeNum(std::string &out, uint64_t value) {
+      do {
+        unsigned char byte = value & 0x7F;
+        value >>= 7;
+        if (value)
+          byte |= 0x80;
+        out.push_back(byte);
+      } while (value);
+    }
+
+  public:
+    std::string table;
+    std::string body;
+    /// The expressions in the table, by index, so kids before parents.
+    std::vector< klee::ref<Expr> > exprs;
+
+    void writeNum(uint64_t value) { writeNum(body, value); }
+
+    void writePointer(const void *p) {
+      writeNum(body, (uint64_t) (uintptr_t) p);
+    }
+
+    void writeBytes(const void *p, unsigned n) {
+      body.append((const char*) p, n);
+    }
+
+    void writeMask(BitArray *mask, unsigned size) {
+      body.push_back(mask != 0);
+      if (!mask)
+        return;
+      for (unsigned i = 0; i < size; i += 8) {
+        unsigned char byte = 0;
+        for (unsigned j = 0; j < 8 && i + j < size; j++)
+          byte |= mask->get(i + j) << j;
+        body.push_back(byte);
+      }
+    }
+
+    unsigned writeExpr(const klee::ref<Expr> &e);
+
+    /// \return 0 for the empty list, and one more than the index of the
+    /// head node otherwise.
+    unsigned writeUpdates(const UpdateNode *head);
+  };
+
+  class SpillReader {
+    const unsigned char *pos, *end;
+    /// Keeps the update nodes alive while the table is being read.
+    std::vector<UpdateList> nodes;
+    /// Expressions to share instead of rebuilding equal ones.
+    const ExprHashSet &interned;
+
+  public:
+    std::vector< klee::ref<Expr> > exprs;
+
+    SpillReader(const std::string &data, const ExprHashSet &_interned)
+      : pos((const unsigned char*) data.data()),
+        end((const unsigned char*) data.data() + data.size()),
+        interned(_interned) {}
+
+    uint64_t readNum() {
+      uint64_t value = 0;
+      unsigned shift = 0;
+      while (pos != end) {
+        unsigned char byte = *pos++;
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+          break;
+        shift += 7;
+      }
+      return value;
+    }
+
+    const void *readPointer() {
+      return (const void*) (uintptr_t) readNum();
+    }
+
+    void readBytes(void *p, unsigned n) {
+      assert(pos + n <= end && "truncated spill file");
+      memcpy(p, pos, n);
+      pos += n;
+    }
+
+    unsigned char readByte() {
+      assert(pos != end && "truncated spill file");
+      return *pos++;
+    }
+
+    BitArray *readMask(unsigned size) {
+      if (!readByte())
+        return 0;
+      BitArray *mask = new BitArray(size);
+      for (unsigned i = 0; i < size; i += 8) {
+        unsigned char byte = readByte();
+        for (unsigned j = 0; j < 8 && i + j < size; j++)
+          mask->set(i + j, (byte >> j) & 1);
+      }
+      return mask;
+    }
+
+    klee::ref<Expr> readExpr() {
+      return exprs[readNum()];
+    }
+
+    const UpdateNode *readUpdates() {
+      unsigned id = readNum();
+      return id ? nodes[id - 1].head : 0;
+    }
+
+    void readTable();
+  };
+
+}
+
+unsigned SpillWriter::writeExpr(const klee::ref<Expr> &e) {
+  std::map<const Expr*, unsigned>::iterator it = exprIds.find(e.get());
+  if (it != exprIds.end())
+    return it->second;
+
+  // Everything the expression refers to goes into the table first, so
+  // that it can be rebuilt in a single pass.
+  unsigned head = 0;
+  if (ReadExpr *re = dyn_cast<ReadExpr>(e))
+    head = writeUpdates(re->updates.head);
+  std::vector<unsigned> kids;
+  for (unsigned i = 0; i < e->getNumKids(); i++)
+    kids.push_back(writeExpr(e->getKid(i)));
+
+  table.push_back(ExprTag);
+  table.push_back(e->getKind());
+  table.push_back(e->ctype);
+  table.push_back(e->accum);
+
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const APInt &value = cast<ConstantExpr>(e)->getAPValue();
+    writeNum(table, value.getBitWidth());
+    writeNum(table, value.getNumWords());
+    for (unsigned i = 0; i < value.getNumWords(); i++)
+      writeNum(table, value.getRawData()[i]);
+    break;
+  }
+  case Expr::Read:
+    writeNum(table, (uint64_t) (uintptr_t) cast<ReadExpr>(e)->updates.root);
+    writeNum(table, head);
+    writeNum(table, kids[0]);
+    break;
+  case Expr::Extract:
+    writeNum(table, kids[0]);
+    writeNum(table, cast<ExtractExpr>(e)->offset);
+    writeNum(table, e->getWidth());
+    break;
+  case Expr::ZExt:
+  case Expr::SExt:
+    writeNum(table, kids[0]);
+    writeNum(table, e->getWidth());
+    break;
+  default:
+    for (unsigned i = 0; i < kids.size(); i++)
+      writeNum(table, kids[i]);
+    break;
+  }
+
+  unsigned id = exprIds.size();
+  exprIds[e.get()] = id;
+  exprs.push_back(e);
+  return id;
+}
+
+unsigned SpillWriter::writeUpdates(const UpdateNode *head) {
+  // Update lists are long and share their tails, so walk back to the
+  // first node already in the table instead of recursing.
+  std::vector<const UpdateNode*> pending;
+  for (const UpdateNode *un = head; un && !nodeIds.count(un); un = un->next)
+    pending.push_back(un);
+
+  for (std::vector<const UpdateNode*>::reverse_iterator
+         it = pending.rbegin(), ie = pending.rend(); it != ie; ++it) {
+    const UpdateNode *un = *it;
+    unsigned index = writeExpr(un->index);
+    unsigned value = writeExpr(un->value);
+    unsigned next = un->next ? nodeIds[un->next] + 1 : 0;
+
+    table.push_back(UpdateNodeTag);
+    writeNum(table, next);
+    writeNum(table, index);
+    writeNum(table, value);
+
+    unsigned id = nodeIds.size();
+    nodeIds[un] = id;
+  }
+
+  return head ? nodeIds[head] + 1 : 0;
+}
+
+void SpillReader::readTable() {
+  for (;;) {
+    unsigned char tag = readByte();
+    if (tag == EndTag)
+      break;
+
+    if (tag == UpdateNodeTag) {
+      const UpdateNode *next = readUpdates();
+      klee::ref<Expr> index = readExpr();
+      klee::ref<Expr> value = readExpr();
+      nodes.push_back(UpdateList(0, new UpdateNode(next, index, value)));
+      continue;
+    }
+
+    assert(tag == ExprTag && "corrupt spill file");
+    Expr::Kind kind = (Expr::Kind) readByte();
+    GPUConfig::CTYPE ctype = (GPUConfig::CTYPE) readByte();
+    bool accum = readByte();
+
+    klee::ref<Expr> e;
+    switch (kind) {
+    case Expr::Constant: {
+      unsigned width = readNum();
+      std::vector<uint64_t> words(readNum());
+      for (unsigned i = 0; i < words.size(); i++)
+        words[i] = readNum();
+      e = ConstantExpr::alloc(APInt(width, ArrayRef<uint64_t>(words)));
+      break;
+    }
+    case Expr::NotOptimized:
+      e = NotOptimizedExpr::alloc(readExpr());
+      break;
+    case Expr::Read: {
+      const Array *root = (const Array*) readPointer();
+      const UpdateNode *head = readUpdates();
+      e = ReadExpr::alloc(UpdateList(root, head), readExpr());
+      break;
+    }
+    case Expr::Select: {
+      klee::ref<Expr> c = readExpr();
+      klee::ref<Expr> t = readExpr();
+      e = SelectExpr::alloc(c, t, readExpr());
+      break;
+    }
+    case Expr::Concat: {
+      klee::ref<Expr> l = readExpr();
+      e = ConcatExpr::alloc(l, readExpr());
+      break;
+    }
+    case Expr::Extract: {
+      klee::ref<Expr> kid = readExpr();
+      unsigned offset = readNum();
+      e = ExtractExpr::alloc(kid, offset, readNum());
+      break;
+    }
+    case Expr::ZExt: {
+      klee::ref<Expr> kid = readExpr();
+      e = ZExtExpr::alloc(kid, readNum());
+      break;
+    }
+    case Expr::SExt: {
+      klee::ref<Expr> kid = readExpr();
+      e = SExtExpr::alloc(kid, readNum());
+      break;
+    }
+    case Expr::Not:
+      e = NotExpr::alloc(readExpr());
+      break;
+
+#define BINARY_EXPR_CASE(T)                     \
+    case Expr::T: {                             \
+      klee::ref<Expr> l = readExpr();           \
+      e = T ## Expr::alloc(l, readExpr());      \
+      break;                                    \
+    }
+
+      BINARY_EXPR_CASE(Add);
+      BINARY_EXPR_CASE(Sub);
+      BINARY_EXPR_CASE(Mul);
+      BINARY_EXPR_CASE(UDiv);
+      BINARY_EXPR_CASE(SDiv);
+      BINARY_EXPR_CASE(URem);
+      BINARY_EXPR_CASE(SRem);
+      BINARY_EXPR_CASE(And);
+      BINARY_EXPR_CASE(Or);
+      BINARY_EXPR_CASE(Xor);
+      BINARY_EXPR_CASE(Shl);
+      BINARY_EXPR_CASE(LShr);
+      BINARY_EXPR_CASE(AShr);
+      BINARY_EXPR_CASE(Eq);
+      BINARY_EXPR_CASE(Ne);
+      BINARY_EXPR_CASE(Ult);
+      BINARY_EXPR_CASE(Ule);
+      BINARY_EXPR_CASE(Ugt);
+      BINARY_EXPR_CASE(Uge);
+      BINARY_EXPR_CASE(Slt);
+      BINARY_EXPR_CASE(Sle);
+      BINARY_EXPR_CASE(Sgt);
+      BINARY_EXPR_CASE(Sge);
+#undef BINARY_EXPR_CASE
+
+    default:
+      assert(0 && "invalid kind in spill file");
+    }
+
+    e->ctype = ctype;
+    e->accum = accum;
+
+    // Kids come first, so an interned expression is found with the kids
+    // it was built on.
+    ExprHashSet::const_iterator it = interned.find(e);
+    if (it != interned.end() && (*it)->ctype == ctype
+        && (*it)->accum == accum)
+      e = *it;
+    exprs.push_back(e);
+  }
+}
+
+/***/
+
+static AddressSpace &getLevel(HierAddressSpace &as, unsigned level,
+                              unsigned index) {
+  switch (level) {
+  case CPULevel:    return as.cpuMemory;
+  case DeviceLevel: return as.deviceMemory;
+  case SharedLevel: return as.sharedMemories[index];
+  default:          return as.localMemories[index];
+  }
+}
+
+static void getLevels(HierAddressSpace &as,
+                      std::vector< std::pair<unsigned, unsigned> > &levels) {
+  levels.push_back(std::make_pair((unsigned) CPULevel, 0u));
+  levels.push_back(std::make_pair((unsigned) DeviceLevel, 0u));
+  for (unsigned k = 0; k < as.sharedMemories.size(); k++)
+    levels.push_back(std::make_pair((unsigned) SharedLevel, k));
+  for (unsigned k = 0; k < as.localMemories.size(); k++)
+    levels.push_back(std::make_pair((unsigned) LocalLevel, k));
+}
+
+StateSpiller::StateSpiller(const std::string &_directory)
+  : directory(_directory), fileCounter(0), internedAfterPrune(0) {
+  if (mkdir(directory.c_str(), 0775) < 0 && errno != EEXIST)
+    klee_warning("unable to create spill directory %s", directory.c_str());
+}
+
+StateSpiller::~StateSpiller() {
+  for (std::map<const ExecutionState*, SpillRecord>::iterator
+         it = spilled.begin(), ie = spilled.end(); it != ie; ++it)
+    unlink(it->second.path.c_str());
+  rmdir(directory.c_str());
+}
+
+void StateSpiller::touch(const ExecutionState &state) {
+  lastSelected[&state] = stats::instructions;
+}
+
+unsigned StateSpiller::spillColdest(const std::set<ExecutionState*> &states,
+                                    const ExecutionState *current,
+                                    unsigned count) {
+  std::vector< std::pair<uint64_t, ExecutionState*> > candidates;
+  for (std::set<ExecutionState*>::const_iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (es == current || es->spilled)
+      continue;
+    std::map<const ExecutionState*, uint64_t>::iterator last =
+      lastSelected.find(es);
+    candidates.push_back(std::make_pair(last == lastSelected.end() ? 0 :
+                                        last->second, es));
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  unsigned numSpilled = 0;
+  for (unsigned i = 0; i < candidates.size() && numSpilled < count; i++) {
+    if (!spill(*candidates[i].second))
+      break;
+    ++numSpilled;
+  }
+  return numSpilled;
+}
+
+bool StateSpiller::spill(ExecutionState &state) {
+  if (state.spilled)
+    return true;
+
+  SpillWriter w;
+
+  w.writeNum(state.constraints.size());
+  for (ConstraintManager::constraint_iterator it = state.constraints.begin(),
+         ie = state.constraints.end(); it != ie; ++it)
+    w.writeNum(w.writeExpr(*it));
+  w.writeNum(state.paraConstraints.size());
+  for (ConstraintManager::constraint_iterator
+         it = state.paraConstraints.begin(),
+         ie = state.paraConstraints.end(); it != ie; ++it)
+    w.writeNum(w.writeExpr(*it));
+
+  for (unsigned i = 0; i < state.stacks.size(); i++) {
+    ExecutionState::stack_ty &stack = state.stacks[i];
+    for (unsigned j = 0; j < stack.size(); j++) {
+      StackFrame &sf = stack[j];
+      unsigned numValues = 0;
+      for (unsigned k = 0; k < sf.kf->numRegisters; k++)
+        if (!sf.locals[k].value.isNull())
+          ++numValues;
+      w.writeNum(numValues);
+      for (unsigned k = 0; k < sf.kf->numRegisters; k++) {
+        if (sf.locals[k].value.isNull())
+          continue;
+        w.writeNum(k);
+        w.writeNum(w.writeExpr(sf.locals[k].value));
+      }
+    }
+  }
+
+  // Only objects this state owns are released; shared ones would stay in
+  // memory anyway. The configuration objects are referenced directly by
+  // the thread info and stay too.
+  std::vector< std::pair<unsigned, unsigned> > levels;
+  getLevels(state.addressSpace, levels);
+  std::vector< std::pair<unsigned, const MemoryObject*> > released;
+  for (unsigned l = 0; l < levels.size(); l++) {
+    AddressSpace &as = getLevel(state.addressSpace,
+                                levels[l].first, levels[l].second);
+    for (MemoryMap::iterator it = as.objects.begin(), ie = as.objects.end();
+         it != ie; ++it) {
+      const MemoryObject *mo = it->first;
+      ObjectState *os = it->second;
+      if (!as.owns(os) || os->readOnly
+          || os == state.tinfo.block_size_os
+          || os == state.tinfo.grid_size_os)
+        continue;
+
+      w.writeNum(levels[l].first);
+      w.writeNum(levels[l].second);
+      w.writePointer(mo);
+      w.writePointer(os->updates.root);
+      w.writeNum(w.writeUpdates(os->updates.head));
+      w.writeNum(os->size);
+      w.writeBytes(os->concreteStore, os->size);
+      w.writeMask(os->concreteMask, os->size);
+      w.writeMask(os->flushMask, os->size);
+      w.writeNum(os->knownSymbolics != 0);
+      if (os->knownSymbolics) {
+        for (unsigned i = 0; i < os->size; i++) {
+          klee::ref<Expr> &e = os->knownSymbolics[i];
+          w.writeNum(e.isNull() ? 0 : w.writeExpr(e) + 1);
+        }
+      }
+
+      released.push_back(std::make_pair(l, mo));
+    }
+  }
+  w.writeNum(~0u);
+  w.table.push_back(EndTag);
+
+  std::ostringstream path;
+  path << directory << "/state" << ++fileCounter << ".spill";
+  FILE *f = fopen(path.str().c_str(), "wb");
+  if (!f) {
+    klee_warning("unable to open spill file %s", path.str().c_str());
+    return false;
+  }
+  bool ok = fwrite(spill_magic, sizeof(spill_magic), 1, f) == 1
+    && fwrite(w.table.data(), 1, w.table.size(), f) == w.table.size()
+    && fwrite(w.body.data(), 1, w.body.size(), f) == w.body.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok) {
+    klee_warning("unable to write spill file %s", path.str().c_str());
+    unlink(path.str().c_str());
+    return false;
+  }
+
+  // Now release the state's copies.
+  SpillRecord &record = spilled[&state];
+  record.path = path.str();
+
+  state.constraints = ConstraintManager();
+  state.paraConstraints = ConstraintManager();
+  for (unsigned i = 0; i < state.stacks.size(); i++) {
+    ExecutionState::stack_ty &stack = state.stacks[i];
+    for (unsigned j = 0; j < stack.size(); j++) {
+      StackFrame &sf = stack[j];
+      for (unsigned k = 0; k < sf.kf->numRegisters; k++)
+        sf.locals[k].value = 0;
+    }
+  }
+  for (unsigned i = 0; i < released.size(); i++) {
+    const MemoryObject *mo = released[i].second;
+    mo->refCount++;
+    record.objects.push_back(mo);
+    getLevel(state.addressSpace, levels[released[i].first].first,
+             levels[released[i].first].second).unbindObject(mo);
+  }
+
+  // What is still alive now is held by other states as well; keep it,
+  // so that this state shares it again once restored. Parents go first,
+  // so a kid is only kept for what holds it besides them.
+  for (unsigned i = w.exprs.size(); i; --i) {
+    klee::ref<Expr> &e = w.exprs[i - 1];
+    if (e->refCount > 1)
+      interned.insert(e);
+    e = 0;
+  }
+  if (interned.size() > 2 * internedAfterPrune + 1024)
+    pruneInterned();
+
+  state.spilled = true;
+  ++stats::statesSpilled;
+  return true;
+}
+
+void StateSpiller::pruneInterned() {
+  // Parents hold their kids, so sweep until nothing more is freed.
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (ExprHashSet::iterator it = interned.begin();
+         it != interned.end(); ) {
+      if ((*it)->refCount == 1) {
+        interned.erase(it++);
+        changed = true;
+      } else {
+        ++it;
+      }
+    }
+  }
+  internedAfterPrune = interned.size();
+}
+
+void StateSpiller::restore(ExecutionState &state) {
+  if (!state.spilled)
+    return;
+
+  std::map<const ExecutionState*, SpillRecord>::iterator rit =
+    spilled.find(&state);
+  assert(rit != spilled.end() && "spilled state without a record");
+  SpillRecord &record = rit->second;
+
+  std::string data;
+  FILE *f = fopen(record.path.c_str(), "rb");
+  if (!f)
+    klee_error("unable to open spill file %s", record.path.c_str());
+  char buffer[1 << 16];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    data.append(buffer, n);
+  fclose(f);
+  if (data.size() < sizeof(spill_magic)
+      || memcmp(data.data(), spill_magic, sizeof(spill_magic)))
+    klee_error("corrupt spill file %s", record.path.c_str());
+
+  SpillReader r(data.substr(sizeof(spill_magic)), interned);
+  r.readTable();
+
+  std::vector< klee::ref<Expr> > constraints(r.readNum());
+  for (unsigned i = 0; i < constraints.size(); i++)
+    constraints[i] = r.readExpr();
+  state.constraints = ConstraintManager(constraints);
+  std::vector< klee::ref<Expr> > paraConstraints(r.readNum());
+  for (unsigned i = 0; i < paraConstraints.size(); i++)
+    paraConstraints[i] = r.readExpr();
+  state.paraConstraints = ConstraintManager(paraConstraints);
+
+  for (unsigned i = 0; i < state.stacks.size(); i++) {
+    ExecutionState::stack_ty &stack = state.stacks[i];
+    for (unsigned j = 0; j < stack.size(); j++) {
+      StackFrame &sf = stack[j];
+      for (unsigned numValues = r.readNum(); numValues; --numValues) {
+        unsigned k = r.readNum();
+        sf.locals[k].value = r.readExpr();
+      }
+    }
+  }
+
+  for (;;) {
+    uint64_t level = r.readNum();
+    if (level == ~0u)
+      break;
+    unsigned index = r.readNum();
+    const MemoryObject *mo = (const MemoryObject*) r.readPointer();
+    const Array *root = (const Array*) r.readPointer();
+    const UpdateNode *head = r.readUpdates();
+
+    ObjectState *os = new ObjectState(mo, UpdateList(root, head));
+    unsigned size = r.readNum();
+    if (size != os->size) {
+      delete[] os->concreteStore;
+      os->concreteStore = new uint8_t[size];
+      os->size = size;
+    }
+    r.readBytes(os->concreteStore, size);
+    os->concreteMask = r.readMask(size);
+    os->flushMask = r.readMask(size);
+    if (r.readNum()) {
+      os->knownSymbolics = new klee::ref<Expr>[size];
+      for (unsigned i = 0; i < size; i++) {
+        unsigned id = r.readNum();
+        if (id)
+          os->knownSymbolics[i] = r.exprs[id - 1];
+      }
+    }
+
+    getLevel(state.addressSpace, level, index).bindObject(mo, os);
+  }
+
+  // The restored object states hold their own references now.
+  for (unsigned i = 0; i < record.objects.size(); i++)
+    record.objects[i]->refCount--;
+
+  unlink(record.path.c_str());
+  spilled.erase(rit);
+  state.spilled = false;
+  ++stats::statesRestored;
+}
+
+void StateSpiller::discard(ExecutionState &state) {
+  lastSelected.erase(&state);
+
+  std::map<const ExecutionState*, SpillRecord>::iterator rit =
+    spilled.find(&state);
+  if (rit == spilled.end())
+    return;
+
+  SpillRecord &record = rit->second;
+  for (unsigned i = 0; i < record.objects.size(); i++) {
+    const MemoryObject *mo = record.objects[i];
+    assert(mo->refCount > 0);
+    mo->refCount--;
+    if (mo->refCount == 0)
+      delete mo;
+  }
+  unlink(record.path.c_str());
+  spilled.erase(rit);
+  state.spilled = false;
+}
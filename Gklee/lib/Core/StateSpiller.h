@@ -0,0 +1,90 @@
+//===-- StateSpiller.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_STATESPILLER_H
+#define KLEE_STATESPILLER_H
+
+#include "klee/util/ExprHashMap.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace klee {
+  class ExecutionState;
+  class MemoryObject;
+
+  /// StateSpiller - Writes dormant states to a spill directory when the
+  /// executor runs short of memory, and reads them back when they are
+  /// selected again.
+  ///
+  /// A spilled state keeps its control state (PCs, stacks, access sets)
+  /// in memory; its constraints, the values of its locals and the
+  /// memory objects it owns exclusively are written out and released.
+  /// Expressions are written once each into a table shared by all parts
+  /// of the state, so the file is about as compact as the DAG itself.
+  /// Those still held by other states are kept in memory, and restored
+  /// states share them again rather than rebuilding copies.
+  class StateSpiller {
+    std::string directory;
+    unsigned fileCounter;
+
+    struct SpillRecord {
+      std::string path;
+      /// The memory objects whose contents were written out. They are
+      /// kept alive while the state is on disk.
+      std::vector<const MemoryObject*> objects;
+    };
+
+    std::map<const ExecutionState*, SpillRecord> spilled;
+
+    /// When each state was last selected, counted in instructions.
+    std::map<const ExecutionState*, uint64_t> lastSelected;
+
+    /// The expressions of spilled states that other states held too.
+    ExprHashSet interned;
+    /// The size of the interned table after it was last pruned.
+    unsigned internedAfterPrune;
+
+    /// Drop the interned expressions no state holds any more.
+    void pruneInterned();
+
+  public:
+    StateSpiller(const std::string &directory);
+    ~StateSpiller();
+
+    /// Note that the searcher has selected \a state.
+    void touch(const ExecutionState &state);
+
+    /// Spill up to \a count of the states, preferring those that have
+    /// waited longest to be selected. \a current is never spilled.
+    ///
+    /// \return The number of states spilled.
+    unsigned spillColdest(const std::set<ExecutionState*> &states,
+                          const ExecutionState *current, unsigned count);
+
+    /// Write \a state out and release what it no longer needs in memory.
+    ///
+    /// \return True on success; otherwise the state is left untouched.
+    bool spill(ExecutionState &state);
+
+    /// Bring a spilled state back into memory.
+    void restore(ExecutionState &state);
+
+    /// Forget a state which is being deleted.
+    void discard(ExecutionState &state);
+
+    unsigned getNumSpilled() const { return spilled.size(); }
+  };
+}
+
+#endif
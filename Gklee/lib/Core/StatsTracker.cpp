@@ -14,6 +14,7 @@
 #include "klee/ExecutionState.h"
 #include "klee/Statistics.h"
 #include "klee/Config/Version.h"
+#include "klee/Internal/ADT/StatsStream.h"
 #include "klee/Internal/Module/InstructionInfoTable.h"
 #include "klee/Internal/Module/KModule.h"
 #include "klee/Internal/Module/KInstruction.h"
@@ -24,6 +25,7 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "MemoryManager.h"
+#include "StateFootprint.h"
 #include "UserSearcher.h"
 #include "../Solver/SolverStats.h"
 
@@ -47,6 +49,8 @@
 #include "llvm/Support/Path.h"
 #endif
 
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <fstream>
 
@@ -69,6 +73,11 @@ namespace {
               cl::desc("Write running stats trace file"),
               cl::init(true));
 
+  cl::opt<bool>
+  OutputBinaryStats("output-binary-stats",
+                    cl::desc("Write the stats trace as a binary stream (run.stats.bin) instead of run.stats"),
+                    cl::init(false));
+
   cl::opt<bool>
   OutputIStats("output-istats",
                cl::desc("Write instruction level statistics (in callgrind format)"),
@@ -96,6 +105,11 @@ namespace {
   UncoveredUpdateInterval("uncovered-update-interval",
                           cl::init(30.));
   
+  cl::opt<bool>
+  OutputStateMemory("output-state-memory",
+                    cl::desc("Estimate the memory held by the states, by subsystem and by kernel, in the stats trace (default=off)"),
+                    cl::init(false));
+
   cl::opt<bool>
   UseCallPaths("use-call-paths",
                cl::desc("Enable calltree tracking for instruction level statistics"),
@@ -166,12 +180,52 @@ static bool instructionIsCoverable(Instruction *i) {
   return true;
 }
 
+/// The columns of the stats trace, in the order getStatsLine fills them.
+static const StatsStream::Column statsColumns[] = {
+  StatsStream::Column("Instructions", StatsStream::Count),
+  StatsStream::Column("FullBranches", StatsStream::Count),
+  StatsStream::Column("PartialBranches", StatsStream::Count),
+  StatsStream::Column("NumBranches", StatsStream::Count),
+  StatsStream::Column("UserTime", StatsStream::Real),
+  StatsStream::Column("NumStates", StatsStream::Count),
+  StatsStream::Column("MallocUsage", StatsStream::Count),
+  StatsStream::Column("NumQueries", StatsStream::Count),
+  StatsStream::Column("NumQueryConstructs", StatsStream::Count),
+  StatsStream::Column("NumObjects", StatsStream::Count),
+  StatsStream::Column("WallTime", StatsStream::Real),
+  StatsStream::Column("CoveredInstructions", StatsStream::Count),
+  StatsStream::Column("UncoveredInstructions", StatsStream::Count),
+  StatsStream::Column("QueryTime", StatsStream::Real),
+  StatsStream::Column("SolverTime", StatsStream::Real),
+  StatsStream::Column("CexCacheTime", StatsStream::Real),
+  StatsStream::Column("ForkTime", StatsStream::Real),
+  StatsStream::Column("ResolveTime", StatsStream::Real),
+  StatsStream::Column("MemObjectStates", StatsStream::Count),
+  StatsStream::Column("MemExprs", StatsStream::Count),
+  StatsStream::Column("MemStacks", StatsStream::Count),
+  StatsStream::Column("MemAccessSets", StatsStream::Count),
+  StatsStream::Column("MemParaTrees", StatsStream::Count),
+  StatsStream::Column("HeaviestKernel1", StatsStream::Count),
+  StatsStream::Column("HeaviestKernel1Mem", StatsStream::Count),
+  StatsStream::Column("HeaviestKernel2", StatsStream::Count),
+  StatsStream::Column("HeaviestKernel2Mem", StatsStream::Count),
+  StatsStream::Column("HeaviestKernel3", StatsStream::Count),
+  StatsStream::Column("HeaviestKernel3Mem", StatsStream::Count)
+};
+
+/// The number of kernels whose state memory is traced, heaviest first.
+static const unsigned NumHeaviestKernels = 3;
+
+static const unsigned NumStatsColumns =
+  sizeof(statsColumns) / sizeof(statsColumns[0]);
+
 StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
                            bool _updateMinDistToUncovered)
   : executor(_executor),
     objectFilename(_objectFilename),
     statsFile(0),
     istatsFile(0),
+    binaryStatsFile(0),
     startWallTime(util::getWallTime()),
     numBranches(0),
     fullBranches(0),
@@ -213,9 +267,27 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     }
   }
 
+  if (OutputStats && OutputBinaryStats) {
+    std::vector<StatsStream::Column> columns(statsColumns,
+                                             statsColumns + NumStatsColumns);
+    for (unsigned i = 0, e = theStatisticManager->getNumStatistics();
+         i != e; ++i) {
+      Statistic &s = theStatisticManager->getStatistic(i);
+      columns.push_back(StatsStream::Column("stat:" + s.getName(),
+                                            StatsStream::Count));
+    }
+    std::string path =
+      executor.interpreterHandler->getOutputFilename("run.stats.bin");
+    binaryStatsFile = StatsStreamWriter::open(path, columns);
+    if (!binaryStatsFile)
+      klee_error("unable to open statistics stream %s", path.c_str());
+  }
+
   if (OutputStats) {
-    statsFile = executor.interpreterHandler->openOutputFile("run.stats");
-    assert(statsFile && "unable to open statistics trace file");
+    if (!binaryStatsFile) {
+      statsFile = executor.interpreterHandler->openOutputFile("run.stats");
+      assert(statsFile && "unable to open statistics trace file");
+    }
     writeStatsHeader();
     writeStatsLine();
 
@@ -238,12 +310,18 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
 StatsTracker::~StatsTracker() {  
   if (statsFile)
     delete statsFile;
+  if (binaryStatsFile) {
+    if (binaryStatsFile->getNumDropped())
+      klee_warning("dropped %u records from the statistics stream",
+                   binaryStatsFile->getNumDropped());
+    delete binaryStatsFile;
+  }
   if (istatsFile)
     delete istatsFile;
 }
 
 void StatsTracker::done() {
-  if (statsFile)
+  if (statsFile || binaryStatsFile)
     writeStatsLine();
   if (OutputIStats)
     writeIStats();
@@ -374,52 +452,94 @@ void StatsTracker::markBranchVisited(ExecutionState *visitedTrue,
 }
 
 void StatsTracker::writeStatsHeader() {
-  *statsFile << "('Instructions',"
-             << "'FullBranches',"
-             << "'PartialBranches',"
-             << "'NumBranches',"
-             << "'UserTime',"
-             << "'NumStates',"
-             << "'MallocUsage',"
-             << "'NumQueries',"
-             << "'NumQueryConstructs',"
-             << "'NumObjects',"
-             << "'WallTime',"
-             << "'CoveredInstructions',"
-             << "'UncoveredInstructions',"
-             << "'QueryTime',"
-             << "'SolverTime',"
-             << "'CexCacheTime',"
-             << "'ForkTime',"
-             << "'ResolveTime',"
-             << ")\n";
+  if (binaryStatsFile)
+    return;
+
+  *statsFile << "(";
+  for (unsigned i = 0; i < NumStatsColumns; i++)
+    *statsFile << "'" << statsColumns[i].name << "',";
+  *statsFile << ")\n";
   statsFile->flush();
 }
 
+void StatsTracker::getStatsLine(uint64_t *values) {
+  unsigned n = 0;
+  values[n++] = stats::instructions;
+  values[n++] = fullBranches;
+  values[n++] = partialBranches;
+  values[n++] = numBranches;
+  values[n++] = StatsStream::fromReal(util::getUserTime());
+  values[n++] = executor.states.size();
+  values[n++] = sys::Process::GetTotalMemoryUsage();
+  values[n++] = stats::queries;
+  values[n++] = stats::queryConstructs;
+  values[n++] = 0; // was numObjects
+  values[n++] = StatsStream::fromReal(elapsed());
+  values[n++] = stats::coveredInstructions;
+  values[n++] = stats::uncoveredInstructions;
+  values[n++] = StatsStream::fromReal(stats::queryTime / 1000000.);
+  values[n++] = StatsStream::fromReal(stats::solverTime / 1000000.);
+  values[n++] = StatsStream::fromReal(stats::cexCacheTime / 1000000.);
+  values[n++] = StatsStream::fromReal(stats::forkTime / 1000000.);
+  values[n++] = StatsStream::fromReal(stats::resolveTime / 1000000.);
+
+  StateFootprint footprint;
+  std::map<unsigned, StateFootprint> kernels;
+  if (OutputStateMemory) {
+    StateFootprint::computeByKernel(executor.states, kernels);
+    for (std::map<unsigned, StateFootprint>::iterator it = kernels.begin(),
+           ie = kernels.end(); it != ie; ++it)
+      footprint += it->second;
+  }
+  for (unsigned i = 0; i < StateFootprint::NumKinds; i++)
+    values[n++] = footprint.bytes[i];
+
+  // The kernels holding the most, as (kernel number, bytes); unused
+  // slots hold no bytes.
+  std::vector< std::pair<uint64_t, unsigned> > heaviest;
+  for (std::map<unsigned, StateFootprint>::iterator it = kernels.begin(),
+         ie = kernels.end(); it != ie; ++it)
+    heaviest.push_back(std::make_pair(it->second.total(), it->first));
+  std::sort(heaviest.begin(), heaviest.end(),
+            std::greater< std::pair<uint64_t, unsigned> >());
+  heaviest.resize(NumHeaviestKernels, std::make_pair(0, 0));
+  for (unsigned i = 0; i < NumHeaviestKernels; i++) {
+    values[n++] = heaviest[i].second;
+    values[n++] = heaviest[i].first;
+  }
+  assert(n == NumStatsColumns && "stats line does not match its columns");
+}
+
 double StatsTracker::elapsed() {
   return util::getWallTime() - startWallTime;
 }
 
 void StatsTracker::writeStatsLine() {
-  *statsFile << "(" << stats::instructions
-             << "," << fullBranches
-             << "," << partialBranches
-             << "," << numBranches
-             << "," << util::getUserTime()
-             << "," << executor.states.size()
-             << "," << sys::Process::GetTotalMemoryUsage()
-             << "," << stats::queries
-             << "," << stats::queryConstructs
-             << "," << 0 // was numObjects
-             << "," << elapsed()
-             << "," << stats::coveredInstructions
-             << "," << stats::uncoveredInstructions
-             << "," << stats::queryTime / 1000000.
-             << "," << stats::solverTime / 1000000.
-             << "," << stats::cexCacheTime / 1000000.
-             << "," << stats::forkTime / 1000000.
-             << "," << stats::resolveTime / 1000000.
-             << ")\n";
+  if (binaryStatsFile) {
+    // The registered statistics follow the columns of run.stats.
+    if (uint64_t *record = binaryStatsFile->beginRecord()) {
+      getStatsLine(record);
+      for (unsigned i = 0, e = theStatisticManager->getNumStatistics();
+           i != e; ++i)
+        record[NumStatsColumns + i] =
+          theStatisticManager->getValue(theStatisticManager->getStatistic(i));
+      binaryStatsFile->commitRecord();
+    }
+    return;
+  }
+
+  uint64_t values[NumStatsColumns];
+  getStatsLine(values);
+  *statsFile << "(";
+  for (unsigned i = 0; i < NumStatsColumns; i++) {
+    if (i)
+      *statsFile << ",";
+    if (statsColumns[i].type == StatsStream::Real)
+      *statsFile << StatsStream::toReal(values[i]);
+    else
+      *statsFile << values[i];
+  }
+  *statsFile << ")\n";
   statsFile->flush();
 }
 
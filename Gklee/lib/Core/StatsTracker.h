@@ -28,6 +28,7 @@ namespace klee {
   class InterpreterHandler;
   struct KInstruction;
   struct StackFrame;
+  class StatsStreamWriter;
 
   class StatsTracker {
     friend class WriteStatsTimer;
@@ -37,6 +38,9 @@ namespace klee {
     std::string objectFilename;
 
     std::ostream *statsFile, *istatsFile;
+    /// Where the stats trace goes instead of statsFile, if it is written
+    /// as a binary stream.
+    StatsStreamWriter *binaryStatsFile;
     double startWallTime;
     
     unsigned numBranches;
@@ -53,6 +57,8 @@ namespace klee {
     void updateStateStatistics(uint64_t addend);
     void writeStatsHeader();
     void writeStatsLine();
+    /// Fill in one slot per column of the stats trace.
+    void getStatsLine(uint64_t *values);
     void writeIStats();
 
   public:
@@ -0,0 +1,352 @@
+//===-- StreamTimeline.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StreamTimeline.h"
+
+#include "klee/Internal/Module/InstructionInfoTable.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+  cl::opt<double>
+  TimelineH2DBandwidth("timeline-h2d-bandwidth",
+                       cl::desc("Host to device copy bandwidth, in GB/s, "
+                                "assumed by -output-timeline (default=6)"),
+                       cl::init(6.));
+
+  cl::opt<double>
+  TimelineD2HBandwidth("timeline-d2h-bandwidth",
+                       cl::desc("Device to host copy bandwidth, in GB/s, "
+                                "assumed by -output-timeline (default=6)"),
+                       cl::init(6.));
+
+  cl::opt<double>
+  TimelineDeviceBandwidth("timeline-device-bandwidth",
+                          cl::desc("Bandwidth of copies and memsets within "
+                                   "the device, in GB/s, assumed by "
+                                   "-output-timeline (default=150)"),
+                          cl::init(150.));
+
+  cl::opt<double>
+  TimelineDeviceSpeed("timeline-device-speed",
+                      cl::desc("Kernel instructions, summed over the "
+                               "threads, run per microsecond, assumed by "
+                               "-output-timeline (default=100000)"),
+                      cl::init(100000.));
+
+  cl::opt<double>
+  TimelineCallLatency("timeline-call-latency",
+                      cl::desc("Microseconds the host spends in each "
+                               "runtime call issuing device work, assumed "
+                               "by -output-timeline (default=5)"),
+                      cl::init(5.));
+}
+
+/***/
+
+StreamTimeline::StreamTimeline()
+  : refCount(0),
+    hostTime(0),
+    openKernel(-1),
+    openKernelInstructions(0),
+    launchStream(0),
+    lastDeviceSync(-1) {
+  std::fill(engineFree, engineFree + NumEngines, 0.);
+}
+
+StreamTimeline::StreamTimeline(const StreamTimeline &other)
+  : refCount(0),
+    operations(other.operations),
+    hostTime(other.hostTime),
+    lastInStream(other.lastInStream),
+    streamWaits(other.streamWaits),
+    events(other.events),
+    openKernel(other.openKernel),
+    openKernelInstructions(other.openKernelInstructions),
+    launchStream(other.launchStream),
+    lastDeviceSync(other.lastDeviceSync) {
+  std::copy(other.engineFree, other.engineFree + NumEngines, engineFree);
+}
+
+StreamTimeline::Engine StreamTimeline::getEngine(Kind kind) {
+  switch (kind) {
+  case CopyToDevice:
+    return CopyInEngine;
+  case CopyToHost:
+    return CopyOutEngine;
+  default:
+    return ComputeEngine;
+  }
+}
+
+bool StreamTimeline::overlaps(const Operation &a, const Operation &b) {
+  for (unsigned i = 0; i < a.memory.size(); i++)
+    for (unsigned j = 0; j < b.memory.size(); j++)
+      if (a.memory[i].first < b.memory[j].second &&
+          b.memory[j].first < a.memory[i].second)
+        return true;
+  return false;
+}
+
+double StreamTimeline::getStreamReady(uint64_t stream) const {
+  double ready = 0;
+  for (std::map<uint64_t, int>::const_iterator it = lastInStream.begin(),
+         ie = lastInStream.end(); it != ie; ++it)
+    if (stream == 0 || it->first == stream)
+      ready = std::max(ready, operations[it->second].end);
+  return ready;
+}
+
+void StreamTimeline::waitFor(int index, double &start, int &blocker) const {
+  if (index >= 0 && operations[index].end > start) {
+    start = operations[index].end;
+    blocker = index;
+  }
+}
+
+void StreamTimeline::schedule(int index, double duration) {
+  Operation &op = operations[index];
+  double start = hostTime;
+  int blocker = -1;
+
+  // The legacy default stream waits for all the others, and they for it.
+  for (std::map<uint64_t, int>::const_iterator it = lastInStream.begin(),
+         ie = lastInStream.end(); it != ie; ++it)
+    if (op.stream == 0 || it->first == 0 || it->first == op.stream)
+      waitFor(it->second, start, blocker);
+
+  // Waiting for an event or an engine is not down to stream order.
+  std::map<uint64_t, double>::const_iterator wait =
+    streamWaits.find(op.stream);
+  if (wait != streamWaits.end() && wait->second > start) {
+    start = wait->second;
+    blocker = -1;
+  }
+  Engine engine = getEngine(op.kind);
+  if (engineFree[engine] > start) {
+    start = engineFree[engine];
+    blocker = -1;
+  }
+
+  if (blocker >= 0) {
+    const Operation &b = operations[blocker];
+    if (getEngine(b.kind) != engine && !overlaps(b, op))
+      op.serializedBehind = blocker;
+  }
+
+  op.start = start;
+  op.end = start + duration;
+  engineFree[engine] = op.end;
+  lastInStream[op.stream] = index;
+  lastDeviceSync = -1;
+}
+
+int StreamTimeline::addWait(const std::string &name,
+                            const InstructionInfo *info, double until) {
+  int index = operations.size();
+  operations.push_back(Operation(Wait, name, info, 0));
+  Operation &op = operations.back();
+  op.start = hostTime;
+  op.end = std::max(hostTime, until);
+  hostTime = op.end;
+  lastDeviceSync = -1;
+  return index;
+}
+
+int StreamTimeline::launchKernel(const std::string &name,
+                                 const InstructionInfo *info,
+                                 const std::vector<Range> &memory,
+                                 uint64_t instructions) {
+  finishKernel(instructions);
+  hostTime += TimelineCallLatency;
+
+  int index = operations.size();
+  operations.push_back(Operation(Kernel, name, info, launchStream));
+  operations.back().memory = memory;
+  // The duration is known once the kernel has been interpreted.
+  schedule(index, 0);
+
+  openKernel = index;
+  openKernelInstructions = instructions;
+  launchStream = 0;
+  return index;
+}
+
+void StreamTimeline::finishKernel(uint64_t instructions) {
+  if (openKernel < 0)
+    return;
+  Operation &op = operations[openKernel];
+  op.end = op.start
+    + (instructions - openKernelInstructions) / TimelineDeviceSpeed;
+  engineFree[ComputeEngine] = std::max(engineFree[ComputeEngine], op.end);
+  openKernel = -1;
+}
+
+int StreamTimeline::copy(Kind kind, const std::string &name,
+                         const InstructionInfo *info, uint64_t stream,
+                         uint64_t bytes, const std::vector<Range> &memory,
+                         bool blocking) {
+  hostTime += TimelineCallLatency;
+
+  int index = operations.size();
+  operations.push_back(Operation(kind, name, info, stream));
+  Operation &op = operations.back();
+  op.bytes = bytes;
+  op.memory = memory;
+  // A blocking call on the default stream waits for the whole device.
+  if (blocking && stream == 0)
+    op.redundantSync = lastDeviceSync;
+
+  double bandwidth = TimelineDeviceBandwidth;
+  if (kind == CopyToDevice)
+    bandwidth = TimelineH2DBandwidth;
+  else if (kind == CopyToHost)
+    bandwidth = TimelineD2HBandwidth;
+  // 1 GB/s is 1000 bytes per microsecond.
+  schedule(index, bytes / (bandwidth * 1000.));
+
+  if (blocking)
+    hostTime = std::max(hostTime, operations[index].end);
+  return index;
+}
+
+int StreamTimeline::synchronizeDevice(const InstructionInfo *info) {
+  int index = addWait("cudaDeviceSynchronize", info, getStreamReady(0));
+  // Only one which waited can be made unnecessary by a later call.
+  if (operations[index].end > operations[index].start)
+    lastDeviceSync = index;
+  return index;
+}
+
+int StreamTimeline::synchronizeStream(const InstructionInfo *info,
+                                      uint64_t stream) {
+  return addWait("cudaStreamSynchronize", info, getStreamReady(stream));
+}
+
+int StreamTimeline::synchronizeEvent(const InstructionInfo *info,
+                                     uint64_t event) {
+  std::map<uint64_t, double>::const_iterator it = events.find(event);
+  return addWait("cudaEventSynchronize", info,
+                 it == events.end() ? hostTime : it->second);
+}
+
+void StreamTimeline::recordEvent(uint64_t event, uint64_t stream) {
+  events[event] = std::max(hostTime, getStreamReady(stream));
+}
+
+void StreamTimeline::waitEvent(uint64_t stream, uint64_t event) {
+  std::map<uint64_t, double>::const_iterator it = events.find(event);
+  if (it == events.end())
+    return;
+  double &until = streamWaits[stream];
+  until = std::max(until, it->second);
+}
+
+double StreamTimeline::getElapsedTime(uint64_t start, uint64_t end) const {
+  std::map<uint64_t, double>::const_iterator s = events.find(start);
+  std::map<uint64_t, double>::const_iterator e = events.find(end);
+  if (s == events.end() || e == events.end())
+    return 0;
+  return (e->second - s->second) / 1000.;
+}
+
+/***/
+
+static void writeString(std::ostream &os, const std::string &s) {
+  os << '"';
+  for (unsigned i = 0; i < s.size(); i++) {
+    char c = s[i];
+    if (c == '"' || c == '\\')
+      os << '\\' << c;
+    else if ((unsigned char) c < 0x20)
+      os << ' ';
+    else
+      os << c;
+  }
+  os << '"';
+}
+
+static std::string getLocation(const InstructionInfo *info) {
+  if (!info || info->file.empty())
+    return "unknown";
+  std::ostringstream os;
+  os << info->file << ":" << info->line;
+  return os.str();
+}
+
+static const char *getCategory(StreamTimeline::Kind kind) {
+  switch (kind) {
+  case StreamTimeline::Kernel:
+    return "kernel";
+  case StreamTimeline::Memset:
+    return "memset";
+  case StreamTimeline::Wait:
+    return "sync";
+  default:
+    return "copy";
+  }
+}
+
+void StreamTimeline::write(std::ostream &os) const {
+  // Row 0 is the host, then the streams in the order they were used.
+  std::map<uint64_t, unsigned> rows;
+  for (unsigned i = 0; i < operations.size(); i++) {
+    if (operations[i].kind == Wait || rows.count(operations[i].stream))
+      continue;
+    unsigned row = rows.size() + 1;
+    rows[operations[i].stream] = row;
+  }
+
+  os.setf(std::ios::fixed);
+  os.precision(3);
+  os << "{\"traceEvents\":[\n"
+     << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,"
+     << "\"args\":{\"name\":\"host\"}}";
+  for (std::map<uint64_t, unsigned>::const_iterator it = rows.begin(),
+         ie = rows.end(); it != ie; ++it) {
+    os << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+       << it->second << ",\"args\":{\"name\":\"";
+    if (it->first)
+      os << "stream " << it->first;
+    else
+      os << "default stream";
+    os << "\"}}";
+  }
+
+  for (unsigned i = 0; i < operations.size(); i++) {
+    const Operation &op = operations[i];
+    os << ",\n{\"name\":";
+    writeString(os, op.name);
+    os << ",\"cat\":\"" << getCategory(op.kind) << "\",\"ph\":\"X\","
+       << "\"pid\":0,\"tid\":" << (op.kind == Wait ? 0 : rows[op.stream])
+       << ",\"ts\":" << op.start << ",\"dur\":" << op.end - op.start
+       << ",\"args\":{\"issued at\":";
+    writeString(os, getLocation(op.info));
+    if (op.bytes)
+      os << ",\"bytes\":" << op.bytes;
+    if (op.serializedBehind >= 0) {
+      const Operation &b = operations[op.serializedBehind];
+      os << ",\"serialized behind\":";
+      writeString(os, b.name + " at " + getLocation(b.info));
+    }
+    if (op.redundantSync >= 0) {
+      os << ",\"makes unnecessary\":";
+      writeString(os, "cudaDeviceSynchronize at " +
+                  getLocation(operations[op.redundantSync].info));
+    }
+    os << "}}";
+  }
+  os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
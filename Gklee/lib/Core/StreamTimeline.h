@@ -0,0 +1,171 @@
+//===-- StreamTimeline.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_STREAMTIMELINE_H
+#define KLEE_STREAMTIMELINE_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace klee {
+  struct InstructionInfo;
+
+  /// StreamTimeline - When the device work a host program issues would
+  /// run, modelled along one path from the CUDA runtime calls it makes:
+  /// kernel launches, copies and memsets on streams, and device, stream
+  /// and event synchronisation.
+  ///
+  /// The host only waits in the calls which block. Each stream runs its
+  /// work in order, and the legacy default stream (0) is ordered with
+  /// all the others. Kernels, copies to the device and copies to the
+  /// host each have an engine of their own, so work on different streams
+  /// overlaps unless it needs the same engine. Copies take their size
+  /// over a fixed bandwidth, and kernels the instructions their threads
+  /// were interpreted for over a fixed throughput.
+  ///
+  /// States branched off on the host share the timeline copy-on-write.
+  class StreamTimeline {
+  public:
+    enum Kind {
+      Kernel,
+      CopyToDevice,
+      CopyToHost,
+      CopyOnDevice,
+      Memset,
+      /// The host blocked in a synchronisation call.
+      Wait
+    };
+
+    /// A range [first, second) of addresses an operation touches.
+    typedef std::pair<uint64_t, uint64_t> Range;
+
+    struct Operation {
+      Kind kind;
+      std::string name;
+      /// The host call which issued the operation.
+      const InstructionInfo *info;
+      uint64_t stream;
+      /// In microseconds from the start of the run.
+      double start, end;
+      uint64_t bytes;
+      std::vector<Range> memory;
+      /// The operation which held this one back in stream order though
+      /// it could have overlapped it: a kernel behind a copy or a copy
+      /// behind a kernel, touching none of its memory. -1 if none.
+      int serializedBehind;
+      /// The device synchronisation this operation made unnecessary, by
+      /// blocking the host until the device was done anyway. -1 if none.
+      int redundantSync;
+
+      Operation(Kind _kind, const std::string &_name,
+                const InstructionInfo *_info, uint64_t _stream)
+        : kind(_kind), name(_name), info(_info), stream(_stream),
+          start(0), end(0), bytes(0), serializedBehind(-1),
+          redundantSync(-1) {}
+    };
+
+    unsigned refCount;
+
+  private:
+    enum Engine {
+      ComputeEngine,
+      CopyInEngine,
+      CopyOutEngine,
+      NumEngines
+    };
+
+    std::vector<Operation> operations;
+    double hostTime;
+    double engineFree[NumEngines];
+    /// The last operation issued to each stream.
+    std::map<uint64_t, int> lastInStream;
+    /// The time before which each stream was told to wait for an event.
+    std::map<uint64_t, double> streamWaits;
+    /// The time at which each recorded event completes.
+    std::map<uint64_t, double> events;
+    /// The kernel still being interpreted, and the device instructions
+    /// executed along the path when it was launched.
+    int openKernel;
+    uint64_t openKernelInstructions;
+    /// The stream given to the next kernel launch.
+    uint64_t launchStream;
+    /// The last device synchronisation, if nothing was issued since.
+    int lastDeviceSync;
+
+    static Engine getEngine(Kind kind);
+    static bool overlaps(const Operation &a, const Operation &b);
+
+    /// The time at which all the work issued to \a stream so far is done.
+    double getStreamReady(uint64_t stream) const;
+    /// Push \a start to the end of operation \a index, if that is later,
+    /// and make it the operation responsible.
+    void waitFor(int index, double &start, int &blocker) const;
+    /// Find when operation \a index can start, and account for it.
+    void schedule(int index, double duration);
+    int addWait(const std::string &name, const InstructionInfo *info,
+                double until);
+
+  public:
+    StreamTimeline();
+    StreamTimeline(const StreamTimeline &other);
+
+    const Operation &getOperation(int index) const {
+      return operations[index];
+    }
+
+    /// Give the next launched kernel to \a stream.
+    void configureLaunch(uint64_t stream) { launchStream = stream; }
+
+    /// Issue a kernel touching \a memory. It runs until finishKernel is
+    /// called; \a instructions are the device instructions executed
+    /// along the path so far.
+    ///
+    /// \return The index of the kernel.
+    int launchKernel(const std::string &name, const InstructionInfo *info,
+                     const std::vector<Range> &memory,
+                     uint64_t instructions);
+
+    /// Give the kernel launched last, if it has not been, the duration of
+    /// the instructions executed since.
+    void finishKernel(uint64_t instructions);
+
+    bool hasOpenKernel() const { return openKernel >= 0; }
+
+    /// Issue a copy, or with kind Memset a memset, of \a bytes touching
+    /// \a memory. A blocking one holds the host until it is done.
+    ///
+    /// \return The index of the copy.
+    int copy(Kind kind, const std::string &name, const InstructionInfo *info,
+             uint64_t stream, uint64_t bytes,
+             const std::vector<Range> &memory, bool blocking);
+
+    /// \return The index of the wait, whose device was already idle if
+    /// it took no time.
+    int synchronizeDevice(const InstructionInfo *info);
+    int synchronizeStream(const InstructionInfo *info, uint64_t stream);
+    int synchronizeEvent(const InstructionInfo *info, uint64_t event);
+
+    void recordEvent(uint64_t event, uint64_t stream);
+    void waitEvent(uint64_t stream, uint64_t event);
+
+    /// The milliseconds between two recorded events, or 0 if either has
+    /// not been recorded.
+    double getElapsedTime(uint64_t start, uint64_t end) const;
+
+    /// Write the operations as a Chrome trace (chrome://tracing), with
+    /// the host and each stream on a row of their own.
+    void write(std::ostream &os) const;
+  };
+}
+
+#endif
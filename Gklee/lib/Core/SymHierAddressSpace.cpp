@@ -1,3 +1,4 @@
+#include "CoreStats.h"
 #include "Executor.h"
 #include "klee/Expr.h"
 #include "klee/util/ExprUtil.h"
@@ -21,10 +22,52 @@ namespace runtime {
                 cl::init(false)); 
   extern cl::opt<bool> UseSymbolicConfig;
   extern cl::opt<bool> SimdSchedule;
+
+  cl::opt<bool>
+  CacheProvenPairs("cache-proven-pairs",
+                   cl::desc("Skip the symbolic-config race and bank conflict queries already proven safe for an instruction pair (default=on)"),
+                   cl::init(true));
 }
 
 using namespace runtime;
 
+static ProvenAccessPairs::Key makeProvenKey(ProvenAccessPairs::Check check, 
+                                            const MemoryAccess &access1, 
+                                            const MemoryAccess &access2, 
+                                            klee::ref<Expr> configExpr, 
+                                            klee::ref<Expr> typeExpr, 
+                                            klee::ref<Expr> defectExpr) {
+  ProvenAccessPairs::Key key;
+  key.check = check;
+  key.inst1 = access1.instr;
+  key.inst2 = access2.instr;
+  key.query = AndExpr::create(configExpr, AndExpr::create(typeExpr, defectExpr));
+  return key;
+}
+
+static bool isProvenPair(ExecutionState &state, 
+                         const ProvenAccessPairs::Key &key) {
+  if (!CacheProvenPairs)
+    return false;
+  if (!state.provenPairs.isNull() && state.provenPairs->pairs.count(key)) {
+    ++stats::provenPairHits;
+    return true;
+  }
+  ++stats::provenPairMisses;
+  return false;
+}
+
+static void addProvenPair(ExecutionState &state, 
+                          const ProvenAccessPairs::Key &key) {
+  if (!CacheProvenPairs)
+    return;
+  if (state.provenPairs.isNull())
+    state.provenPairs = new ProvenAccessPairs();
+  else if (state.provenPairs->refCount > 1)
+    state.provenPairs = new ProvenAccessPairs(*state.provenPairs);
+  state.provenPairs->pairs.insert(key);
+}
+
 static bool isCurrentConfigFulfilled(Executor &executor, ExecutionState &state, 
                                      klee::ref<Expr> &configExpr, klee::ref<Expr> &typeExpr) {
   Logging::enterFunc( configExpr, __PRETTY_FUNCTION__ );
@@ -41,10 +84,8 @@ static bool isCurrentConfigFulfilled(Executor &executor, ExecutionState &state,
   return result;
 }
 
-void AddressSpaceUtil::updateBuiltInRelatedConstraint(ExecutionState &state, ConstraintManager &constr, 
-                                                      klee::ref<Expr> &expr) {
-  Logging::enterFunc( expr, __PRETTY_FUNCTION__ );
-  std::map< klee::ref<Expr>, klee::ref<Expr> > equalities; 
+BuiltInSubstitution::BuiltInSubstitution(ExecutionState &state)
+  : refCount(0) {
   // update bid 
   MemoryObject *bo = state.tinfo.block_id_mo;
   std::vector<AddressSpace> &sharedMemories = state.addressSpace.sharedMemories;
@@ -79,11 +120,39 @@ void AddressSpaceUtil::updateBuiltInRelatedConstraint(ExecutionState &state, Con
   equalities.insert(std::make_pair(tidx0, tidx1));
   equalities.insert(std::make_pair(tidy0, tidy1));
   equalities.insert(std::make_pair(tidz0, tidz1));
+}
+
+klee::ref<Expr> BuiltInSubstitution::apply(const ConstraintManager &constr, 
+                                           const klee::ref<Expr> &e) {
+  if (isa<klee::ConstantExpr>(e))
+    return e;
 
-  if (expr.get() != NULL) {
-    klee::ref<Expr> tmp = constr.updateExprThroughReplacement(expr, equalities); 
-    expr = constr.simplifyExpr(tmp);  
+  klee::ref<Expr> result;
+  ExprHashMap< klee::ref<Expr> >::iterator it = substituted.find(e);
+  if (it != substituted.end()) {
+    result = it->second;
+  } else {
+    result = constr.updateExprThroughReplacement(e, equalities);
+    substituted.insert(std::make_pair(e, result));
   }
+
+  // The checkers pass in an empty manager; skip the walk for them.
+  if (constr.empty())
+    return result;
+  return constr.simplifyExpr(result);
+}
+
+void AddressSpaceUtil::updateBuiltInRelatedConstraint(ExecutionState &state, ConstraintManager &constr, 
+                                                      klee::ref<Expr> &expr) {
+  Logging::enterFunc( expr, __PRETTY_FUNCTION__ );
+  // The blockIdx and threadIdx of the parametric flows only change between
+  // barrier intervals, so one substitution serves every check at a
+  // barrier. Executor::encounterBarrier drops it once the checks are done.
+  if (state.builtInSubstitution.isNull())
+    state.builtInSubstitution = new BuiltInSubstitution(state);
+
+  if (expr.get() != NULL)
+    expr = state.builtInSubstitution->apply(constr, expr);
   Logging::exitFunc();
 }
 
@@ -365,6 +434,12 @@ static bool symCheckWriteBankConflictExprsCap1x(Executor &executor, ExecutionSta
   // Symbolic values ...
   klee::ref<Expr> configExpr = AndExpr::create(access1.accessCondExpr, access2.accessCondExpr);
   klee::ref<Expr> tRelationExpr = AddressSpaceUtil::threadSameWarpConstraint(state, BankNum); 
+  ProvenAccessPairs::Key key = makeProvenKey(ProvenAccessPairs::BankConflictCheck, 
+                                             access1, access2, configExpr, 
+                                             tRelationExpr, expr);
+  if (isProvenPair(state, key))
+    return false;
+
   bool configFulfilled = isCurrentConfigFulfilled(executor, state, configExpr, tRelationExpr); 
 
   if (configFulfilled) {
@@ -376,8 +451,12 @@ static bool symCheckWriteBankConflictExprsCap1x(Executor &executor, ExecutionSta
         dumpSymBankConflict(executor, state, expr, access1, access2);
       }
       ExecutorUtil::copyBackConstraint(state);
+      if (result)
+        addProvenPair(state, key);
       return !result;
     }
+  } else {
+    addProvenPair(state, key);
   }
   ExecutorUtil::copyBackConstraint(state);
   return false;
@@ -390,10 +469,26 @@ static bool symCheckReadBankConflictExprsCap1x(Executor &executor, ExecutionStat
   klee::ref<Expr> addr2 = access2.offset; 
 
   klee::ref<Expr> origEq = EqExpr::create(addr1, addr2);
+  klee::ref<Expr> tmpExpr = NeExpr::create(addr1, addr2);
+  klee::ref<Expr> bankSize = klee::ConstantExpr::create(BankNum * 4, addr1->getWidth());
+  klee::ref<Expr> wordSize = klee::ConstantExpr::create(4, addr1->getWidth());
+  klee::ref<Expr> a1 = UDivExpr::create(URemExpr::create(addr1, bankSize), wordSize);
+  klee::ref<Expr> a2 = UDivExpr::create(URemExpr::create(addr2, bankSize), wordSize);
+  klee::ref<Expr> expr = EqExpr::create(a1, a2);
+  klee::ref<Expr> andExpr = AndExpr::create(tmpExpr, expr);
+
   // Determine whether the offset expression is related to 
   // Symbolic values ...
   klee::ref<Expr> configExpr = AndExpr::create(access1.accessCondExpr, access2.accessCondExpr);
   klee::ref<Expr> tRelationExpr = AddressSpaceUtil::threadSameWarpConstraint(state, BankNum);
+  // A broadcast rules the conflict out as well, so either way the pair
+  // is safe exactly when andExpr cannot hold.
+  ProvenAccessPairs::Key key = makeProvenKey(ProvenAccessPairs::BankConflictCheck, 
+                                             access1, access2, configExpr, 
+                                             tRelationExpr, andExpr);
+  if (isProvenPair(state, key))
+    return false;
+
   bool configFulfilled = isCurrentConfigFulfilled(executor, state, configExpr, tRelationExpr); 
 
   if (configFulfilled) {
@@ -403,18 +498,11 @@ static bool symCheckReadBankConflictExprsCap1x(Executor &executor, ExecutionStat
     if (success) {
       if (result) {
         ExecutorUtil::copyBackConstraint(state);
+        addProvenPair(state, key);
         return false; // broadcast...
       }
     }
 
-    klee::ref<Expr> tmpExpr = NeExpr::create(addr1, addr2);
-    klee::ref<Expr> bankSize = klee::ConstantExpr::create(BankNum * 4, addr1->getWidth());
-    klee::ref<Expr> wordSize = klee::ConstantExpr::create(4, addr1->getWidth());
-    klee::ref<Expr> a1 = UDivExpr::create(URemExpr::create(addr1, bankSize), wordSize);
-    klee::ref<Expr> a2 = UDivExpr::create(URemExpr::create(addr2, bankSize), wordSize);
-    klee::ref<Expr> expr = EqExpr::create(a1, a2);
-    klee::ref<Expr> andExpr = AndExpr::create(tmpExpr, expr);
-  
     success = executor.solver->mustBeFalse(state, andExpr, result);
     if (success) {
       if (!result) {
@@ -422,8 +510,12 @@ static bool symCheckReadBankConflictExprsCap1x(Executor &executor, ExecutionStat
         dumpSymBankConflict(executor, state, expr, access1, access2);
       }
       ExecutorUtil::copyBackConstraint(state);
+      if (result)
+        addProvenPair(state, key);
       return !result;
     }
+  } else {
+    addProvenPair(state, key);
   }
 
   ExecutorUtil::copyBackConstraint(state);
@@ -452,6 +544,10 @@ static bool checkSymBankConflictCap1x(Executor &executor, ExecutionState &state,
     }
   }
 
+  // Look again if queries that ran out of time got an answer on retry.
+  if (!hasBC && executor.solver->retryAbandoned())
+    return checkSymBankConflictCap1x(executor, state, rwSet, isWrite);
+
   return hasBC;
 }
 
@@ -467,10 +563,22 @@ static bool symCheckBankConflictExprsCap2x(Executor &executor, ExecutionState &s
   klee::ref<Expr> a2 = UDivExpr::create(addr2, wordSize);
   klee::ref<Expr> expr = EqExpr::create(a1, a2);
 
+  klee::ref<Expr> tmpExpr = NeExpr::create(a1, a2);
+  klee::ref<Expr> bankSize = klee::ConstantExpr::create(BankNum * 4, addr1->getWidth());
+  klee::ref<Expr> b1 = UDivExpr::create(URemExpr::create(addr1, bankSize), wordSize);
+  klee::ref<Expr> b2 = UDivExpr::create(URemExpr::create(addr2, bankSize), wordSize);
+  klee::ref<Expr> andExpr = AndExpr::create(tmpExpr, EqExpr::create(b1, b2));
+
   // Determine whether the offset expression is related to 
   // Symbolic values ...
   klee::ref<Expr> configExpr = AndExpr::create(access1.accessCondExpr, access2.accessCondExpr);
   klee::ref<Expr> tRelationExpr = AddressSpaceUtil::threadSameWarpConstraint(state, BankNum); 
+  ProvenAccessPairs::Key key = makeProvenKey(ProvenAccessPairs::BankConflictCheck, 
+                                             access1, access2, configExpr, 
+                                             tRelationExpr, andExpr);
+  if (isProvenPair(state, key))
+    return false;
+
   bool configFulfilled = isCurrentConfigFulfilled(executor, state, configExpr, tRelationExpr);
 
   if (configFulfilled) {
@@ -481,15 +589,10 @@ static bool symCheckBankConflictExprsCap2x(Executor &executor, ExecutionState &s
     if (success)
       if (result) {
         ExecutorUtil::copyBackConstraint(state);
+        addProvenPair(state, key);
         return false; // broadcast ...
       }
 
-    klee::ref<Expr> tmpExpr = NeExpr::create(a1, a2);
-    klee::ref<Expr> bankSize = klee::ConstantExpr::create(BankNum * 4, addr1->getWidth());
-    klee::ref<Expr> b1 = UDivExpr::create(URemExpr::create(addr1, bankSize), wordSize);
-    klee::ref<Expr> b2 = UDivExpr::create(URemExpr::create(addr2, bankSize), wordSize);
-    klee::ref<Expr> andExpr = AndExpr::create(tmpExpr, EqExpr::create(b1, b2));
-
     success = executor.solver->mayBeTrue(state, andExpr, result);
     if (success) {
       if (result) {
@@ -497,8 +600,12 @@ static bool symCheckBankConflictExprsCap2x(Executor &executor, ExecutionState &s
         dumpSymBankConflict(executor, state, andExpr, access1, access2);
       }
       ExecutorUtil::copyBackConstraint(state);
+      if (!result)
+        addProvenPair(state, key);
       return result;
     }
+  } else {
+    addProvenPair(state, key);
   }
 
   ExecutorUtil::copyBackConstraint(state);
@@ -522,6 +629,10 @@ static bool checkSymBankConflictCap2x(Executor &executor, ExecutionState &state,
     }
   }
 
+  // Look again if queries that ran out of time got an answer on retry.
+  if (!hasBC && executor.solver->retryAbandoned())
+    return checkSymBankConflictCap2x(executor, state, rwSet);
+
   return hasBC;
 } 
 
@@ -709,6 +820,10 @@ static bool symCheckMemoryCoalescingCap0(Executor &executor, ExecutionState &sta
     }
   }
 
+  // Look again if queries that ran out of time got an answer on retry.
+  if (hasMC && executor.solver->retryAbandoned())
+    return symCheckMemoryCoalescingCap0(executor, state, rwSet);
+
   return hasMC;
 }
 
@@ -756,6 +871,11 @@ static bool symCheckMemoryCoalescingCap1(Executor &executor, ExecutionState &sta
     }
 
   }
+
+  // Look again if queries that ran out of time got an answer on retry.
+  if (hasMC && executor.solver->retryAbandoned())
+    return symCheckMemoryCoalescingCap1(executor, state, rwSet);
+
   return hasMC;
 }
 
@@ -797,6 +917,11 @@ static bool symCheckMemoryCoalescingCap2(Executor &executor, ExecutionState &sta
       break;
     }
   }
+
+  // Look again if queries that ran out of time got an answer on retry.
+  if (hasMC && executor.solver->retryAbandoned())
+    return symCheckMemoryCoalescingCap2(executor, state, rwSet);
+
   return hasMC;
 }
 
@@ -956,6 +1081,10 @@ bool AddressSpace::hasSymVolatileMissing(Executor &executor, ExecutionState &sta
     }
   }
 
+  // Look again if queries that ran out of time got an answer on retry.
+  if (!volatilemiss && executor.solver->retryAbandoned())
+    return hasSymVolatileMissing(executor, state);
+
   return volatilemiss;
 }
 
@@ -1075,6 +1204,14 @@ static bool checkSymTwoAccessRace(Executor &executor, ExecutionState &state,
     else
       typeExpr = AddressSpaceUtil::threadDiffBlockConstraint(state);
 
+    klee::ref<Expr> conflictExpr = symCheckConflictExprs(access1.offset, access1.width, 
+                                                   access2.offset, access2.width);
+    ProvenAccessPairs::Key key = makeProvenKey(ProvenAccessPairs::RaceCheck, 
+                                               access1, access2, configExpr, 
+                                               typeExpr, conflictExpr);
+    if (isProvenPair(state, key))
+      return false;
+
     bool configFulfilled = isCurrentConfigFulfilled(executor, state, configExpr, typeExpr); 
 
     if (configFulfilled) {
@@ -1087,16 +1224,18 @@ static bool checkSymTwoAccessRace(Executor &executor, ExecutionState &state,
       //GKLEE_INFO << "access2 offset: " << std::endl;
       //access2.offset->dump();
 
-      klee::ref<Expr> conflictExpr = symCheckConflictExprs(access1.offset, access1.width, 
-                                                     access2.offset, access2.width);
       bool success = executor.solver->mustBeFalse(state, conflictExpr, result); 
       if (success) {
         if (!result) {
           bool benign = dumpSymRace(executor, state, conflictExpr, 
                                     true, access1, access2, BI1, BI2); 
           hasRace = !benign;
+        } else {
+          addProvenPair(state, key);
         }
       }
+    } else {
+      addProvenPair(state, key);
     }
   }
   
@@ -1274,6 +1413,14 @@ static bool checkSymTwoAccessRacePureCS(Executor &executor, ExecutionState &stat
       typeExpr = Expr::createIsZero(sameBlockExpr);
       fence = fenceRelation(access1, access2, false);
     }
+    klee::ref<Expr> conflictExpr = symCheckConflictExprs(access1.offset, access1.width, 
+                                                   access2.offset, access2.width);
+    ProvenAccessPairs::Key key = makeProvenKey(ProvenAccessPairs::PureCSRaceCheck, 
+                                               access1, access2, configExpr, 
+                                               typeExpr, conflictExpr);
+    if (fence && isProvenPair(state, key))
+      return false;
+
     bool configFulfilled = isCurrentConfigFulfilled(executor, state, configExpr, typeExpr); 
 
     if (configFulfilled && fence) {
@@ -1286,16 +1433,18 @@ static bool checkSymTwoAccessRacePureCS(Executor &executor, ExecutionState &stat
       //GKLEE_INFO << "access2 offset: " << std::endl;
       //access2.offset->dump();
 
-      klee::ref<Expr> conflictExpr = symCheckConflictExprs(access1.offset, access1.width, 
-                                                     access2.offset, access2.width);
       bool success = executor.solver->mustBeFalse(state, conflictExpr, result); 
       if (success) {
         if (!result) {
           bool benign = dumpSymRace(executor, state, conflictExpr, 
                                     true, access1, access2, BI1, BI2); 
           hasRace = !benign;
+        } else {
+          addProvenPair(state, key);
         }
       }
+    } else if (fence) {
+      addProvenPair(state, key);
     }
   }
   
@@ -1309,16 +1458,19 @@ static bool checkRWRacePureCS(Executor &executor, ExecutionState &state,
   unsigned BINum = state.BINum;
 
   GKLEE_INFO << "++++++++++ Read-Write race checking (Pure Canonical Schedule) ++++++++++" << std::endl;
-  for (MemoryAccessVec::iterator ii = readSet.begin(); ii != readSet.end(); ii++) {
-    for (MemoryAccessVec::iterator jj = writeSet.begin(); jj != writeSet.end(); jj++) {
-      MemoryAccess tmpAccess(*jj);
-      ConstraintManager constr;     
-      AddressSpaceUtil::updateMemoryAccess(state, constr, tmpAccess);  
-      hasRace = checkSymTwoAccessRacePureCS(executor, state, *ii, tmpAccess, 0, false, BINum, BINum);
+  // Look again if queries that ran out of time got an answer on retry.
+  do {
+    for (MemoryAccessVec::iterator ii = readSet.begin(); ii != readSet.end(); ii++) {
+      for (MemoryAccessVec::iterator jj = writeSet.begin(); jj != writeSet.end(); jj++) {
+        MemoryAccess tmpAccess(*jj);
+        ConstraintManager constr;     
+        AddressSpaceUtil::updateMemoryAccess(state, constr, tmpAccess);  
+        hasRace = checkSymTwoAccessRacePureCS(executor, state, *ii, tmpAccess, 0, false, BINum, BINum);
+        if (hasRace) break;
+      }
       if (hasRace) break;
     }
-    if (hasRace) break;
-  }
+  } while (!hasRace && executor.solver->retryAbandoned());
   
   return hasRace;
 } 
@@ -1329,16 +1481,19 @@ static bool checkWWRacePureCS(Executor &executor, ExecutionState &state,
   unsigned BINum = state.BINum;
 
   GKLEE_INFO << "++++++++++ Write-Write race checking (Pure Canonical Schedule) ++++++++++" << std::endl;
-  for (MemoryAccessVec::iterator ii = writeSet.begin(); ii != writeSet.end(); ii++) {
-    for (MemoryAccessVec::iterator jj = ii; jj != writeSet.end(); jj++) {
-      MemoryAccess tmpAccess(*jj);
-      ConstraintManager constr;     
-      AddressSpaceUtil::updateMemoryAccess(state, constr, tmpAccess);  
-      hasRace = checkSymTwoAccessRacePureCS(executor, state, *ii, tmpAccess, 0, true, BINum, BINum);
+  // Look again if queries that ran out of time got an answer on retry.
+  do {
+    for (MemoryAccessVec::iterator ii = writeSet.begin(); ii != writeSet.end(); ii++) {
+      for (MemoryAccessVec::iterator jj = ii; jj != writeSet.end(); jj++) {
+        MemoryAccess tmpAccess(*jj);
+        ConstraintManager constr;     
+        AddressSpaceUtil::updateMemoryAccess(state, constr, tmpAccess);  
+        hasRace = checkSymTwoAccessRacePureCS(executor, state, *ii, tmpAccess, 0, true, BINum, BINum);
+        if (hasRace) break;
+      }
       if (hasRace) break;
     }
-    if (hasRace) break;
-  }
+  } while (!hasRace && executor.solver->retryAbandoned());
 
   return hasRace;
 }
@@ -1492,6 +1647,13 @@ bool AddressSpace::hasSymRaceInShare(Executor &executor, ExecutionState &state)
   bool hasRace = false;
   ConstraintManager constr;     
   hasRace = hasSymRaceWithinBlock(executor, state, constr, readSet, writeSet);  
+  // Look again if queries that ran out of time got an answer on retry.
+  if (!hasRace && executor.solver->retryAbandoned()) {
+    GKLEE_INFO << "++++++++++ Race checking again with the queries answered on retry ++++++++++" 
+               << std::endl;
+    return hasSymRaceWithinBlock(executor, state, constr, readSet, writeSet);
+  }
+
   return hasRace;
 }
 
@@ -1585,6 +1747,14 @@ bool AddressSpace::hasSymRaceInGlobalAcrossBlocks(Executor &executor, ExecutionS
     }
   }
 
+  // Look again if queries that ran out of time got an answer on retry.
+  if (!hasRace && executor.solver->retryAbandoned())
+    return checkRWAcrossBlock(executor, state, readSet, writeSet, BI1, BI2, PureCS);
+
+  // Look again if queries that ran out of time got an answer on retry.
+  if (!hasRace && executor.solver->retryAbandoned())
+    return checkWWAcrossBlock(executor, state, writeSet1, writeSet2, BI1, BI2, PureCS);
+
   return hasRace;
 }
 
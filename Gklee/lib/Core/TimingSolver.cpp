@@ -16,24 +16,55 @@
 
 #include "CoreStats.h"
 
+#include "llvm/Support/CommandLine.h"
 #if LLVM_VERSION_CODE < LLVM_VERSION(2, 9)
 #include "llvm/System/Process.h"
 #else
 #include "llvm/Support/Process.h"
 #endif
 
+#include <algorithm>
+
 using namespace klee;
 using namespace llvm;
 using namespace Gklee;
 
 namespace runtime {
   extern cl::opt<bool> UseSymbolicConfig;
+
+  cl::opt<double>
+  CheckTimeBudget("check-time-budget",
+                  cl::desc("Solver seconds each defect checker (race, bank conflict, coalescing, volatile, out-of-bounds) may spend on a kernel (default=0 (unlimited))"),
+                  cl::init(0.));
+
+  cl::opt<double>
+  CheckTimeoutFactor("check-timeout-factor",
+                     cl::desc("Under -check-time-budget, cut a checker query off after this many times the 90th percentile of the checker's recent query times (default=10)"),
+                     cl::init(10.));
 }
 
 using namespace runtime;
 
+/// STP timeouts are whole seconds.
+static const double MinCheckTimeout = 1.;
+/// The number of recent query times kept per checker.
+static const unsigned RecentQueryTimes = 64;
+
+const char *TimingSolver::getClientName(QueryClient client) {
+  switch (client) {
+  case ExecutionClient: return "execution";
+  case RaceCheckClient: return "race check";
+  case BankConflictCheckClient: return "bank conflict check";
+  case CoalescingCheckClient: return "coalescing check";
+  case VolatileCheckClient: return "volatile check";
+  case OutOfBoundsCheckClient: return "out-of-bounds check";
+  default: return "unknown";
+  }
+}
+
 bool TimingSolver::evaluate(const ExecutionState& state, klee::ref<Expr> expr,
                             Solver::Validity &result) {
+  lastAbandoned = false;
 
   Logging::enterFunc( expr, __PRETTY_FUNCTION__ );
   // Fast path, to avoid timer and OS overhead.
@@ -50,6 +81,24 @@ bool TimingSolver::evaluate(const ExecutionState& state, klee::ref<Expr> expr,
   if (simplifyExprs)
     expr = state.constraints.simplifyExpr(expr);
 
+  if (lookupPrefetched(state, expr, result)) {
+    Logging::exitFunc();
+    return true;
+  }
+
+  bool budgeted = isBudgeted();
+  if (budgeted) {
+    if (lookupRetried(state, expr, result)) {
+      Logging::exitFunc();
+      return true;
+    }
+    if (!beginCheckQuery(state)) {
+      Logging::exitFunc();
+      return false;
+    }
+  }
+
+  setCexReuseContext(state.lineage, state.parentLineage, queryClient);
   bool success = solver->evaluate(Query(state.constraints, expr), result);
 
   sys::Process::GetTimeUsage(delta,user,sys);
@@ -57,6 +106,12 @@ bool TimingSolver::evaluate(const ExecutionState& state, klee::ref<Expr> expr,
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
 
+  if (budgeted) {
+    endCheckQuery(state, delta.usec()/1000000., success);
+    if (!success)
+      abandon(state, expr);
+  }
+
   Logging::outItem( std::to_string( success ), "Exit Val" );
   Logging::exitFunc();
   return success;
@@ -64,6 +119,8 @@ bool TimingSolver::evaluate(const ExecutionState& state, klee::ref<Expr> expr,
 
 bool TimingSolver::mustBeTrue(const ExecutionState& state, klee::ref<Expr> expr, 
                               bool &result) {
+  lastAbandoned = false;
+
   // Fast path, to avoid timer and OS overhead.
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(expr)) {
     result = CE->isTrue() ? true : false;
@@ -76,7 +133,24 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, klee::ref<Expr> expr,
   if (simplifyExprs)
     expr = state.constraints.simplifyExpr(expr);
 
+  Solver::Validity validity;
+  if (lookupPrefetched(state, expr, validity)) {
+    result = validity == Solver::True;
+    return true;
+  }
+
+  bool budgeted = isBudgeted();
+  if (budgeted) {
+    if (lookupRetried(state, expr, validity)) {
+      result = validity == Solver::True;
+      return true;
+    }
+    if (!beginCheckQuery(state))
+      return false;
+  }
+
   //state.constraints.dump();
+  setCexReuseContext(state.lineage, state.parentLineage, queryClient);
   bool success = solver->mustBeTrue(Query(state.constraints, expr), result);
 
   sys::Process::GetTimeUsage(delta,user,sys);
@@ -84,9 +158,270 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, klee::ref<Expr> expr,
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
 
+  if (budgeted) {
+    endCheckQuery(state, delta.usec()/1000000., success);
+    if (!success)
+      abandon(state, expr);
+  }
+
   return success;
 }
 
+bool TimingSolver::isBudgeted() const {
+  return CheckTimeBudget > 0. && queryClient != ExecutionClient;
+}
+
+double &TimingSolver::getBudgetSpent(QueryClient client, unsigned kernel) {
+  std::vector<double> &spent = budgetSpent[kernel];
+  if (spent.empty())
+    spent.resize(NumQueryClients, 0.);
+  return spent[client];
+}
+
+double TimingSolver::getCheckTimeout(const ExecutionState &state) {
+  double left = CheckTimeBudget - 
+    getBudgetSpent(queryClient, state.kernelNum);
+  if (left < MinCheckTimeout)
+    return 0.;
+
+  // Until the checker has a history, no one query may take more than a
+  // tenth of its budget.
+  std::vector<double> times = recentQueryTimes[queryClient];
+  double limit = CheckTimeBudget / 10.;
+  if (times.size() >= 8) {
+    std::vector<double>::iterator p90 = times.begin() + times.size() * 9 / 10;
+    std::nth_element(times.begin(), p90, times.end());
+    limit = *p90 * CheckTimeoutFactor;
+  }
+  return std::min(left, std::max(limit, MinCheckTimeout));
+}
+
+void TimingSolver::recordQueryTime(QueryClient client, double seconds) {
+  std::vector<double> &times = recentQueryTimes[client];
+  if (times.size() < RecentQueryTimes) {
+    times.push_back(seconds);
+  } else {
+    times[nextQueryTime[client]] = seconds;
+    nextQueryTime[client] = (nextQueryTime[client] + 1) % RecentQueryTimes;
+  }
+}
+
+bool TimingSolver::beginCheckQuery(const ExecutionState &state) {
+  double checkTimeout = getCheckTimeout(state);
+  if (checkTimeout == 0.) {
+    // The budget only shrinks, so there is no point in a retry.
+    ++stats::checkQueriesSkipped;
+    ++unanswered[queryClient];
+    lastAbandoned = true;
+    return false;
+  }
+  stpSolver->setTimeout(checkTimeout);
+  return true;
+}
+
+void TimingSolver::endCheckQuery(const ExecutionState &state, double seconds,
+                                 bool success) {
+  stpSolver->setTimeout(timeout);
+  getBudgetSpent(queryClient, state.kernelNum) += seconds;
+  if (success) {
+    recordQueryTime(queryClient, seconds);
+  } else {
+    ++stats::checkQueriesAbandoned;
+    ++unanswered[queryClient];
+    lastAbandoned = true;
+  }
+}
+
+void TimingSolver::abandon(const ExecutionState &state, klee::ref<Expr> expr) {
+  AbandonedQuery aq;
+  aq.client = queryClient;
+  aq.kernel = state.kernelNum;
+  aq.constraints = state.constraints;
+  aq.expr = expr;
+  abandoned.push_back(aq);
+}
+
+bool TimingSolver::lookupRetried(const ExecutionState &state, 
+                                 klee::ref<Expr> expr, 
+                                 Solver::Validity &result) {
+  if (retried.empty())
+    return false;
+  ExprHashMap< std::vector<RetriedVerdict> >::iterator it = retried.find(expr);
+  if (it == retried.end())
+    return false;
+  // The symbolic configuration checkers add and take back constraints
+  // around each query, so the generation does not carry over to the
+  // checker's second look; compare the constraints themselves.
+  for (std::vector<RetriedVerdict>::iterator vi = it->second.begin(), 
+         ve = it->second.end(); vi != ve; ++vi) {
+    if (vi->constraints == state.constraints) {
+      result = vi->validity;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TimingSolver::retryAbandoned() {
+  if (!isBudgeted())
+    return false;
+
+  bool recovered = false;
+  std::deque<AbandonedQuery> others;
+  while (!abandoned.empty()) {
+    AbandonedQuery aq = abandoned.front();
+    abandoned.pop_front();
+    if (aq.client != queryClient) {
+      others.push_back(aq);
+      continue;
+    }
+
+    // Left unanswered, as already counted.
+    double &spent = getBudgetSpent(aq.client, aq.kernel);
+    double left = CheckTimeBudget - spent;
+    if (left < MinCheckTimeout)
+      continue;
+
+    sys::TimeValue now(0,0),user(0,0),delta(0,0),sys(0,0);
+    sys::Process::GetTimeUsage(now,user,sys);
+
+    stpSolver->setTimeout(left);
+    Solver::Validity validity;
+    bool success = solver->evaluate(Query(aq.constraints, aq.expr), validity);
+    stpSolver->setTimeout(timeout);
+
+    sys::Process::GetTimeUsage(delta,user,sys);
+    delta -= now;
+    stats::solverTime += delta.usec();
+    spent += delta.usec()/1000000.;
+
+    if (success) {
+      ++stats::checkQueriesRecovered;
+      --unanswered[aq.client];
+      RetriedVerdict rv;
+      rv.constraints = aq.constraints;
+      rv.validity = validity;
+      retried[aq.expr].push_back(rv);
+      recovered = true;
+    }
+  }
+  abandoned.swap(others);
+  return recovered;
+}
+
+void TimingSolver::takeUnanswered(std::vector<unsigned> &lost) {
+  lost = unanswered;
+  unanswered.assign(NumQueryClients, 0);
+  abandoned.clear();
+  retried.clear();
+}
+
+klee::ref<Expr> TimingSolver::getQueryExpr(const ExecutionState& state,
+                                          klee::ref<Expr> expr) {
+  return simplifyExprs && !isa<ConstantExpr>(expr) ?
+    state.constraints.simplifyExpr(expr) : expr;
+}
+
+bool TimingSolver::lookupPrefetched(const ExecutionState& state, 
+                                    klee::ref<Expr> expr,
+                                    Solver::Validity &result) {
+  if ((prefetched.empty() && pending.empty()) ||
+      state.constraints.getGeneration() != prefetchGeneration)
+    return false;
+
+  ExprHashMap<Solver::Validity>::iterator it = prefetched.find(expr);
+  if (it == prefetched.end()) {
+    ExprHashMap<unsigned>::iterator pi = pendingIndex.find(expr);
+    if (pi == pendingIndex.end() || pi->second < pendingNext)
+      return false;
+    evaluatePending(state, pi->second);
+    it = prefetched.find(expr);
+    if (it == prefetched.end())
+      return false;
+  }
+  result = it->second;
+  return true;
+}
+
+void TimingSolver::evaluatePending(const ExecutionState& state, unsigned from) {
+  unsigned end = std::min((unsigned) pending.size(), from + 4 * batchWorkers);
+  std::vector< klee::ref<Expr> > todo;
+  for (unsigned i = from; i < end; ++i)
+    todo.push_back(pending[i].first);
+  pendingNext = end;
+
+  std::vector<Solver::Validity> results;
+  std::vector<bool> solved;
+  bool simplify = simplifyExprs;
+  simplifyExprs = false; // already done by prefetch
+  evaluateBatch(state, todo, results, solved);
+  simplifyExprs = simplify;
+
+  // The checkers ask mustBeFalse(e), that is mustBeTrue(e == false), as
+  // well as about e itself; the verdict on one gives the other.
+  for (unsigned i = 0; i < todo.size(); ++i) {
+    if (!solved[i])
+      continue;
+    prefetched[todo[i]] = results[i];
+    klee::ref<Expr> negated = pending[from + i].second;
+    if (!isa<ConstantExpr>(negated))
+      prefetched[negated] = (Solver::Validity) -results[i];
+  }
+}
+
+bool TimingSolver::evaluateBatch(const ExecutionState& state, 
+                                 const std::vector< klee::ref<Expr> > &exprs,
+                                 std::vector<Solver::Validity> &results,
+                                 std::vector<bool> &solved) {
+  std::vector< klee::ref<Expr> > simplified;
+  simplified.reserve(exprs.size());
+  for (unsigned i = 0; i < exprs.size(); ++i)
+    simplified.push_back(simplifyExprs && !isa<ConstantExpr>(exprs[i]) ?
+                         state.constraints.simplifyExpr(exprs[i]) : exprs[i]);
+
+  sys::TimeValue now(0,0),user(0,0),delta(0,0),sys(0,0);
+  sys::Process::GetTimeUsage(now,user,sys);
+
+  setCexReuseContext(state.lineage, state.parentLineage, queryClient);
+  bool success = solver->evaluateBatch(state.constraints, simplified, 
+                                       results, solved, batchWorkers);
+
+  sys::Process::GetTimeUsage(delta,user,sys);
+  delta -= now;
+  stats::solverTime += delta.usec();
+  state.queryCost += delta.usec()/1000000.;
+
+  return success;
+}
+
+void TimingSolver::prefetch(const ExecutionState& state, 
+                            const std::vector< klee::ref<Expr> > &exprs) {
+  if (batchWorkers < 2)
+    return;
+
+  // Verdicts of other constraint sets are of no use to this one.
+  if (state.constraints.getGeneration() != prefetchGeneration)
+    clearPrefetched();
+
+  // Only announce what has not been answered yet, once each.
+  for (unsigned i = 0; i < exprs.size(); ++i) {
+    klee::ref<Expr> e = getQueryExpr(state, exprs[i]);
+    if (isa<ConstantExpr>(e) || prefetched.count(e))
+      continue;
+    ExprHashMap<unsigned>::iterator pi = pendingIndex.find(e);
+    if (pi != pendingIndex.end() && pi->second >= pendingNext)
+      continue;
+    // The same rewriting mustBeFalse does, so that the key is the query
+    // it will make (createIsZero turns a negated Or into an And, say).
+    klee::ref<Expr> negated = getQueryExpr(state, Expr::createIsZero(exprs[i]));
+    pendingIndex[e] = pending.size();
+    if (!isa<ConstantExpr>(negated))
+      pendingIndex[negated] = pending.size();
+    pending.push_back(std::make_pair(e, negated));
+  }
+  prefetchGeneration = state.constraints.getGeneration();
+}
+
 bool TimingSolver::mustBeFalse(const ExecutionState& state, klee::ref<Expr> expr,
                                bool &result) {
   return mustBeTrue(state, Expr::createIsZero(expr), result);
@@ -112,6 +447,7 @@ bool TimingSolver::mayBeFalse(const ExecutionState& state, klee::ref<Expr> expr,
 
 bool TimingSolver::getValue(const ExecutionState& state, klee::ref<Expr> expr, 
                             klee::ref<ConstantExpr> &result) {
+  lastAbandoned = false;
 
   // Fast path, to avoid timer and OS overhead.
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(expr)) {
@@ -126,6 +462,13 @@ bool TimingSolver::getValue(const ExecutionState& state, klee::ref<Expr> expr,
     expr = state.constraints.simplifyExpr(expr);
   }
 
+  // A value only describes a defect already found, so one cut off is
+  // not worth a retry.
+  bool budgeted = isBudgeted();
+  if (budgeted && !beginCheckQuery(state))
+    return false;
+
+  setCexReuseContext(state.lineage, state.parentLineage, queryClient);
   bool success = solver->getValue(Query(state.constraints, expr), result);
 
   sys::Process::GetTimeUsage(delta,user,sys);
@@ -133,6 +476,9 @@ bool TimingSolver::getValue(const ExecutionState& state, klee::ref<Expr> expr,
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
 
+  if (budgeted)
+    endCheckQuery(state, delta.usec()/1000000., success);
+
   return success;
 }
 
@@ -143,6 +489,7 @@ TimingSolver::getInitialValues(const ExecutionState& state,
                                std::vector< std::vector<unsigned char> >
                                  &result) {
 //   std::cout << "getInitialValues \n";
+  lastAbandoned = false;
 
   if (objects.empty())
     return true;
@@ -150,6 +497,11 @@ TimingSolver::getInitialValues(const ExecutionState& state,
   sys::TimeValue now(0,0),user(0,0),delta(0,0),sys(0,0);
   sys::Process::GetTimeUsage(now,user,sys);
 
+  bool budgeted = isBudgeted();
+  if (budgeted && !beginCheckQuery(state))
+    return false;
+
+  setCexReuseContext(state.lineage, state.parentLineage, queryClient);
   bool success = solver->getInitialValues(Query(state.constraints, 
                                           ConstantExpr::alloc(0, Expr::Bool)),
                                           objects, result);
@@ -158,6 +510,9 @@ TimingSolver::getInitialValues(const ExecutionState& state,
   delta -= now;
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
+
+  if (budgeted)
+    endCheckQuery(state, delta.usec()/1000000., success);
   
   return success;
 }
@@ -166,5 +521,6 @@ TimingSolver::getInitialValues(const ExecutionState& state,
 
 std::pair< klee::ref<Expr>, klee::ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, klee::ref<Expr> expr) {
+  setCexReuseContext(state.lineage, state.parentLineage, queryClient);
   return solver->getRange(Query(state.constraints, expr));
 }
@@ -10,9 +10,13 @@
 #ifndef KLEE_TIMINGSOLVER_H
 #define KLEE_TIMINGSOLVER_H
 
+#include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/Solver.h"
+#include "klee/util/ExprHashMap.h"
 
+#include <deque>
+#include <map>
 #include <vector>
 
 namespace klee {
@@ -27,6 +31,96 @@ namespace klee {
     Solver *solver;
     STPSolver *stpSolver;
     bool simplifyExprs;
+    /// The number of forked workers used by evaluateBatch; 0 or 1
+    /// evaluates batches in process.
+    unsigned batchWorkers;
+
+    /// Who the current queries are for. Recent counterexamples are kept
+    /// apart for each client of each state lineage.
+    enum QueryClient {
+      ExecutionClient = 0,
+      RaceCheckClient,
+      BankConflictCheckClient,
+      CoalescingCheckClient,
+      VolatileCheckClient,
+      OutOfBoundsCheckClient,
+      NumQueryClients
+    };
+    QueryClient queryClient;
+
+    static const char *getClientName(QueryClient client);
+
+  private:
+    /// Verdicts computed ahead of time by prefetch, keyed by the query
+    /// mustBeTrue or evaluate will make for them, and valid only while
+    /// the querying state's constraints are of prefetchGeneration.
+    ExprHashMap<Solver::Validity> prefetched;
+    uint64_t prefetchGeneration;
+    /// The expressions announced by prefetch and not yet evaluated, in
+    /// the order the caller will ask for them, each with the query that
+    /// mustBeFalse makes for it; a window of them is evaluated when the
+    /// caller asks for one. pendingIndex maps both queries to the position.
+    std::vector< std::pair< klee::ref<Expr>, klee::ref<Expr> > > pending;
+    ExprHashMap<unsigned> pendingIndex;
+    unsigned pendingNext;
+
+    klee::ref<Expr> getQueryExpr(const ExecutionState&, klee::ref<Expr>);
+    void evaluatePending(const ExecutionState&, unsigned from);
+    bool lookupPrefetched(const ExecutionState&, klee::ref<Expr>,
+                          Solver::Validity &result);
+
+    /// The timeout last set by the executor; budgeted queries restore it.
+    double timeout;
+
+    /// With -check-time-budget, each checker gets its own solver time
+    /// budget for each kernel. A query is cut off after a timeout derived
+    /// from the checker's recent query times; queries cut off, or not
+    /// asked once the budget is spent, are counted as unanswered. Those
+    /// cut off are queued, and retryAbandoned tries them again with what
+    /// budget is left once the checker has looked at everything else.
+    ///
+    /// The solver seconds spent by each checker, by kernel.
+    std::map<unsigned, std::vector<double> > budgetSpent;
+    /// The times of each checker's latest solved queries.
+    std::vector< std::vector<double> > recentQueryTimes;
+    std::vector<unsigned> nextQueryTime;
+
+    /// The queries left unanswered since they were last taken, by client.
+    std::vector<unsigned> unanswered;
+
+    struct AbandonedQuery {
+      QueryClient client;
+      unsigned kernel;
+      ConstraintManager constraints;
+      klee::ref<Expr> expr;
+    };
+    std::deque<AbandonedQuery> abandoned;
+
+    /// The verdicts found on retry, for when the checker asks again.
+    struct RetriedVerdict {
+      ConstraintManager constraints;
+      Solver::Validity validity;
+    };
+    ExprHashMap< std::vector<RetriedVerdict> > retried;
+
+    /// Whether the last query was given up on for lack of budget or time.
+    bool lastAbandoned;
+
+    bool isBudgeted() const;
+    double &getBudgetSpent(QueryClient client, unsigned kernel);
+    /// getCheckTimeout - The timeout for the next query of the current
+    /// client, or 0 if its budget is used up.
+    double getCheckTimeout(const ExecutionState&);
+    void recordQueryTime(QueryClient client, double seconds);
+    /// beginCheckQuery - Set the timeout for a budgeted query, or count
+    /// it as unanswered and return false if its budget is used up.
+    bool beginCheckQuery(const ExecutionState&);
+    /// endCheckQuery - Charge a budgeted query to its checker.
+    void endCheckQuery(const ExecutionState&, double seconds, bool success);
+    /// abandon - Queue a checker query which timed out to be retried.
+    void abandon(const ExecutionState&, klee::ref<Expr>);
+    bool lookupRetried(const ExecutionState&, klee::ref<Expr>,
+                       Solver::Validity &result);
 
   public:
     /// TimingSolver - Construct a new timing solver.
@@ -36,17 +130,63 @@ namespace klee {
     /// querying.
     TimingSolver(Solver *_solver, STPSolver *_stpSolver, 
                  bool _simplifyExprs = true) 
-      : solver(_solver), stpSolver(_stpSolver), simplifyExprs(_simplifyExprs) {}
+      : solver(_solver), stpSolver(_stpSolver), simplifyExprs(_simplifyExprs),
+        batchWorkers(0), queryClient(ExecutionClient),
+        prefetchGeneration(0), pendingNext(0), timeout(0.),
+        recentQueryTimes(NumQueryClients), nextQueryTime(NumQueryClients),
+        unanswered(NumQueryClients), lastAbandoned(false) {}
     ~TimingSolver() {
       delete solver;
     }
 
     void setTimeout(double t) {
+      timeout = t;
       stpSolver->setTimeout(t);
     }
 
+    /// wasAbandoned - Whether the last query failed because its checker
+    /// ran out of solver time (see -check-time-budget) rather than for
+    /// some other reason.
+    bool wasAbandoned() const { return lastAbandoned; }
+
+    /// retryAbandoned - Try the current client's queries that timed out
+    /// again, for as long as its budget lasts. Returns true if any got an
+    /// answer, in which case the checker should look again at what it
+    /// asked: the same queries are now answered from memory.
+    bool retryAbandoned();
+
+    /// takeUnanswered - Get, for each client, the number of queries given
+    /// up on since the last call, and reset the counts and the retries.
+    void takeUnanswered(std::vector<unsigned> &lost);
+
     bool evaluate(const ExecutionState&, klee::ref<Expr>, Solver::Validity &result);
 
+    /// evaluateBatch - Evaluate independent expressions under the
+    /// state's constraints, spread over batchWorkers solver processes.
+    /// Results are in the order of \a exprs.
+    bool evaluateBatch(const ExecutionState&,
+                       const std::vector< klee::ref<Expr> > &exprs,
+                       std::vector<Solver::Validity> &results,
+                       std::vector<bool> &solved);
+
+    /// prefetch - Announce expressions the caller is about to ask
+    /// mustBeTrue, mustBeFalse or evaluate about one by one, in that
+    /// order. When the caller reaches one that is not answered yet, it
+    /// and the next few are evaluated in one batch, so a caller that
+    /// stops early (at the first race, say) has not paid for the rest.
+    /// Does nothing unless batchWorkers > 1.
+    void prefetch(const ExecutionState&,
+                  const std::vector< klee::ref<Expr> > &exprs);
+
+    /// clearPrefetched - Drop all prefetched verdicts.
+    void clearPrefetched() {
+      prefetched.clear();
+      prefetchGeneration = 0;
+      pending.clear();
+      pendingIndex.clear();
+      pendingNext = 0;
+    }
+
     bool mustBeTrue(const ExecutionState&, klee::ref<Expr>, bool &result);
 
     bool mustBeFalse(const ExecutionState&, klee::ref<Expr>, bool &result);
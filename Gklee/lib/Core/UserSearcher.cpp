@@ -50,6 +50,10 @@ namespace {
   cl::opt<bool>
   UseRandomPathSearch("use-random-path");
 
+  cl::opt<bool>
+  UseBarrierAwareSearch("use-barrier-aware-search",
+                        cl::desc("Prefer kernel states covering new code in their barrier interval or with pending defect checks"));
+
   cl::opt<WeightedRandomSearcher::WeightType>
   WeightType("weight-type", cl::desc("Set the weight type for --use-non-uniform-random-search"),
              cl::values(clEnumValN(WeightedRandomSearcher::Depth, "none", "use (2^depth)"),
@@ -62,11 +66,11 @@ namespace {
   
   cl::opt<bool>
   UseMerge("use-merge", 
-           cl::desc("Enable support for klee_merge() (experimental)"));
+           cl::desc("Enable support for klee_merge(), and merge states after __syncthreads barriers (experimental)"));
  
   cl::opt<bool>
   UseBumpMerge("use-bump-merge", 
-           cl::desc("Enable support for klee_merge() (extra experimental)"));
+           cl::desc("Enable support for klee_merge(), and merge states after __syncthreads barriers (extra experimental)"));
  
   cl::opt<bool>
   UseIterativeDeepeningTimeSearch("use-iterative-deepening-time-search", 
@@ -107,6 +111,8 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
 
   if (UseRandomPathSearch) {
     searcher = new RandomPathSearcher(executor);
+  } else if (UseBarrierAwareSearch) {
+    searcher = new BarrierAwareSearcher(executor);
   } else if (UseNonUniformRandomSearch) {
     searcher = new WeightedRandomSearcher(executor, WeightType);
   } else if (UseRandomSearch) {
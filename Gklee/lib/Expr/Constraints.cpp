@@ -10,13 +10,18 @@
 #include "klee/Constraints.h"
 
 #include "klee/util/ExprPPrinter.h"
+#include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <set>
 
 using namespace klee;
 
+uint64_t ConstraintManager::nextGeneration = 0;
+
 class ExprReplaceVisitor : public ExprVisitor {
 private:
   klee::ref<Expr> src, dst;
@@ -61,10 +66,182 @@ public:
   }
 };
 
+/***/
+
+void IndependenceIndex::findIndependenceArrays(klee::ref<Expr> e,
+                                               std::vector<const Array*> &arrays) {
+  std::vector< klee::ref<ReadExpr> > reads;
+  findReads(e, /* visitUpdates= */ true, reads);
+  for (unsigned i = 0; i != reads.size(); ++i) {
+    ReadExpr *re = reads[i].get();
+    // Reads of a constant array don't alias.
+    if (re->updates.root->isConstantArray() && !re->updates.head)
+      continue;
+    arrays.push_back(re->updates.root);
+  }
+}
+
+const Array *IndependenceIndex::find(const Array *array) {
+  std::map<const Array*, const Array*>::iterator it = parents.find(array);
+  if (it == parents.end()) {
+    parents.insert(std::make_pair(array, array));
+    return array;
+  }
+  if (it->second == array)
+    return array;
+
+  const Array *root = find(it->second);
+  it->second = root;
+  return root;
+}
+
+const Array *IndependenceIndex::unite(const Array *a, const Array *b) {
+  a = find(a);
+  b = find(b);
+  if (a == b)
+    return a;
+
+  // Keep the larger class, so every position is moved O(log n) times.
+  if (classes[a].size() < classes[b].size())
+    std::swap(a, b);
+  std::vector<unsigned> &into = classes[a];
+  std::map<const Array*, std::vector<unsigned> >::iterator from =
+    classes.find(b);
+  into.insert(into.end(), from->second.begin(), from->second.end());
+  classes.erase(from);
+  parents[b] = a;
+  return a;
+}
+
+void IndependenceIndex::add(klee::ref<Expr> e, unsigned position) {
+  std::vector<const Array*> arrays;
+  findIndependenceArrays(e, arrays);
+  if (arrays.empty())
+    return;
+
+  const Array *root = find(arrays[0]);
+  for (unsigned i = 1; i < arrays.size(); ++i)
+    root = unite(root, arrays[i]);
+  classes[root].push_back(position);
+}
+
+void IndependenceIndex::getPositions(const std::vector<const Array*> &arrays,
+                                     std::vector<unsigned> &positions) {
+  std::set<const Array*> roots;
+  for (unsigned i = 0; i < arrays.size(); ++i) {
+    const Array *root = find(arrays[i]);
+    if (!roots.insert(root).second)
+      continue;
+    std::map<const Array*, std::vector<unsigned> >::iterator it =
+      classes.find(root);
+    if (it != classes.end())
+      positions.insert(positions.end(), it->second.begin(), it->second.end());
+  }
+}
+
+/***/
+
+const unsigned EqualityIndex::MaxSimplified;
+const unsigned EqualityIndex::MaxDepth;
+
+EqualityIndex::EqualityIndex(klee::ref<EqualityIndex> _base)
+  : refCount(0), base(_base), depth(_base->depth + 1) {
+  if (depth <= MaxDepth)
+    return;
+
+  // Flatten, the deepest index first so that earlier substitutions
+  // still take precedence.
+  std::vector<const EqualityIndex*> chain;
+  for (const EqualityIndex *index = _base.get(); index;
+       index = index->base.get())
+    chain.push_back(index);
+  for (unsigned i = chain.size(); i != 0; --i)
+    equalities.insert(chain[i - 1]->equalities.begin(),
+                      chain[i - 1]->equalities.end());
+  base = 0;
+  depth = 0;
+}
+
+bool EqualityIndex::contains(klee::ref<Expr> e) const {
+  for (const EqualityIndex *index = this; index; index = index->base.get())
+    if (index->equalities.count(e))
+      return true;
+  return false;
+}
+
+void EqualityIndex::add(klee::ref<Expr> e) {
+  klee::ref<Expr> key = e, value = ConstantExpr::alloc(1, Expr::Bool);
+  const EqExpr *ee = dyn_cast<EqExpr>(e);
+  if (ee && isa<ConstantExpr>(ee->left)) {
+    key = ee->right;
+    value = ee->left;
+  }
+
+  if (!contains(key)) {
+    equalities.insert(std::make_pair(key, value));
+    simplified.clear();
+  }
+}
+
+klee::ref<Expr> EqualityIndex::simplify(klee::ref<Expr> e) {
+  equalities_ty::iterator it = simplified.find(e);
+  if (it != simplified.end())
+    return it->second;
+
+  // Keep the memo from pinning too many expressions.
+  if (simplified.size() >= MaxSimplified)
+    simplified.clear();
+
+  // Every substitution holds under the constraints, so applying the
+  // base's first and then this index's own is as sound as one pass.
+  klee::ref<Expr> result = base.isNull() ? e : base->simplify(e);
+  if (!equalities.empty())
+    result = ExprReplaceVisitor2(equalities).visit(result);
+  simplified.insert(std::make_pair(e, result));
+  return result;
+}
+
+/***/
+
+void ConstraintManager::getIndependentSlice(klee::ref<Expr> e,
+                                            std::vector< klee::ref<Expr> > &result) const {
+  std::vector<const Array*> arrays;
+  IndependenceIndex::findIndependenceArrays(e, arrays);
+  if (arrays.empty())
+    return;
+
+  if (independence.isNull()) {
+    independence = new IndependenceIndex();
+    for (unsigned i = 0; i < constraints.size(); ++i)
+      independence->add(constraints[i], i);
+  }
+
+  // Lookups only compress paths, so they are safe on a shared index.
+  std::vector<unsigned> positions;
+  independence->getPositions(arrays, positions);
+  std::sort(positions.begin(), positions.end());
+  for (unsigned i = 0; i < positions.size(); ++i)
+    result.push_back(constraints[positions[i]]);
+}
+
+void ConstraintManager::addToIndependence(klee::ref<Expr> e) {
+  if (independence.isNull())
+    return;
+  if (independence->refCount > 1)
+    independence = new IndependenceIndex(*independence);
+  independence->add(e, constraints.size() - 1);
+}
+
 bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
   ConstraintManager::constraints_ty old;
   bool changed = false;
 
+  // Positions move while rewriting; only an unchanged set keeps its index.
+  klee::ref<IndependenceIndex> oldIndependence = independence;
+  independence = 0;
+  klee::ref<EqualityIndex> oldEqualities = equalities;
+  equalities = 0;
+
   constraints.swap(old);
   for (ConstraintManager::constraints_ty::iterator 
          it = old.begin(), ie = old.end(); it != ie; ++it) {
@@ -79,6 +256,10 @@ bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
     }
   }
 
+  if (!changed) {
+    independence = oldIndependence;
+    equalities = oldEqualities;
+  }
   return changed;
 }
 
@@ -90,29 +271,26 @@ klee::ref<Expr> ConstraintManager::simplifyExpr(klee::ref<Expr> e) const {
   if (isa<ConstantExpr>(e))
     return e;
 
-  std::map< klee::ref<Expr>, klee::ref<Expr> > equalities;
-  
-  for (ConstraintManager::constraints_ty::const_iterator 
-         it = constraints.begin(), ie = constraints.end(); it != ie; ++it) {
-    if (const EqExpr *ee = dyn_cast<EqExpr>(*it)) {
-      if (isa<ConstantExpr>(ee->left)) {
-        equalities.insert(std::make_pair(ee->right,
-                                         ee->left));
-      } else {
-        equalities.insert(std::make_pair(*it,
-                                         ConstantExpr::alloc(1, Expr::Bool)));
-      }
-    } else {
-      equalities.insert(std::make_pair(*it,
-                                       ConstantExpr::alloc(1, Expr::Bool)));
-    }
+  if (equalities.isNull()) {
+    equalities = new EqualityIndex();
+    for (ConstraintManager::constraints_ty::const_iterator 
+           it = constraints.begin(), ie = constraints.end(); it != ie; ++it)
+      equalities->add(*it);
   }
 
-  return ExprReplaceVisitor2(equalities).visit(e);
+  return equalities->simplify(e);
+}
+
+void ConstraintManager::addToEqualities(klee::ref<Expr> e) {
+  if (equalities.isNull())
+    return;
+  if (equalities->refCount > 1)
+    equalities = new EqualityIndex(equalities);
+  equalities->add(e);
 }
 
 klee::ref<Expr> ConstraintManager::updateExprThroughReplacement(klee::ref<Expr> e, 
-                                                          std::map< klee::ref<Expr>, klee::ref<Expr> > equalities) const {
+                                                          const std::map< klee::ref<Expr>, klee::ref<Expr> > &equalities) const {
   if (isa<ConstantExpr>(e))
     return e;
 
@@ -154,17 +332,22 @@ void ConstraintManager::addConstraintInternal(klee::ref<Expr> e) {
       rewriteConstraints(visitor);
     }
     constraints.push_back(e);
+    addToIndependence(e);
+    addToEqualities(e);
     break;
   }
     
   default:
     constraints.push_back(e);
+    addToIndependence(e);
+    addToEqualities(e);
     break;
   }
 
 }
 
 void ConstraintManager::addConstraint(klee::ref<Expr> e) {
+  generation = ++nextGeneration;
   e = simplifyExpr(e);
   addConstraintInternal(e);
 }
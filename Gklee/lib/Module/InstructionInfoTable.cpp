@@ -75,6 +75,29 @@ static void buildInstructionToLineMap(Module *m,
   }
 }
 
+// Use the lines recorded for an identical module instead of printing this
+// one again. Fails if the number of instructions does not match.
+static bool mapAssemblyLines(Module *m, const std::vector<unsigned> &lines,
+                             std::map<const Instruction*, unsigned> &out) {
+  unsigned i = 0;
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
+       fnIt != fn_ie; ++fnIt) {
+    for (inst_iterator it = inst_begin(fnIt), ie = inst_end(fnIt);
+         it != ie; ++it) {
+      if (i == lines.size()) {
+        out.clear();
+        return false;
+      }
+      out.insert(std::make_pair(&*it, lines[i++]));
+    }
+  }
+  if (i != lines.size()) {
+    out.clear();
+    return false;
+  }
+  return true;
+}
+
 #if LLVM_VERSION_CODE < LLVM_VERSION(2, 7)
 static std::string getDSPIPath(const DbgStopPointInst *dspi) {
   std::string dir, file;
@@ -117,11 +140,13 @@ bool InstructionInfoTable::getInstructionDebugInfo(const llvm::Instruction *I,
   return false;
 }
 
-InstructionInfoTable::InstructionInfoTable(Module *m) 
+InstructionInfoTable::InstructionInfoTable(Module *m,
+                                           const std::vector<unsigned> *assemblyLines) 
   : dummyString(""), dummyInfo(0, dummyString, 0, 0) {
   unsigned id = 0;
   std::map<const Instruction*, unsigned> lineTable;
-  buildInstructionToLineMap(m, lineTable);
+  if (!assemblyLines || !mapAssemblyLines(m, *assemblyLines, lineTable))
+    buildInstructionToLineMap(m, lineTable);
 
   for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
        fnIt != fn_ie; ++fnIt) {
@@ -228,3 +253,13 @@ InstructionInfoTable::getFunctionInfo(const Function *f) const {
     return getInfo(f->begin()->begin());
   }
 }
+
+void InstructionInfoTable::getAssemblyLines(Module *m,
+                                            std::vector<unsigned> &out) const {
+  out.clear();
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
+       fnIt != fn_ie; ++fnIt)
+    for (inst_iterator it = inst_begin(fnIt), ie = inst_end(fnIt);
+         it != ie; ++it)
+      out.push_back(getInfo(&*it).assemblyLine);
+}
@@ -29,8 +29,12 @@
 #include "llvm/Module.h"
 #include "llvm/PassManager.h"
 #include "llvm/ValueSymbolTable.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/Support/CallSite.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/system_error.h"
 #include "llvm/Support/raw_ostream.h"
 #if LLVM_VERSION_CODE >= LLVM_VERSION(2, 7)
 #include "llvm/Support/raw_os_ostream.h"
@@ -49,6 +53,11 @@
 
 #include <sstream>
 #include <iostream>
+#include <fstream>
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace llvm;
 using namespace klee;
@@ -91,6 +100,12 @@ namespace {
   cl::opt<bool>
   DebugPrintEscapingFunctions("debug-print-escaping-functions", 
                               cl::desc("Print functions whose address is taken."));
+
+  cl::opt<std::string>
+  ModuleCacheDir("module-cache-dir",
+                 cl::desc("Keep prepared modules in this directory and reuse them "
+                          "when the input, runtime and options match (default=off)"),
+                 cl::init(""));
 }
 
 KModule::KModule(Module *_module) 
@@ -122,6 +137,7 @@ KModule::~KModule() {
 
 namespace llvm {
 extern void Optimize(Module*);
+extern std::string getOptimizeSettings();
 }
 
 // what a hack
@@ -213,8 +229,140 @@ static void forceImport(Module *m, const char *name, LLVM_TYPE_Q Type *retType,
   }
 }
 
-void KModule::prepare(const Interpreter::ModuleOptions &opts,
-                      InterpreterHandler *ih) {
+/***/
+
+/// Bump the version whenever the way modules are prepared changes, so
+/// that stale cache entries are not used.
+static const unsigned moduleCacheVersion = 1;
+
+static uint64_t hashBytes(uint64_t hash, const char *data, size_t size) {
+  // FNV-1a
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= (unsigned char) data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const std::string &s) {
+  return hashBytes(hash, s.c_str(), s.size() + 1);
+}
+
+static uint64_t hashFile(uint64_t hash, const std::string &path) {
+  OwningPtr<MemoryBuffer> buffer;
+  hash = hashString(hash, path);
+  if (!MemoryBuffer::getFile(path, buffer))
+    hash = hashBytes(hash, buffer->getBufferStart(), buffer->getBufferSize());
+  return hash;
+}
+
+/// Name a prepared module after everything that goes into it: the input
+/// module, the runtime libraries linked into it and the options that
+/// affect the passes run over it.
+static std::string getModuleCacheKey(Module *module, 
+                                     const Interpreter::ModuleOptions &opts) {
+  uint64_t hash = 14695981039346656037ULL;
+  std::ostringstream settings;
+  settings << moduleCacheVersion << ' ' << opts.Optimize << ' ' 
+           << opts.CheckDivZero << ' ' << SwitchType << ' '
+           << getOptimizeSettings();
+  for (cl::list<std::string>::iterator it = MergeAtExit.begin(), 
+         ie = MergeAtExit.end(); it != ie; ++it)
+    settings << ' ' << *it;
+  hash = hashString(hash, settings.str());
+
+  std::string bitcode;
+  llvm::raw_string_ostream os(bitcode);
+  WriteBitcodeToFile(module, os);
+  os.flush();
+  hash = hashBytes(hash, bitcode.data(), bitcode.size());
+
+  llvm::sys::Path path(opts.LibraryDir);
+  path.appendComponent("libkleeRuntimeIntrinsic.bca");
+  hash = hashFile(hash, path.str());
+  path.eraseComponent();
+  path.appendComponent("libcudaRuntimeIntrinsic.bca");
+  hash = hashFile(hash, path.str());
+
+  char key[17];
+  snprintf(key, sizeof(key), "%016llx", (unsigned long long) hash);
+  return key;
+}
+
+static Module *loadCachedModule(const std::string &path) {
+  OwningPtr<MemoryBuffer> buffer;
+  if (MemoryBuffer::getFile(path, buffer))
+    return 0;
+
+  std::string error;
+  Module *m = ParseBitcodeFile(buffer.get(), getGlobalContext(), &error);
+  if (!m)
+    klee_warning("ignoring cached module %s: %s", path.c_str(), error.c_str());
+  return m;
+}
+
+/// Cache entries are written to a temporary file and renamed into place,
+/// so that concurrent runs never see a partial entry.
+static std::string getCacheTempPath(const std::string &path) {
+  mkdir(ModuleCacheDir.c_str(), 0775);
+  std::ostringstream tmp;
+  tmp << path << ".tmp" << getpid();
+  return tmp.str();
+}
+
+static void renameCacheFile(const std::string &path, const std::string &tmpPath,
+                            bool ok) {
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    klee_warning("unable to write %s", path.c_str());
+    unlink(tmpPath.c_str());
+  }
+}
+
+static void storeCachedModule(Module *module, const std::string &path) {
+  std::string tmpPath = getCacheTempPath(path), error;
+  bool ok;
+  {
+    llvm::raw_fd_ostream os(tmpPath.c_str(), error, 
+                            llvm::raw_fd_ostream::F_Binary);
+    ok = error.empty();
+    if (ok) {
+      WriteBitcodeToFile(module, os);
+      os.close();
+      ok = !os.has_error();
+      os.clear_error();
+    }
+  }
+  renameCacheFile(path, tmpPath, ok);
+}
+
+static void loadAssemblyLines(const std::string &path, 
+                              std::vector<unsigned> &lines) {
+  std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+  uint32_t count;
+  if (!is.read((char*) &count, sizeof(count)))
+    return;
+  lines.resize(count);
+  if (count && !is.read((char*) &lines[0], count * sizeof(unsigned)))
+    lines.clear();
+}
+
+static void storeAssemblyLines(const std::string &path, 
+                               const std::vector<unsigned> &lines) {
+  std::string tmpPath = getCacheTempPath(path);
+  bool ok;
+  {
+    std::ofstream os(tmpPath.c_str(), std::ios::out | std::ios::binary);
+    uint32_t count = lines.size();
+    os.write((const char*) &count, sizeof(count));
+    if (count)
+      os.write((const char*) &lines[0], count * sizeof(unsigned));
+    os.close();
+    ok = !os.fail();
+  }
+  renameCacheFile(path, tmpPath, ok);
+}
+
+void KModule::transform(const Interpreter::ModuleOptions &opts) {
   if (!MergeAtExit.empty()) {
     Function *mergeFn = module->getFunction("klee_merge");
     if (!mergeFn) {
@@ -348,7 +496,30 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
   if (f && f->use_empty()) f->eraseFromParent();
   f = module->getFunction("memset");
   if (f && f->use_empty()) f->eraseFromParent();
+}
 
+void KModule::prepare(const Interpreter::ModuleOptions &opts,
+                      InterpreterHandler *ih) {
+  std::string cachePath;
+  std::vector<unsigned> assemblyLines;
+  bool cached = false;
+  if (!ModuleCacheDir.empty()) {
+    cachePath = ModuleCacheDir + "/" + getModuleCacheKey(module, opts);
+    if (Module *m = loadCachedModule(cachePath + ".bc")) {
+      klee_message("using cached module: %s.bc", cachePath.c_str());
+      m->setModuleIdentifier(module->getModuleIdentifier());
+      delete module;
+      module = m;
+      cached = true;
+      loadAssemblyLines(cachePath + ".lines", assemblyLines);
+    }
+  }
+
+  if (!cached) {
+    transform(opts);
+    if (!cachePath.empty())
+      storeCachedModule(module, cachePath + ".bc");
+  }
 
   // Write out the .ll assembly file. We truncate long lines to work
   // around a kcachegrind parsing bug (it puts them on new lines), so
@@ -440,7 +611,12 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
 
   /* Build shadow structures */
 
-  infos = new InstructionInfoTable(module);  
+  infos = new InstructionInfoTable(module, 
+                                   assemblyLines.empty() ? 0 : &assemblyLines);
+  if (!cachePath.empty() && assemblyLines.empty()) {
+    infos->getAssemblyLines(module, assemblyLines);
+    storeAssemblyLines(cachePath + ".lines", assemblyLines);
+  }
   
   for (Module::iterator it = module->begin(), ie = module->end();
        it != ie; ++it) {
@@ -524,6 +700,29 @@ static int getOperandNum(Value *v,
   }
 }
 
+/// Find the function a call goes to without looking at the state: the
+/// called value through bitcasts and global aliases.
+static Function *getStaticTarget(Value *calledVal) {
+  SmallPtrSet<const GlobalValue*, 3> Visited;
+
+  Constant *c = dyn_cast<Constant>(calledVal);
+  while (c) {
+    if (GlobalValue *gv = dyn_cast<GlobalValue>(c)) {
+      if (!Visited.insert(gv))
+        return 0;
+      if (Function *f = dyn_cast<Function>(gv))
+        return f;
+      GlobalAlias *ga = dyn_cast<GlobalAlias>(gv);
+      c = ga ? ga->getAliasee() : 0;
+    } else if (llvm::ConstantExpr *ce = dyn_cast<llvm::ConstantExpr>(c)) {
+      c = ce->getOpcode() == Instruction::BitCast ? ce->getOperand(0) : 0;
+    } else {
+      c = 0;
+    }
+  }
+  return 0;
+}
+
 KFunction::KFunction(llvm::Function *_function,
                      KModule *km) 
   : function(_function),
@@ -570,6 +769,10 @@ KFunction::KFunction(llvm::Function *_function,
 
       ki->inst = it;
       ki->dest = registerMap[it];
+      ki->width = it->getType()->isSized()
+        ? km->targetData->getTypeSizeInBits(it->getType()) : 0;
+      ki->target = 0;
+      ki->cudaIntrinsic = 0;
 
       if (isa<CallInst>(it) || isa<InvokeInst>(it)) {
         CallSite cs(it);
@@ -577,6 +780,7 @@ KFunction::KFunction(llvm::Function *_function,
         ki->operands = new int[numArgs+1];
         ki->operands[0] = getOperandNum(cs.getCalledValue(), registerMap, km,
                                         ki);
+        ki->target = getStaticTarget(cs.getCalledValue());
         for (unsigned j=0; j<numArgs; j++) {
           Value *v = cs.getArgument(j);
           ki->operands[j+1] = getOperandNum(v, registerMap, km, ki);
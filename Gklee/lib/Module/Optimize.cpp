@@ -170,6 +170,18 @@ static void AddStandardCompilePasses(PassManager &PM) {
   addPass(PM, createConstantMergePass());        // Merge dup global constants
 }
 
+/// getOptimizeSettings - Describe the options which change what Optimize
+/// does, so that its results can be cached against them.
+std::string getOptimizeSettings() {
+  std::string settings;
+  settings += DisableOptimizations ? 'O' : 'o';
+  settings += DisableInline ? 'I' : 'i';
+  settings += DisableInternalize ? 'N' : 'n';
+  settings += Strip ? 'S' : 's';
+  settings += StripDebug ? 'D' : 'd';
+  return settings;
+}
+
 /// Optimize - Perform link time optimizations. This will run the scalar
 /// optimizations, any loaded plugin-optimization modules, and then the
 /// inter-procedural optimizations if applicable.
@@ -22,6 +22,9 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+#include <deque>
+
 using namespace klee;
 using namespace llvm;
 
@@ -37,6 +40,26 @@ namespace {
   cl::opt<bool>
   CexCacheExperimental("cex-cache-exp", cl::init(false));
 
+  cl::opt<unsigned>
+  CexReuseDepth("cex-reuse-depth",
+                cl::desc("Number of recent counterexamples kept per state lineage and checker, and tried before asking STP (default=0 (off))"),
+                cl::init(0));
+
+}
+
+/// The contexts recent counterexamples are kept under and looked up in:
+/// the state's own lineage, then the one it was forked from; see
+/// setCexReuseContext.
+static std::pair<unsigned, unsigned> cexReuseContext;
+static std::pair<unsigned, unsigned> cexReuseParentContext;
+
+/// The number of reuse contexts kept before they are all dropped.
+static const unsigned MaxCexReuseContexts = 4096;
+
+void klee::setCexReuseContext(unsigned lineage, unsigned parentLineage,
+                              unsigned client) {
+  cexReuseContext = std::make_pair(lineage, client);
+  cexReuseParentContext = std::make_pair(parentLineage, client);
 }
 
 ///
@@ -58,6 +81,16 @@ class CexCachingSolver : public SolverImpl {
   MapOfSets<klee::ref<Expr>, Assignment*> cache;
   // memo table
   assignmentsTable_ty assignmentsTable;
+  // most recent satisfying assignments for each reuse context, newest
+  // first; they are owned by assignmentsTable
+  std::map<std::pair<unsigned, unsigned>, std::deque<Assignment*> > recent;
+
+  bool searchRecent(KeyType &key, Assignment *&result);
+  bool searchRecentIn(std::deque<Assignment*> &assignments, KeyType &key,
+                      Assignment *&result);
+  void rememberRecent(Assignment *binding);
+  void rememberRecentIn(std::deque<Assignment*> &assignments,
+                        Assignment *binding);
 
   bool searchForAssignment(KeyType &key, 
                            Assignment *&result);
@@ -169,6 +202,67 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
   return false;
 }
 
+/// searchRecent - Try the most recent assignments of the current reuse
+/// context on a query, then those of the lineage the state was forked
+/// from. Sibling states and repeated defect checks tend to be satisfied
+/// by the same values, even when their constraint sets share no cache
+/// entry.
+bool CexCachingSolver::searchRecent(KeyType &key, Assignment *&result) {
+  if (!CexReuseDepth)
+    return false;
+
+  if (searchRecentIn(recent[cexReuseContext], key, result))
+    return true;
+  if (cexReuseParentContext.first &&
+      searchRecentIn(recent[cexReuseParentContext], key, result)) {
+    rememberRecentIn(recent[cexReuseContext], result);
+    return true;
+  }
+  ++stats::cexReuseMisses;
+  return false;
+}
+
+bool CexCachingSolver::searchRecentIn(std::deque<Assignment*> &assignments,
+                                      KeyType &key, Assignment *&result) {
+  for (std::deque<Assignment*>::iterator it = assignments.begin(),
+         ie = assignments.end(); it != ie; ++it) {
+    if ((*it)->satisfies(key.begin(), key.end())) {
+      result = *it;
+      // Keep the hit at the front.
+      assignments.erase(it);
+      assignments.push_front(result);
+      ++stats::cexReuseHits;
+      return true;
+    }
+  }
+  return false;
+}
+
+/// rememberRecent - Keep a new assignment under the current reuse context
+/// and under the lineage the state was forked from, where its siblings
+/// look.
+void CexCachingSolver::rememberRecent(Assignment *binding) {
+  if (!CexReuseDepth)
+    return;
+
+  if (recent.size() >= MaxCexReuseContexts)
+    recent.clear();
+  rememberRecentIn(recent[cexReuseContext], binding);
+  if (cexReuseParentContext.first)
+    rememberRecentIn(recent[cexReuseParentContext], binding);
+}
+
+void CexCachingSolver::rememberRecentIn(std::deque<Assignment*> &assignments,
+                                        Assignment *binding) {
+  std::deque<Assignment*>::iterator it =
+    std::find(assignments.begin(), assignments.end(), binding);
+  if (it != assignments.end())
+    assignments.erase(it);
+  assignments.push_front(binding);
+  if (assignments.size() > CexReuseDepth)
+    assignments.pop_back();
+}
+
 /// lookupAssignment - Lookup a cached result for the given \arg query.
 ///
 /// \param query - The query to lookup.
@@ -199,6 +293,11 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   if (lookupAssignment(query, key, result))
     return true;
 
+  if (searchRecent(key, result)) {
+    cache.insert(key, result);
+    return true;
+  }
+
   std::vector<const Array*> objects;
   findSymbolicObjects(key.begin(), key.end(), objects);
 
@@ -222,6 +321,8 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
     
     if (DebugCexCacheCheckBinding)
       assert(binding->satisfies(key.begin(), key.end()));
+
+    rememberRecent(binding);
   } else {
     binding = (Assignment*) 0;
   }
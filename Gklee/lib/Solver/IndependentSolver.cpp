@@ -225,8 +225,13 @@ IndependentElementSet getIndependentConstraints(const Query& query,
   IndependentElementSet eltsClosure(query.expr);
   std::vector< std::pair<klee::ref<Expr>, IndependentElementSet> > worklist;
 
-  for (ConstraintManager::const_iterator it = query.constraints.begin(), 
-         ie = query.constraints.end(); it != ie; ++it)
+  // Only constraints in the same array classes as the query can be
+  // reached, so refine the constraint manager's slice rather than
+  // scanning every constraint.
+  std::vector< klee::ref<Expr> > slice;
+  query.constraints.getIndependentSlice(query.expr, slice);
+  for (std::vector< klee::ref<Expr> >::const_iterator it = slice.begin(), 
+         ie = slice.end(); it != ie; ++it)
     worklist.push_back(std::make_pair(*it, IndependentElementSet(*it)));
 
   // XXX This should be more efficient (in terms of low level copy stuff).
@@ -0,0 +1,363 @@
+//===-- PortfolioSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "SolverStats.h"
+
+#include "klee/Expr.h"
+#include "klee/Constraints.h"
+#include "klee/SolverImpl.h"
+#include "klee/TimerStatIncrementer.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprHashMap.h"
+#include "klee/util/ExprUtil.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+using namespace klee;
+using namespace llvm;
+
+/***/
+
+/// The part of the shared mapping owned by one configuration. It is
+/// followed by the bytes of the counterexample.
+struct PortfolioSlot {
+  unsigned char solved;
+  unsigned char hasSolution;
+};
+
+static const unsigned portfolio_slot_size = 1<<20;
+
+/// A configuration is trusted to run alone on a query shape after it has
+/// won this many races on it, and nobody else has won one since.
+static const unsigned portfolio_confidence = 8;
+
+static void portfolioTimeoutHandler(int x) {
+  _exit(52);
+}
+
+class PortfolioSolver : public SolverImpl {
+private:
+  /// configurations[0] is the primary solver, the rest are alternates.
+  std::vector<Solver*> configurations;
+  STPSolver *primary;
+  unsigned char *sharedMemory;
+  SolverRunStatus runStatusCode;
+
+  /// For each query shape, the configuration that won the last race and
+  /// how many races in a row it has won.
+  std::map<unsigned, std::pair<unsigned, unsigned> > winners;
+
+  unsigned getShape(const Query&);
+  PortfolioSlot *getSlot(unsigned i) {
+    return (PortfolioSlot*) (sharedMemory + i * portfolio_slot_size);
+  }
+  int race(const Query&, const std::vector<unsigned> &entrants,
+           const std::vector<const Array*> &objects, bool &timedOut);
+
+public:
+  PortfolioSolver(STPSolver *_primary, const std::vector<Solver*> &alternates);
+  ~PortfolioSolver();
+
+  bool computeTruth(const Query&, bool &isValid);
+  bool computeValue(const Query&, klee::ref<Expr> &result);
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+};
+
+PortfolioSolver::PortfolioSolver(STPSolver *_primary,
+                                 const std::vector<Solver*> &alternates)
+  : primary(_primary),
+    sharedMemory(0),
+    runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+  configurations.push_back(primary);
+  configurations.insert(configurations.end(),
+                        alternates.begin(), alternates.end());
+
+  void *mem = mmap(NULL, configurations.size() * portfolio_slot_size,
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  assert(mem != MAP_FAILED && "mmap failed");
+  sharedMemory = (unsigned char*) mem;
+}
+
+PortfolioSolver::~PortfolioSolver() {
+  munmap(sharedMemory, configurations.size() * portfolio_slot_size);
+  for (unsigned i = 0; i < configurations.size(); ++i)
+    delete configurations[i];
+}
+
+/// getShape - Classify a query by the size of its constraint set and by
+/// the operators in the query expression which the configurations
+/// handle differently.
+unsigned PortfolioSolver::getShape(const Query &query) {
+  unsigned numConstraints = query.constraints.size();
+  unsigned sizeClass = 0;
+  while (numConstraints >>= 1)
+    ++sizeClass;
+
+  bool hasDivision = false, hasMultiplication = false;
+  std::vector< klee::ref<Expr> > stack;
+  ExprHashSet visited;
+  stack.push_back(query.expr);
+  while (!stack.empty()) {
+    klee::ref<Expr> e = stack.back();
+    stack.pop_back();
+    if (isa<ConstantExpr>(e) || !visited.insert(e).second)
+      continue;
+    switch (e->getKind()) {
+    case Expr::UDiv: case Expr::SDiv: case Expr::URem: case Expr::SRem:
+      hasDivision = true;
+      break;
+    case Expr::Mul:
+      hasMultiplication = true;
+      break;
+    default:
+      break;
+    }
+    for (unsigned i = 0; i < e->getNumKids(); ++i)
+      stack.push_back(e->getKid(i));
+  }
+
+  return (sizeClass << 2) | (hasDivision << 1) | hasMultiplication;
+}
+
+/// race - Run each entrant on the query in its own process and return
+/// the index of the first one to answer, or -1 if none did. The losers
+/// are killed.
+int PortfolioSolver::race(const Query &query,
+                          const std::vector<unsigned> &entrants,
+                          const std::vector<const Array*> &objects,
+                          bool &timedOut) {
+  double timeout = primary->getTimeout();
+  pid_t group = 0;
+  unsigned running = 0;
+
+  fflush(stdout);
+  fflush(stderr);
+  for (unsigned k = 0; k < entrants.size(); ++k) {
+    unsigned i = entrants[k];
+    getSlot(i)->solved = 0;
+
+    pid_t pid = fork();
+    if (pid == -1) {
+      fprintf(stderr, "error: fork failed (for portfolio solver)");
+      continue;
+    }
+
+    if (pid == 0) {
+      setpgid(0, group);
+      if (timeout) {
+        ::alarm(0); /* Turn off alarm so we can safely set signal handler */
+        ::signal(SIGALRM, portfolioTimeoutHandler);
+        ::alarm(std::max(1, (int)timeout));
+      }
+
+      std::vector< std::vector<unsigned char> > values;
+      bool hasSolution;
+      if (!configurations[i]->impl->computeInitialValues(query, objects,
+                                                         values, hasSolution))
+        _exit(1);
+
+      PortfolioSlot *slot = getSlot(i);
+      unsigned char *pos = (unsigned char*) (slot + 1);
+      if (hasSolution)
+        for (unsigned j = 0; j < values.size(); ++j)
+          pos = std::copy(values[j].begin(), values[j].end(), pos);
+      slot->hasSolution = hasSolution;
+      slot->solved = 1;
+      _exit(0);
+    }
+
+    // Set the group from both sides, so it is in place whichever of
+    // parent and child runs first.
+    setpgid(pid, group ? group : pid);
+    if (!group)
+      group = pid;
+    ++running;
+  }
+
+  int winner = -1;
+  while (running && winner < 0) {
+    int status;
+    pid_t res = waitpid(-group, &status, 0);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "error: waitpid() for portfolio solver failed");
+      break;
+    }
+    --running;
+
+    if (WIFSIGNALED(status) || !WIFEXITED(status))
+      continue;
+    if (WEXITSTATUS(status) == 52) {
+      timedOut = true;
+      continue;
+    }
+    if (WEXITSTATUS(status) != 0)
+      continue;
+
+    // Winners are decided by exit order, but several may have finished
+    // by now; take the first entrant with an answer.
+    for (unsigned k = 0; k < entrants.size() && winner < 0; ++k)
+      if (getSlot(entrants[k])->solved)
+        winner = entrants[k];
+  }
+
+  if (running) {
+    kill(-group, SIGKILL);
+    while (running) {
+      int status;
+      pid_t res = waitpid(-group, &status, 0);
+      if (res < 0 && errno == EINTR)
+        continue;
+      if (res < 0)
+        break;
+      --running;
+    }
+  }
+
+  return winner;
+}
+
+bool PortfolioSolver::computeTruth(const Query& query, bool &isValid) {
+  std::vector<const Array*> objects;
+  std::vector< std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  if (!computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolver::computeValue(const Query& query,
+                                   klee::ref<Expr> &result) {
+  std::vector<const Array*> objects;
+  std::vector< std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+bool
+PortfolioSolver::computeInitialValues(const Query &query,
+                                      const std::vector<const Array*> &objects,
+                                      std::vector< std::vector<unsigned char> > &values,
+                                      bool &hasSolution) {
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  TimerStatIncrementer t(stats::queryTime);
+  ++stats::queries;
+  ++stats::queryCounterexamples;
+
+  unsigned sum = 0;
+  for (std::vector<const Array*>::const_iterator
+         it = objects.begin(), ie = objects.end(); it != ie; ++it)
+    sum += (*it)->size;
+  assert(sum + sizeof(PortfolioSlot) < portfolio_slot_size &&
+         "not enough shared memory for counterexample");
+
+  unsigned shape = getShape(query);
+  std::map<unsigned, std::pair<unsigned, unsigned> >::iterator it =
+    winners.find(shape);
+
+  // Once a configuration reliably wins on this shape, run it alone and
+  // only race the others if it fails. Having just failed, it is left out
+  // of that race and has to win its confidence back.
+  std::vector<unsigned> entrants;
+  bool timedOut = false;
+  int winner = -1;
+  int trusted = -1;
+  if (it != winners.end() && it->second.second >= portfolio_confidence) {
+    trusted = it->second.first;
+    entrants.push_back(trusted);
+    winner = race(query, entrants, objects, timedOut);
+    if (winner >= 0)
+      ++stats::portfolioShortcuts;
+    else
+      it->second.second = 0;
+    entrants.clear();
+  }
+
+  for (unsigned i = 0; winner < 0 && i < configurations.size(); ++i)
+    if ((int) i != trusted)
+      entrants.push_back(i);
+
+  if (!entrants.empty()) {
+    winner = race(query, entrants, objects, timedOut);
+    ++stats::portfolioRaces;
+
+    if (winner >= 0) {
+      std::pair<unsigned, unsigned> &w = winners[shape];
+      if (w.first == (unsigned) winner) {
+        ++w.second;
+      } else {
+        w.first = winner;
+        w.second = 1;
+      }
+    }
+  }
+
+  if (winner < 0) {
+    runStatusCode = timedOut ? SOLVER_RUN_STATUS_TIMEOUT :
+                               SOLVER_RUN_STATUS_FAILURE;
+    return false;
+  }
+
+  PortfolioSlot *slot = getSlot(winner);
+  hasSolution = slot->hasSolution;
+  if (hasSolution) {
+    unsigned char *pos = (unsigned char*) (slot + 1);
+    values = std::vector< std::vector<unsigned char> >(objects.size());
+    for (unsigned i = 0; i < objects.size(); ++i) {
+      values[i].insert(values[i].begin(), pos, pos + objects[i]->size);
+      pos += objects[i]->size;
+    }
+    ++stats::queriesInvalid;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  } else {
+    ++stats::queriesValid;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  }
+
+  return true;
+}
+
+SolverImpl::SolverRunStatus PortfolioSolver::getOperationStatusCode() {
+  return runStatusCode;
+}
+
+Solver *klee::createPortfolioSolver(STPSolver *primary,
+                                    const std::vector<Solver*> &alternates) {
+  return new Solver(new PortfolioSolver(primary, alternates));
+}
@@ -23,14 +23,17 @@
 
 #define vc_bvBoolExtract IAMTHESPAWNOFSATAN
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 #include <map>
 #include <vector>
 
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
@@ -105,6 +108,108 @@ bool Solver::evaluate(const Query& query, Validity &result) {
   return impl->computeValidity(query, result);
 }
 
+/// One result slot per batched query, written by the worker which owns
+/// the query. A zero status means no worker got to it.
+struct BatchSlot {
+  unsigned char status;
+  signed char validity;
+};
+
+enum { BATCH_SLOT_EMPTY = 0, BATCH_SLOT_SOLVED, BATCH_SLOT_FAILED };
+
+bool Solver::evaluateBatch(const ConstraintManager &constraints,
+                           const std::vector< klee::ref<Expr> > &exprs,
+                           std::vector<Validity> &results,
+                           std::vector<bool> &solved,
+                           unsigned numWorkers) {
+  results.assign(exprs.size(), Unknown);
+  solved.assign(exprs.size(), false);
+
+  std::vector<unsigned> pending;
+  for (unsigned i = 0; i < exprs.size(); ++i) {
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(exprs[i])) {
+      results[i] = CE->isTrue() ? True : False;
+      solved[i] = true;
+    } else {
+      pending.push_back(i);
+    }
+  }
+
+  BatchSlot *slots = 0;
+  size_t slotBytes = pending.size() * sizeof(BatchSlot);
+  if (numWorkers > 1 && pending.size() > 1) {
+    void *mem = mmap(NULL, slotBytes, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem != MAP_FAILED) {
+      slots = (BatchSlot*) mem;
+      memset(slots, 0, slotBytes);
+    }
+  }
+
+  if (slots) {
+    if (numWorkers > pending.size())
+      numWorkers = pending.size();
+
+    std::vector<pid_t> workers;
+    fflush(stdout);
+    fflush(stderr);
+    for (unsigned w = 0; w < numWorkers; ++w) {
+      pid_t pid = fork();
+      if (pid == -1) {
+        fprintf(stderr, "warning: fork failed (for solver worker %u)\n", w);
+        break;
+      }
+
+      if (pid == 0) {
+        // The worker inherits the parent's solver chain. Give it its own
+        // counterexample segment so that forked STP runs in sibling
+        // workers do not overwrite each other.
+        reinitializeSolverSharedMemory();
+        for (unsigned k = w; k < pending.size(); k += numWorkers) {
+          Validity v;
+          if (evaluate(Query(constraints, exprs[pending[k]]), v)) {
+            slots[k].validity = v;
+            slots[k].status = BATCH_SLOT_SOLVED;
+          } else {
+            slots[k].status = BATCH_SLOT_FAILED;
+          }
+        }
+        _exit(0);
+      }
+      workers.push_back(pid);
+    }
+
+    for (unsigned w = 0; w < workers.size(); ++w) {
+      int status;
+      pid_t res;
+      do {
+        res = waitpid(workers[w], &status, 0);
+      } while (res < 0 && errno == EINTR);
+    }
+
+    ++stats::queryBatches;
+    for (unsigned k = 0; k < pending.size(); ++k) {
+      unsigned i = pending[k];
+      if (slots[k].status == BATCH_SLOT_SOLVED) {
+        results[i] = (Validity) slots[k].validity;
+        solved[i] = true;
+        ++stats::queryBatchHits;
+      } else if (slots[k].status == BATCH_SLOT_EMPTY) {
+        // The worker crashed or was never started; answer it here.
+        solved[i] = evaluate(Query(constraints, exprs[i]), results[i]);
+      }
+    }
+    munmap(slots, slotBytes);
+  } else {
+    for (unsigned k = 0; k < pending.size(); ++k) {
+      unsigned i = pending[k];
+      solved[i] = evaluate(Query(constraints, exprs[i]), results[i]);
+    }
+  }
+
+  return std::find(solved.begin(), solved.end(), false) == solved.end();
+}
+
 bool Solver::mustBeTrue(const Query& query, bool &result) {
   assert(query.expr->getWidth() == Expr::Bool && "Invalid expression type!");
 
@@ -461,6 +566,7 @@ public:
 
   char *getConstraintLog(const Query&);
   void setTimeout(double _timeout) { timeout = _timeout; }
+  double getTimeout() const { return timeout; }
 
   bool computeTruth(const Query&, bool &isValid);
   bool computeValue(const Query&, klee::ref<Expr> &result);
@@ -480,6 +586,21 @@ static void stp_error_handler(const char* err_msg) {
   abort();
 }
 
+static void allocateSolverSharedMemory() {
+  shared_memory_id = shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
+  assert(shared_memory_id>=0 && "shmget failed");
+  shared_memory_ptr = (unsigned char*) shmat(shared_memory_id, NULL, 0);
+  assert(shared_memory_ptr!=(void*)-1 && "shmat failed");
+  shmctl(shared_memory_id, IPC_RMID, NULL);
+}
+
+void klee::reinitializeSolverSharedMemory() {
+  if (!shared_memory_ptr)
+    return;
+  shmdt(shared_memory_ptr);
+  allocateSolverSharedMemory();
+}
+
 STPSolverImpl::STPSolverImpl(STPSolver *_solver, bool _useForkedSTP, bool _optimizeDivides)
   : solver(_solver),
     vc(vc_createValidityChecker()),
@@ -501,13 +622,8 @@ STPSolverImpl::STPSolverImpl(STPSolver *_solver, bool _useForkedSTP, bool _optim
 
   vc_registerErrorHandler(::stp_error_handler);
 
-  if (useForkedSTP) {
-    shared_memory_id = shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
-    assert(shared_memory_id>=0 && "shmget failed");
-    shared_memory_ptr = (unsigned char*) shmat(shared_memory_id, NULL, 0);
-    assert(shared_memory_ptr!=(void*)-1 && "shmat failed");
-    shmctl(shared_memory_id, IPC_RMID, NULL);
-  }
+  if (useForkedSTP)
+    allocateSolverSharedMemory();
 }
 
 STPSolverImpl::~STPSolverImpl() {
@@ -531,6 +647,10 @@ void STPSolver::setTimeout(double timeout) {
   static_cast<STPSolverImpl*>(impl)->setTimeout(timeout);
 }
 
+double STPSolver::getTimeout() const {
+  return static_cast<STPSolverImpl*>(impl)->getTimeout();
+}
+
 /***/
 
 char *STPSolverImpl::getConstraintLog(const Query &query) {
@@ -12,7 +12,13 @@
 using namespace klee;
 
 Statistic stats::cexCacheTime("CexCacheTime", "CCtime");
+Statistic stats::cexReuseHits("CexReuseHits", "CRhits");
+Statistic stats::cexReuseMisses("CexReuseMisses", "CRmisses");
+Statistic stats::portfolioRaces("PortfolioRaces", "PFraces");
+Statistic stats::portfolioShortcuts("PortfolioShortcuts", "PFshort");
 Statistic stats::queries("Queries", "Q");
+Statistic stats::queryBatches("QueryBatches", "QBatch");
+Statistic stats::queryBatchHits("QueryBatchHits", "QBhits");
 Statistic stats::queriesInvalid("QueriesInvalid", "Qiv");
 Statistic stats::queriesValid("QueriesValid", "Qv");
 Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
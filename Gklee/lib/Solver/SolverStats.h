@@ -16,7 +16,13 @@ namespace klee {
 namespace stats {
 
   extern Statistic cexCacheTime;
+  extern Statistic cexReuseHits;
+  extern Statistic cexReuseMisses;
+  extern Statistic portfolioRaces;
+  extern Statistic portfolioShortcuts;
   extern Statistic queries;
+  extern Statistic queryBatches;
+  extern Statistic queryBatchHits;
   extern Statistic queriesInvalid;
   extern Statistic queriesValid;
   extern Statistic queryCacheHits;
@@ -12,6 +12,7 @@
 #include <llvm/Support/raw_os_ostream.h>
 #include <llvm/Function.h>
 #include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Module/Cell.h"
 
 #include "../Core/Memory.h"
 #include "../Core/AddressSpace.h"
@@ -351,6 +352,21 @@ Logging::outItem( const klee::ref<klee::Expr>& cond,
   }
 }
 
+// Inline concrete values are printed as is, without building an
+// expression for them.
+template <>
+void
+Logging::outItem( const klee::CellValue& value,
+		  const std::string& name ){
+  uint64_t bits;
+  klee::Expr::Width width;
+  if( !value.isInline() || !value.getConcrete( bits, width )){
+    outItem( value.getExpr(), name );
+  }else if( initLeadComma()){
+    lstream << "\"" << name << "_" << count++ << "\": " << "\"" << bits << "\"";
+  }
+}
+
  std::string
    Logging::getInstString( const llvm::Value& val){
    std::ostringstream ostr;
@@ -11,11 +11,20 @@
 #include <string.h>
 #include <cuda/driver_types.h>
 
+void __timeline_event_record(cudaEvent_t event, cudaStream_t stream);
+void __timeline_event_sync(cudaEvent_t event);
+float __timeline_elapsed_time(cudaEvent_t start, cudaEvent_t end);
+
+// Events are only told apart, never dereferenced.
+static unsigned long numEvents = 0;
+
 cudaError_t cudaEventCreate(cudaEvent_t *event) {
+  *event = (cudaEvent_t) ++numEvents;
   return cudaSuccess;
 } 
 
 cudaError_t cudaEventCreateWithFlags(cudaEvent_t *event, unsigned int flags) {
+  *event = (cudaEvent_t) ++numEvents;
   return cudaSuccess;
 }
 
@@ -24,6 +33,7 @@ cudaError_t cudaEventDestroy(cudaEvent_t event) {
 }
 
 cudaError_t cudaEventElapsedTime(float *ms, cudaEvent_t start, cudaEvent_t end) {
+  *ms = __timeline_elapsed_time(start, end);
   return cudaSuccess;
 }
 
@@ -31,10 +41,13 @@ cudaError_t cudaEventQuery(cudaEvent_t event) {
   return cudaSuccess;
 }
 
-/*cudaError_t cudaEventRecord(cudaEvent_t event, cudaStream_t stream=0) {
+// The stream defaults to 0 in C++ only.
+cudaError_t cudaEventRecord(cudaEvent_t event, cudaStream_t stream) {
+  __timeline_event_record(event, stream);
   return cudaSuccess;
-}*/
+}
 
 cudaError_t cudaEventSynchronize(cudaEvent_t event) {
+  __timeline_event_sync(event);
   return cudaSuccess;
 }
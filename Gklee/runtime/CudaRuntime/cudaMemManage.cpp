@@ -20,6 +20,10 @@ void __set_device();
 void __clear_device();
 void __set_host();
 void __clear_host();
+void __timeline_copy(void *dst, const void *src, size_t count, 
+                     int kind, cudaStream_t stream, int async);
+void __timeline_memset(void *devPtr, size_t count, 
+                       cudaStream_t stream, int async);
 
 cudaError_t cudaArrayGetInfo(struct cudaChannelFormatDesc *desc, struct cudaExtent *extent, 
                              unsigned int *flags, struct cudaArray *array) {
@@ -105,6 +109,7 @@ cudaError_t cudaMallocPitch(void **devPtr, size_t *pitch, size_t width, size_t h
 
 cudaError_t cudaMemcpy(void *dst, const void *src, size_t count, enum cudaMemcpyKind kind) {
   memcpy(dst, src, count);
+  __timeline_copy(dst, src, count, kind, 0, 0);
   return cudaSuccess;
 }
 
@@ -173,6 +178,9 @@ cudaError_t cudaMemcpyArrayToArray(struct cudaArray *dst, size_t wOffsetDst, siz
 
 cudaError_t cudaMemcpyAsync(void *dst, const void *src, size_t count, 
                             enum cudaMemcpyKind kind, cudaStream_t stream=0) {
+  // Copying right away is one of the orders the device may pick.
+  memcpy(dst, src, count);
+  __timeline_copy(dst, src, count, kind, stream, 1);
   return cudaSuccess;
 }
 
@@ -200,12 +208,14 @@ cudaError_t cudaMemcpyFromSymbolAsync(void *dst, const char *symbol, size_t coun
 
 cudaError_t cudaMemcpyPeer(void *dst, int dstDevice, const void *src, int srcDevice, size_t count) {
   memcpy(dst, src, count);
+  __timeline_copy(dst, src, count, cudaMemcpyDeviceToDevice, 0, 0);
   return cudaSuccess;
 }
  
 cudaError_t cudaMemcpyPeerAsync(void *dst, int dstDevice, const void *src, int srcDevice, 
                                 size_t count, cudaStream_t stream=0) {
   memcpy(dst, src, count);
+  __timeline_copy(dst, src, count, cudaMemcpyDeviceToDevice, stream, 1);
   return cudaSuccess;
 }
 
@@ -223,11 +233,14 @@ cudaError_t cudaMemcpyToArrayAsync(struct cudaArray *dst, size_t wOffset, size_t
 cudaError_t cudaMemcpyToSymbol(char *symbol, const void *src, size_t count, 
                                size_t offset=0, enum cudaMemcpyKind kind=cudaMemcpyHostToDevice) {
   memcpy(symbol+offset, src, count);
+  __timeline_copy(symbol+offset, src, count, kind, 0, 0);
   return cudaSuccess;
 }
 
 cudaError_t cudaMemcpyToSymbolAsync(const char *symbol, const void *src, size_t count, size_t offset, 
                                     enum cudaMemcpyKind kind, cudaStream_t stream=0) {
+  memcpy((char *)symbol+offset, src, count);
+  __timeline_copy((char *)symbol+offset, src, count, kind, stream, 1);
   return cudaSuccess;
 }
 
@@ -237,6 +250,7 @@ cudaError_t cudaMemGetInfo(size_t *free, size_t *total) {
 
 cudaError_t cudaMemset(void *devPtr, int value, size_t count) {
   memset(devPtr, value, count);
+  __timeline_memset(devPtr, count, 0, 0);
   return cudaSuccess;
 }
 
@@ -261,6 +275,8 @@ cudaError_t cudaMemset3DAsync(struct cudaPitchedPtr pitchedDevPtr, int value,
 }
 
 cudaError_t cudaMemsetAsync(void *devPtr, int value, size_t count, cudaStream_t stream=0) {
+  memset(devPtr, value, count);
+  __timeline_memset(devPtr, count, stream, 1);
   return cudaSuccess;
 }
 
@@ -11,7 +11,14 @@
 #include <string.h>
 #include <cuda/driver_types.h>
 
+void __timeline_stream_sync(cudaStream_t stream);
+void __timeline_stream_wait_event(cudaStream_t stream, cudaEvent_t event);
+
+// Streams are only told apart, never dereferenced; 0 is the default stream.
+static unsigned long numStreams = 0;
+
 cudaError_t cudaStreamCreate(cudaStream_t *pStream) {
+  *pStream = (cudaStream_t) ++numStreams;
   return cudaSuccess;
 } 
 
@@ -24,9 +31,11 @@ cudaError_t cudaStreamQuery(cudaStream_t stream) {
 }
 
 cudaError_t cudaStreamSynchronize (cudaStream_t stream) {
+  __timeline_stream_sync(stream);
   return cudaSuccess;
 }
 
 cudaError_t cudaStreamWaitEvent(cudaStream_t stream, cudaEvent_t event, unsigned int flags) {
+  __timeline_stream_wait_event(stream, event);
   return cudaSuccess;
 }
@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <cuda/driver_types.h>
 
+void __timeline_device_sync(void);
+
 cudaError_t cudaThreadExit(void) {
   return cudaSuccess;
 }
@@ -31,5 +33,6 @@ cudaError_t cudaThreadSetLimit(enum cudaLimit limit, size_t value) {
 }
 
 cudaError_t cudaThreadSynchronize(void) {
+  __timeline_device_sync();
   return cudaSuccess;
 }  	
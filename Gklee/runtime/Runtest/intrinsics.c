@@ -72,7 +72,14 @@ void klee_make_symbolic(void *array, size_t nbytes, const char *name) {
       }
       tmp[strlen(tmp)-1] = '\0'; /* kill newline */
     }
-    testData = kTest_fromFile(name);
+    if (kTestPack_isPackFile(name)) {
+      /* The pack stays mapped for the rest of the run. */
+      KTestPack *pack = kTestPack_open(name);
+      char *index = getenv("KTEST_INDEX");
+      testData = pack ? kTestPack_get(pack, index ? atoi(index) : 0, 0) : 0;
+    } else {
+      testData = kTest_fromFile(name);
+    }
     if (!testData) {
       fprintf(stderr, "KLEE-RUNTIME: unable to open .ktest file\n");
       exit(1);
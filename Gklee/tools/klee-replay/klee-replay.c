@@ -192,8 +192,59 @@ static void run_monitored(char *executable, int argc, char **argv) {
   }
 }
 
+/* Replay the current input against executable. */
+static void replay_input(char *executable, const char *test_name) {
+  static unsigned num_replayed = 0;
+  int prg_argc;
+  char ** prg_argv;
+  unsigned i;
+
+  obj_index = 0;
+  prg_argc = input->numArgs;
+  prg_argv = input->args;
+  prg_argv[0] = executable;
+  klee_init_env(&prg_argc, &prg_argv);
+
+  if (num_replayed++)
+    fprintf(stderr, "\n");
+  fprintf(stderr, "%s: TEST CASE: %s\n", progname, test_name);
+  fprintf(stderr, "%s: ARGS: ", progname);
+  for (i=0; i != (unsigned) prg_argc; ++i) {
+    char *s = prg_argv[i];
+    if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
+    fprintf(stderr, "\"%s\" ", prg_argv[i]); 
+  }
+  fprintf(stderr, "\n");
+
+  /* Run the test case machinery in a subprocess, eventually this parent
+     process should be a script or something which shells out to the actual
+     execution tool. */
+  int pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    _exit(66);
+  } else if (pid == 0) {
+    /* Create the input files, pipes, etc., and run the process. */
+    replay_create_files(&__exe_fs);
+    run_monitored(executable, prg_argc, prg_argv);
+    _exit(0);
+  } else {
+    /* Wait for the test case. */
+    int res, status;
+
+    do {
+      res = waitpid(pid, &status, 0);
+    } while (res < 0 && errno == EINTR);
+    
+    if (res < 0) {
+      perror("waitpid");
+      _exit(66);
+    }
+  }
+}
+
 static void usage(void) {
-  fprintf(stderr, "Usage: %s <executable> { <ktest-files> }\n", progname);
+  fprintf(stderr, "Usage: %s <executable> { <ktest-files> | <ktpack-files> }\n", progname);
   fprintf(stderr, "   or: %s --create-files-only <ktest-file>\n", progname);
   fprintf(stderr, "\n");
   fprintf(stderr, "Set KLEE_REPLAY_TIMEOUT environment variable to set a timeout (in seconds).\n");
@@ -249,57 +300,40 @@ int main(int argc, char** argv) {
   int idx = 0;
   for (idx = 2; idx != argc; ++idx) {
     char* input_fname = argv[idx];
-    unsigned i;
-    
+
+    if (kTestPack_isPackFile(input_fname)) {
+      KTestPack *pack = kTestPack_open(input_fname);
+      unsigned i;
+      if (!pack) {
+        fprintf(stderr, "%s: error: input file %s not valid.\n", progname,
+                input_fname);
+        exit(1);
+      }
+      for (i = 0; i != kTestPack_numTests(pack); ++i) {
+        KTestInfo info;
+        char name[1024];
+        input = kTestPack_get(pack, i, &info);
+        if (!input) {
+          fprintf(stderr, "%s: error: test %u of %s not valid.\n", progname,
+                  i, input_fname);
+          exit(1);
+        }
+        snprintf(name, sizeof name, "%s[%u] (test%06u%s%s)", input_fname, i,
+                 info.id, *info.defect ? ", " : "", info.defect);
+        replay_input(executable, name);
+        kTestPack_freeTest(input);
+      }
+      kTestPack_close(pack);
+      continue;
+    }
+
     input = kTest_fromFile(input_fname);
     if (!input) {
       fprintf(stderr, "%s: error: input file %s not valid.\n", progname, 
               input_fname);
       exit(1);
     }
-    
-    obj_index = 0;
-    prg_argc = input->numArgs;
-    prg_argv = input->args;
-    prg_argv[0] = argv[1];
-    klee_init_env(&prg_argc, &prg_argv);
-
-    if (idx > 2)
-      fprintf(stderr, "\n");
-    fprintf(stderr, "%s: TEST CASE: %s\n", progname, input_fname);
-    fprintf(stderr, "%s: ARGS: ", progname);
-    for (i=0; i != (unsigned) prg_argc; ++i) {
-      char *s = prg_argv[i];
-      if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
-      fprintf(stderr, "\"%s\" ", prg_argv[i]); 
-    }
-    fprintf(stderr, "\n");
-
-    /* Run the test case machinery in a subprocess, eventually this parent
-       process should be a script or something which shells out to the actual
-       execution tool. */
-    int pid = fork();
-    if (pid < 0) {
-      perror("fork");
-      _exit(66);
-    } else if (pid == 0) {
-      /* Create the input files, pipes, etc., and run the process. */
-      replay_create_files(&__exe_fs);
-      run_monitored(executable, prg_argc, prg_argv);
-      _exit(0);
-    } else {
-      /* Wait for the test case. */
-      int res, status;
-
-      do {
-        res = waitpid(pid, &status, 0);
-      } while (res < 0 && errno == EINTR);
-      
-      if (res < 0) {
-        perror("waitpid");
-        _exit(66);
-      }
-    }
+    replay_input(executable, input_fname);
   }
 
   return 0;
@@ -0,0 +1,228 @@
+//===-- klee-stats-tail.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Summarises the binary statistics streams (run.stats.bin) written with
+// -output-binary-stats, reading only the last record of each, or follows
+// one stream as it is written.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/ADT/StatsStream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using namespace klee;
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "Usage: %s [options] <output-dir or stream>...\n", argv0);
+  fprintf(stderr, "  -f          follow a single stream, printing each new record\n");
+  fprintf(stderr, "  -c <name>   print column <name> (repeatable; \"-c all\" for every column)\n");
+  fprintf(stderr, "  -s <secs>   polling interval when following (default: 1)\n");
+  fprintf(stderr, "Without -c, prints the summary columns of klee-stats.\n");
+  exit(1);
+}
+
+static std::string getStreamPath(const std::string &arg) {
+  struct stat st;
+  if (stat(arg.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+    return arg + "/run.stats.bin";
+  return arg;
+}
+
+/// Reads one column of a record, by name, whatever its type.
+class RecordView {
+  const StatsStreamReader &reader;
+  const std::vector<uint64_t> &slots;
+
+public:
+  RecordView(const StatsStreamReader &_reader,
+             const std::vector<uint64_t> &_slots)
+    : reader(_reader), slots(_slots) {}
+
+  double get(const char *name) const {
+    int i = reader.getColumnIndex(name);
+    if (i < 0)
+      return 0;
+    if (reader.getColumns()[i].type == StatsStream::Real)
+      return StatsStream::toReal(slots[i]);
+    return (double) slots[i];
+  }
+};
+
+static void printSummaryHeader() {
+  printf("%-30s %12s %10s %8s %8s %8s %9s %8s %9s\n",
+         "Path", "Instrs", "Time(s)", "ICov(%)", "BCov(%)", "ICount",
+         "Solver(%)", "States", "Mem(MB)");
+}
+
+static void printSummary(const std::string &name, const RecordView &r) {
+  double covered = r.get("CoveredInstructions");
+  double uncovered = r.get("UncoveredInstructions");
+  double fullBranches = r.get("FullBranches");
+  double partialBranches = r.get("PartialBranches");
+  double numBranches = r.get("NumBranches");
+  double wallTime = r.get("WallTime");
+  // Straight-line code has full branch coverage, as in klee-stats.
+  if (numBranches == 0)
+    fullBranches = numBranches = 1;
+
+  printf("%-30s %12.0f %10.2f %8.2f %8.2f %8.0f %9.2f %8.0f %9.2f\n",
+         name.c_str(), r.get("Instructions"), wallTime,
+         covered + uncovered ? 100. * covered / (covered + uncovered) : 0.,
+         100. * (2 * fullBranches + partialBranches) / (2. * numBranches),
+         covered + uncovered,
+         wallTime ? 100. * r.get("SolverTime") / wallTime : 0.,
+         r.get("NumStates"), r.get("MallocUsage") / 1024. / 1024.);
+}
+
+static void printColumnsHeader(const StatsStreamReader &reader,
+                               const std::vector<int> &columns) {
+  for (unsigned i = 0; i < columns.size(); i++)
+    printf("%s%s", i ? "\t" : "", reader.getColumns()[columns[i]].name.c_str());
+  printf("\n");
+}
+
+static void printColumns(const StatsStreamReader &reader,
+                         const std::vector<uint64_t> &slots,
+                         const std::vector<int> &columns) {
+  for (unsigned i = 0; i < columns.size(); i++) {
+    int c = columns[i];
+    if (i)
+      printf("\t");
+    if (reader.getColumns()[c].type == StatsStream::Real)
+      printf("%.2f", StatsStream::toReal(slots[c]));
+    else
+      printf("%llu", (unsigned long long) slots[c]);
+  }
+  printf("\n");
+}
+
+static bool selectColumns(const StatsStreamReader &reader,
+                          const std::vector<std::string> &names,
+                          std::vector<int> &columns) {
+  columns.clear();
+  for (unsigned i = 0; i < names.size(); i++) {
+    if (names[i] == "all") {
+      for (unsigned c = 0; c < reader.getColumns().size(); c++)
+        columns.push_back(c);
+      continue;
+    }
+    int c = reader.getColumnIndex(names[i]);
+    if (c < 0) {
+      fprintf(stderr, "no column named %s\n", names[i].c_str());
+      return false;
+    }
+    columns.push_back(c);
+  }
+  return true;
+}
+
+static int follow(const std::string &path,
+                  const std::vector<std::string> &names, unsigned interval) {
+  StatsStreamReader *reader = StatsStreamReader::open(path);
+  if (!reader) {
+    fprintf(stderr, "%s: not a statistics stream\n", path.c_str());
+    return 1;
+  }
+
+  std::vector<int> columns;
+  if (!names.empty() && !selectColumns(*reader, names, columns)) {
+    delete reader;
+    return 1;
+  }
+  if (columns.empty())
+    printSummaryHeader();
+  else
+    printColumnsHeader(*reader, columns);
+
+  // Start from the last record written so far.
+  uint64_t next = reader->getNumRecords() ? reader->getNumRecords() - 1 : 0;
+  std::vector<uint64_t> slots;
+  for (;;) {
+    for (; next < reader->getNumRecords(); ++next) {
+      if (!reader->readRecord(next, slots))
+        break;
+      if (columns.empty())
+        printSummary(path, RecordView(*reader, slots));
+      else
+        printColumns(*reader, slots, columns);
+    }
+    fflush(stdout);
+    sleep(interval);
+    reader->refresh();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  bool followStream = false;
+  unsigned interval = 1;
+  std::vector<std::string> names;
+  std::vector<std::string> paths;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-f") == 0) {
+      followStream = true;
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      names.push_back(argv[++i]);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      interval = atoi(argv[++i]);
+      if (!interval)
+        interval = 1;
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+    } else {
+      paths.push_back(getStreamPath(argv[i]));
+    }
+  }
+
+  if (paths.empty() || (followStream && paths.size() != 1))
+    usage(argv[0]);
+
+  if (followStream)
+    return follow(paths[0], names, interval);
+
+  int res = 0;
+  bool printedHeader = false;
+  std::vector<uint64_t> slots;
+  for (unsigned i = 0; i < paths.size(); i++) {
+    StatsStreamReader *reader = StatsStreamReader::open(paths[i]);
+    if (!reader || !reader->getNumRecords() ||
+        !reader->readRecord(reader->getNumRecords() - 1, slots)) {
+      fprintf(stderr, "Unable to open: %s\n", paths[i].c_str());
+      delete reader;
+      res = 1;
+      continue;
+    }
+
+    if (names.empty()) {
+      if (!printedHeader)
+        printSummaryHeader();
+      printSummary(paths[i], RecordView(*reader, slots));
+    } else {
+      std::vector<int> columns;
+      if (!selectColumns(*reader, names, columns)) {
+        delete reader;
+        return 1;
+      }
+      if (!printedHeader)
+        printColumnsHeader(*reader, columns);
+      printColumns(*reader, slots, columns);
+    }
+    printedHeader = true;
+    delete reader;
+  }
+  return res;
+}
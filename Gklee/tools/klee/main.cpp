@@ -10,6 +10,7 @@
 #include "klee/Interpreter.h"
 #include "klee/Statistics.h"
 #include "klee/Config/Version.h"
+#include "klee/Internal/ADT/ForkGuard.h"
 #include "klee/Internal/ADT/KTest.h"
 #include "klee/Internal/ADT/TreeStream.h"
 #include "klee/Internal/Support/ModuleUtil.h"
@@ -58,12 +59,15 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <pthread.h>
 #include <signal.h>
 
 #include <iostream>
 #include <iterator>
 #include <fstream>
 #include <sstream>
+#include <deque>
 
 using namespace llvm;
 using namespace klee;
@@ -117,6 +121,20 @@ namespace {
   cl::opt<bool>
   ExitOnError("exit-on-error", 
               cl::desc("Exit if errors occur"));
+
+  cl::opt<unsigned>
+  OutputQueueSize("output-queue-size",
+                  cl::desc("Write test case files from a background thread, and block once this many KB are waiting to be written (0=write synchronously, default=16384)"),
+                  cl::init(16384));
+
+  cl::opt<unsigned>
+  OutputBatchSize("output-batch-size",
+                  cl::desc("Number of test cases the background writer collects before writing them out (default=16)"),
+                  cl::init(16));
+
+  cl::opt<bool>
+  PackTests("pack-tests",
+            cl::desc("Append the test cases to tests.ktpack instead of writing a .ktest file for each"));
     
 
   enum LibcType {
@@ -227,10 +245,190 @@ extern cl::opt<double> MaxTime;
 
 /***/
 
+/// The files of one test case, built on the interpreter thread and
+/// written out by a TestCaseWriter.
+struct TestCaseFiles {
+  KTest *test;
+  std::string testPath;
+  /// Where to append the test instead of writing it to testPath, if any.
+  KTestPackWriter *pack;
+  KTestInfo info;
+  std::string defect;
+  std::vector< std::pair<std::string, std::string> > files;
+  size_t size;
+
+  TestCaseFiles() : test(0), pack(0), size(0) {
+    memset(&info, 0, sizeof info);
+  }
+  ~TestCaseFiles() {
+    if (test) {
+      for (unsigned i=0; i<test->numObjects; i++) {
+        delete[] test->objects[i].bytes;
+        free(test->objects[i].name);
+      }
+      delete[] test->objects;
+      delete test;
+    }
+  }
+
+  void add(const std::string &path, const std::string &contents) {
+    files.push_back(std::make_pair(path, contents));
+    size += contents.size();
+  }
+
+  /// Write the files one at a time, each inside \a guard.
+  void write(ForkGuard &guard);
+};
+
+void TestCaseFiles::write(ForkGuard &guard) {
+  if (test) {
+    guard.enter();
+    if (pack) {
+      info.defect = defect.c_str();
+      if (!kTestPackWriter_append(pack, test, &info))
+        klee_warning("unable to append output test case, losing it");
+    } else if (!kTest_toFile(test, testPath.c_str())) {
+      klee_warning("unable to write output test case, losing it");
+    }
+    guard.leave();
+  }
+
+  for (unsigned i = 0; i < files.size(); i++) {
+    guard.enter();
+    FILE *f = fopen(files[i].first.c_str(), "wb");
+    if (!f || fwrite(files[i].second.data(), 1, files[i].second.size(), f)
+                != files[i].second.size())
+      klee_warning("unable to write %s", files[i].first.c_str());
+    if (f)
+      fclose(f);
+    guard.leave();
+  }
+}
+
+/// TestCaseWriter - Writes test case files from a background thread, so
+/// that exploration does not wait on the filesystem. Test cases are
+/// written in batches; once too much is waiting, submitting blocks until
+/// the writer catches up.
+class TestCaseWriter {
+  pthread_t m_thread;
+  pthread_mutex_t m_lock;
+  pthread_cond_t m_workAvailable, m_spaceAvailable;
+
+  /// Held while writing one file, so that fork() waits for at most that
+  /// file rather than the whole batch.
+  ForkGuard m_forkGuard;
+
+  std::deque<TestCaseFiles*> m_queue;
+  size_t m_queuedBytes;
+  size_t m_maxQueuedBytes;
+  unsigned m_batchSize;
+  bool m_done;
+
+  static void *run(void *writer);
+  void writeBatches();
+
+public:
+  TestCaseWriter(size_t maxQueuedBytes, unsigned batchSize);
+  /// Writes whatever is still queued.
+  ~TestCaseWriter();
+
+  /// Queue a test case; the writer takes ownership.
+  void submit(TestCaseFiles *tc);
+};
+
+TestCaseWriter::TestCaseWriter(size_t maxQueuedBytes, unsigned batchSize)
+  : m_queuedBytes(0),
+    m_maxQueuedBytes(maxQueuedBytes),
+    m_batchSize(std::max(1U, batchSize)),
+    m_done(false) {
+  pthread_mutex_init(&m_lock, 0);
+  pthread_cond_init(&m_workAvailable, 0);
+  pthread_cond_init(&m_spaceAvailable, 0);
+  if (pthread_create(&m_thread, 0, &TestCaseWriter::run, this))
+    klee_error("unable to start the test case writer thread");
+}
+
+TestCaseWriter::~TestCaseWriter() {
+  pthread_mutex_lock(&m_lock);
+  m_done = true;
+  pthread_cond_signal(&m_workAvailable);
+  pthread_mutex_unlock(&m_lock);
+  pthread_join(m_thread, 0);
+
+  pthread_cond_destroy(&m_spaceAvailable);
+  pthread_cond_destroy(&m_workAvailable);
+  pthread_mutex_destroy(&m_lock);
+}
+
+void TestCaseWriter::submit(TestCaseFiles *tc) {
+  pthread_mutex_lock(&m_lock);
+  while (m_queuedBytes > m_maxQueuedBytes) {
+    pthread_cond_signal(&m_workAvailable);
+    pthread_cond_wait(&m_spaceAvailable, &m_lock);
+  }
+  m_queue.push_back(tc);
+  m_queuedBytes += tc->size;
+  if (m_queue.size() >= m_batchSize)
+    pthread_cond_signal(&m_workAvailable);
+  pthread_mutex_unlock(&m_lock);
+}
+
+void *TestCaseWriter::run(void *writer) {
+  static_cast<TestCaseWriter*>(writer)->writeBatches();
+  return 0;
+}
+
+void TestCaseWriter::writeBatches() {
+  pthread_mutex_lock(&m_lock);
+  for (;;) {
+    // Wait for a full batch, but do not hold back a partial one for
+    // more than a second.
+    while (!m_done && m_queue.size() < m_batchSize
+           && m_queuedBytes <= m_maxQueuedBytes) {
+      struct timeval now;
+      gettimeofday(&now, 0);
+      struct timespec deadline;
+      deadline.tv_sec = now.tv_sec + 1;
+      deadline.tv_nsec = now.tv_usec * 1000;
+      if (pthread_cond_timedwait(&m_workAvailable, &m_lock, &deadline)
+            == ETIMEDOUT)
+        break;
+    }
+    if (m_queue.empty()) {
+      if (m_done)
+        break;
+      continue;
+    }
+
+    std::deque<TestCaseFiles*> batch;
+    batch.swap(m_queue);
+    pthread_mutex_unlock(&m_lock);
+
+    size_t written = 0;
+    for (std::deque<TestCaseFiles*>::iterator it = batch.begin(),
+           ie = batch.end(); it != ie; ++it) {
+      (*it)->write(m_forkGuard);
+      written += (*it)->size;
+      m_forkGuard.enter();
+      delete *it;
+      m_forkGuard.leave();
+    }
+
+    pthread_mutex_lock(&m_lock);
+    m_queuedBytes -= written;
+    pthread_cond_broadcast(&m_spaceAvailable);
+  }
+  pthread_mutex_unlock(&m_lock);
+}
+
+/***/
+
 class KleeHandler : public InterpreterHandler {
 private:
   Interpreter *m_interpreter;
   TreeStreamWriter *m_pathWriter, *m_symPathWriter;
+  TestCaseWriter *m_testWriter;
+  KTestPackWriter *m_testPack;
   std::ostream *m_infoFile;
 
   char m_outputDirectory[1024];
@@ -252,6 +450,10 @@ public:
 
   void setInterpreter(Interpreter *i);
 
+  /// Write out the queued test cases and close tests.ktpack. Called on
+  /// every way out, including klee_error() and the other exit() paths.
+  void finishTestCases();
+
   void processTestCase(const ExecutionState  &state,
                        const char *errorMessage, 
                        const char *errorSuffix,
@@ -274,10 +476,20 @@ public:
 			  std::vector<std::string> &results);
 };
 
+/// The handler whose test cases finishTestCasesAtExit() writes out.
+static KleeHandler *liveHandler = 0;
+
+static void finishTestCasesAtExit() {
+  if (liveHandler)
+    liveHandler->finishTestCases();
+}
+
 KleeHandler::KleeHandler(int argc, char **argv) 
   : m_interpreter(0),
     m_pathWriter(0),
     m_symPathWriter(0),
+    m_testWriter(0),
+    m_testPack(0),
     m_infoFile(0),
     m_testIndex(0),
     m_pathsExplored(0),
@@ -350,14 +562,41 @@ KleeHandler::KleeHandler(int argc, char **argv)
   assert(klee_message_file);
 
   m_infoFile = openOutputFile("info");
+
+  if (PackTests && !NoOutput) {
+    m_testPack = kTestPackWriter_open(getOutputFilename("tests.ktpack").c_str());
+    if (!m_testPack)
+      klee_error("unable to open tests.ktpack");
+  }
+
+  if (OutputQueueSize && !NoOutput)
+    m_testWriter = new TestCaseWriter((size_t) OutputQueueSize << 10,
+                                      OutputBatchSize);
+
+  if (m_testWriter || m_testPack) {
+    static bool registered = false;
+    if (!registered && !atexit(finishTestCasesAtExit))
+      registered = true;
+    liveHandler = this;
+  }
 }
 
 KleeHandler::~KleeHandler() {
+  finishTestCases();
+  if (liveHandler == this)
+    liveHandler = 0;
   if (m_pathWriter) delete m_pathWriter;
   if (m_symPathWriter) delete m_symPathWriter;
   delete m_infoFile;
 }
 
+void KleeHandler::finishTestCases() {
+  delete m_testWriter;
+  m_testWriter = 0;
+  if (m_testPack) kTestPackWriter_close(m_testPack);
+  m_testPack = 0;
+}
+
 void KleeHandler::setInterpreter(Interpreter *i) {
   m_interpreter = i;
 
@@ -417,6 +656,8 @@ void KleeHandler::processTestCase(const ExecutionState &state,
                                   char *performSuffix) {
   if (errorMessage && ExitOnError) {
     std::cerr << "EXITING ON ERROR:\n" << errorMessage << "\n";
+    // Finish writing the earlier test cases.
+    finishTestCases();
     exit(1);
   }
 
@@ -436,112 +677,113 @@ void KleeHandler::processTestCase(const ExecutionState &state,
     else 
       id = m_testIndex;
 
-    if (!state.traceInfo.empty()) {
-      std::ostream *f = openTestFile("trace", id);
-      *f << state.traceInfo;
-      delete f;
-    }
+    TestCaseFiles *tc = new TestCaseFiles();
+
+    if (!state.traceInfo.empty())
+      tc->add(getTestFilename("trace", id), state.traceInfo);
 
     if (success) {
-      KTest b;
-      b.numArgs = m_argc;
-      b.args = m_argv;
-      b.symArgvs = 0;
-      b.symArgvLen = 0;
-      b.numObjects = out.size();
-      b.objects = new KTestObject[b.numObjects];
-      assert(b.objects);
-      for (unsigned i=0; i<b.numObjects; i++) {
-        KTestObject *o = &b.objects[i];
-        o->name = const_cast<char*>(out[i].first.c_str());
+      KTest *b = new KTest;
+      b->numArgs = m_argc;
+      b->args = m_argv;
+      b->symArgvs = 0;
+      b->symArgvLen = 0;
+      b->numObjects = out.size();
+      b->objects = new KTestObject[b->numObjects];
+      assert(b->objects);
+      for (unsigned i=0; i<b->numObjects; i++) {
+        KTestObject *o = &b->objects[i];
+        o->name = strdup(out[i].first.c_str());
         o->numBytes = out[i].second.size();
         o->bytes = new unsigned char[o->numBytes];
         assert(o->bytes);
         std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
+        tc->size += o->numBytes;
       }
-      
+      tc->test = b;
+      tc->pack = m_testPack;
+      tc->info.id = id;
+      tc->info.kernel = state.kernelNum;
+      tc->info.barrierInterval = state.BINum;
+      if (errorMessage)
+        tc->defect = errorSuffix;
+
       if (performSuffix) {
         strcat(performSuffix, ".ktest"); 
-        if (!kTest_toFile(&b, getTestFilename(performSuffix, id).c_str())) {
-          klee_warning("unable to write output test case, losing it");
-        }
+        tc->testPath = getTestFilename(performSuffix, id);
       } else {
-        if (!kTest_toFile(&b, getTestFilename("ktest", id).c_str())) {
-          klee_warning("unable to write output test case, losing it");
-        }
+        tc->testPath = getTestFilename("ktest", id);
       }
-      
-      for (unsigned i=0; i<b.numObjects; i++)
-        delete[] b.objects[i].bytes;
-      delete[] b.objects;
     }
 
-    if (errorMessage) {
-      std::ostream *f = openTestFile(errorSuffix, id);
-      *f << errorMessage;
-      delete f;
-    }
+    if (errorMessage)
+      tc->add(getTestFilename(errorSuffix, id), errorMessage);
     
     if (m_pathWriter) {
       std::vector<unsigned char> concreteBranches;
       m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
                                concreteBranches);
-      std::ostream *f = openTestFile("path", id);
+      std::ostringstream f;
       std::copy(concreteBranches.begin(), concreteBranches.end(), 
-                std::ostream_iterator<unsigned char>(*f, "\n"));
-      delete f;
+                std::ostream_iterator<unsigned char>(f, "\n"));
+      tc->add(getTestFilename("path", id), f.str());
     }
 
     if (errorMessage || WritePCs) {
       std::string constraints;
       m_interpreter->getConstraintLog(state, constraints);
-      std::ostream *f = openTestFile("pc", id);
-      *f << constraints;
-      delete f;
+      tc->add(getTestFilename("pc", id), constraints);
     }
 
     if (WriteCVCs) {
       std::string constraints;
       m_interpreter->getConstraintLog(state, constraints, true);
-      std::ostream *f = openTestFile("cvc", id);
-      *f << constraints;
-      delete f;
+      tc->add(getTestFilename("cvc", id), constraints);
     }
     
     if (m_symPathWriter) {
       std::vector<unsigned char> symbolicBranches;
       m_symPathWriter->readStream(m_interpreter->getSymbolicPathStreamID(state),
                                   symbolicBranches);
-      std::ostream *f = openTestFile("sym.path", id);
+      std::ostringstream f;
       std::copy(symbolicBranches.begin(), symbolicBranches.end(), 
-                std::ostream_iterator<unsigned char>(*f, "\n"));
-      delete f;
+                std::ostream_iterator<unsigned char>(f, "\n"));
+      tc->add(getTestFilename("sym.path", id), f.str());
     }
 
     if (WriteCov) {
       std::map<const std::string*, std::set<unsigned> > cov;
       m_interpreter->getCoveredLines(state, cov);
-      std::ostream *f = openTestFile("cov", id);
+      std::ostringstream f;
       for (std::map<const std::string*, std::set<unsigned> >::iterator
              it = cov.begin(), ie = cov.end();
            it != ie; ++it) {
         for (std::set<unsigned>::iterator
                it2 = it->second.begin(), ie = it->second.end();
              it2 != ie; ++it2)
-          *f << *it->first << ":" << *it2 << "\n";
+          f << *it->first << ":" << *it2 << "\n";
       }
-      delete f;
+      tc->add(getTestFilename("cov", id), f.str());
     }
 
     if (m_testIndex == StopAfterNTests)
       m_interpreter->setHaltExecution(true);
 
+    // The time reported covers building the test case, not writing it
+    // when that happens in the background.
     if (WriteTestInfo) {
       double elapsed_time = util::getWallTime() - start_time;
-      std::ostream *f = openTestFile("info", id);
-      *f << "Time to generate test case: " 
-         << elapsed_time << "s\n";
-      delete f;
+      std::ostringstream f;
+      f << "Time to generate test case: " 
+        << elapsed_time << "s\n";
+      tc->add(getTestFilename("info", id), f.str());
+    }
+
+    if (m_testWriter) {
+      m_testWriter->submit(tc);
+    } else {
+      tc->write();
+      delete tc;
     }
   }
 }
@@ -579,12 +821,67 @@ void KleeHandler::getOutFiles(std::string path,
 #else
     std::string f = it->toString();
 #endif
-    if (f.substr(f.size()-6,f.size()) == ".ktest") {
+    if (f.substr(f.size()-6,f.size()) == ".ktest" ||
+        (f.size() > 7 && f.substr(f.size()-7) == ".ktpack")) {
       results.push_back(f);
     }
   }
 }
 
+/// KTestSet - The test cases read for -replay-out or -seed-out, from
+/// .ktest files or test packs. Tests read from a pack point into it, so
+/// the packs stay open until the set is destroyed.
+struct KTestSet {
+  std::vector<KTest*> tests;
+  std::vector<KTestPack*> packs;
+  std::set<KTest*> packed;
+
+  /// Read every test in \a path.
+  ///
+  /// \return True on success.
+  bool load(const std::string &path);
+  ~KTestSet();
+};
+
+bool KTestSet::load(const std::string &path) {
+  if (!kTestPack_isPackFile(path.c_str())) {
+    KTest *out = kTest_fromFile(path.c_str());
+    if (!out)
+      return false;
+    tests.push_back(out);
+    return true;
+  }
+
+  KTestPack *pack = kTestPack_open(path.c_str());
+  if (!pack)
+    return false;
+  packs.push_back(pack);
+  for (unsigned i = 0, e = kTestPack_numTests(pack); i != e; ++i) {
+    KTest *out = kTestPack_get(pack, i, 0);
+    if (!out) {
+      std::cerr << "KLEE: skipping damaged test " << i << " of " << path
+                << "\n";
+      continue;
+    }
+    tests.push_back(out);
+    packed.insert(out);
+  }
+  return true;
+}
+
+KTestSet::~KTestSet() {
+  for (std::vector<KTest*>::iterator it = tests.begin(), ie = tests.end();
+       it != ie; ++it) {
+    if (packed.count(*it))
+      kTestPack_freeTest(*it);
+    else
+      kTest_free(*it);
+  }
+  for (std::vector<KTestPack*>::iterator it = packs.begin(),
+         ie = packs.end(); it != ie; ++it)
+    kTestPack_close(*it);
+}
+
 //===----------------------------------------------------------------------===//
 // main Driver function
 //
@@ -1433,6 +1730,9 @@ int main(int argc, char **argv, char **envp) {
   const Module *finalModule = 
     interpreter->setModule(mainModule, Opts);
   externalsAndGlobalsCheck(finalModule);
+  // With -module-cache-dir the interpreter may run a cached copy of the
+  // module.
+  mainFn = finalModule->getFunction("main");
 
   if (ReplayPathFile != "") {
     interpreter->setReplayPath(&replayPath);
@@ -1454,16 +1754,13 @@ int main(int argc, char **argv, char **envp) {
            it = ReplayOutDir.begin(), ie = ReplayOutDir.end();
          it != ie; ++it)
       KleeHandler::getOutFiles(*it, outFiles);    
-    std::vector<KTest*> kTests;
+    KTestSet kTestSet;
+    std::vector<KTest*> &kTests = kTestSet.tests;
     for (std::vector<std::string>::iterator
            it = outFiles.begin(), ie = outFiles.end();
          it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (out) {
-        kTests.push_back(out);
-      } else {
+      if (!kTestSet.load(*it))
         std::cerr << "KLEE: unable to open: " << *it << "\n";
-      }
     }
 
     if (RunInDir != "") {
@@ -1480,27 +1777,22 @@ int main(int argc, char **argv, char **envp) {
       KTest *out = *it;
       interpreter->setReplayOut(out);
       std::cerr << "KLEE: replaying: " << *it << " (" << kTest_numBytes(out) << " bytes)"
-                 << " (" << ++i << "/" << outFiles.size() << ")\n";
+                 << " (" << ++i << "/" << kTests.size() << ")\n";
       // XXX should put envp in .ktest ?
       interpreter->runFunctionAsMain(mainFn, out->numArgs, out->args, pEnvp);
       if (interrupted) break;
     }
     interpreter->setReplayOut(0);
-    while (!kTests.empty()) {
-      kTest_free(kTests.back());
-      kTests.pop_back();
-    }
   } else {
-    std::vector<KTest *> seeds;
+    KTestSet seedSet;
+    std::vector<KTest *> &seeds = seedSet.tests;
     for (std::vector<std::string>::iterator
            it = SeedOutFile.begin(), ie = SeedOutFile.end();
          it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (!out) {
+      if (!seedSet.load(*it)) {
         std::cerr << "KLEE: unable to open: " << *it << "\n";
         exit(1);
       }
-      seeds.push_back(out);
     } 
     for (std::vector<std::string>::iterator
            it = SeedOutDir.begin(), ie = SeedOutDir.end();
@@ -1510,12 +1802,10 @@ int main(int argc, char **argv, char **envp) {
       for (std::vector<std::string>::iterator
              it2 = outFiles.begin(), ie = outFiles.end();
            it2 != ie; ++it2) {
-        KTest *out = kTest_fromFile(it2->c_str());
-        if (!out) {
+        if (!seedSet.load(*it2)) {
           std::cerr << "KLEE: unable to open: " << *it2 << "\n";
           exit(1);
         }
-        seeds.push_back(out);
       }
       if (outFiles.empty()) {
         std::cerr << "KLEE: seeds directory is empty: " << *it << "\n";
@@ -1535,11 +1825,6 @@ int main(int argc, char **argv, char **envp) {
     }
 
     interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
-
-    while (!seeds.empty()) {
-      kTest_free(seeds.back());
-      seeds.pop_back();
-    }
   }
       
   t[1] = time(NULL);
@@ -1574,6 +1859,10 @@ int main(int argc, char **argv, char **envp) {
     *theStatisticManager->getStatisticByName("Instructions");
   uint64_t forks = 
     *theStatisticManager->getStatisticByName("Forks");
+  uint64_t provenPairHits = 
+    *theStatisticManager->getStatisticByName("ProvenPairHits");
+  uint64_t provenPairMisses = 
+    *theStatisticManager->getStatisticByName("ProvenPairMisses");
 
   handler->getInfoStream() 
     << "KLEE: done: explored paths = " << 1 + forks << "\n";
@@ -1589,6 +1878,10 @@ int main(int argc, char **argv, char **envp) {
     << "KLEE: done: valid queries = " << queriesValid << "\n"
     << "KLEE: done: invalid queries = " << queriesInvalid << "\n"
     << "KLEE: done: query cex = " << queryCounterexamples << "\n";
+  if (provenPairHits + provenPairMisses)
+    handler->getInfoStream() 
+      << "KLEE: done: proven pair hits = " << provenPairHits 
+      << " of " << provenPairHits + provenPairMisses << " checks\n";
 
   std::stringstream stats;
   stats << "\n";
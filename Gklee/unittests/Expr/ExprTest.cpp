@@ -10,6 +10,7 @@
 #include <iostream>
 #include "gtest/gtest.h"
 
+#include "klee/Constraints.h"
 #include "klee/Expr.h"
 
 using namespace klee;
@@ -110,4 +111,139 @@ TEST(ExprTest, ExtractConcat) {
   EXPECT_EQ(Expr::Extract, concat2->getKid(1)->getKind());
 }
 
+TEST(ExprTest, IndependentSlice) {
+  Array *a = new Array("a", 4), *b = new Array("b", 4), *c = new Array("c", 4);
+  ref<Expr> readA = Expr::createTempRead(a, 8);
+  ref<Expr> readB = Expr::createTempRead(b, 8);
+  ref<Expr> readC = Expr::createTempRead(c, 8);
+  ref<Expr> c10 = getConstant(10, 8);
+
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(readA, c10));
+  cm.addConstraint(UltExpr::create(readB, readC));
+
+  std::vector< ref<Expr> > slice;
+  cm.getIndependentSlice(readA, slice);
+  ASSERT_EQ(1U, slice.size());
+  EXPECT_EQ(UltExpr::create(readA, c10), slice[0]);
+
+  // Linking a to b in a copy pulls in b's class there but not here.
+  ConstraintManager forked(cm);
+  forked.addConstraint(UltExpr::create(readA, readB));
+
+  slice.clear();
+  forked.getIndependentSlice(readA, slice);
+  ASSERT_EQ(3U, slice.size());
+  EXPECT_EQ(UltExpr::create(readB, readC), slice[1]);
+
+  slice.clear();
+  cm.getIndependentSlice(readC, slice);
+  ASSERT_EQ(1U, slice.size());
+  EXPECT_EQ(UltExpr::create(readB, readC), slice[0]);
+}
+
+TEST(ExprTest, SimplifyExprEqualities) {
+  Array *a = new Array("a", 4), *b = new Array("b", 4);
+  ref<Expr> readA = Expr::createTempRead(a, 8);
+  ref<Expr> readB = Expr::createTempRead(b, 8);
+
+  // Memoize b as it stands before the index is shared.
+  ConstraintManager cm;
+  cm.addConstraint(EqExpr::create(getConstant(5, 8), readA));
+  EXPECT_EQ(readB, cm.simplifyExpr(readB));
+
+  // The copy writes to its own index, without the memo of the shared one.
+  ConstraintManager forked(cm);
+  forked.addConstraint(EqExpr::create(getConstant(3, 8), readB));
+  EXPECT_EQ(getConstant(3, 8), forked.simplifyExpr(readB));
+  EXPECT_EQ(getConstant(6, 8),
+            forked.simplifyExpr(AddExpr::create(readA, getConstant(1, 8))));
+  EXPECT_EQ(readB, cm.simplifyExpr(readB));
+
+  // The original, no longer sharing, writes to its index in place.
+  cm.addConstraint(EqExpr::create(getConstant(7, 8), readB));
+  EXPECT_EQ(getConstant(7, 8), cm.simplifyExpr(readB));
+  EXPECT_EQ(getConstant(3, 8), forked.simplifyExpr(readB));
+}
+
+TEST(ExprTest, EqualityIndexMemo) {
+  Array *a = new Array("a", 4);
+  ref<Expr> readA = Expr::createTempRead(a, 32);
+
+  EqualityIndex index;
+  index.add(EqExpr::create(getConstant(5, 32), readA));
+  for (unsigned i = 0; i < EqualityIndex::MaxSimplified; i++)
+    index.simplify(AddExpr::create(readA, getConstant(i, 32)));
+  EXPECT_EQ(EqualityIndex::MaxSimplified, index.getNumSimplified());
+
+  // A repeat is answered from the memo; a new expression past the cap
+  // starts it over.
+  EXPECT_EQ(getConstant(6, 32),
+            index.simplify(AddExpr::create(readA, getConstant(1, 32))));
+  EXPECT_EQ(EqualityIndex::MaxSimplified, index.getNumSimplified());
+  index.simplify(SubExpr::create(readA, getConstant(1, 32)));
+  EXPECT_EQ(1U, index.getNumSimplified());
+
+  // Only a new substitution drops the memo.
+  index.add(EqExpr::create(getConstant(9, 32), readA));
+  EXPECT_EQ(1U, index.getNumSimplified());
+  index.add(EqExpr::create(getConstant(9, 32), Expr::createTempRead(a, 8)));
+  EXPECT_EQ(0U, index.getNumSimplified());
+}
+
+TEST(ExprTest, EqualityIndexOverlay) {
+  Array *a = new Array("a", 4);
+  Array *b = new Array("b", 4);
+  ref<Expr> readA = Expr::createTempRead(a, 32);
+  ref<Expr> readB = Expr::createTempRead(b, 32);
+
+  ref<EqualityIndex> base = new EqualityIndex();
+  base->add(EqExpr::create(getConstant(5, 32), readA));
+  EXPECT_EQ(getConstant(6, 32),
+            base->simplify(AddExpr::create(readA, getConstant(1, 32))));
+
+  // The overlay adds to the base's result without writing the base's
+  // substitutions; its memo lookups also fill the base's.
+  ref<EqualityIndex> overlay = new EqualityIndex(base);
+  EXPECT_EQ(1U, overlay->getDepth());
+  overlay->add(EqExpr::create(getConstant(3, 32), readB));
+  EXPECT_EQ(getConstant(8, 32),
+            overlay->simplify(AddExpr::create(readA, readB)));
+  EXPECT_EQ(2U, base->getNumSimplified());
+  EXPECT_EQ(readB, base->simplify(readB));
+
+  // An earlier substitution in the base still takes precedence.
+  overlay->add(EqExpr::create(getConstant(9, 32), readA));
+  EXPECT_EQ(getConstant(5, 32), overlay->simplify(readA));
+
+  // A deep chain is flattened, keeping every substitution.
+  ref<EqualityIndex> top = overlay;
+  for (unsigned i = 0; i < EqualityIndex::MaxDepth; i++)
+    top = new EqualityIndex(top);
+  EXPECT_EQ(0U, top->getDepth());
+  EXPECT_EQ(getConstant(8, 32), top->simplify(AddExpr::create(readA, readB)));
+}
+
+TEST(ExprTest, ConstraintGeneration) {
+  Array *a = new Array("a", 4);
+  ref<Expr> readA = Expr::createTempRead(a, 32);
+
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(readA, getConstant(10, 32)));
+  ConstraintManager copy(cm);
+  EXPECT_EQ(cm.getGeneration(), copy.getGeneration());
+
+  // Forks that add different constraints part ways, even when both add
+  // the same number of them.
+  cm.addConstraint(UltExpr::create(readA, getConstant(5, 32)));
+  copy.addConstraint(UgtExpr::create(readA, getConstant(5, 32)));
+  EXPECT_NE(cm.getGeneration(), copy.getGeneration());
+
+  ConstraintManager assigned;
+  assigned = cm;
+  EXPECT_EQ(cm.getGeneration(), assigned.getGeneration());
+  cm.getConstraints();
+  EXPECT_NE(cm.getGeneration(), assigned.getGeneration());
+}
+
 }
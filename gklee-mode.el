@@ -285,6 +285,7 @@ line arguments"
 (defvar gklee-bankcon-info-list nil)
 (defvar gklee-memcol-info-list nil)
 (defvar gklee-warpdiv-info-list nil)
+(defvar gklee-occupancy-info-list nil)
 (defvar gklee-summary-info-list nil)
 (defvar gklee-process-record-count 0)
 
@@ -1571,7 +1572,7 @@ i.e. ((0 subList)(1 sublist)...(n sublist))"
 
 ;;this function will return a string with a line for each
 ;;statistic collected for the path represented
-;;for BC, MC and WD . . .
+;;for BC, MC, WD and OC . . .
 (defun gklee-get-stat-list (trace)
   "Gets the statistics for a selected (path) trace
 to be displayed for it (usually in gklee-run window)"
@@ -1582,8 +1583,9 @@ to be displayed for it (usually in gklee-run window)"
 	 (bc (gklee-lookup-stat lineno gklee-bankcon-info-list))
 	 (mc (gklee-lookup-stat lineno gklee-memcol-info-list))
 	 (wd (gklee-lookup-stat lineno gklee-warpdiv-info-list))
+	 (oc (gklee-lookup-stat lineno gklee-occupancy-info-list))
 	 )
-    (concat "\n" rc as dl bc mc wd "\n")
+    (concat "\n" rc as dl bc mc wd oc "\n")
     ))
 
 (defun gklee-get-buff-name (trace)
@@ -1990,11 +1992,36 @@ Gklee data output"
 										    (match-string 2 record)
 										    (match-string 5 record)
 										    ))))))
+	  (if (string-match (concat "OC:"
+				    "\\([0-9]+\\):\\([^:]+\\):\\([0-9]+\\):\\([0-9]+\\)"
+				    ":\\([0-9]+\\):\\([0-9]+\\):\\([0-9]+\\):\\([0-9]+\\)"
+				    ":\\([0-9]+\\):\\([[:alpha:] ]+\\)") record)
+	      (gklee-add-occupancy-info
+	       (string-to-number (match-string 1 record))
+	       (format
+		(concat "%s%% occupancy for %s<<<%s, %s>>>\n"
+			"(%s/%s warps per SM, limited by %s)\n\n")
+		(match-string 9 record)
+		(match-string 2 record)
+		(match-string 3 record)
+		(match-string 4 record)
+		(match-string 7 record)
+		(match-string 8 record)
+		(match-string 10 record))))
 	  (if (string-match "KLEE: done: " record)
 	      (setq gklee-summary-info-list 
 		    (append gklee-summary-info-list (list (substring record (match-end 0))))))
 	  (setq gklee-record nil)))))
 
+(defun gklee-add-occupancy-info (path info)
+  "A path reports one OC: line per kernel launch; gather them
+under the path, in launch order"
+  (let ((entry (assoc path gklee-occupancy-info-list)))
+    (if entry
+	(setcdr entry (concat (cdr entry) info))
+      (setq gklee-occupancy-info-list
+	    (append gklee-occupancy-info-list (list (cons path info)))))))
+
 (defun gklee-reset-run-state (run-buffer)
   (setq gklee-instruction-count 0)
   (setq gklee-path-count 0)
@@ -2012,6 +2039,7 @@ Gklee data output"
   (setq gklee-bankcon-info-list nil) 
   (setq gklee-memcol-info-list nil)
   (setq gklee-warpdiv-info-list nil)
+  (setq gklee-occupancy-info-list nil)
   (setq gklee-summary-info-list nil)
   (setq gklee-process-record-count 0)
   (setq gklee-trace-buffer nil)